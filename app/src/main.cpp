@@ -1,15 +1,35 @@
+#include <algorithm>
 #include <iostream>
 #include <stdio.h>
 #include <stdint.h>
 #include <vector>
 #include <memory>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 
 #include <glad/glad.h>
 #include <SDL2/SDL.h>
 
 #include <shader.hpp>
+#include <geometry.hpp>
 #include <model.hpp>
+#include <simplify.hpp>
 #include <textures.hpp>
+#include <jobs.hpp>
+#include <frame.hpp>
+#include <renderer.hpp>
+#include <resolution.hpp>
+#include <streaming.hpp>
+#include <transforms.hpp>
+#include <alloctrack.hpp>
+#include <glcapture.hpp>
+#include <virtualtexture.hpp>
+#include <batchrender.hpp>
+#include <lightmap.hpp>
+#include <scenequery.hpp>
+#include <framepacing.hpp>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -21,14 +41,863 @@
 #define WinWidth 1600
 #define WinHeight 900
 
+// Maximum screen-space LOD error in pixels, shadow maps tolerate coarser
+// geometry than the main pass.
+#define LodPixelError 1.0f
+#define ShadowLodPixelError 4.0f
+
+// Sun shadow cascades, used with --sun.
+#define SunCascadeCount 4
+#define SunCascadeDistance 100.0f
+#define SunCascadeSplitLambda 0.75f
+#define SunShadowResolution 2048
+
+// Lowest scale dynamic resolution may drop the main pass to.
+#define MinRenderScale 0.5f
+
+// World streaming, distances in world units.
+#define StreamLoadRadius 40.0f
+#define StreamUnloadRadius 50.0f
+#define StreamPredictionTime 0.5f
+#define StreamMemoryBudget (256u << 20)
+#define StreamUploadBudget (4u << 20)
+
+// Virtual texturing, used with --virtual-textures. The cache holds
+// VirtualCachePages squared pages of albedo and normals whatever the scene.
+#define VirtualCachePages 12
+#define VirtualFeedbackDivisor 8
+#define VirtualUploadsPerFrame 8
+
+// Static lighting baked with --bake. Densities are lightmap texels per
+// model unit, the crate being 5 units wide and the room 20.
+#define LightmapMaxSize 2048
+#define LightmapSamples 32
+#define LightmapLightRadius 0.15f
+#define LightmapLightPower 20.0f
+#define LightmapBias 0.01f
+#define CrateLightmapDensity 8.0f
+#define RoomLightmapDensity 8.0f
+
+// Frame rate of the capped pacing mode.
+#define PacingCapFps 120.0f
+
+// Triangles drawn per pass and timed frames of --bench-vertex-cache.
+#define VertexCacheBenchTriangles (1u << 22)
+#define VertexCacheBenchFrames 64
+#define VertexCacheBenchWarmup 8
+
+// Frames after which the loop must stop allocating, when tracked. Arenas
+// and command buffers reach their final size while the camera settles.
+#define AllocationWarmupFrames 16
+
+// Averages frame timings and prints them every Period frames.
+struct FrameStats {
+  static const int Period = 240;
+
+  int frames = 0;
+  double build_ms = 0.0;
+  double replay_ms = 0.0;
+  double frame_ms = 0.0;
+  double render_scale = 0.0;
+  size_t allocations = 0;
+  std::vector<double> gpu_ms;
+  // Meshlet culling of the view, the six shadow faces and the cascades.
+  static const int CullPasses = 1 + FrameCommands::CubeFaces + FrameCommands::MaxCascades;
+  double cull_triangles[CullPasses] = {};
+  double frustum_culled[CullPasses] = {};
+  double backface_culled[CullPasses] = {};
+
+  // Returns true when the averages were printed.
+  bool add(double build, double replay, double frame, float scale, size_t frame_allocations,
+           const FrameCommands& commands, const GpuTimer& gpu) {
+    const CullStats* passes[CullPasses] = {&commands.view_culling};
+    for(unsigned int f = 0; f < FrameCommands::CubeFaces; f++)
+      passes[1 + f] = &commands.shadow_culling[f];
+    for(unsigned int c = 0; c < FrameCommands::MaxCascades; c++)
+      passes[1 + FrameCommands::CubeFaces + c] = &commands.cascade_culling[c];
+    for(int i = 0; i < CullPasses; i++) {
+      cull_triangles[i] += passes[i]->triangles;
+      frustum_culled[i] += passes[i]->frustum_culled;
+      backface_culled[i] += passes[i]->backface_culled;
+    }
+    build_ms += build;
+    replay_ms += replay;
+    frame_ms += frame;
+    render_scale += scale;
+    allocations += frame_allocations;
+    gpu_ms.resize(gpu.stage_count());
+    for(unsigned int i = 0; i < gpu.stage_count(); i++)
+      gpu_ms[i] += gpu.milliseconds(i);
+    if(++frames < Period)
+      return false;
+    std::cout << "frame " << frame_ms / frames << " ms (" << 1000.0 * frames / frame_ms << " fps), build "
+              << build_ms / frames << " ms, replay " << replay_ms / frames << " ms, render scale "
+              << render_scale / frames << std::endl;
+    if(AllocationTrackingEnabled())
+      std::cout << "heap allocations " << (double)allocations / frames << " per frame" << std::endl;
+    std::cout << "gpu";
+    for(unsigned int i = 0; i < gpu.stage_count(); i++)
+      std::cout << (i ? ", " : " ") << gpu.name(i) << " " << gpu_ms[i] / frames << " ms";
+    std::cout << std::endl;
+    // Culled triangles of the instances each pass kept, by frustum and by
+    // normal cone.
+    static const char* CullNames[CullPasses] = {"view", "+x", "-x", "+y", "-y", "+z", "-z",
+                                                "cascade 0", "cascade 1", "cascade 2", "cascade 3"};
+    std::cout << "meshlet culling";
+    for(int i = 0, printed = 0; i < CullPasses; i++) {
+      if(!cull_triangles[i])
+        continue;
+      std::cout << (printed++ ? ", " : " ") << CullNames[i] << " "
+                << 100.0 * (frustum_culled[i] + backface_culled[i]) / cull_triangles[i] << "% ("
+                << 100.0 * frustum_culled[i] / cull_triangles[i] << " + "
+                << 100.0 * backface_culled[i] / cull_triangles[i] << ")";
+    }
+    std::cout << std::endl;
+    // Keeps the capacity of gpu_ms, this runs inside the frame loop.
+    frames = 0;
+    build_ms = replay_ms = frame_ms = render_scale = 0.0;
+    allocations = 0;
+    std::fill(gpu_ms.begin(), gpu_ms.end(), 0.0);
+    std::fill(cull_triangles, cull_triangles + CullPasses, 0.0);
+    std::fill(frustum_culled, frustum_culled + CullPasses, 0.0);
+    std::fill(backface_culled, backface_culled + CullPasses, 0.0);
+    return true;
+  }
+};
+
+// Presets cycled with P and measured in turn by --pacing-bench. Serial modes
+// build each frame from the input sampled right before it instead of
+// building the next one from it while the current one is submitted.
+struct PacingMode {
+  const char* name;
+  int swap_interval;  // 1 vsync, -1 adaptive vsync, 0 off
+  PacingSettings settings;
+  bool serial;
+};
+
+const PacingMode PacingModes[] = {
+  {"vsync, driver queue", 1, {0, 0.0f}, false},
+  {"vsync, 2 frames in flight", 1, {2, 0.0f}, false},
+  {"vsync, 1 frame in flight, serial", 1, {1, 0.0f}, true},
+  {"adaptive vsync, 1 frame in flight, serial", -1, {1, 0.0f}, true},
+  {"no vsync, capped, 1 frame in flight, serial", 0, {1, PacingCapFps}, true}
+};
+const int PacingModeCount = sizeof(PacingModes) / sizeof(PacingModes[0]);
+
+// Adaptive vsync falls back to vsync where the driver lacks it.
+void ApplySwapInterval(int interval) {
+  if(SDL_GL_SetSwapInterval(interval) != 0) {
+    std::cout << "Swap interval " << interval << " unsupported: " << SDL_GetError() << std::endl;
+    if(interval == -1)
+      SDL_GL_SetSwapInterval(1);
+  }
+}
+
+void PrintPacing(const char* name, const PacingStats& stats) {
+  std::cout << "pacing " << name << ": frame " << stats.frame_ms << " ms +- " << stats.frame_deviation_ms
+            << " (max " << stats.max_frame_ms << "), input to GPU done " << stats.latency_ms << " ms (max "
+            << stats.max_latency_ms << "), fence wait " << stats.fence_wait_ms << " ms, sleep " << stats.sleep_ms
+            << " ms" << std::endl;
+}
+
+// Times TransformSystem on count transforms, every fourth one a root with
+// the following three as its children, against composing the same matrices
+// one by one with glm. Returns whether the results match glm and an
+// unrotated instance pose comes out as a pure translate and scale.
+bool BenchmarkTransforms(unsigned int count, int workers) {
+  const int Iterations = 20;
+  JobSystem jobs(workers);
+  TransformSystem transforms;
+  transforms.resize(count);
+
+  std::vector<glm::vec3> positions(count);
+  std::vector<glm::quat> rotations(count);
+  std::vector<float> scales(count);
+  for(unsigned int i = 0; i < count; i++) {
+    positions[i] = glm::vec3(std::rand() % 1000, std::rand() % 1000, std::rand() % 1000) * 0.01f;
+    glm::vec3 axis = glm::normalize(glm::vec3(std::rand() % 100 + 1, std::rand() % 100, std::rand() % 100));
+    rotations[i] = glm::angleAxis(glm::radians((float)(std::rand() % 360)), axis);
+    scales[i] = 0.5f + (std::rand() % 100) * 0.01f;
+    if(i % 4)
+      transforms.set_parent(i, i - i % 4);
+  }
+
+  auto time = [&](unsigned int stride) {
+    auto start = std::chrono::steady_clock::now();
+    for(int iteration = 0; iteration < Iterations; iteration++) {
+      for(unsigned int i = 0; i < count; i += stride)
+        transforms.set(i, positions[i], rotations[i], scales[i]);
+      transforms.update(jobs);
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Iterations;
+  };
+  double allMs = time(1);
+  double rootsMs = time(4);
+  double unchangedMs = time(count + 1);
+
+  std::vector<glm::mat4> reference(count);
+  auto start = std::chrono::steady_clock::now();
+  for(int iteration = 0; iteration < Iterations; iteration++) {
+    for(unsigned int i = 0; i < count; i++) {
+      reference[i] = glm::translate(glm::mat4(1.0f), positions[i]) * glm::mat4_cast(rotations[i]) *
+        glm::scale(glm::mat4(1.0f), glm::vec3(scales[i]));
+      if(i % 4)
+        reference[i] = reference[i - i % 4] * reference[i];
+    }
+  }
+  double glmMs =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Iterations;
+
+  float error = 0.0f;
+  for(unsigned int i = 0; i < count; i++)
+    for(int column = 0; column < 4; column++)
+      for(int row = 0; row < 4; row++)
+        error = std::max(error, std::abs(transforms.world(i)[column][row] - reference[i][column][row]));
+
+  std::cout << count << " transforms, " << jobs.worker_count() << " workers, per update: all changed " << allMs
+            << " ms (" << 1e6 * allMs / count << " ns each), roots changed " << rootsMs << " ms, unchanged "
+            << unchangedMs << " ms, serial glm " << glmMs << " ms, max difference " << error << std::endl;
+
+  TransformSystem unrotated;
+  unrotated.resize(1);
+  glm::vec3 position(1.0f, -2.0f, 3.0f);
+  unrotated.set(0, position, InstanceRotation(glm::vec3(0.3f, 1.0f, 0.2f), 0.0f), 2.0f);
+  unrotated.update(jobs);
+  glm::mat4 expected = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(2.0f));
+  float unrotatedError = 0.0f;
+  for(int column = 0; column < 4; column++)
+    for(int row = 0; row < 4; row++)
+      unrotatedError = std::max(unrotatedError, std::abs(unrotated.world(0)[column][row] - expected[column][row]));
+
+  bool passed = error < 1e-3f && unrotatedError < 1e-6f;
+  std::cout << "unrotated pose difference " << unrotatedError << (passed ? ", passed" : ", FAILED") << std::endl;
+  return passed;
+}
+
+// Simplifies an open cylinder with a UV seam down its side level by level,
+// and a unit icosphere to ever lower targets. Returns whether no cylinder
+// triangle crosses the seam, the triangle counts meet their targets and the
+// errors never decrease while staying below the radius.
+bool CheckSimplifier() {
+  const unsigned int Columns = 64, Rows = 16, Levels = 7;
+  std::vector<glm::vec3> vertices;
+  std::vector<glm::vec2> uvs;
+  std::vector<unsigned int> indices;
+  // The last column repeats the positions of the first with u = 1.
+  for(unsigned int row = 0; row <= Rows; row++) {
+    for(unsigned int column = 0; column <= Columns; column++) {
+      float angle = glm::radians(360.0f * (column % Columns) / Columns);
+      vertices.push_back(glm::vec3(std::cos(angle), 4.0f * row / Rows, std::sin(angle)));
+      uvs.push_back(glm::vec2((float)column / Columns, (float)row / Rows));
+    }
+  }
+  for(unsigned int row = 0; row < Rows; row++) {
+    for(unsigned int column = 0; column < Columns; column++) {
+      unsigned int a = row * (Columns + 1) + column, b = a + 1, c = a + Columns + 1, d = c + 1;
+      indices.insert(indices.end(), {a, c, b, b, c, d});
+    }
+  }
+
+  bool passed = true;
+  std::vector<std::vector<unsigned int>> levels;
+  std::vector<float> errors;
+  SimplifyMeshLevels(vertices, indices, Levels, levels, errors);
+  unsigned int previous = indices.size() / 3;
+  float previousError = 0.0f;
+  for(unsigned int level = 0; level < Levels; level++) {
+    unsigned int triangles = levels[level].size() / 3, crossing = 0;
+    for(unsigned int t = 0; t < triangles; t++) {
+      float low = 1.0f, high = 0.0f;
+      for(int c = 0; c < 3; c++) {
+        low = std::min(low, uvs[levels[level][t * 3 + c]].x);
+        high = std::max(high, uvs[levels[level][t * 3 + c]].x);
+      }
+      crossing += high - low > 0.5f;
+    }
+    std::cout << "Cylinder level " << level + 1 << ": " << triangles << " triangles, error " << errors[level]
+              << ", " << crossing << " across the seam" << std::endl;
+    passed = passed && crossing == 0 && triangles <= previous / 2 && errors[level] >= previousError &&
+      errors[level] < 1.0f;
+    previous = triangles;
+    previousError = errors[level];
+  }
+
+  std::vector<glm::vec3> sphereVertices, sphereNormals;
+  std::vector<glm::vec2> sphereUVs;
+  std::vector<unsigned int> sphereIndices;
+  GenerateIcosphere(4, sphereVertices, sphereUVs, sphereNormals, sphereIndices);
+  previousError = 0.0f;
+  for(unsigned int target = sphereIndices.size() / 6; target >= 20; target /= 2) {
+    std::vector<unsigned int> simplified;
+    float error = SimplifyMesh(sphereVertices, sphereIndices, target, simplified);
+    std::cout << "Icosphere to " << target << " triangles: " << simplified.size() / 3 << ", error " << error
+              << std::endl;
+    passed = passed && simplified.size() / 3 <= target && error >= previousError && error < 1.0f;
+    previousError = error;
+  }
+
+  std::cout << "Simplifier " << (passed ? "passed" : "FAILED") << std::endl;
+  return passed;
+}
+
+// Loads path, a copy of models/importer_check.obj, which mixes face formats,
+// negative indices, n-gons and two materials. Returns whether every triangle comes out
+// with the expected corners, UVs, normals and material, and LoadMesh gives
+// one part per material.
+bool CheckOBJImport(const char* path) {
+  const glm::vec3 Positions[] = {glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f),
+                                 glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                                 glm::vec3(0.5f, 1.5f, 0.0f)};
+  const glm::vec2 UVs[] = {glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f),
+                           glm::vec2(0.0f, 1.0f)};
+  const glm::vec3 Normal(0.0f, 0.6f, 0.8f);
+  // File indices of the corners of the fanned triangles, 0 for none, and
+  // whether the face gave normals.
+  const unsigned int TriangleCount = 9;
+  const unsigned int CornerPositions[TriangleCount * 3] = {1, 2, 3, 1, 3, 4, 1, 2, 3, 1, 3, 5, 1, 5, 4,
+                                                           1, 2, 3, 1, 3, 5, 1, 5, 4, 2, 3, 5};
+  const unsigned int CornerUVs[TriangleCount * 3] = {0, 0, 0, 0, 0, 0, 1, 2, 3, 0, 0, 0, 0, 0, 0,
+                                                     1, 2, 3, 1, 3, 4, 1, 4, 4, 2, 3, 4};
+  const bool HasNormals[TriangleCount] = {false, false, false, true, true, true, true, true, false};
+  const unsigned int Materials[TriangleCount] = {0, 0, 0, 1, 1, 1, 1, 1, 0};
+
+  std::vector<glm::vec3> vertices, normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<unsigned int> triangleMaterials;
+  std::vector<Material> materials;
+  if(!LoadOBJ(path, vertices, uvs, normals, triangleMaterials, materials))
+    return false;
+
+  bool passed = vertices.size() == TriangleCount * 3 && uvs.size() == vertices.size() &&
+    normals.size() == vertices.size() && triangleMaterials.size() == TriangleCount && materials.size() == 2 &&
+    materials[0].name == "red" && materials[1].name == "blue";
+  for(unsigned int i = 0; passed && i < TriangleCount * 3; i++) {
+    // OBJ UVs start at the bottom left, textures at the top left.
+    glm::vec2 uv = CornerUVs[i] ? glm::vec2(UVs[CornerUVs[i] - 1].x, 1.0f - UVs[CornerUVs[i] - 1].y) : glm::vec2(0.0f);
+    glm::vec3 normal = HasNormals[i / 3] ? Normal : glm::vec3(0.0f, 0.0f, 1.0f);
+    passed = vertices[i] == Positions[CornerPositions[i] - 1] && uvs[i] == uv &&
+      glm::length(normals[i] - normal) < 1e-6f && triangleMaterials[i / 3] == Materials[i / 3];
+    if(!passed)
+      std::cout << "Corner " << i << " does not match" << std::endl;
+  }
+
+  MeshData mesh;
+  passed = passed && LoadMesh(path, 0, mesh) && mesh.materials.size() == 2 && mesh.lods[0].part_count == 2 &&
+    mesh.parts[0].material == 0 && mesh.parts[0].count == 12 && mesh.parts[1].material == 1 &&
+    mesh.parts[1].count == 15;
+
+  std::cout << path << ": " << vertices.size() / 3 << " triangles, " << materials.size() << " materials, "
+            << (passed ? "passed" : "FAILED") << std::endl;
+  return passed;
+}
+
+// Runs RangeAllocator through a fixed sequence, then through random
+// allocations and frees checked against a map of the used units, growing it
+// halfway. Returns whether every allocation took the first free range that
+// fits, failed only when none did, and freeing everything coalesced the
+// ranges back into one.
+bool CheckRangeAllocator() {
+  const unsigned int Operations = 20000;
+  unsigned int a = 0, b = 0, c = 0, offset = 0;
+  RangeAllocator fixed(100);
+  bool passed = fixed.allocate(30, a) && fixed.allocate(30, b) && fixed.allocate(40, c) && !fixed.allocate(1, offset) &&
+    a == 0 && b == 30 && c == 60;
+  fixed.free(b, 30);
+  passed = passed && fixed.allocate(20, b) && b == 30 && !fixed.allocate(20, offset);
+  fixed.free(a, 30);
+  passed = passed && !fixed.allocate(40, offset);
+  fixed.free(b, 20);
+  passed = passed && fixed.allocate(60, offset) && offset == 0 && fixed.used() == 100;
+  fixed.grow(150);
+  passed = passed && fixed.allocate(50, offset) && offset == 100 && fixed.capacity() == 150;
+
+  struct Allocation {
+    unsigned int offset;
+    unsigned int size;
+  };
+  unsigned int capacity = 4096;
+  RangeAllocator allocator(capacity);
+  std::vector<bool> used(capacity, false);
+  std::vector<Allocation> live;
+  unsigned int usedUnits = 0, allocations = 0, failures = 0;
+  for(unsigned int i = 0; passed && i < Operations; i++) {
+    if(i == Operations / 2) {
+      capacity += 1024;
+      allocator.grow(capacity);
+      used.resize(capacity, false);
+    }
+    if(live.empty() || std::rand() % 3) {
+      unsigned int size = 1 + std::rand() % 64;
+      unsigned int expected = capacity, run = 0;
+      for(unsigned int unit = 0; unit < capacity && expected == capacity; unit++) {
+        run = used[unit] ? 0 : run + 1;
+        if(run == size)
+          expected = unit + 1 - size;
+      }
+      bool allocated = allocator.allocate(size, offset);
+      passed = allocated == (expected != capacity) && (!allocated || offset == expected);
+      if(allocated) {
+        std::fill(used.begin() + offset, used.begin() + offset + size, true);
+        live.push_back({offset, size});
+        usedUnits += size;
+        allocations++;
+      } else {
+        failures++;
+      }
+    } else {
+      unsigned int index = std::rand() % live.size();
+      Allocation allocation = live[index];
+      allocator.free(allocation.offset, allocation.size);
+      std::fill(used.begin() + allocation.offset, used.begin() + allocation.offset + allocation.size, false);
+      usedUnits -= allocation.size;
+      live[index] = live.back();
+      live.pop_back();
+    }
+    passed = passed && allocator.used() == usedUnits;
+  }
+  for(const Allocation& allocation : live)
+    allocator.free(allocation.offset, allocation.size);
+  passed = passed && allocator.used() == 0 && allocator.allocate(capacity, offset) && offset == 0;
+
+  std::cout << "RangeAllocator: " << allocations << " allocations, " << failures << " full, "
+            << (passed ? "passed" : "FAILED") << std::endl;
+  return passed;
+}
+
+// Times GenerateIcosphere with normals and UVs at the given number of
+// divisions and prints the memory its arrays hold, and with allocation
+// tracking what it allocated on the way.
+void BenchmarkIcosphere(uint16_t divisions) {
+  const int Iterations = 10;
+  std::vector<glm::vec3> vertices, normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<unsigned int> indices;
+  size_t allocations = AllocationCount(), allocated = AllocatedBytes();
+  auto start = std::chrono::steady_clock::now();
+  for(int iteration = 0; iteration < Iterations; iteration++) {
+    std::vector<glm::vec3> sphereVertices, sphereNormals;
+    std::vector<glm::vec2> sphereUVs;
+    std::vector<unsigned int> sphereIndices;
+    GenerateIcosphere(divisions, sphereVertices, sphereUVs, sphereNormals, sphereIndices);
+    vertices.swap(sphereVertices);
+    normals.swap(sphereNormals);
+    uvs.swap(sphereUVs);
+    indices.swap(sphereIndices);
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Iterations;
+  allocations = (AllocationCount() - allocations) / Iterations;
+  allocated = (AllocatedBytes() - allocated) / Iterations;
+
+  size_t used = vertices.size() * sizeof(glm::vec3) + normals.size() * sizeof(glm::vec3) +
+                uvs.size() * sizeof(glm::vec2) + indices.size() * sizeof(unsigned int);
+  size_t held = vertices.capacity() * sizeof(glm::vec3) + normals.capacity() * sizeof(glm::vec3) +
+                uvs.capacity() * sizeof(glm::vec2) + indices.capacity() * sizeof(unsigned int);
+  std::cout << "Icosphere " << divisions << ": " << vertices.size() << " vertices, " << indices.size() / 3
+            << " triangles in " << ms << " ms, " << (used >> 10) << " KB used of " << (held >> 10) << " KB held"
+            << std::endl;
+  if(AllocationTrackingEnabled())
+    std::cout << allocations << " allocations, " << (allocated >> 10) << " KB allocated per sphere" << std::endl;
+}
+
+// Times the CPU queries against the lit and shadow casting instances of the
+// scene: count closest hit rays from random points in the room towards
+// random directions, traced on the calling thread then batched over the
+// workers, as many segments between random points, and frustum queries of
+// the starting view.
+void BenchmarkQueries(JobSystem& jobs, const Scene& scene, const FrameSettings& settings, unsigned int count) {
+  const int FrustumIterations = 20;
+  SceneQuery query;
+  query.build(jobs, scene, Instance::CastsShadow | Instance::Lit);
+  const SceneQueryStats& queryStats = query.stats();
+  std::cout << "Query: " << queryStats.instances << " instances, " << queryStats.triangles << " triangles, "
+            << queryStats.models << " model BVHs, built in " << queryStats.build_ms << " ms" << std::endl;
+
+  auto random_point = []() {
+    return glm::vec3(std::rand() % 2000 - 1000, std::rand() % 1000 - 500, std::rand() % 2000 - 1000) * 0.0095f;
+  };
+  std::vector<QueryRay> rays(count), segments(count);
+  for(unsigned int i = 0; i < count; i++) {
+    glm::vec3 direction;
+    do
+      direction = glm::vec3(std::rand() % 2001 - 1000, std::rand() % 2001 - 1000, std::rand() % 2001 - 1000);
+    while(glm::dot(direction, direction) < 1.0f);
+    rays[i] = {random_point(), glm::normalize(direction), 100.0f};
+    glm::vec3 from = random_point();
+    segments[i] = {from, random_point() - from, 1.0f};
+  }
+  std::vector<SceneHit> hits(count);
+  std::vector<unsigned char> occluded(count);
+
+  auto ms_since = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+  auto start = std::chrono::steady_clock::now();
+  for(unsigned int i = 0; i < count; i++)
+    query.intersect(rays[i], hits[i]);
+  double serialMs = ms_since(start);
+  start = std::chrono::steady_clock::now();
+  query.intersect(jobs, rays.data(), count, hits.data());
+  double batchMs = ms_since(start);
+  start = std::chrono::steady_clock::now();
+  query.occluded(jobs, segments.data(), count, occluded.data());
+  double segmentMs = ms_since(start);
+  unsigned int hitCount = std::count_if(hits.begin(), hits.end(), [](const SceneHit& hit) {
+    return hit.instance != SceneQuery::NoInstance;
+  });
+  unsigned int occludedCount = std::count(occluded.begin(), occluded.end(), 1);
+
+  glm::mat4 viewProjection = glm::perspective(settings.fov, settings.aspect, settings.near, settings.far) *
+    glm::lookAt(scene.camera_position, scene.camera_target, glm::vec3(0, 1, 0));
+  std::vector<SceneTriangle> triangles;
+  start = std::chrono::steady_clock::now();
+  for(int iteration = 0; iteration < FrustumIterations; iteration++) {
+    triangles.clear();
+    query.frustum(viewProjection, triangles);
+  }
+  double frustumMs = ms_since(start) / FrustumIterations;
+
+  std::cout << count << " rays, " << hitCount << " hits: " << count / std::max(0.001, serialMs * 1000.0)
+            << " Mrays/s on one thread, " << count / std::max(0.001, batchMs * 1000.0) << " Mrays/s on "
+            << jobs.worker_count() + 1 << " threads" << std::endl;
+  std::cout << count << " segments, " << occludedCount << " blocked: "
+            << count / std::max(0.001, segmentMs * 1000.0) << " Mrays/s on " << jobs.worker_count() + 1
+            << " threads" << std::endl;
+  std::cout << "Frustum: " << triangles.size() << " triangles in " << frustumMs << " ms" << std::endl;
+}
+
+// Builds and renders count frames of the scene while the camera turns, each
+// finished on the GPU before the next: serially on the calling thread alone,
+// serially with the workers, then building the next frame on the workers
+// while the current one is submitted. Prints the frames per second of each.
+void BenchmarkFrames(JobSystem& jobs, Scene& scene, const FrameSettings& settings, Renderer& renderer,
+                     unsigned int count) {
+  const unsigned int WarmupFrames = 8;
+  JobSystem inlineJobs(0);
+  struct Mode {
+    const char* name;
+    JobSystem* jobs;
+    bool pipelined;
+  };
+  const Mode modes[] = {
+    {"serial, 1 thread", &inlineJobs, false},
+    {"serial, workers", &jobs, false},
+    {"pipelined, workers", &jobs, true}
+  };
+
+  std::cout << scene.instances.size() << " instances, " << jobs.worker_count() << " workers" << std::endl;
+  for(const Mode& mode : modes) {
+    FramePipeline pipeline(*mode.jobs, scene, settings);
+    FrameInput input = {0.0f, 0.0f};
+    FrameCommands frames[2];
+    int current = 0;
+    pipeline.build(input, frames[current]);
+    double buildMs = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < WarmupFrames + count; i++) {
+      if(i == WarmupFrames) {
+        buildMs = 0.0;
+        start = std::chrono::steady_clock::now();
+      }
+      input.camera_angle += 1.0f;
+      auto buildStart = std::chrono::steady_clock::now();
+      if(mode.pipelined) {
+        pipeline.build_async(input, frames[current ^ 1]);
+      } else {
+        pipeline.build(input, frames[current]);
+        buildMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+      }
+      renderer.render(frames[current]);
+      glFinish();
+      if(mode.pipelined) {
+        pipeline.wait();
+        current ^= 1;
+      }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << mode.name << ": " << ms / count << " ms per frame, " << 1000.0 * count / ms << " fps";
+    if(!mode.pipelined)
+      std::cout << ", build " << buildMs / count << " ms";
+    std::cout << std::endl;
+  }
+}
+
+// Renders every pose into output, building the next one on the workers
+// while the current one is submitted unless serial, and prints the
+// sustained images per second from the first build to the last file.
+void RenderBatch(const std::vector<RenderPose>& poses, Scene& scene, FramePipeline& pipeline, Renderer& renderer,
+                 BatchOutput& output, bool serial) {
+  FrameInput input = {0.0f, 0.0f};
+  FrameCommands frames[2];
+  auto pose = [&](size_t i) {
+    scene.camera_position = poses[i].camera_position;
+    scene.camera_target = poses[i].camera_target;
+    scene.light_position = poses[i].light_position;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  renderer.output_framebuffer = output.framebuffer();
+  int current = 0;
+  pose(0);
+  pipeline.build(input, frames[current]);
+  for(size_t i = 0; i < poses.size(); i++) {
+    bool last = i + 1 == poses.size();
+    if(!serial && !last) {
+      pose(i + 1);
+      pipeline.build_async(input, frames[current ^ 1]);
+    }
+    renderer.render(frames[current]);
+    output.capture(poses[i].name);
+    if(last)
+      break;
+    if(serial) {
+      pose(i + 1);
+      pipeline.build(input, frames[current ^ 1]);
+    } else {
+      pipeline.wait();
+    }
+    current ^= 1;
+  }
+  output.finish();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const BatchStats& stats = output.stats();
+  std::cout << stats.images << " images in " << seconds << " s, " << stats.images / seconds << " images/s, "
+            << stats.failures << " failed, " << (stats.bytes >> 20) << " MB written, encoding "
+            << stats.encode_ms / std::max(1u, stats.images) << " ms per image" << std::endl;
+  std::cout << "waited " << stats.readback_wait_ms << " ms on " << stats.readback_stalls << " readbacks, "
+            << stats.encode_wait_ms << " ms on encoders" << std::endl;
+}
+
+void PrintVertexCache(const char* path, const Model& model) {
+  std::cout << path << ": " << model.materials().size() << " materials, ACMR " << model.cache_before().acmr
+            << " -> " << model.cache_after().acmr << ", ATVR " << model.cache_before().atvr << " -> "
+            << model.cache_after().atvr << std::endl;
+}
+
+// Draws LOD 0 of the OBJ at path as indexed and after OptimizeMesh into a
+// single pixel with a position only shader, so the passes are bound by
+// vertex shading, and prints their GPU times.
+bool BenchmarkVertexCache(const char* path) {
+  std::vector<glm::vec3> soupVertices, soupNormals;
+  std::vector<glm::vec2> soupUVs;
+  if(!LoadOBJ(path, soupVertices, soupUVs, soupNormals))
+    return false;
+  MeshData indexed;
+  IndexVertices(soupVertices, soupUVs, soupNormals, indexed.vertices, indexed.uvs, indexed.normals,
+                indexed.indices);
+  if(indexed.indices.empty())
+    return false;
+  indexed.lods.push_back({0, (unsigned int)indexed.indices.size(), 0.0f});
+  indexed.cache_before = indexed.cache_after = AnalyzeVertexCache(indexed.indices, indexed.vertices.size());
+  MeshData optimized = indexed;
+  OptimizeMesh(optimized);
+  Model models[2] = {Model(indexed), Model(optimized)};
+
+  Shader shader("shaders/CascadeShadowMap.vert", NULL, "shaders/CascadeShadowMap.frag");
+  if(!shader.is_valid())
+    return false;
+  const glm::mat4 identity(1.0f);
+  GLuint buffer, texture;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), &identity, GL_STATIC_DRAW);
+  glGenTextures(1, &texture);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_BUFFER, texture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+  shader.use();
+  shader.set_int("Transforms", 0);
+  shader.set_int("DrawOffset", 0);
+  shader.set_mat4("LightMatrix", identity);
+  glViewport(0, 0, 1, 1);
+
+  unsigned int draws = std::max<size_t>(1, VertexCacheBenchTriangles / (indexed.indices.size() / 3));
+  GpuTimer timer({"indexed", "optimized"});
+  double ms[2] = {};
+  for(unsigned int frame = 0; frame < VertexCacheBenchFrames + VertexCacheBenchWarmup; frame++) {
+    glClear(GL_DEPTH_BUFFER_BIT);
+    for(unsigned int m = 0; m < 2; m++) {
+      timer.begin(m);
+      for(unsigned int d = 0; d < draws; d++)
+        models[m].render(0);
+      timer.end();
+    }
+    timer.next_frame();
+    glFinish();
+    for(unsigned int m = 0; frame >= VertexCacheBenchWarmup && m < 2; m++)
+      ms[m] += timer.milliseconds(m);
+  }
+  glDeleteTextures(1, &texture);
+  glDeleteBuffers(1, &buffer);
+
+  std::cout << path << ": " << indexed.vertices.size() << " vertices, " << indexed.indices.size() / 3
+            << " triangles drawn " << draws << " times per pass" << std::endl;
+  const VertexCacheStats* stats[2] = {&indexed.cache_before, &optimized.cache_after};
+  for(unsigned int m = 0; m < 2; m++)
+    std::cout << timer.name(m) << ": ACMR " << stats[m]->acmr << ", ATVR " << stats[m]->atvr << ", "
+              << ms[m] / VertexCacheBenchFrames << " ms per pass" << std::endl;
+  return true;
+}
+
 int main (int ArgCount, char **Args)
 {
-  int32_t WindowFlags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+  // --instances N adds a grid of N crates, --threads N sets the worker count
+  // and --serial builds every frame on the GL thread without overlap.
+  // --budget MS turns on dynamic resolution with a GPU frame time budget.
+  // --world PATH streams the cells of a world manifest around the camera.
+  // --sun replaces the point light by a directional one with cascaded shadows.
+  // --bench-transforms N times the transform system on N transforms and exits.
+  // --check-simplify runs the simplifier on a seamed cylinder and an
+  // icosphere, checks their errors and seams and exits.
+  // --check-obj PATH loads PATH, which must be models/importer_check.obj,
+  // checks the triangles and materials it gives and exits.
+  // --check-range-allocator checks RangeAllocator against a map of the used
+  // units and exits.
+  // --capture PATH FIRST COUNT records the GL calls of COUNT frames starting at
+  // frame FIRST for tools/glreplay.
+  // --virtual-textures streams texture pages into a fixed-size cache.
+  // --batch POSES DIR renders the poses of a pose list offscreen into PNGs in
+  // DIR and exits, --batch-size W H sets their resolution.
+  // --model PATH SCALE adds an OBJ at the origin, textured by its materials.
+  // --bake bakes the point light on the fixed crates and the room into a
+  // lightmap, static casters then leave the shadow map.
+  // --shadow-mask N filters the point light shadow in screen space at 1/N
+  // resolution, 2 or 4, instead of in the lit pass. M cycles the modes.
+  // --bench-queries N times N rays and segments against the scene on the
+  // CPU and exits. Clicking prints the instance under the cursor.
+  // --vsync N sets the swap interval, 1 on, 0 off, -1 adaptive.
+  // --frames-in-flight N lets the CPU run at most N frames ahead of the GPU
+  // and --fps-cap F starts at most F frames per second. P cycles the pacing
+  // presets, --pacing-bench SECONDS runs each of them in turn, prints their
+  // frame times and latencies and exits.
+  // --bench-frames N times building and rendering N frames on one thread,
+  // on the workers and pipelined and exits, the comparison being made at
+  // --instances 10000.
+  // --bench-icosphere N times generating an icosphere of N divisions and
+  // exits.
+  // --bench-vertex-cache PATH times drawing an OBJ with and without the
+  // index and vertex reordering of OptimizeMesh on the GPU and exits.
+  int instanceCount = 0;
+  int workerCount = -1;
+  bool serial = false;
+  float budgetMs = 0.0f;
+  const char* worldPath = nullptr;
+  bool sun = false;
+  unsigned int benchTransforms = 0;
+  bool checkSimplify = false;
+  const char* checkOBJPath = nullptr;
+  bool checkRangeAllocator = false;
+  const char* capturePath = nullptr;
+  unsigned int captureFirst = 0, captureCount = 0;
+  bool virtualTexturing = false;
+  const char* batchPath = nullptr;
+  const char* batchDirectory = nullptr;
+  unsigned int renderWidth = WinWidth, renderHeight = WinHeight;
+  const char* modelPath = nullptr;
+  float modelScale = 1.0f;
+  bool bake = false;
+  unsigned int shadowMaskDivisor = 0;
+  unsigned int benchQueries = 0;
+  bool setSwapInterval = false;
+  int swapInterval = 1;
+  unsigned int framesInFlight = 0;
+  float fpsCap = 0.0f;
+  float pacingBenchSeconds = 0.0f;
+  const char* benchVertexCachePath = nullptr;
+  int benchIcosphere = -1;
+  unsigned int benchFrames = 0;
+  for(int i = 1; i < ArgCount; i++) {
+    std::string arg = Args[i];
+    if(arg == "--instances" && i + 1 < ArgCount)
+      instanceCount = std::atoi(Args[++i]);
+    else if(arg == "--threads" && i + 1 < ArgCount)
+      workerCount = std::atoi(Args[++i]);
+    else if(arg == "--serial")
+      serial = true;
+    else if(arg == "--budget" && i + 1 < ArgCount)
+      budgetMs = std::atof(Args[++i]);
+    else if(arg == "--world" && i + 1 < ArgCount)
+      worldPath = Args[++i];
+    else if(arg == "--sun")
+      sun = true;
+    else if(arg == "--bench-transforms" && i + 1 < ArgCount)
+      benchTransforms = std::atoi(Args[++i]);
+    else if(arg == "--check-simplify")
+      checkSimplify = true;
+    else if(arg == "--check-obj" && i + 1 < ArgCount)
+      checkOBJPath = Args[++i];
+    else if(arg == "--check-range-allocator")
+      checkRangeAllocator = true;
+    else if(arg == "--capture" && i + 3 < ArgCount) {
+      capturePath = Args[++i];
+      captureFirst = std::atoi(Args[++i]);
+      captureCount = std::atoi(Args[++i]);
+    }
+    else if(arg == "--virtual-textures")
+      virtualTexturing = true;
+    else if(arg == "--batch" && i + 2 < ArgCount) {
+      batchPath = Args[++i];
+      batchDirectory = Args[++i];
+    }
+    else if(arg == "--model" && i + 2 < ArgCount) {
+      modelPath = Args[++i];
+      modelScale = std::atof(Args[++i]);
+    }
+    else if(arg == "--batch-size" && i + 2 < ArgCount) {
+      renderWidth = std::max(1, std::atoi(Args[++i]));
+      renderHeight = std::max(1, std::atoi(Args[++i]));
+    }
+    else if(arg == "--bake")
+      bake = true;
+    else if(arg == "--shadow-mask" && i + 1 < ArgCount)
+      shadowMaskDivisor = std::atoi(Args[++i]);
+    else if(arg == "--bench-queries" && i + 1 < ArgCount)
+      benchQueries = std::atoi(Args[++i]);
+    else if(arg == "--vsync" && i + 1 < ArgCount) {
+      setSwapInterval = true;
+      swapInterval = std::atoi(Args[++i]);
+    }
+    else if(arg == "--frames-in-flight" && i + 1 < ArgCount)
+      framesInFlight = std::atoi(Args[++i]);
+    else if(arg == "--fps-cap" && i + 1 < ArgCount)
+      fpsCap = std::atof(Args[++i]);
+    else if(arg == "--pacing-bench" && i + 1 < ArgCount)
+      pacingBenchSeconds = std::atof(Args[++i]);
+    else if(arg == "--bench-vertex-cache" && i + 1 < ArgCount)
+      benchVertexCachePath = Args[++i];
+    else if(arg == "--bench-icosphere" && i + 1 < ArgCount)
+      benchIcosphere = std::atoi(Args[++i]);
+    else if(arg == "--bench-frames" && i + 1 < ArgCount)
+      benchFrames = std::atoi(Args[++i]);
+  }
+
+  if(benchTransforms) {
+    return BenchmarkTransforms(benchTransforms, workerCount) ? 0 : 1;
+  }
+  if(checkSimplify)
+    return CheckSimplifier() ? 0 : 1;
+  if(checkOBJPath)
+    return CheckOBJImport(checkOBJPath) ? 0 : 1;
+  if(checkRangeAllocator)
+    return CheckRangeAllocator() ? 0 : 1;
+  if(benchIcosphere >= 0) {
+    BenchmarkIcosphere(benchIcosphere);
+    return 0;
+  }
+
+  std::vector<RenderPose> poses;
+  if(batchPath && (!LoadPoses(batchPath, poses) || poses.empty())) {
+    std::cout << "No poses to render in " << batchPath << std::endl;
+    return -1;
+  }
+
+  // Batches only need a context, their window stays hidden.
+  int32_t WindowFlags = SDL_WINDOW_OPENGL | (batchPath ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE);
   SDL_Window *Window = SDL_CreateWindow("GP Project",
                                         SDL_WINDOWPOS_CENTERED,
                                         SDL_WINDOWPOS_CENTERED,
-                                        WinWidth,
-                                        WinHeight,
+                                        renderWidth,
+                                        renderHeight,
                                         WindowFlags);
   if(!Window) {
     std::cout << "Failed to create a window";
@@ -46,101 +915,264 @@ int main (int ArgCount, char **Args)
     return -1;
   }
 
+  // Installed before any resource is created so the trace can recreate them.
+  std::unique_ptr<GLCapture> capture;
+  if(capturePath)
+    capture.reset(new GLCapture(capturePath, renderWidth, renderHeight, captureFirst, captureCount));
+
   glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
   glEnable(GL_CULL_FACE);
 
-  Shader tex_shader("shaders/ShadowedNormal.vert",
-                    NULL,
-                    "shaders/ShadowedNormal.frag");
+  // Shared vertex and index storage, must outlive every model below.
+  GeometryArena arena;
 
-  Shader cube_shadow_shader("shaders/CubeShadowMap.vert",
-                            "shaders/CubeShadowMap.geom",
-                            "shaders/CubeShadowMap.frag");
-  
-  Shader monocolor_shader("shaders/Monocolor.vert",
-                          NULL,
-                          "shaders/Monocolor.frag");
+  if(benchVertexCachePath) {
+    bool benched = BenchmarkVertexCache(benchVertexCachePath);
+    SDL_DestroyWindow(Window);
+    return benched ? 0 : 1;
+  }
+
+  const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
+  std::unique_ptr<VirtualTextureCache> virtualTextures;
+  if(virtualTexturing) {
+    VirtualTextureSettings settings;
+    settings.cache_pages = VirtualCachePages;
+    settings.feedback_width = renderWidth / VirtualFeedbackDivisor;
+    settings.feedback_height = renderHeight / VirtualFeedbackDivisor;
+    settings.uploads_per_frame = VirtualUploadsPerFrame;
+    virtualTextures.reset(new VirtualTextureCache(settings));
+  }
+  Renderer renderer(renderWidth, renderHeight, SHADOW_WIDTH, sun ? SunShadowResolution : 0, virtualTextures.get());
+  renderer.shadow_mask_divisor = shadowMaskDivisor;
 
-  std::shared_ptr<Model> CrateModel = Model::FromOBJ("models/crate.obj");
+  // The sun is never baked.
+  bake = bake && !sun;
+  float crateDensity = bake ? CrateLightmapDensity : 0.0f;
+  float roomDensity = bake ? RoomLightmapDensity : 0.0f;
+  std::shared_ptr<Model> CrateModel = Model::FromOBJ("models/crate.obj", 3, crateDensity);
+  if(!CrateModel) {
+    SDL_DestroyWindow(Window);
+    return -1;
+  }
+  PrintVertexCache("models/crate.obj", *CrateModel);
 
   std::vector<std::shared_ptr<Model>> walls = {
-    Model::FlatModel(2, 2, {-10, -5, 10}, {-10, -5, -10}, {-10, 5, -10}),
-    Model::FlatModel(2, 2, {-10, -5, -10}, {10, -5, -10}, {10, 5, -10}),
-    Model::FlatModel(2, 2, {10, -5, -10}, {10, -5, 10}, {10, 5, 10}),
-    Model::FlatModel(2, 2, {10, -5, 10}, {-10, -5, 10}, {-10, 5, 10})
+    Model::FlatModel(2, 2, {-10, -5, 10}, {-10, -5, -10}, {-10, 5, -10}, roomDensity),
+    Model::FlatModel(2, 2, {-10, -5, -10}, {10, -5, -10}, {10, 5, -10}, roomDensity),
+    Model::FlatModel(2, 2, {10, -5, -10}, {10, -5, 10}, {10, 5, 10}, roomDensity),
+    Model::FlatModel(2, 2, {10, -5, 10}, {-10, -5, 10}, {-10, 5, 10}, roomDensity)
   };
 
   std::vector<std::shared_ptr<Model>> floors = {
-    Model::FlatModel(4, 4, {-10, -5, 10}, {10, -5, 10}, {10, -5, -10}),
-    Model::FlatModel(4, 4, {10, 5, 10}, {-10, 5, 10}, {-10, 5, -10})
+    Model::FlatModel(4, 4, {-10, -5, 10}, {10, -5, 10}, {10, -5, -10}, roomDensity),
+    Model::FlatModel(4, 4, {10, 5, 10}, {-10, 5, 10}, {-10, 5, -10}, roomDensity)
   };
 
-  std::shared_ptr<Model> LightbulbModel = Model::Sphere(3);
+  std::shared_ptr<Model> LightbulbModel = Model::LightProxySphere(3);
 
-  std::shared_ptr<Texture> CrateTexture =
-    std::make_shared<Texture>(Texture::Format::PNG,
-                              "textures/crate_albedo.png",
-                              "textures/crate_normals.png");
-  std::shared_ptr<Texture> WallTexture =
-    std::make_shared<Texture>(Texture::Format::PNG,
-                              "textures/wall_albedo.png",
-                              "textures/wall_normal.png");
-  std::shared_ptr<Texture> FloorTexture =
-    std::make_shared<Texture>(Texture::Format::PNG,
-                              "textures/floor_albedo.png",
-                              "textures/floor_normal.png");
+  // A texture that can not be made virtual is loaded as a regular one.
+  auto LoadTexture = [&](const char* albedo, const char* normal) {
+    std::shared_ptr<Texture> texture;
+    if(virtualTextures)
+      texture = virtualTextures->add(albedo, normal);
+    if(!texture)
+      texture = std::make_shared<Texture>(Texture::Format::PNG, albedo, normal);
+    return texture;
+  };
+  std::shared_ptr<Texture> CrateTexture = LoadTexture("textures/crate_albedo.png", "textures/crate_normals.png");
+  std::shared_ptr<Texture> WallTexture = LoadTexture("textures/wall_albedo.png", "textures/wall_normal.png");
+  std::shared_ptr<Texture> FloorTexture = LoadTexture("textures/floor_albedo.png", "textures/floor_normal.png");
+  TextureCache textureCache(LoadTexture);
 
-  monocolor_shader.use();
-  monocolor_shader.set_vec3("Color", {1.0f, 1.0f, 1.0f});
+  Scene scene;
+  scene.camera_position = glm::vec3(0, 2, -5);
+  scene.light_position = glm::vec3(5, 0, 5);
+  if(sun) {
+    scene.light = Scene::Light::Directional;
+    scene.sun_direction = glm::normalize(glm::vec3(1.0f, 2.0f, 1.0f));
+  }
 
-  tex_shader.use();
-  tex_shader.set_int("DiffuseTextureSampler", 0);
-  tex_shader.set_int("NormalTextureSampler", 1);
-  tex_shader.set_int("DepthSampler", 2);
+  Model* crate = CrateModel.get();
+  Texture* crateTexture = CrateTexture.get();
+  const glm::vec3 up(0.0f, 1.0f, 0.0f);
+  const glm::vec3 tilt = glm::normalize(glm::vec3(1.0, 0.0, 1.0));
 
-  // Utilities for shadow mapping
-  GLuint depthMapFBO = 0;
-  glGenFramebuffers(1, &depthMapFBO);
+  scene.instances = {
+    {crate, crateTexture, {4.0f, -3.5f, 0.0f}, up, 0.0f, 0.5f, Instance::CastsShadow | Instance::Static},
+    {crate, crateTexture, {2.0f, 3.0f, 1.0f}, up, 0.0f, 0.75f, Instance::CastsShadow | Instance::Static},
+    {crate, crateTexture, {-3.0f, -1.0f, 0.0f}, up, 0.0f, 0.5f, Instance::CastsShadow | Instance::Static},
+    {crate, crateTexture, {-1.5f, 2.0f, -3.0f}, tilt, 60.0f, 0.75f, Instance::CastsShadow | Instance::Static},
 
-  GLuint depthCubemap;
-  glGenTextures(1, &depthCubemap);
+    {crate, crateTexture, {-1.0f, -6.5f, -4.0f}, up, 0.0f, 0.5f, Instance::Lit | Instance::Static},
+    {crate, crateTexture, {2.0f, -2.0f, 3.0f}, up, 0.0f, 0.75f, Instance::Lit | Instance::Static},
+    {crate, crateTexture, {-3.0f, -4.0f, 3.0f}, up, 0.0f, 0.5f, Instance::Lit | Instance::Static},
+    {crate, crateTexture, {-4.5f, -2.0f, -2.0f}, tilt, 60.0f, 0.75f, Instance::Lit | Instance::Static},
 
-  const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-  glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-  for (int i = 0; i < 6; i++)
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, 
-                 SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-  glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
-  glDrawBuffer(GL_NONE);
-  glReadBuffer(GL_NONE);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-  glm::mat4 Projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
-	glm::vec3 initialCameraPos(0, 2, -5);
-
-	glm::mat4 View = glm::lookAt(
-				initialCameraPos,
-				glm::vec3(0, -3, 0),
-				glm::vec3(0, 1, 0)
-			  );
-	glm::mat4 Model = glm::mat4(1.0f);
-	glm::mat4 MVP = Projection * View * Model;
-
-
-  float angle = 0.0;
-  float angle_light = 0.0;
+    {LightbulbModel.get(), nullptr, {0.0f, 0.0f, 0.0f}, up, 0.0f, 0.15f, Instance::Unlit | Instance::AtLight}
+  };
+  for(auto& wall : walls)
+    scene.instances.push_back({wall.get(), WallTexture.get(), {0.0f, 0.0f, 0.0f}, up, 0.0f, 1.0f,
+                               Instance::Lit | Instance::Static});
+  for(auto& floor : floors)
+    scene.instances.push_back({floor.get(), FloorTexture.get(), {0.0f, 0.0f, 0.0f}, up, 0.0f, 1.0f,
+                               Instance::Lit | Instance::Static});
+
+  // Stress scene: a grid of small crates filling the room.
+  if(instanceCount > 0) {
+    int side = (int)std::ceil(std::cbrt((double)instanceCount));
+    float spacing = 18.0f / side;
+    for(int i = 0; i < instanceCount; i++) {
+      glm::vec3 cell(i % side, (i / side) % side, i / (side * side));
+      glm::vec3 position = glm::vec3(-9.0f, -4.5f, -9.0f) + cell * spacing * glm::vec3(1.0f, 0.5f, 1.0f);
+      scene.instances.push_back({crate, crateTexture, position, up, 0.0f, spacing * 0.08f,
+                                 Instance::CastsShadow | Instance::Lit});
+    }
+  }
+
+  // One model whatever the number of materials, drawn with a texture per
+  // material.
+  std::shared_ptr<Model> importedModel;
+  std::vector<Texture*> importedMaterials;
+  if(modelPath)
+    importedModel = Model::FromOBJ(modelPath, 3);
+  if(importedModel) {
+    PrintVertexCache(modelPath, *importedModel);
+    for(const Material& material : importedModel->materials())
+      importedMaterials.push_back(textureCache.get(material.albedo, material.normal, material.diffuse));
+    if(importedModel->lod_count()) {
+      Instance instance = {importedModel.get(), crateTexture, {0.0f, 0.0f, 0.0f}, up, 0.0f, modelScale,
+                           Instance::CastsShadow | Instance::Lit};
+      if(importedMaterials.size())
+        instance.materials = importedMaterials.data();
+      scene.instances.push_back(instance);
+      std::cout << modelPath << ": " << importedModel->parts().size() << " parts over "
+                << importedModel->lod_count() << " LODs, " << textureCache.size() << " textures" << std::endl;
+    }
+  }
+
+  std::unique_ptr<WorldStreamer> streamer;
+  if(worldPath) {
+    std::vector<StreamCell> cells;
+    if(LoadWorld(worldPath, cells)) {
+      StreamSettings streamSettings;
+      streamSettings.load_radius = StreamLoadRadius;
+      streamSettings.unload_radius = StreamUnloadRadius;
+      streamSettings.prediction_time = StreamPredictionTime;
+      streamSettings.memory_budget = StreamMemoryBudget;
+      streamSettings.upload_budget = StreamUploadBudget;
+      streamSettings.lod_levels = 3;
+      std::cout << "Streaming " << cells.size() << " cells from " << worldPath << std::endl;
+      streamer.reset(new WorldStreamer(scene, std::move(cells), streamSettings));
+    }
+  }
+
+  FrameSettings settings;
+  settings.fov = glm::radians(45.0f);
+  settings.aspect = (float)renderWidth / renderHeight;
+  settings.near = 0.1f;
+  settings.far = 100.0f;
+  settings.viewport_height = renderHeight;
+  settings.shadow_far = 100.0f;
+  settings.shadow_resolution = SHADOW_HEIGHT;
+  settings.lod_pixel_error = LodPixelError;
+  settings.shadow_lod_pixel_error = ShadowLodPixelError;
+  settings.cascade_count = SunCascadeCount;
+  settings.cascade_distance = SunCascadeDistance;
+  settings.cascade_split_lambda = SunCascadeSplitLambda;
+  settings.cascade_resolution = SunShadowResolution;
+
+  JobSystem jobs(workerCount);
+
+  LightmapSettings lightmapSettings;
+  lightmapSettings.max_size = LightmapMaxSize;
+  lightmapSettings.samples = LightmapSamples;
+  lightmapSettings.light_radius = LightmapLightRadius;
+  lightmapSettings.light_power = LightmapLightPower;
+  lightmapSettings.bias = LightmapBias;
+  Lightmap lightmap(lightmapSettings);
+  if(bake) {
+    lightmap.bake(jobs, scene, scene.light_position);
+    lightmap.upload();
+    renderer.lightmap_texture = lightmap.texture();
+    const LightmapStats& bakeStats = lightmap.stats();
+    std::cout << "Lightmap: " << bakeStats.instances << " instances (" << bakeStats.skipped << " skipped) in "
+              << bakeStats.size << "x" << bakeStats.size << ", " << bakeStats.texels << " texels, BVH of "
+              << bakeStats.occluders << " triangles in " << bakeStats.bvh_ms << " ms, " << bakeStats.rays
+              << " rays in " << bakeStats.trace_ms << " ms on " << bakeStats.workers << " threads, "
+              << bakeStats.rays / std::max(0.001, bakeStats.trace_ms * 1000.0) << " Mrays/s" << std::endl;
+  }
+
+  if(benchQueries) {
+    BenchmarkQueries(jobs, scene, settings, benchQueries);
+    SDL_DestroyWindow(Window);
+    return 0;
+  }
+  if(benchFrames) {
+    BenchmarkFrames(jobs, scene, settings, renderer, benchFrames);
+    SDL_DestroyWindow(Window);
+    return 0;
+  }
+
+  FramePipeline pipeline(jobs, scene, settings);
+  std::cout << "Instances: " << scene.instances.size() << ", workers: " << jobs.worker_count()
+            << (serial ? ", serial" : ", pipelined") << std::endl;
+
+  if(batchPath) {
+    BatchOutput output(jobs, renderWidth, renderHeight, batchDirectory);
+    if(output.is_valid())
+      RenderBatch(poses, scene, pipeline, renderer, output, serial);
+    SDL_DestroyWindow(Window);
+    return 0;
+  }
+
+  FrameInput input = {0.0f, 0.0f};
+  FrameCommands frames[2];
+  // When the input each of the frames was built from was sampled.
+  std::chrono::steady_clock::time_point inputTimes[2];
+  int current = 0;
+  inputTimes[current] = std::chrono::steady_clock::now();
+  pipeline.build(input, frames[current]);
+
+  if(setSwapInterval)
+    ApplySwapInterval(swapInterval);
+  FramePacer pacer({framesInFlight, fpsCap});
+  int pacingMode = -1;  // the settings of the flags
+  auto pacingModeStart = std::chrono::steady_clock::now();
+  std::vector<PacingStats> pacingResults;
+  pacingResults.reserve(PacingModeCount);
+  auto selectPacing = [&](int mode) {
+    pacingMode = mode;
+    ApplySwapInterval(PacingModes[mode].swap_interval);
+    pacer.set_settings(PacingModes[mode].settings);
+    serial = PacingModes[mode].serial;
+    pacer.take_stats();
+    pacingModeStart = std::chrono::steady_clock::now();
+    std::cout << "Pacing: " << PacingModes[mode].name << std::endl;
+  };
+  if(pacingBenchSeconds > 0.0f)
+    selectPacing(0);
+
+  ResolutionController resolution(budgetMs, MinRenderScale);
+  FrameStats stats;
+  double lastFrameMs = 0.0;
+  unsigned int frameNumber = 0;
   int32_t Running = 1;
+  // Instances are picked against LOD 0 once the frame under the cursor is
+  // done with the scene.
+  SceneQuery pickQuery;
+  bool pick = false;
+  int pickX = 0, pickY = 0;
 
   while (Running)
   {
+    auto frameStart = std::chrono::steady_clock::now();
+    size_t allocationsBefore = AllocationCount();
+    // Input is sampled once the pacer lets the frame start, as late as the
+    // frames in flight allow.
+    auto inputTime = pacer.wait();
+    if(capture)
+      capture->begin_frame();
     SDL_Event Event;
 
     while (SDL_PollEvent(&Event))
@@ -150,16 +1182,27 @@ int main (int ArgCount, char **Args)
         switch (Event.key.keysym.sym)
         {
           case SDLK_RIGHT:
-            angle += 2.0f;
+            input.camera_angle += 2.0f;
             break;
           case SDLK_LEFT:
-            angle -= 2.0f;
+            input.camera_angle -= 2.0f;
             break;
           case SDLK_UP:
-            angle_light += 2.0f;
+            input.light_angle += 2.0f;
             break;
           case SDLK_DOWN:
-            angle_light -= 2.0f;
+            input.light_angle -= 2.0f;
+            break;
+          case SDLK_m:
+            // Inline, half then quarter resolution.
+            renderer.shadow_mask_divisor = renderer.shadow_mask_divisor ? renderer.shadow_mask_divisor * 2 % 8 : 2;
+            if(renderer.shadow_mask_divisor)
+              std::cout << "Shadow mask at 1/" << renderer.shadow_mask_divisor << " resolution" << std::endl;
+            else
+              std::cout << "Inline shadows" << std::endl;
+            break;
+          case SDLK_p:
+            selectPacing((pacingMode + 1) % PacingModeCount);
             break;
           case SDLK_ESCAPE:
             Running = false;
@@ -168,158 +1211,115 @@ int main (int ArgCount, char **Args)
             break;
         }
       }
+      else if (Event.type == SDL_MOUSEBUTTONDOWN && Event.button.button == SDL_BUTTON_LEFT)
+      {
+        pick = true;
+        pickX = Event.button.x;
+        pickY = Event.button.y;
+      }
       else if (Event.type == SDL_QUIT)
       {
         Running = 0;
       } 
     }
 
-    glm::mat4 rotateX =
-		  glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::vec4 newCameraPos = rotateX * glm::vec4(initialCameraPos, 1);
-		glm::mat4 View = glm::lookAt(
-				glm::vec3(newCameraPos),
-				glm::vec3(0, 0, 0),
-				glm::vec3(0, 1, 0)
-			  );
-		MVP = Projection * View * Model;
-    glm::mat3 ModelView = glm::mat3(View * Model);
-
-    glm::mat4 rotateLightX =
-		  glm::rotate(glm::mat4(1.0f), glm::radians(angle_light), glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::vec4 lightPos = rotateLightX * glm::vec4(5, 0, 5, 1);
-
-    // Rendering to the depth buffer
-    float aspect = (float)SHADOW_WIDTH/(float)SHADOW_HEIGHT;
-    float near = 0.1f;
-    float far = 100.0f;
-    glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), aspect, near, far);
-
-    std::vector<glm::mat4> shadowTransforms;
-    shadowTransforms.push_back(shadowProj * 
-                    glm::lookAt(glm::vec3(lightPos), glm::vec3(lightPos) + glm::vec3( 1.0, 0.0, 0.0), glm::vec3(0.0,-1.0, 0.0)));
-    shadowTransforms.push_back(shadowProj * 
-                    glm::lookAt(glm::vec3(lightPos), glm::vec3(lightPos) + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0,-1.0, 0.0)));
-    shadowTransforms.push_back(shadowProj * 
-                    glm::lookAt(glm::vec3(lightPos), glm::vec3(lightPos) + glm::vec3( 0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0)));
-    shadowTransforms.push_back(shadowProj * 
-                    glm::lookAt(glm::vec3(lightPos), glm::vec3(lightPos) + glm::vec3( 0.0,-1.0, 0.0), glm::vec3(0.0, 0.0,-1.0)));
-    shadowTransforms.push_back(shadowProj * 
-                    glm::lookAt(glm::vec3(lightPos), glm::vec3(lightPos) + glm::vec3( 0.0, 0.0, 1.0), glm::vec3(0.0,-1.0, 0.0)));
-    shadowTransforms.push_back(shadowProj * 
-                    glm::lookAt(glm::vec3(lightPos), glm::vec3(lightPos) + glm::vec3( 0.0, 0.0,-1.0), glm::vec3(0.0,-1.0, 0.0)));
-
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    cube_shadow_shader.use();
-
-    cube_shadow_shader.set_vec3("LightPosition", glm::vec3(lightPos.x, lightPos.y, lightPos.z));
-    cube_shadow_shader.set_float("far_plane", far);
-    for(int i = 0; i < 6; i++)
-      cube_shadow_shader.set_mat4(std::string("ShadowMatrices[" + std::to_string(i) + "]").c_str(), shadowTransforms[i]);
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(4.0f, -3.5f, 0.0));
-    Model = glm::scale(Model, glm::vec3(0.5f));
-    cube_shadow_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(2.0f, 3.0f, 1.0));
-    Model = glm::scale(Model, glm::vec3(0.75f));
-    cube_shadow_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(-3.0f, -1.0f, 0.0));
-    Model = glm::scale(Model, glm::vec3(0.5f));
-    cube_shadow_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(-1.5f, 2.0f, -3.0));
-    Model = glm::rotate(Model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-    Model = glm::scale(Model, glm::vec3(0.75f));
-    cube_shadow_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    // Proper rendering
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, WinWidth, WinHeight);
-    glClearColor(0.5f, 0.5f, 0.5f, 0.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    tex_shader.use();
-
-    tex_shader.set_mat4("P", Projection);
-    tex_shader.set_mat4("V", View);
-    tex_shader.set_vec3("LightPosition", glm::vec3(lightPos.x, lightPos.y, lightPos.z));
-    tex_shader.set_vec3("CameraPosition", glm::vec3(newCameraPos.x, newCameraPos.y, newCameraPos.z));
-    tex_shader.set_float("far_plane", far);
-
-    CrateTexture->use();
-
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(-1.0f, -6.5f, -4.0));
-    Model = glm::scale(Model, glm::vec3(0.5f));
-    tex_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(2.0f, -2.0f, 3.0));
-    Model = glm::scale(Model, glm::vec3(0.75f));
-    tex_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(-3.0f, -4.0f, 3.0));
-    Model = glm::scale(Model, glm::vec3(0.5f));
-    tex_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(-4.5f, -2.0f, -2.0));
-    Model = glm::rotate(Model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-    Model = glm::scale(Model, glm::vec3(0.75f));
-    tex_shader.set_mat4("M", Model);
-    CrateModel->render();
-
-    WallTexture->use();
-
-    Model = glm::mat4(1.0f);
-    tex_shader.set_mat4("M", Model);
-
-    for(int i = 0; i < 4; i++)
-      walls[i]->render();
-
-    FloorTexture->use();
-
-    for(int i = 0; i < 2; i++)
-      floors[i]->render();
-
-    monocolor_shader.use();
-    monocolor_shader.set_mat4("V", View);
-    monocolor_shader.set_mat4("P", Projection);
-
-    Model = glm::mat4(1.0f);
-    Model = glm::translate(Model, glm::vec3(lightPos.x, lightPos.y, lightPos.z));
-    Model = glm::scale(Model, glm::vec3(0.15));
-    
-    monocolor_shader.set_mat4("M", Model);
-
-    LightbulbModel->render();
+    // The next frame is built on the workers while this one is submitted.
+    if(serial) {
+      pipeline.build(input, frames[current]);
+      inputTimes[current] = inputTime;
+    } else {
+      pipeline.build_async(input, frames[current ^ 1]);
+      inputTimes[current ^ 1] = inputTime;
+    }
 
+    auto replayStart = std::chrono::steady_clock::now();
+    renderer.render(frames[current]);
     SDL_GL_SwapWindow(Window);
+    pacer.end_frame(inputTimes[current]);
+    if(capture)
+      capture->end_frame();
+    auto replayEnd = std::chrono::steady_clock::now();
+
+    if(!serial) {
+      pipeline.wait();
+      current ^= 1;
+    }
+
+    // Nothing reads the scene until the next build starts. The query is
+    // rebuilt on every pick, the models keep their BVHs.
+    bool picked = pick;
+    if(pick) {
+      pick = false;
+      int width, height;
+      SDL_GetWindowSize(Window, &width, &height);
+      glm::vec2 ndc(2.0f * (pickX + 0.5f) / width - 1.0f, 1.0f - 2.0f * (pickY + 0.5f) / height);
+      glm::mat4 inverse = glm::inverse(frames[current].projection * frames[current].view);
+      glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+      glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+      glm::vec3 from = glm::vec3(nearPoint) / nearPoint.w;
+      glm::vec3 to = glm::vec3(farPoint) / farPoint.w;
+      pickQuery.build(jobs, scene, Instance::CastsShadow | Instance::Lit);
+      SceneHit hit;
+      if(pickQuery.intersect({from, to - from, 1.0f}, hit))
+        std::cout << "Picked instance " << hit.instance << ", triangle " << hit.triangle << " at distance "
+                  << hit.t * glm::distance(from, to) << std::endl;
+      else
+        std::cout << "Picked nothing" << std::endl;
+    }
+    if(streamer)
+      streamer->update(frames[current].camera_position, lastFrameMs / 1000.0f);
+
+    // Streaming loads and uploads resources and picking builds the query, so
+    // only a static scene is held to zero allocations, outside of picks.
+    size_t frameAllocations = AllocationCount() - allocationsBefore;
+    // Checked in every build type, tracking is mostly turned on in release.
+    if(AllocationTrackingEnabled() && !streamer && !picked && ++frameNumber > AllocationWarmupFrames &&
+       frameAllocations) {
+      std::cout << "Frame " << frameNumber << " allocated " << frameAllocations << " times" << std::endl;
+      std::abort();
+    }
+
+    lastFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    bool printed = stats.add(frames[current].build_ms,
+                             std::chrono::duration<double, std::milli>(replayEnd - replayStart).count(),
+                             lastFrameMs, renderer.render_scale, frameAllocations, frames[current],
+                             renderer.timer());
+    if(printed && streamer) {
+      StreamStats streamStats = streamer->take_stats();
+      std::cout << "streaming: " << streamStats.resident_cells << " cells resident, "
+                << streamStats.loading_cells << " loading, " << (streamStats.resident_bytes >> 20) << " MB (peak "
+                << (streamStats.peak_resident_bytes >> 20) << " MB), staged peak "
+                << (streamStats.peak_staged_bytes >> 20) << " MB, " << streamStats.loads << " loads, "
+                << streamStats.evictions << " evictions, worst load " << streamStats.max_load_ms
+                << " ms, worst update " << streamStats.max_update_ms << " ms" << std::endl;
+    }
+    if(printed && virtualTextures) {
+      VirtualTextureStats textureStats = virtualTextures->take_stats();
+      std::cout << "virtual textures: " << textureStats.textures << " textures, " << textureStats.resident_pages
+                << "/" << textureStats.cache_pages << " pages resident in " << (textureStats.cache_bytes >> 20)
+                << " MB, " << textureStats.requests << " requests, " << textureStats.uploads << " uploads, "
+                << textureStats.evictions << " evictions" << std::endl;
+    }
+
+    if(printed && pacingBenchSeconds <= 0.0f)
+      PrintPacing(pacingMode < 0 ? "flags" : PacingModes[pacingMode].name, pacer.take_stats());
+
+    if(budgetMs > 0.0f)
+      renderer.render_scale = resolution.update(renderer.timer().total_milliseconds());
+
+    if(pacingBenchSeconds > 0.0f &&
+       std::chrono::duration<float>(std::chrono::steady_clock::now() - pacingModeStart).count() >= pacingBenchSeconds) {
+      pacingResults.push_back(pacer.take_stats());
+      if(pacingMode + 1 < PacingModeCount)
+        selectPacing(pacingMode + 1);
+      else
+        Running = 0;
+    }
   }
 
-  glDeleteTextures(1, &depthCubemap);
-  glDeleteFramebuffers(1, &depthMapFBO);
-  
+  for(size_t i = 0; i < pacingResults.size(); i++)
+    PrintPacing(PacingModes[i].name, pacingResults[i]);
+
   SDL_DestroyWindow(Window);
 
   return 0;
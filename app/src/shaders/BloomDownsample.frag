@@ -0,0 +1,72 @@
+#version 330 core
+
+in vec2 UV;
+
+out vec3 color;
+
+uniform sampler2D Source;
+uniform vec2 SourceTexelSize;
+// Part of the source that holds the image, see PostProcess::set_scene_region.
+uniform vec2 SourceScale;
+uniform vec2 SourceClamp;
+uniform int BrightPass;
+// threshold, threshold - knee, 0.25 / knee
+uniform vec3 Threshold;
+
+float Luminance(vec3 c) {
+	return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Quadratic soft knee below the threshold.
+vec3 Prefilter(vec3 c) {
+	float brightness = max(c.r, max(c.g, c.b));
+	float soft = clamp(brightness - Threshold.y, 0.0, 2.0 * (Threshold.x - Threshold.y));
+	soft = soft * soft * Threshold.z;
+	float contribution = max(soft, brightness - Threshold.x) / max(brightness, 1e-4);
+	return c * contribution;
+}
+
+// Weights a group of four by its inverse luminance so single bright pixels
+// do not flicker in the bloom.
+vec3 KarisAverage(vec3 a, vec3 b, vec3 c, vec3 d) {
+	float wa = 1.0 / (1.0 + Luminance(a));
+	float wb = 1.0 / (1.0 + Luminance(b));
+	float wc = 1.0 / (1.0 + Luminance(c));
+	float wd = 1.0 / (1.0 + Luminance(d));
+	return (a * wa + b * wb + c * wc + d * wd) / (wa + wb + wc + wd);
+}
+
+vec3 Tap(vec2 offset) {
+	return texture(Source, min(UV * SourceScale + SourceTexelSize * offset, SourceClamp)).rgb;
+}
+
+// 13 bilinear taps covering a 6x6 texel footprint, grouped into five
+// overlapping 2x2 boxes.
+void main() {
+	vec3 a = Tap(vec2(-2,  2));
+	vec3 b = Tap(vec2( 0,  2));
+	vec3 c = Tap(vec2( 2,  2));
+	vec3 d = Tap(vec2(-2,  0));
+	vec3 e = Tap(vec2(0));
+	vec3 f = Tap(vec2( 2,  0));
+	vec3 g = Tap(vec2(-2, -2));
+	vec3 h = Tap(vec2( 0, -2));
+	vec3 i = Tap(vec2( 2, -2));
+	vec3 j = Tap(vec2(-1,  1));
+	vec3 k = Tap(vec2( 1,  1));
+	vec3 l = Tap(vec2(-1, -1));
+	vec3 m = Tap(vec2( 1, -1));
+
+	if(BrightPass != 0) {
+		color = KarisAverage(j, k, l, m) * 0.5 +
+			(KarisAverage(a, b, d, e) + KarisAverage(b, c, e, f) +
+			 KarisAverage(d, e, g, h) + KarisAverage(e, f, h, i)) * 0.125;
+		color = Prefilter(color);
+		return;
+	}
+
+	color = (j + k + l + m) * 0.125 +
+		(a + c + g + i) * 0.03125 +
+		(b + d + f + h) * 0.0625 +
+		e * 0.125;
+}
@@ -0,0 +1,24 @@
+#version 330 core
+
+in vec2 UV;
+
+out vec3 color;
+
+uniform sampler2D Source;
+uniform vec2 SourceTexelSize;
+uniform float Radius;
+
+// 3x3 tent; the radius only spreads the taps, their number stays the same.
+void main() {
+	vec2 t = SourceTexelSize * Radius;
+	color  = texture(Source, UV + t * vec2(-1,  1)).rgb;
+	color += texture(Source, UV + t * vec2( 0,  1)).rgb * 2.0;
+	color += texture(Source, UV + t * vec2( 1,  1)).rgb;
+	color += texture(Source, UV + t * vec2(-1,  0)).rgb * 2.0;
+	color += texture(Source, UV).rgb * 4.0;
+	color += texture(Source, UV + t * vec2( 1,  0)).rgb * 2.0;
+	color += texture(Source, UV + t * vec2(-1, -1)).rgb;
+	color += texture(Source, UV + t * vec2( 0, -1)).rgb * 2.0;
+	color += texture(Source, UV + t * vec2( 1, -1)).rgb;
+	color /= 16.0;
+}
@@ -0,0 +1,18 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+layout(location = 5) in uint DrawID;
+
+// Instance transforms, four RGBA32F texels per matrix.
+uniform samplerBuffer Transforms;
+uniform int DrawOffset;
+// Orthographic projection times view of one sun cascade.
+uniform mat4 LightMatrix;
+
+void main()
+{
+    int base = (int(DrawID) + DrawOffset) * 4;
+    mat4 M = mat4(texelFetch(Transforms, base), texelFetch(Transforms, base + 1),
+                  texelFetch(Transforms, base + 2), texelFetch(Transforms, base + 3));
+    gl_Position = LightMatrix * M * vec4(aPos, 1.0);
+}
@@ -2,10 +2,17 @@
 
 layout(location = 0) in vec3 vertexPosition;
 
-uniform mat4 M;
+layout(location = 5) in uint DrawID;
+
+// Instance transforms, four RGBA32F texels per matrix.
+uniform samplerBuffer Transforms;
+uniform int DrawOffset;
 uniform mat4 V;
 uniform mat4 P;
 
-void main(){	
+void main(){
+	int base = (int(DrawID) + DrawOffset) * 4;
+	mat4 M = mat4(texelFetch(Transforms, base), texelFetch(Transforms, base + 1),
+	              texelFetch(Transforms, base + 2), texelFetch(Transforms, base + 3));
 	gl_Position =  P * V * M * vec4(vertexPosition, 1);
 }
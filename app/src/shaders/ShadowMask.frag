@@ -0,0 +1,52 @@
+#version 330 core
+
+// Shadow of the surface under the middle pixel of the block, and its
+// distance to the camera for the upsample.
+out vec2 mask;
+
+uniform sampler2D Depth;
+uniform samplerCube DepthSampler;
+uniform mat4 InverseViewProjection;
+uniform vec3 CameraPosition;
+uniform vec3 LightPosition;
+uniform float far_plane;
+uniform vec2 SceneSize;
+uniform int Divisor;
+
+// Same filter as ShadowCalculation in ShadowedNormal.frag.
+float ShadowCalculation(vec3 fragPos) {
+    vec3 fragToLight = fragPos - LightPosition;
+    float currentDepth = length(fragToLight);
+    float shadow = 0.0;
+    float bias = 0.05;
+    float samples = 4.0;
+    float offset = 0.1;
+    for(float x = -offset; x < offset; x += offset / (samples * 0.5))
+    {
+        for(float y = -offset; y < offset; y += offset / (samples * 0.5))
+        {
+            for(float z = -offset; z < offset; z += offset / (samples * 0.5))
+            {
+                float closestDepth = texture(DepthSampler, fragToLight + vec3(x, y, z)).r;
+                closestDepth *= far_plane;
+                if(currentDepth - bias > closestDepth)
+                    shadow += 1.0;
+            }
+        }
+    }
+    shadow /= (samples * samples * samples);
+    return shadow;
+}
+
+void main() {
+	ivec2 pixel = min(ivec2(gl_FragCoord.xy) * Divisor + Divisor / 2, ivec2(SceneSize) - 1);
+	float depth = texelFetch(Depth, pixel, 0).r;
+	if(depth == 1.0) {
+		// Nothing drawn, never matches a surface.
+		mask = vec2(0.0, -1.0);
+		return;
+	}
+	vec4 world = InverseViewProjection * vec4((vec2(pixel) + 0.5) / SceneSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	vec3 position = world.xyz / world.w;
+	mask = vec2(ShadowCalculation(position), distance(position, CameraPosition));
+}
@@ -0,0 +1,52 @@
+#version 330 core
+
+out float shadow;
+
+uniform sampler2D Depth;
+// Shadow and camera distance per block, see ShadowMask.frag.
+uniform sampler2D LowMask;
+uniform mat4 InverseViewProjection;
+uniform vec3 CameraPosition;
+uniform vec2 SceneSize;
+uniform vec2 LowSize;
+uniform int Divisor;
+
+// Relative distance difference at which a block weighs 1/e of one at the
+// same distance as the pixel.
+const float DepthTolerance = 0.02;
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(Depth, pixel, 0).r;
+	if(depth == 1.0) {
+		shadow = 0.0;
+		return;
+	}
+	vec4 world = InverseViewProjection * vec4((vec2(pixel) + 0.5) / SceneSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	float pixelDistance = distance(world.xyz / world.w, CameraPosition);
+
+	// Blocks were evaluated at their middle pixel, interpolate between the
+	// four whose middles surround this one.
+	vec2 low = (vec2(pixel) - float(Divisor / 2)) / float(Divisor);
+	ivec2 base = ivec2(floor(low));
+	vec2 f = low - vec2(base);
+	float sum = 0.0;
+	float total = 0.0;
+	float closest = 1e30;
+	float nearest = 0.0;
+	for(int i = 0; i < 4; i++) {
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		vec2 block = texelFetch(LowMask, clamp(base + offset, ivec2(0), ivec2(LowSize) - 1), 0).rg;
+		vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+		float difference = abs(block.g - pixelDistance) / pixelDistance;
+		float weight = bilinear.x * bilinear.y * exp(-difference / DepthTolerance);
+		sum += weight * block.r;
+		total += weight;
+		if(difference < closest) {
+			closest = difference;
+			nearest = block.r;
+		}
+	}
+	// No block on this surface nearby, take the closest in depth.
+	shadow = total > 1e-4 ? sum / total : nearest;
+}
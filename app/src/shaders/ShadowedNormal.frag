@@ -12,15 +12,40 @@ in vec3 EyeDirection_tangentspace;
 in vec3 FragPos;
 in vec3 Normal;
 
+in vec2 LightmapUV;
+flat in int Lightmapped;
+
 out vec3 color;
 
 uniform sampler2D DiffuseTextureSampler;
 uniform sampler2D NormalTextureSampler;
 uniform samplerCube DepthSampler;
+uniform sampler2DArrayShadow CascadeSampler;
+// Virtual textures, VirtualTexture is 0 for regular ones.
+uniform usampler2D PageTable;
+uniform sampler2D AlbedoCache;
+uniform sampler2D NormalCache;
+uniform int VirtualTexture;
+// Irradiance of the light without shadows (rgb) and the fraction of it
+// reaching the texel (a), baked for the static geometry.
+uniform sampler2D Lightmap;
+uniform int UseLightmap;
+// Whether the cube map holds any caster, static ones are left out of it
+// when the lightmap applies.
+uniform int DynamicShadows;
+// Point light shadow filtered ahead in screen space, one texel per pixel.
+uniform sampler2D ShadowMask;
+uniform int UseShadowMask;
 
 uniform vec3 LightPosition;
 uniform vec3 CameraPosition;
 uniform float far_plane;
+uniform int Directional;
+uniform int CascadeCount;
+uniform mat4 CascadeMatrices[4];
+
+const float PageSize = 128.0;
+const float PageBorder = 4.0;
 
 vec3 gridSamplingDisk[20] = vec3[](
    vec3(1, 1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1, 1,  1), 
@@ -54,17 +79,72 @@ float ShadowCalculation(vec3 fragPos) {
     return shadow;
 }
 
+float PointShadow() {
+    if(UseShadowMask != 0)
+        return texelFetch(ShadowMask, ivec2(gl_FragCoord.xy), 0).r;
+    return ShadowCalculation(FragPos);
+}
+
+// Sun shadow from the first cascade covering the fragment, 3x3 PCF on top
+// of the hardware comparison.
+float CascadeShadow(vec3 fragPos) {
+    vec2 texel = 1.0 / vec2(textureSize(CascadeSampler, 0).xy);
+    float margin = 2.0 * texel.x;
+    for(int c = 0; c < CascadeCount; c++)
+    {
+        vec3 p = (CascadeMatrices[c] * vec4(fragPos, 1.0)).xyz * 0.5 + 0.5;
+        if(any(lessThan(p.xy, vec2(margin))) || any(greaterThan(p.xy, vec2(1.0 - margin))) || p.z > 1.0)
+            continue;
+        float lit = 0.0;
+        for(int x = -1; x <= 1; x++)
+            for(int y = -1; y <= 1; y++)
+                lit += texture(CascadeSampler, vec4(p.xy + vec2(x, y) * texel, c, p.z - 0.0005));
+        return 1.0 - lit / 9.0;
+    }
+    return 0.0;
+}
+
+// Where a virtual texture coordinate lands in the page caches. The page
+// table entry of the mip holds the cache slot (xy) and the level (z) of the
+// page to read, the wanted one or its closest resident ancestor.
+vec2 VirtualAddress(vec2 uv) {
+    float pages = float(textureSize(PageTable, 0).x);
+    vec2 texels = uv * pages * PageSize;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    int mip = clamp(int(lod), 0, int(round(log2(pages))));
+
+    vec2 wrapped = fract(uv);
+    uvec4 entry = texelFetch(PageTable, ivec2(wrapped * (pages / exp2(float(mip)))), mip);
+    vec2 inPage = fract(wrapped * (pages / exp2(float(entry.z))));
+    vec2 texel = vec2(entry.xy) * (PageSize + 2.0 * PageBorder) + PageBorder + inPage * PageSize;
+    return texel / vec2(textureSize(AlbedoCache, 0));
+}
+
 void main() {
 	vec3 LightColor = vec3(1, 1, 1);
 	float LightPower = 20.0f;
 	
-	vec3 MaterialDiffuseColor = texture(DiffuseTextureSampler, UV).rgb;
+	vec3 MaterialDiffuseColor;
+	vec3 TextureNormal_tangentspace;
+	if(VirtualTexture != 0) {
+		vec2 address = VirtualAddress(UV);
+		MaterialDiffuseColor = textureLod(AlbedoCache, address, 0.0).rgb;
+		TextureNormal_tangentspace = normalize(textureLod(NormalCache, address, 0.0).rgb * 2.0 - 1.0);
+	} else {
+		MaterialDiffuseColor = texture(DiffuseTextureSampler, UV).rgb;
+		TextureNormal_tangentspace = normalize(texture(NormalTextureSampler, UV).rgb * 2.0 - 1.0);
+	}
 	vec3 MaterialAmbientColor = vec3(0.5, 0.5, 0.5) * MaterialDiffuseColor;
 	vec3 MaterialSpecularColor = vec3(0.3, 0.3, 0.3);
-
-	vec3 TextureNormal_tangentspace = normalize(texture(NormalTextureSampler, UV).rgb * 2.0 - 1.0);
 	
 	float distance = length( LightPosition - Position_worldspace );
+	if(Directional != 0) {
+		// No falloff, the sun is as bright as the point light at 4 units.
+		distance = 1.0;
+		LightPower = 1.25f;
+	}
 
 	vec3 n = TextureNormal_tangentspace;
 	vec3 l = normalize(LightDirection_tangentspace);
@@ -77,7 +157,17 @@ void main() {
 	vec3 halfway_vector = normalize(E + l);
     float spec = pow(max(dot(n, halfway_vector), 0.0), 225.0f);
 	
-    float shadow = ShadowCalculation(FragPos); 
+    if(Lightmapped != 0 && UseLightmap != 0) {
+        vec4 baked = texture(Lightmap, LightmapUV);
+        float dynamicShadow = DynamicShadows != 0 ? PointShadow() : 0.0;
+        float lit = min(baked.a, 1.0 - dynamicShadow);
+        color = MaterialAmbientColor + lit *
+            (MaterialDiffuseColor * LightColor * baked.rgb +
+            MaterialSpecularColor * LightColor * LightPower * spec / (distance * distance));
+        return;
+    }
+
+    float shadow = Directional != 0 ? CascadeShadow(FragPos) : PointShadow(); 
 
 	color = 
 		MaterialAmbientColor + (1.0 - shadow) * 
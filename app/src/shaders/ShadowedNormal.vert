@@ -5,6 +5,8 @@ layout(location = 1) in vec2 vertexUV;
 layout(location = 2) in vec3 vertexNormal_modelspace;
 layout(location = 3) in vec3 vertexTangent_modelspace;
 layout(location = 4) in vec3 vertexBitangent_modelspace;
+layout(location = 5) in uint DrawID;
+layout(location = 6) in vec2 vertexLightmapUV;
 
 out vec2 UV;
 out vec3 Position_worldspace;
@@ -18,12 +20,28 @@ out vec3 EyeDirection_tangentspace;
 out vec3 FragPos;
 out vec3 Normal;
 
-uniform mat4 M;
+out vec2 LightmapUV;
+flat out int Lightmapped;
+
+// The depth prepass runs this shader too, its depth must match exactly.
+invariant gl_Position;
+
+// Instance transforms, four RGBA32F texels per matrix.
+uniform samplerBuffer Transforms;
+uniform int DrawOffset;
+// Scale (xy) and offset (zw) into the lightmap of each instance, zero when
+// it is not baked.
+uniform samplerBuffer LightmapRects;
 uniform mat4 V;
 uniform mat4 P;
 uniform vec3 LightPosition;
+uniform int Directional;
+uniform vec3 SunDirection;
 
 void main() {
+	int base = (int(DrawID) + DrawOffset) * 4;
+	mat4 M = mat4(texelFetch(Transforms, base), texelFetch(Transforms, base + 1),
+	              texelFetch(Transforms, base + 2), texelFetch(Transforms, base + 3));
 	gl_Position =  P * V * M * vec4(vertexPosition_modelspace, 1);
 	
 	Position_worldspace = (M * vec4(vertexPosition_modelspace, 1)).xyz;
@@ -33,8 +51,13 @@ void main() {
 
 	vec3 LightPosition_cameraspace = (V * vec4(LightPosition, 1)).xyz;
 	LightDirection_cameraspace = LightPosition_cameraspace + EyeDirection_cameraspace;
+	if(Directional != 0)
+		LightDirection_cameraspace = (V * vec4(SunDirection, 0)).xyz;
 	
 	UV = vertexUV;
+	vec4 rect = texelFetch(LightmapRects, int(DrawID) + DrawOffset);
+	LightmapUV = vertexLightmapUV * rect.xy + rect.zw;
+	Lightmapped = rect.x > 0.0 ? 1 : 0;
 	vec4 vertexTangent_cameraspace = V * M * vec4(vertexTangent_modelspace, 1);
 	vec4 vertexBitangent_cameraspace = V * M * vec4(vertexBitangent_modelspace, 1);
 	vec4 vertexNormal_cameraspace = V * M * vec4(vertexNormal_modelspace, 1);
@@ -0,0 +1,63 @@
+#version 330 core
+
+in vec2 UV;
+
+out vec3 color;
+
+uniform sampler2D Scene;
+uniform sampler2D Bloom;
+uniform float BloomIntensity;
+uniform float Exposure;
+uniform vec2 SceneSize;
+uniform int Upscale;
+// Part of the scene target that holds the image, see
+// PostProcess::set_scene_region.
+uniform vec2 SourceScale;
+uniform vec2 SourceClamp;
+
+vec3 SceneTap(vec2 uv) {
+	return texture(Scene, min(uv, SourceClamp)).rgb;
+}
+
+// Catmull-Rom in 9 bilinear taps, the middle two weights of each axis are
+// merged into one tap between their texels.
+vec3 SampleCatmullRom(vec2 uv) {
+	vec2 position = uv * SceneSize;
+	vec2 center = floor(position - 0.5) + 0.5;
+	vec2 f = position - center;
+
+	vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+	vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+	vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+	vec2 w3 = f * f * (-0.5 + 0.5 * f);
+	vec2 w12 = w1 + w2;
+
+	vec2 p0 = (center - 1.0) / SceneSize;
+	vec2 p12 = (center + w2 / w12) / SceneSize;
+	vec2 p3 = (center + 2.0) / SceneSize;
+
+	vec3 result =
+		SceneTap(vec2(p0.x,  p0.y)) * w0.x  * w0.y +
+		SceneTap(vec2(p12.x, p0.y)) * w12.x * w0.y +
+		SceneTap(vec2(p3.x,  p0.y)) * w3.x  * w0.y +
+		SceneTap(vec2(p0.x,  p12.y)) * w0.x  * w12.y +
+		SceneTap(vec2(p12.x, p12.y)) * w12.x * w12.y +
+		SceneTap(vec2(p3.x,  p12.y)) * w3.x  * w12.y +
+		SceneTap(vec2(p0.x,  p3.y)) * w0.x  * w3.y +
+		SceneTap(vec2(p12.x, p3.y)) * w12.x * w3.y +
+		SceneTap(vec2(p3.x,  p3.y)) * w3.x  * w3.y;
+	// The negative lobes can ring below zero next to bright edges.
+	return max(result, vec3(0.0));
+}
+
+// Narkowicz's fit of the ACES filmic curve.
+vec3 ACESFilm(vec3 x) {
+	return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main() {
+	vec2 uv = UV * SourceScale;
+	vec3 scene = Upscale != 0 ? SampleCatmullRom(uv) : SceneTap(uv);
+	vec3 hdr = scene + texture(Bloom, UV).rgb * BloomIntensity;
+	color = ACESFilm(hdr * Exposure);
+}
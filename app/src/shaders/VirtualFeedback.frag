@@ -0,0 +1,29 @@
+#version 330 core
+
+in vec2 UV;
+
+// The virtual texture page this pixel samples: texture, mip and page x, y.
+out uvec4 Page;
+
+uniform usampler2D PageTable;
+uniform int VirtualTexture;
+// log2 of the feedback over the scene resolution, so the mips asked for are
+// the ones the scene samples.
+uniform float MipBias;
+
+const float PageSize = 128.0;
+
+void main() {
+	if(VirtualTexture == 0) {
+		Page = uvec4(0);
+		return;
+	}
+	float pages = float(textureSize(PageTable, 0).x);
+	vec2 texels = UV * pages * PageSize;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + MipBias;
+	int mip = clamp(int(lod), 0, int(round(log2(pages))));
+	ivec2 page = ivec2(fract(UV) * (pages / exp2(float(mip))));
+	Page = uvec4(uint(VirtualTexture), uint(mip), uvec2(page));
+}
@@ -0,0 +1,16 @@
+#ifndef _ALLOCTRACK_HPP_GP_
+#define _ALLOCTRACK_HPP_GP_
+
+#include <cstddef>
+
+// Debug hook counting every call of the global operator new. Only active
+// when built with GP_TRACK_ALLOCATIONS, otherwise the counters stay at 0.
+// Allocations made by C code (malloc in drivers, SDL) are not seen.
+
+bool AllocationTrackingEnabled();
+
+// Totals since startup, over all threads.
+size_t AllocationCount();
+size_t AllocatedBytes();
+
+#endif // _ALLOCTRACK_HPP_GP_
@@ -0,0 +1,80 @@
+#ifndef _ARENA_HPP_GP_
+#define _ARENA_HPP_GP_
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that lives for one frame. Allocations bump an
+// offset into a single block and are all released at once by reset().
+// When a frame needs more than the block holds, the excess comes from the
+// heap and the next reset() grows the block to the frame's peak, so a steady
+// frame settles on zero heap allocations. Not thread-safe.
+class FrameArena {
+ public:
+  explicit FrameArena(size_t capacity = 1 << 20);
+  ~FrameArena();
+
+  FrameArena(const FrameArena &) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment);
+
+  // Invalidates everything allocated since the last reset.
+  void reset();
+
+  size_t used() const;
+  size_t capacity() const;
+  // Largest use of a single frame so far.
+  size_t peak() const;
+
+ private:
+  char* block_;
+  size_t capacity_;
+  size_t offset_;
+  // Heap blocks of allocations which did not fit this frame.
+  std::vector<char*> overflow_;
+  size_t overflow_bytes_;
+  size_t peak_;
+};
+
+// STL allocator handing out FrameArena memory. Deallocation is a no-op,
+// containers using it must not outlive the arena's next reset().
+template <typename T>
+class FrameAllocator {
+ public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  FrameAllocator() : arena_(nullptr) {}
+  explicit FrameAllocator(FrameArena& arena) : arena_(&arena) {}
+  template <typename U>
+  FrameAllocator(const FrameAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(arena_->allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  FrameArena* arena() const { return arena_; }
+
+ private:
+  FrameArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+#endif // _ARENA_HPP_GP_
@@ -0,0 +1,113 @@
+#ifndef _BATCHRENDER_HPP_GP_
+#define _BATCHRENDER_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <jobs.hpp>
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct RenderPose {
+  std::string name;  // of the image, without extension
+  glm::vec3 camera_position;
+  glm::vec3 camera_target;
+  glm::vec3 light_position;
+};
+
+// Reads a pose list. Each line is
+//   pose <name> <camera x> <y> <z> <target x> <y> <z> <light x> <y> <z>
+// Blank lines and lines starting with # are skipped.
+bool LoadPoses(const char* path, std::vector<RenderPose>& ret_poses);
+
+struct BatchStats {
+  unsigned int images;
+  unsigned int failures;
+  size_t bytes;  // of the written files
+  // Time the GL thread blocked on readbacks still in flight when the ring
+  // came round to them, and on encoders.
+  unsigned int readback_stalls;
+  double readback_wait_ms;
+  double encode_wait_ms;
+  double encode_ms;  // summed over the workers
+};
+
+// Offscreen target of a batch render and the way of its images to disk.
+// capture() reads the finished image into the next pixel buffer of a ring
+// and fences it, so the copy runs while the following poses render. A
+// readback is mapped once its fence signaled and an encode buffer is free,
+// or when the ring comes round to it, and its pixels are handed to a job
+// writing the PNG. The GL thread only blocks when the GPU or the encoders
+// fall a whole ring behind.
+class BatchOutput {
+ public:
+  // encode_buffers of 0 picks one per worker plus one.
+  BatchOutput(JobSystem& jobs, unsigned int width, unsigned int height, const std::string& directory,
+              unsigned int ring_size = 3, unsigned int encode_buffers = 0);
+  ~BatchOutput();
+
+  BatchOutput(const BatchOutput &) = delete;
+  BatchOutput& operator=(const BatchOutput&) = delete;
+
+  bool is_valid();
+
+  // RGBA8 colour only, width x height.
+  GLuint framebuffer() const;
+
+  // Queues the image in framebuffer() as <directory>/<name>.png.
+  void capture(const std::string& name);
+  // Waits for every queued image to be written.
+  void finish();
+
+  // Complete after finish().
+  const BatchStats& stats() const;
+
+ private:
+  struct Readback {
+    GLuint pbo;
+    GLsync fence;
+    std::string name;
+  };
+
+  struct Encode {
+    BatchOutput* owner;
+    std::vector<unsigned char> pixels;
+    std::string path;
+    JobGroup group;
+    bool busy;
+    // Written by the job.
+    bool written;
+    size_t bytes;
+    double ms;
+  };
+
+  static void EncodeJob(void* data, unsigned int begin, unsigned int end);
+
+  // Whether the next encode buffer can take an image without waiting.
+  bool encode_ready() const;
+  Encode& next_encode();
+  void collect(Encode& encode);
+  // Copies the oldest readback into an encode buffer, waiting on its fence.
+  void map_oldest();
+
+  JobSystem& jobs_;
+  unsigned int width_;
+  unsigned int height_;
+  std::string directory_;
+  BatchStats stats_;
+
+  GLuint fbo_;
+  GLuint color_;
+
+  std::vector<Readback> ring_;
+  unsigned int ring_head_;
+  unsigned int ring_pending_;
+
+  std::vector<std::unique_ptr<Encode>> encodes_;
+  unsigned int next_encode_;
+};
+
+#endif // _BATCHRENDER_HPP_GP_
@@ -0,0 +1,107 @@
+#ifndef _BVH_HPP_GP_
+#define _BVH_HPP_GP_
+
+#include <glm/glm.hpp>
+
+#include <jobs.hpp>
+
+#include <vector>
+
+// Closest intersection of a ray, at origin + t * direction.
+struct RayHit {
+  float t;
+  unsigned int triangle;  // index into the triangles the BVH was built from
+  float u;                // barycentric weights of the second and third
+  float v;                // corners
+};
+
+// Bounding volume hierarchy over a triangle soup for occlusion rays, built
+// with a binned surface area heuristic. Nodes take 32 bytes, the second child
+// of an inner node follows the first subtree. Leaves hold up to four
+// triangles as one block of structure of arrays, tested against the ray in a
+// single SSE batch. Read-only once built, so any number of threads may trace.
+class TriangleBVH {
+ public:
+  static constexpr unsigned int MaxPlanes = 32;
+
+  TriangleBVH();
+
+  // Three corners per triangle.
+  void build(const std::vector<glm::vec3>& triangles);
+  // Same on the workers: the top of the tree is split serially until there
+  // is a range of triangles per job, the subtrees are built concurrently and
+  // spliced back in depth-first order.
+  void build(JobSystem& jobs, const std::vector<glm::vec3>& triangles);
+
+  // Whether a triangle crosses origin + t * direction for t in (0, max_t).
+  bool occluded(const glm::vec3& origin, const glm::vec3& direction, float max_t) const;
+  // Nearest such triangle. Children are visited front to back and subtrees
+  // behind the closest hit so far are skipped.
+  bool intersect(const glm::vec3& origin, const glm::vec3& direction, float max_t, RayHit& ret_hit) const;
+  // Appends the triangles not entirely behind any of the planes, inside
+  // being dot(plane, (p, 1)) >= 0. Subtrees inside a plane stop testing it,
+  // those inside all of them are taken whole.
+  void frustum(const glm::vec4* planes, unsigned int plane_count, std::vector<unsigned int>& ret_triangles) const;
+
+  // Bounds of all triangles, empty (lower above upper) without any.
+  glm::vec3 lower() const;
+  glm::vec3 upper() const;
+
+  unsigned int triangle_count() const;
+  unsigned int node_count() const;
+
+ private:
+  struct Node {
+    glm::vec3 lower;
+    unsigned int index;  // second child, or first block of a leaf
+    glm::vec3 upper;
+    unsigned int blocks;  // 0 for inner nodes
+  };
+
+  // Four triangles as v0 and two edges, unused lanes are degenerate and
+  // have NoTriangle.
+  struct Block {
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+    unsigned int triangle[4];
+  };
+
+  struct Reference {
+    glm::vec3 lower;
+    glm::vec3 upper;
+    glm::vec3 centroid;
+    unsigned int triangle;
+  };
+
+  // Nodes and blocks indexed from the start of their own vectors.
+  struct Subtree {
+    std::vector<Node> nodes;
+    std::vector<Block> blocks;
+  };
+
+  // References left to a job by the top of a parallel build, a node with
+  // blocks == Pending and the index of the task stands in for them.
+  struct Task {
+    unsigned int begin;
+    unsigned int end;
+    unsigned int depth;
+    Subtree subtree;
+  };
+
+  void build(JobSystem* jobs, const std::vector<glm::vec3>& triangles);
+  static unsigned int build_node(Subtree& subtree, std::vector<Reference>& references, unsigned int begin,
+                                 unsigned int end, unsigned int depth, const std::vector<glm::vec3>& triangles,
+                                 std::vector<Task>* tasks, unsigned int task_size);
+  unsigned int splice(const Subtree& top, unsigned int node, const std::vector<Task>& tasks);
+  // Lanes of the block crossed by the ray within (0, max_t) as a bit mask,
+  // with their distance and barycentrics when ret_t is set.
+  unsigned int test_block(const Block& block, const glm::vec3& origin, const glm::vec3& direction, float max_t,
+                          float* ret_t, float* ret_u, float* ret_v) const;
+
+  std::vector<Node> nodes_;
+  std::vector<Block> blocks_;
+  unsigned int triangle_count_;
+};
+
+#endif // _BVH_HPP_GP_
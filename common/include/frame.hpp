@@ -0,0 +1,273 @@
+#ifndef _FRAME_HPP_GP_
+#define _FRAME_HPP_GP_
+
+#include <glm/glm.hpp>
+
+#include <arena.hpp>
+#include <jobs.hpp>
+#include <model.hpp>
+#include <textures.hpp>
+#include <transforms.hpp>
+
+#include <atomic>
+#include <vector>
+
+struct Instance {
+  enum Flags : unsigned int {
+    CastsShadow = 1,
+    Lit = 2,
+    Unlit = 4,
+    AtLight = 8,  // moved to the light position every frame
+    Static = 16   // never moves, its lighting may be baked
+  };
+
+  Model* model;
+  Texture* texture;
+  glm::vec3 position;
+  glm::vec3 axis;
+  float angle;  // degrees
+  float scale;
+  unsigned int flags;
+  // Index of an earlier instance the transform above is relative to.
+  unsigned int parent = TransformSystem::NoParent;
+  // Texture of each material of the model, used instead of texture when
+  // set. Must outlive the instance.
+  Texture* const* materials = nullptr;
+  // Scale and offset taking the lightmap UVs of the model into the baked
+  // lightmap of the scene, zero when the instance has not been baked.
+  glm::vec4 lightmap = glm::vec4(0.0f);
+};
+
+struct Scene {
+  enum class Light {
+    Point,       // cube shadow map
+    Directional  // sun with cascaded shadow maps
+  };
+
+  std::vector<Instance> instances;
+  // Camera and light orbit the origin starting from these positions, the
+  // camera looking at camera_target.
+  glm::vec3 camera_position;
+  glm::vec3 camera_target = glm::vec3(0.0f);
+  glm::vec3 light_position;
+  Light light = Light::Point;
+  glm::vec3 sun_direction = glm::vec3(0.0f, 1.0f, 0.0f);  // towards the sun
+  // Set once the static instances are baked for the point light at
+  // lightmap_light_position. Their lightmaps are used, and static casters
+  // left out of the shadow map, only while the light stays there.
+  bool lightmap_baked = false;
+  glm::vec3 lightmap_light_position = glm::vec3(0.0f);
+};
+
+// Rotation of an instance pose, the identity for a zero angle whatever the
+// axis.
+glm::quat InstanceRotation(const glm::vec3& axis, float angle);
+
+// World matrix of every instance, its parent's applied. AtLight instances
+// are placed at their own position.
+void InstanceTransforms(const Scene& scene, std::vector<glm::mat4>& ret_transforms);
+
+struct FrameSettings {
+  float fov;  // radians
+  float aspect;
+  float near;
+  float far;
+  float viewport_height;
+  float shadow_far;
+  unsigned int shadow_resolution;
+  float lod_pixel_error;
+  float shadow_lod_pixel_error;
+  // Directional light only.
+  unsigned int cascade_count;
+  float cascade_distance;      // view depth covered by the cascades
+  float cascade_split_lambda;  // 0 uniform, 1 logarithmic splits
+  unsigned int cascade_resolution;
+};
+
+// Everything sampled from the user for one frame.
+struct FrameInput {
+  float camera_angle;  // degrees
+  float light_angle;   // degrees
+};
+
+// Consecutive draws of a pass sharing a texture, issued as one indirect
+// multi-draw.
+struct DrawBatch {
+  Texture* texture;
+  unsigned int first;
+  unsigned int count;
+};
+
+struct DrawPass {
+  std::vector<DrawElementsIndirectCommand> draws;
+  std::vector<DrawBatch> batches;
+};
+
+// Meshlet culling of one pass, counted over the selected LODs of the
+// instances that survived instance culling.
+struct CullStats {
+  unsigned int meshlets;
+  unsigned int triangles;
+  unsigned int frustum_culled;   // triangles of meshlets outside the frustum
+  unsigned int backface_culled;  // triangles of meshlets facing away
+};
+
+// A fully resolved frame, the GL thread only replays it.
+struct FrameCommands {
+  static constexpr unsigned int MaxCascades = 4;
+  static constexpr unsigned int CubeFaces = 6;
+
+  glm::mat4 projection;
+  glm::mat4 view;
+  glm::vec3 camera_position;
+  glm::vec3 light_position;
+  float shadow_far;
+  glm::mat4 shadow_transforms[CubeFaces];
+
+  // Transforms of every instance drawn by any pass. The base instance of a
+  // draw indexes into it. Each draw covers a run of visible meshlets.
+  std::vector<glm::mat4> transforms;
+  // Instance::lightmap of each transform while the lightmap applies, zero
+  // for instances lit the regular way.
+  std::vector<glm::vec4> lightmaps;
+  bool lightmapped;
+  DrawPass shadow[CubeFaces];
+  DrawPass lit;  // sorted by texture, then model
+  DrawPass unlit;
+
+  // Directional light. Cascades not updated this frame keep their matrix
+  // and the contents of their layer from an earlier frame.
+  bool directional;
+  glm::vec3 sun_direction;
+  unsigned int cascade_count;
+  glm::mat4 cascade_matrices[MaxCascades];
+  bool cascade_updated[MaxCascades];
+  DrawPass cascades[MaxCascades];
+
+  CullStats view_culling;  // lit and unlit
+  CullStats shadow_culling[CubeFaces];
+  CullStats cascade_culling[MaxCascades];
+
+  double build_ms;
+};
+
+// Turns the scene and a frame's input into FrameCommands on the job system:
+// transforms, culling and LOD selection run in parallel over the instances,
+// culling whole instances, then the meshlets of the survivors against each
+// pass, and the per-pass indirect draws are compacted concurrently. Intermediate
+// data lives in a frame arena and the commands reuse their capacity, so once
+// the scene is steady a build does not touch the heap.
+class FramePipeline {
+ public:
+  FramePipeline(JobSystem& jobs, Scene& scene, const FrameSettings& settings);
+
+  FramePipeline(const FramePipeline &) = delete;
+  FramePipeline& operator=(const FramePipeline&) = delete;
+
+  void build(const FrameInput& input, FrameCommands& commands);
+
+  // Builds in the background. Neither the scene nor commands may be touched
+  // until wait() returns.
+  void build_async(const FrameInput& input, FrameCommands& commands);
+  void wait();
+
+ private:
+  static void build_job(void* data, unsigned int begin, unsigned int end);
+
+  void fit_cascades(const FrameInput& input, FrameCommands& commands);
+  void sync_transforms(const FrameCommands& commands, unsigned int begin, unsigned int end);
+  void update_instances(const FrameCommands& commands, unsigned int begin, unsigned int end);
+  void compact_shadow(FrameCommands& commands, unsigned int face);
+  void compact_visible(FrameCommands& commands);
+  void compact_cascade(FrameCommands& commands, unsigned int cascade);
+
+  struct PendingDraw {
+    Texture* texture;
+    Model* model;
+    const Model::Range* ranges;
+    unsigned int range_count;
+    unsigned int slot;
+  };
+  static void emit(FrameVector<PendingDraw>& pending, size_t range_capacity, DrawPass& pass);
+
+  JobSystem& jobs_;
+  Scene& scene_;
+  FrameSettings settings_;
+
+  JobGroup group_;
+  FrameInput pending_input_;
+  FrameCommands* pending_commands_;
+
+  glm::vec4 frustum_[6];
+  glm::vec4 shadow_frustums_[FrameCommands::CubeFaces][6];
+  // Static casters are left out of the point light shadow map.
+  bool casters_baked_;
+
+  // Instance transforms as last handed to transforms_, only changes are
+  // passed on.
+  struct Pose {
+    glm::vec3 position;
+    glm::vec3 axis;
+    float angle;
+    float scale;
+  };
+  std::vector<Pose> poses_;
+  // Parents as the scene asked for them, transforms_ drops invalid ones.
+  std::vector<unsigned int> parents_;
+  TransformSystem transforms_;
+
+  // Orthographic box of each cascade in light view space, x and y of the
+  // center snapped to texels.
+  struct Cascade {
+    glm::vec3 center;
+    float radius;
+    float depth;  // extent from the center towards the sun
+  };
+  unsigned int frame_index_;
+  glm::vec3 last_sun_direction_;
+  unsigned int last_cascade_count_;
+  glm::mat4 light_view_;
+  Cascade cascades_[FrameCommands::MaxCascades];
+  glm::mat4 cascade_matrices_[FrameCommands::MaxCascades];
+  glm::vec4 cascade_frustums_[FrameCommands::MaxCascades][6];
+
+  // Working set of one build, allocated from arena_ and reserved up front
+  // so the jobs filling it never allocate.
+  struct Scratch {
+    Scratch(FrameArena& arena, const Scene& scene, bool point_light, unsigned int cascade_count);
+
+    // The meshlet runs of one pass. Those of instance i start at
+    // meshlet_offsets[i], range_counts[i] is 0 when it is not drawn.
+    struct Visible {
+      void allocate(FrameArena& arena, unsigned int count, size_t range_capacity);
+      void add(const CullStats& stats);
+      CullStats stats() const;
+
+      FrameVector<Model::Range> ranges;
+      FrameVector<unsigned int> range_counts;
+      std::atomic<unsigned int> meshlets{0};
+      std::atomic<unsigned int> triangles{0};
+      std::atomic<unsigned int> frustum_culled{0};
+      std::atomic<unsigned int> backface_culled{0};
+    };
+
+    // Room for the most ranges any LOD of the instance can be culled to.
+    FrameVector<unsigned int> meshlet_offsets;
+    size_t meshlet_total;
+    // Lit draws if every instance was visible, one per material of those
+    // drawn with materials.
+    size_t lit_total;
+    Visible shadow[FrameCommands::CubeFaces];  // point light only
+    Visible view;
+    Visible cascades[FrameCommands::MaxCascades];
+    FrameVector<unsigned int> slots;
+    FrameVector<PendingDraw> shadow_pending[FrameCommands::CubeFaces];
+    FrameVector<PendingDraw> lit_pending;
+    FrameVector<PendingDraw> unlit_pending;
+    FrameVector<PendingDraw> cascade_pending[FrameCommands::MaxCascades];
+  };
+  FrameArena arena_;
+  Scratch* scratch_;
+};
+
+#endif // _FRAME_HPP_GP_
@@ -0,0 +1,97 @@
+#ifndef _FRAMEPACING_HPP_GP_
+#define _FRAMEPACING_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <chrono>
+
+struct PacingSettings {
+  // Frames the CPU may submit before the GPU has finished the oldest, 0
+  // leaves the queue to the driver.
+  unsigned int frames_in_flight;
+  // Frames never start faster than this, 0 for no cap.
+  float max_fps;
+};
+
+// Over the frames since the last take_stats().
+struct PacingStats {
+  unsigned int frames;
+  double frame_ms;            // mean time between frame starts
+  double frame_deviation_ms;  // its standard deviation
+  double max_frame_ms;
+  // From sampling the input of a frame to the GPU finishing it, over the
+  // frames whose fence was seen signaled.
+  unsigned int latency_frames;
+  double latency_ms;
+  double max_latency_ms;
+  double fence_wait_ms;  // per frame
+  double sleep_ms;       // per frame
+};
+
+// Bounds how far the CPU runs ahead of the GPU and how often frames start,
+// so the input a frame samples is at most frames_in_flight frames old when
+// the GPU gets to it. A fence follows the last command of every frame, and
+// before the next one samples its input the oldest are waited on until fewer
+// than frames_in_flight are pending. The cap sleeps to a fixed schedule, the
+// OS sleep stopping short of the deadline and the rest spun, since sleeps
+// overshoot by up to a scheduler tick. The fences also time the latency of
+// each frame; nothing waits on them without a limit, so they are polled
+// once per frame and the latency comes out up to a frame long.
+class FramePacer {
+ public:
+  static constexpr unsigned int MaxFramesInFlight = 4;
+
+  explicit FramePacer(const PacingSettings& settings);
+  ~FramePacer();
+
+  FramePacer(const FramePacer &) = delete;
+  FramePacer& operator=(const FramePacer&) = delete;
+
+  // Takes effect at the next wait(). frames_in_flight is clamped to
+  // MaxFramesInFlight.
+  void set_settings(const PacingSettings& settings);
+  const PacingSettings& settings() const;
+
+  // Blocks until the next frame may start, right before it samples input.
+  // Returns the time the input is sampled at.
+  std::chrono::steady_clock::time_point wait();
+  // After the swap of the frame built from the input sampled at input_time.
+  void end_frame(std::chrono::steady_clock::time_point input_time);
+
+  PacingStats take_stats();
+
+ private:
+  // More than MaxFramesInFlight, fences beyond it are only timed and the
+  // oldest are dropped when the driver queues even more frames.
+  static constexpr unsigned int MaxFences = 8;
+
+  struct Fence {
+    GLsync sync;
+    std::chrono::steady_clock::time_point input_time;
+  };
+
+  // Retires the oldest fence, blocking until it is signaled when wait is
+  // set. Returns false when it is still pending.
+  bool retire(bool wait);
+
+  PacingSettings settings_;
+  Fence fences_[MaxFences];
+  unsigned int fence_head_;
+  unsigned int fence_count_;
+
+  std::chrono::steady_clock::time_point next_start_;
+  std::chrono::steady_clock::time_point last_start_;
+  bool started_;
+
+  unsigned int frames_;
+  double frame_sum_;
+  double frame_square_sum_;
+  double max_frame_;
+  unsigned int latency_frames_;
+  double latency_sum_;
+  double max_latency_;
+  double fence_wait_;
+  double sleep_;
+};
+
+#endif // _FRAMEPACING_HPP_GP_
@@ -0,0 +1,99 @@
+#ifndef _GEOMETRY_HPP_GP_
+#define _GEOMETRY_HPP_GP_
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Layout of a single indirect draw, as consumed by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+struct ArenaVertex {
+  glm::vec3 position;
+  glm::vec2 uv;
+  glm::vec3 normal;
+  glm::vec3 tangent;
+  glm::vec3 bitangent;
+  glm::vec2 lightmap_uv;
+};
+
+// First-fit allocator of [offset, offset + size) ranges with coalescing.
+class RangeAllocator {
+ public:
+  explicit RangeAllocator(unsigned int capacity);
+
+  // Returns false when no free range is large enough.
+  bool allocate(unsigned int size, unsigned int& offset);
+  void free(unsigned int offset, unsigned int size);
+  void grow(unsigned int capacity);
+
+  unsigned int capacity() const;
+  unsigned int used() const;
+
+ private:
+  struct Range {
+    unsigned int offset;
+    unsigned int size;
+  };
+
+  std::vector<Range> free_;  // sorted by offset
+  unsigned int capacity_;
+  unsigned int used_;
+};
+
+// One vertex buffer, one index buffer and one VAO shared by every Model.
+// Models suballocate ranges and draw with a base vertex, so switching meshes
+// needs no VAO or buffer binds and whole passes can go out as one indirect
+// multi-draw. Attribute 5 is a per-instance draw ID (0, 1, 2, ...) which the
+// base instance of an indirect draw turns into the index of its transform,
+// attribute 6 the lightmap UV.
+//
+// Exactly one arena is current at a time. It has to be created after the GL
+// context and outlive all models.
+class GeometryArena {
+ public:
+  GeometryArena(unsigned int vertex_capacity = 1 << 16, unsigned int index_capacity = 1 << 18);
+  ~GeometryArena();
+
+  GeometryArena(const GeometryArena &) = delete;
+  GeometryArena& operator=(const GeometryArena&) = delete;
+
+  static GeometryArena* current();
+
+  // Grows the buffers when the ranges do not fit.
+  void allocate(const std::vector<ArenaVertex>& vertices, const std::vector<unsigned int>& indices,
+                unsigned int& base_vertex, unsigned int& first_index);
+  void free(unsigned int base_vertex, unsigned int vertex_count, unsigned int first_index, unsigned int index_count);
+
+  // Makes sure draw IDs up to count - 1 exist.
+  void reserve_draw_ids(unsigned int count);
+
+  void bind();
+  GLuint vao() const;
+
+  unsigned int vertex_bytes() const;
+  unsigned int index_bytes() const;
+
+ private:
+  void grow_vertices(unsigned int capacity);
+  void grow_indices(unsigned int capacity);
+  void setup_attributes();
+
+  GLuint VAO_;
+  GLuint vertexbuffer_;
+  GLuint elementbuffer_;
+  GLuint drawidbuffer_;
+  unsigned int draw_id_capacity_;
+
+  RangeAllocator vertices_;
+  RangeAllocator indices_;
+};
+
+#endif // _GEOMETRY_HPP_GP_
@@ -0,0 +1,41 @@
+#ifndef _GLCAPTURE_HPP_GP_
+#define _GLCAPTURE_HPP_GP_
+
+#include <gltrace.hpp>
+
+// Records the GL calls of the process into a trace (see gltrace.hpp) by
+// swapping glad's function pointers for recording wrappers. Everything from
+// construction on is recorded so the trace creates its own resources, the
+// draws, clears and queries of frames before first_frame are dropped to keep
+// it small. Recording stops once frame_count frames starting at first_frame
+// have ended.
+//
+// Create it right after loading GL, at most one at a time, and use it on the
+// GL thread only.
+class GLCapture {
+ public:
+  GLCapture(const char* path, unsigned int width, unsigned int height, unsigned int first_frame,
+            unsigned int frame_count);
+  ~GLCapture();
+
+  GLCapture(const GLCapture &) = delete;
+  GLCapture& operator=(const GLCapture&) = delete;
+
+  // Brackets every frame, end_frame() right after the buffer swap.
+  void begin_frame();
+  void end_frame();
+
+  bool active() const;
+
+ private:
+  void finish();
+
+  TraceWriter writer_;
+  const char* path_;
+  unsigned int first_frame_;
+  unsigned int frame_count_;
+  unsigned int frame_;
+  bool active_;
+};
+
+#endif // _GLCAPTURE_HPP_GP_
@@ -0,0 +1,114 @@
+#ifndef _GLTRACE_HPP_GP_
+#define _GLTRACE_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// Binary trace of GL calls, written by GLCapture and replayed by the
+// glreplay tool. A trace is a TraceHeader followed by records, each a
+// TraceCall byte and the call's arguments in order. Scalars take 4 bytes
+// (booleans 1), sizes, offsets and pointers 8. Arrays are a 4 byte count
+// followed by the elements, data blobs a 4 byte size followed by the
+// bytes. Object names and uniform locations are the capturing context's,
+// the replay maps them to its own.
+#define GP_TRACE_CALLS(X) \
+  X(FrameBegin) X(FrameEnd) \
+  X(ActiveTexture) X(AttachShader) X(BeginQuery) X(BindBuffer) X(BindFramebuffer) X(BindRenderbuffer) \
+  X(BindTexture) X(BindVertexArray) X(BlendFunc) X(BufferData) X(BufferSubData) X(Clear) X(ClearBufferuiv) \
+  X(ClearColor) X(ColorMask) X(CompileShader) X(CopyBufferSubData) X(CreateProgram) X(CreateShader) \
+  X(DeleteBuffers) X(DeleteFramebuffers) X(DeleteProgram) X(DeleteQueries) X(DeleteRenderbuffers) X(DeleteShader) \
+  X(DeleteTextures) X(DeleteVertexArrays) X(DepthFunc) X(DetachShader) X(Disable) X(DrawArrays) \
+  X(DrawBuffer) X(DrawElementsBaseVertex) X(Enable) X(EnableVertexAttribArray) X(EndQuery) \
+  X(FramebufferRenderbuffer) X(FramebufferTexture) X(FramebufferTexture2D) X(FramebufferTextureLayer) \
+  X(GenBuffers) X(GenFramebuffers) X(GenQueries) X(GenRenderbuffers) X(GenTextures) X(GenVertexArrays) \
+  X(GetUniformLocation) X(LinkProgram) X(MapBufferRange) X(MultiDrawElementsIndirect) X(PolygonOffset) \
+  X(ReadBuffer) X(ReadPixels) X(RenderbufferStorage) X(ShaderSource) X(TexBuffer) X(TexImage2D) \
+  X(TexImage3D) X(TexParameteri) X(TexSubImage2D) X(Uniform1f) X(Uniform1i) X(Uniform2fv) X(Uniform3fv) \
+  X(Uniform4fv) X(UniformMatrix2fv) X(UniformMatrix3fv) X(UniformMatrix4fv) X(UnmapBuffer) X(UseProgram) \
+  X(VertexAttribDivisor) X(VertexAttribIPointer) X(VertexAttribPointer) X(Viewport)
+
+enum class TraceCall : unsigned char {
+#define GP_TRACE_ENUM(name) name,
+  GP_TRACE_CALLS(GP_TRACE_ENUM)
+#undef GP_TRACE_ENUM
+  Count
+};
+
+const char* TraceCallName(TraceCall call);
+
+struct TraceHeader {
+  char magic[4];  // "GPTR"
+  uint32_t version;
+  uint32_t width;   // of the captured window
+  uint32_t height;
+};
+
+const uint32_t TraceVersion = 3;
+
+// Bytes glTexImage* reads from client memory, with the default unpack
+// alignment of 4.
+size_t ImageBytes(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth);
+
+class TraceWriter {
+ public:
+  TraceWriter(const char* path, unsigned int width, unsigned int height);
+
+  bool is_valid() const;
+
+  void call(TraceCall call);
+  void write(uint32_t value);
+  void write(int32_t value);
+  void write(int64_t value);
+  void write(float value);
+  void write(unsigned char value);
+  // Offsets into bound buffers, the pointers never point at client memory.
+  void write(const void* offset);
+  void write_blob(const void* data, size_t bytes);
+
+  void close();
+  size_t bytes() const;
+
+ private:
+  void put(const void* data, size_t bytes);
+
+  std::ofstream file_;
+  size_t bytes_;
+};
+
+class TraceReader {
+ public:
+  explicit TraceReader(const char* path);
+
+  bool is_valid() const;
+  const TraceHeader& header() const;
+
+  // False at the end of the trace.
+  bool next(TraceCall& ret_call);
+
+  template <typename T>
+  T read() {
+    T value = T();
+    get(&value, sizeof(T));
+    return value;
+  }
+  // Points into the trace, valid as long as the reader.
+  const void* read_blob(uint32_t& ret_bytes);
+
+  // True once a read ran past the end.
+  bool truncated() const;
+
+ private:
+  void get(void* data, size_t bytes);
+
+  std::vector<char> data_;
+  size_t offset_;
+  TraceHeader header_;
+  bool valid_;
+  bool truncated_;
+};
+
+#endif // _GLTRACE_HPP_GP_
@@ -0,0 +1,42 @@
+#ifndef _GPUTIMER_HPP_GP_
+#define _GPUTIMER_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// GL_TIME_ELAPSED queries for a fixed set of sequential stages. Results are
+// read back Latency frames later so the CPU never waits on the GPU, stages
+// may not nest.
+class GpuTimer {
+ public:
+  explicit GpuTimer(const std::vector<std::string>& stages);
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+
+  void begin(unsigned int stage);
+  void end();
+
+  // Collects the results of the oldest frame in flight, once per frame.
+  void next_frame();
+
+  // Latest measured duration of a stage.
+  double milliseconds(unsigned int stage) const;
+  double total_milliseconds() const;
+  const std::string& name(unsigned int stage) const;
+  unsigned int stage_count() const;
+
+ private:
+  static const unsigned int Latency = 3;
+
+  std::vector<std::string> stages_;
+  std::vector<GLuint> queries_;  // Latency frames of one query per stage
+  std::vector<bool> issued_;
+  std::vector<double> milliseconds_;
+  unsigned int frame_;
+};
+
+#endif // _GPUTIMER_HPP_GP_
@@ -0,0 +1,20 @@
+#ifndef _IMAGEWRITE_HPP_GP_
+#define _IMAGEWRITE_HPP_GP_
+
+#include <cstddef>
+#include <vector>
+
+// Encodes 8-bit pixels as an RGB (channels 3) or RGBA (channels 4) PNG.
+// The source may carry more channels per pixel than are written, extra ones
+// are dropped, and bottom_up rows as glReadPixels returns them are flipped.
+// Rows use the Paeth filter, compressed with a single fixed Huffman deflate
+// block over hash chain matches, which is most of what a stock encoder gains
+// on rendered images at a fraction of the time.
+void EncodePNG(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int source_channels,
+               unsigned int channels, bool bottom_up, std::vector<unsigned char>& ret_png);
+
+// Encodes and writes in one go, false if the file can not be written.
+bool WritePNG(const char* path, const unsigned char* pixels, unsigned int width, unsigned int height,
+              unsigned int source_channels, unsigned int channels, bool bottom_up, size_t* ret_bytes = nullptr);
+
+#endif // _IMAGEWRITE_HPP_GP_
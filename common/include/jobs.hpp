@@ -0,0 +1,106 @@
+#ifndef _JOBS_HPP_GP_
+#define _JOBS_HPP_GP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tracks outstanding jobs. A group must outlive the jobs that were run on it.
+class JobGroup {
+ public:
+  JobGroup() : pending_(0) {}
+
+  JobGroup(const JobGroup &) = delete;
+  JobGroup& operator=(const JobGroup&) = delete;
+
+  bool done() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+ private:
+  friend class JobSystem;
+  std::atomic<unsigned int> pending_;
+};
+
+// Fixed pool of worker threads, each owning a deque of jobs. Owners pop from
+// the back, idle workers steal from the front of other deques. Threads that
+// are not workers (the GL thread) submit into a shared deque and help with
+// the work while waiting, so a pool of zero workers runs everything inline.
+class JobSystem {
+ public:
+  typedef void (*Function)(void* data, unsigned int begin, unsigned int end);
+
+  // workers == -1 picks one less than the hardware concurrency.
+  explicit JobSystem(int workers = -1);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  void run(JobGroup& group, Function function, void* data, unsigned int begin = 0, unsigned int end = 0);
+
+  // Calls f(begin, end) over [0, count) in chunks of at most grain items.
+  // f is referenced, not copied, and must live until the group is waited on.
+  template <typename F>
+  void parallel_for(JobGroup& group, unsigned int count, unsigned int grain, const F& f) {
+    if(grain == 0)
+      grain = 1;
+    for(unsigned int begin = 0; begin < count; begin += grain)
+      run(group, &invoke<F>, (void*)&f, begin, std::min(count, begin + grain));
+  }
+
+  // Executes queued jobs on the calling thread until the group is done,
+  // then blocks until the jobs still running elsewhere finish.
+  void wait(JobGroup& group);
+
+  unsigned int worker_count() const;
+
+ private:
+  struct Job {
+    Function function;
+    void* data;
+    unsigned int begin;
+    unsigned int end;
+    JobGroup* group;
+  };
+
+  // Bounded ring of jobs; contention is low enough for a lock per deque.
+  class Deque {
+   public:
+    Deque();
+    bool push(const Job& job);
+    bool pop(Job& job);
+    bool steal(Job& job);
+
+   private:
+    static const unsigned int Capacity = 4096;
+    std::mutex mutex_;
+    Job jobs_[Capacity];
+    unsigned int head_;
+    unsigned int tail_;
+  };
+
+  template <typename F>
+  static void invoke(void* data, unsigned int begin, unsigned int end) {
+    (*static_cast<const F*>(data))(begin, end);
+  }
+
+  void worker_loop(unsigned int index);
+  unsigned int deque_index() const;
+  bool acquire(unsigned int index, Job& job);
+  void execute(const Job& job);
+
+  // Deque 0 is shared by all threads that are not workers.
+  std::vector<std::unique_ptr<Deque>> deques_;
+  std::vector<std::thread> threads_;
+
+  std::atomic<bool> running_;
+  std::atomic<unsigned int> queued_;
+  // Idle workers and waiting threads sleep on it.
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+};
+
+#endif // _JOBS_HPP_GP_
@@ -0,0 +1,93 @@
+#ifndef _LIGHTMAP_HPP_GP_
+#define _LIGHTMAP_HPP_GP_
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <bvh.hpp>
+#include <frame.hpp>
+#include <jobs.hpp>
+
+#include <vector>
+
+struct LightmapSettings {
+  unsigned int max_size;  // of the atlas, in texels
+  unsigned int samples;   // shadow rays per texel, spread over the light
+  float light_radius;
+  // As in the lit shader, the light is white with this power.
+  float light_power;
+  // Distance ray origins are pushed off the surface along its normal.
+  float bias;
+};
+
+struct LightmapStats {
+  unsigned int instances;  // baked
+  unsigned int skipped;    // static and lit, but did not fit the atlas
+  unsigned int size;       // of the atlas
+  unsigned int texels;
+  size_t rays;
+  unsigned int occluders;  // triangles in the BVH
+  unsigned int workers;
+  double bvh_ms;
+  double trace_ms;
+};
+
+// Direct light of a point light on the static geometry of a scene, baked on the
+// CPU. Every Static, Lit instance whose model has lightmap UVs gets a square of
+// the atlas, the size of its model's lightmap, and every Static caster with
+// lightmap UVs goes into a BVH. Each texel covered by a chart is traced towards
+// samples spread over the light, on all workers, and stores the irradiance the
+// light would give it unshadowed in rgb and the fraction of the light it sees
+// in alpha, so the lit shader can combine it with dynamic shadows. Texels
+// around the charts are filled from their neighbours so filtering does not pull
+// in black.
+class Lightmap {
+ public:
+  explicit Lightmap(const LightmapSettings& settings);
+  ~Lightmap();
+
+  Lightmap(const Lightmap &) = delete;
+  Lightmap& operator=(const Lightmap&) = delete;
+
+  // Touches no GL state. Sets Instance::lightmap of the baked instances and
+  // marks the scene baked for light_position. The scene must not be built
+  // meanwhile.
+  void bake(JobSystem& jobs, Scene& scene, const glm::vec3& light_position);
+  // Copies the last bake into texture().
+  void upload();
+
+  GLuint texture() const;
+  const LightmapStats& stats() const;
+
+ private:
+  // A surface point a texel bakes, in world space.
+  struct Sample {
+    glm::vec3 position;
+    glm::vec3 normal;
+    float distance;  // from the texel center to the triangle, in texels
+  };
+
+  struct Region {
+    unsigned int instance;
+    unsigned int x;
+    unsigned int y;
+    unsigned int size;
+    unsigned int first_sample;
+  };
+
+  void rasterize(const Scene& scene, const Region& region, const glm::mat4& transform);
+  void trace(const glm::vec3& light_position, unsigned int begin, unsigned int end, size_t& rays);
+  void dilate(const Region& region);
+
+  LightmapSettings settings_;
+  LightmapStats stats_;
+  GLuint texture_;
+
+  TriangleBVH bvh_;
+  std::vector<Region> regions_;
+  std::vector<Sample> samples_;      // per texel of each region
+  std::vector<glm::vec4> texels_;    // of the whole atlas
+  std::vector<glm::vec2> disc_;      // light samples on the unit disc
+};
+
+#endif // _LIGHTMAP_HPP_GP_
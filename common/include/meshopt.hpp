@@ -0,0 +1,79 @@
+#ifndef _MESHOPT_HPP_GP_
+#define _MESHOPT_HPP_GP_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct VertexCacheStats {
+  float acmr;  // transformed vertices per triangle
+  float atvr;  // transformed vertices per referenced vertex
+};
+
+// Simulates a FIFO post-transform cache of cache_size entries.
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices,
+                                    unsigned int vertex_count,
+                                    unsigned int cache_size = 16);
+
+// Reorders triangles for post-transform cache hits (Tipsify).
+void OptimizeVertexCache(std::vector<unsigned int>& indices,
+                         unsigned int vertex_count,
+                         unsigned int cache_size = 16);
+
+// Sorts clusters of cache-optimized triangles so that outward facing ones go
+// first. threshold bounds the ACMR increase the extra cluster splits may cost.
+void OptimizeOverdraw(std::vector<unsigned int>& indices,
+                      const std::vector<glm::vec3>& vertices,
+                      float threshold = 1.05f,
+                      unsigned int cache_size = 16);
+
+// Computes the order in which vertices are first referenced and rewrites
+// indices to it. Unreferenced vertices are moved to the end.
+// ret_remap[old_index] is the new index of a vertex.
+void OptimizeVertexFetch(std::vector<unsigned int>& indices,
+                         unsigned int vertex_count,
+                         std::vector<unsigned int>& ret_remap);
+
+// A cluster of nearby triangles with similar normals, drawn as one range of
+// the index buffer and culled as a whole. Every triangle faces away from
+// viewers at p with dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff,
+// or viewing along d with dot(d, cone_axis) >= cone_cutoff. Clusters too
+// curved to ever face away entirely have a cutoff above 1.
+struct Meshlet {
+  unsigned int first;  // index offset
+  unsigned int count;  // indices
+  glm::vec3 center;
+  float radius;
+  glm::vec3 cone_apex;
+  glm::vec3 cone_axis;
+  float cone_cutoff;
+};
+
+// Regroups the triangles of indices into meshlets of at most max_triangles
+// triangles and max_vertices distinct vertices, keeping the existing order
+// within each, and appends them with offsets relative to indices.
+void BuildMeshlets(std::vector<unsigned int>& indices,
+                   const std::vector<glm::vec3>& vertices,
+                   std::vector<Meshlet>& ret_meshlets,
+                   unsigned int max_triangles = 124,
+                   unsigned int max_vertices = 64);
+
+// Sorts the meshlets BuildMeshlets appended from first_meshlet on the way
+// OptimizeOverdraw sorts clusters, moving their indices along. The triangle
+// order within each meshlet is kept.
+void OptimizeMeshletOverdraw(std::vector<unsigned int>& indices,
+                             const std::vector<glm::vec3>& vertices,
+                             std::vector<Meshlet>& meshlets,
+                             size_t first_meshlet);
+
+template <typename T>
+void RemapVertexStream(std::vector<T>& stream, const std::vector<unsigned int>& remap) {
+  if(stream.empty())
+    return;
+  std::vector<T> remapped(stream.size());
+  for(unsigned int i = 0; i < stream.size(); i++)
+    remapped[remap[i]] = stream[i];
+  stream.swap(remapped);
+}
+
+#endif // _MESHOPT_HPP_GP_
@@ -4,12 +4,40 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <bvh.hpp>
+#include <geometry.hpp>
+#include <jobs.hpp>
+#include <meshopt.hpp>
+
 #include <memory>
+#include <string>
+#include <vector>
+
+// A material of an MTL file. Map paths are relative to the working directory
+// and empty when the material has no such map.
+struct Material {
+  std::string name;
+  std::string albedo;
+  std::string normal;
+  glm::vec3 diffuse;
+};
 
+// Triangle soup of an OBJ. Faces of any size are fanned into triangles and
+// negative indices count back from the last element. Corners without a uv
+// or normal get zero uvs and the face normal when other corners have them.
 bool LoadOBJ(const char* path,
              std::vector<glm::vec3>& vertices,
              std::vector<glm::vec2>& uvs,
              std::vector<glm::vec3>& normals);
+// Same, with the materials of its mtllib files and the material of every
+// triangle. Faces before any usemtl and unknown material names get a
+// material of their own.
+bool LoadOBJ(const char* path,
+             std::vector<glm::vec3>& ret_vertices,
+             std::vector<glm::vec2>& ret_uvs,
+             std::vector<glm::vec3>& ret_normals,
+             std::vector<unsigned int>& ret_triangle_materials,
+             std::vector<Material>& ret_materials);
 
 void ComputeTangents(std::vector<glm::vec3>& vertices,
                      std::vector<glm::vec2>& uvs,
@@ -17,9 +45,78 @@ void ComputeTangents(std::vector<glm::vec3>& vertices,
                      std::vector<glm::vec3>& tangents,
                      std::vector<glm::vec3>& bitangents);
 
+void ComputeTangents(const std::vector<glm::vec3>& vertices,
+                     const std::vector<glm::vec2>& uvs,
+                     const std::vector<glm::vec3>& normals,
+                     const std::vector<unsigned int>& indices,
+                     std::vector<glm::vec3>& tangents,
+                     std::vector<glm::vec3>& bitangents);
+
+// Welds identical (position, uv, normal) triples of a triangle soup.
+void IndexVertices(const std::vector<glm::vec3>& vertices,
+                   const std::vector<glm::vec2>& uvs,
+                   const std::vector<glm::vec3>& normals,
+                   std::vector<glm::vec3>& ret_vertices,
+                   std::vector<glm::vec2>& ret_uvs,
+                   std::vector<glm::vec3>& ret_normals,
+                   std::vector<unsigned int>& ret_indices);
+
+// Indexed unit icosphere. Edge midpoints are cached so that neighbouring
+// triangles share vertices, the first overload generates positions only.
+void GenerateIcosphere(uint16_t divisions,
+                       std::vector<glm::vec3>& ret_vertices,
+                       std::vector<unsigned int>& ret_indices);
+void GenerateIcosphere(uint16_t divisions,
+                       std::vector<glm::vec3>& ret_vertices,
+                       std::vector<glm::vec2>& ret_uvs,
+                       std::vector<glm::vec3>& ret_normals,
+                       std::vector<unsigned int>& ret_indices);
+
+// Pixels covered by one world unit at distance 1 for the given vertical fov.
+float LodProjectionScale(float fovy, float viewport_height);
+
+struct MeshData;
+
 class Model {
  public:
-  Model(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals);
+  // A level of detail is a range of the shared index buffer, level 0 being
+  // the most detailed. error bounds its deviation from the true surface in
+  // model units. Its triangles are sorted by material into consecutive
+  // parts, and those of each part grouped into consecutive meshlets.
+  struct Lod {
+    unsigned int first;
+    unsigned int count;
+    float error;
+    unsigned int first_meshlet;
+    unsigned int meshlet_count;
+    unsigned int first_part;
+    unsigned int part_count;
+  };
+
+  struct Part {
+    unsigned int material;
+    unsigned int first;
+    unsigned int count;
+    unsigned int first_meshlet;
+    unsigned int meshlet_count;
+  };
+
+  // Indices of a model, relative to its first index like Lod and Meshlet,
+  // within a single part.
+  struct Range {
+    unsigned int first;
+    unsigned int count;
+    unsigned int material;
+  };
+
+  // Lightmap UVs are generated at lightmap_texels_per_unit when not 0, see
+  // UnwrapLightmap.
+  Model(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals,
+        unsigned int lod_levels = 0, float lightmap_texels_per_unit = 0.0f);
+  Model(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals,
+        std::vector<unsigned int>& indices, std::vector<Lod>& lods);
+  // Only uploads, the mesh is expected to be optimized already.
+  explicit Model(const MeshData& mesh);
   
   Model() = delete;
   Model(const Model &) = delete;
@@ -30,23 +127,125 @@ class Model {
 
   ~Model();
 
-  static std::shared_ptr<Model> FromOBJ(const char * path);
-  static std::shared_ptr<Model> FlatModel(float base_x, float base_y, glm::vec3 lower_left, glm::vec3 lower_right, glm::vec3 upper_right);
+  // Null when the OBJ can not be loaded or has no faces.
+  static std::shared_ptr<Model> FromOBJ(const char * path, unsigned int lod_levels = 0,
+                                        float lightmap_texels_per_unit = 0.0f);
+  static std::shared_ptr<Model> FlatModel(float base_x, float base_y, glm::vec3 lower_left, glm::vec3 lower_right, glm::vec3 upper_right,
+                                          float lightmap_texels_per_unit = 0.0f);
+  // Both spheres keep every subdivision level as a LOD. The light proxy
+  // carries positions only.
   static std::shared_ptr<Model> Sphere(uint16_t divisions);
+  static std::shared_ptr<Model> LightProxySphere(uint16_t divisions);
   void render();
+  void render(unsigned int lod);
   bool is_valid();
+
+  // Picks the coarsest level whose error projects to at most max_pixel_error
+  // pixels when seen from eye. Shadow passes pass a larger threshold.
+  unsigned int select_lod(const glm::mat4& model, const glm::vec3& eye,
+                          float projection_scale, float max_pixel_error) const;
+  // Same for orthographic views covering pixels_per_unit pixels per world
+  // unit at any distance.
+  unsigned int select_lod_ortho(const glm::mat4& model, float pixels_per_unit, float max_pixel_error) const;
+  unsigned int lod_count() const;
+
+  // Indirect draw of a level out of the shared arena buffers.
+  DrawElementsIndirectCommand indirect(unsigned int lod, unsigned int base_instance) const;
+  DrawElementsIndirectCommand indirect(const Range& range, unsigned int base_instance) const;
+
+  const Lod& lod(unsigned int lod) const;
+  const std::vector<Meshlet>& meshlets() const;
+  const std::vector<Part>& parts() const;
+  // Empty for models not loaded from an OBJ with materials, their single
+  // part uses material 0.
+  const std::vector<Material>& materials() const;
+  unsigned int material_count() const;
+  // Post-transform cache efficiency of LOD 0 before and after OptimizeMesh.
+  const VertexCacheStats& cache_before() const;
+  const VertexCacheStats& cache_after() const;
+
+  // Side of the square lightmap of an instance in texels, 0 for models
+  // without lightmap UVs.
+  unsigned int lightmap_size() const;
+  // CPU copy of the uploaded mesh, only kept for models with lightmap UVs
+  // so their static instances can be baked.
+  const MeshData* mesh() const;
+
+  // Builds the BVH of LOD 0 for CPU queries, once. Drops the CPU copy of
+  // LOD 0 kept for it.
+  void build_bvh(JobSystem& jobs);
+  // Null until built.
+  const TriangleBVH* bvh() const;
   
 //  private:
-  GLuint VAO_;
-  GLuint vertexbuffer_;
-  GLuint uvbuffer_;
-  GLuint normalbuffer_;
-  GLuint tangentbuffer_;
-  GLuint bitangentbuffer_;
-
+  // Ranges of the current GeometryArena.
+  unsigned int base_vertex_;
+  unsigned int vertex_count_;
+  unsigned int first_index_;
   unsigned int size_;
+  std::vector<Lod> lods_;
+  std::vector<Meshlet> meshlets_;
+  std::vector<Part> parts_;
+  std::vector<Material> materials_;
+  unsigned int lightmap_size_;
+  std::shared_ptr<const MeshData> mesh_;
+  glm::vec3 center_;
+  float radius_;
+
+  // Post-transform cache efficiency of LOD 0 before and after optimization.
+  VertexCacheStats cache_before_;
+  VertexCacheStats cache_after_;
 
-  std::vector<glm::vec3> my_v;
+  // Positions and LOD 0 indices, relative to the first vertex, until the
+  // BVH is built from them.
+  std::vector<glm::vec3> query_vertices_;
+  std::vector<unsigned int> query_indices_;
+  std::shared_ptr<const TriangleBVH> bvh_;
+
+ private:
+  void release();
+  void adopt(const MeshData& mesh);
+  void upload(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec2>& uvs,
+              const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& lightmap_uvs,
+              const std::vector<unsigned int>& indices);
+};
+
+// CPU side of a model, everything up to the upload. Building one touches no
+// GL state, so it can happen off the GL thread.
+struct MeshData {
+  std::vector<glm::vec3> vertices;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+  std::vector<unsigned int> indices;
+  std::vector<Model::Lod> lods;
+  // Filled in by OptimizeMesh when left empty, one part of material 0 per
+  // LOD.
+  std::vector<Model::Part> parts;
+  std::vector<Meshlet> meshlets;
+  VertexCacheStats cache_before;
+  VertexCacheStats cache_after;
+  std::vector<Material> materials;
+  // Empty without a lightmap, UVs in the square of lightmap_size texels.
+  std::vector<glm::vec2> lightmap_uvs;
+  unsigned int lightmap_size = 0;
+
+  // Size once uploaded into the GeometryArena.
+  size_t gpu_bytes() const;
 };
 
+// Reorders every part of every LOD for the vertex cache and overdraw, splits
+// it into meshlets, then reorders the vertices for fetch locality.
+void OptimizeMesh(MeshData& mesh);
+
+// Adds lightmap UVs, every LOD unwrapped into charts of its own so switching
+// levels never samples texels baked for another one. Splits the vertices
+// shared by charts, so it runs before OptimizeMesh.
+void UnwrapLightmap(MeshData& mesh, float texels_per_unit);
+
+// Loads, indexes, simplifies and optimizes an OBJ and its materials, each
+// LOD simplified per material so parts keep their borders. Lightmap UVs are
+// added when lightmap_texels_per_unit is not 0. Returns false when the OBJ
+// can not be loaded or has no faces.
+bool LoadMesh(const char* path, unsigned int lod_levels, MeshData& ret_mesh, float lightmap_texels_per_unit = 0.0f);
+
 #endif // _MODEL_HPP_GP_
\ No newline at end of file
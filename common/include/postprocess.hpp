@@ -0,0 +1,83 @@
+#ifndef _POSTPROCESS_HPP_GP_
+#define _POSTPROCESS_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <shader.hpp>
+
+#include <vector>
+
+struct BloomSettings {
+  float threshold;  // luminance where bloom starts
+  float knee;       // width of the soft transition below threshold
+  float intensity;
+  float radius;     // upsample tent radius in texels of each mip
+  float exposure;
+};
+
+// HDR scene target followed by a bloom mip chain and a tonemap composite.
+// The bright-pass is folded into the first downsample, each later step
+// halves the resolution with a 13-tap filter and the upsample walks back up
+// with a 9-tap tent, blending additively into the next larger mip. Every
+// step has a fixed tap count, so the cost does not depend on the radius.
+class PostProcess {
+ public:
+  PostProcess(unsigned int width, unsigned int height, unsigned int max_levels = 6);
+  ~PostProcess();
+
+  PostProcess(const PostProcess &) = delete;
+  PostProcess& operator=(const PostProcess&) = delete;
+
+  bool is_valid();
+
+  // Binds the HDR framebuffer the scene renders into. With a scale below 1
+  // only the lower left part of the target is used and the composite
+  // upscales it to the window with a Catmull-Rom filter.
+  void begin_scene(float scale = 1.0f);
+
+  void bright_pass(const BloomSettings& settings);
+  void downsample();
+  void upsample(const BloomSettings& settings);
+  // Tonemaps scene and bloom into framebuffer, the window by default.
+  void composite(const BloomSettings& settings, GLuint framebuffer = 0);
+
+  unsigned int level_count() const;
+  float scale() const;
+  // Part of the scene target rendered into since begin_scene.
+  unsigned int scene_width() const;
+  unsigned int scene_height() const;
+  // Depth texture of the scene target, for screen-space passes.
+  GLuint scene_depth() const;
+
+ private:
+  struct Level {
+    GLuint texture;
+    GLuint framebuffer;
+    unsigned int width;
+    unsigned int height;
+  };
+
+  void bind_level(const Level& level);
+  void draw_fullscreen();
+  void set_scene_region(const Shader& shader);
+
+  unsigned int width_;
+  unsigned int height_;
+  float scale_;
+  unsigned int scene_width_;
+  unsigned int scene_height_;
+
+  Shader downsample_shader_;
+  Shader upsample_shader_;
+  Shader tonemap_shader_;
+
+  GLuint scene_framebuffer_;
+  GLuint scene_texture_;
+  GLuint scene_depth_;
+  std::vector<Level> levels_;
+
+  // Core profiles need a bound VAO even for attributeless draws.
+  GLuint fullscreen_vao_;
+};
+
+#endif // _POSTPROCESS_HPP_GP_
@@ -0,0 +1,118 @@
+#ifndef _RENDERER_HPP_GP_
+#define _RENDERER_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <frame.hpp>
+#include <gputimer.hpp>
+#include <postprocess.hpp>
+#include <shader.hpp>
+#include <shadowmask.hpp>
+#include <virtualtexture.hpp>
+
+// Owns the GL side of a frame: shaders, the point light shadow cube map, the
+// sun cascade array and their framebuffers, the HDR post chain and the
+// per-frame transform and indirect buffers. Each batch of a pass is a single
+// glMultiDrawElementsIndirect on GL 4.3, older contexts fall back to one
+// glDrawElementsBaseVertex per draw. With a virtual texture cache the lit
+// geometry is drawn again into its feedback after the scene. The point light
+// shadow is filtered either inline in the lit pass or ahead of it into a
+// ShadowMask, after a depth prepass of the lit geometry. Only ever used from
+// the thread owning the GL context.
+class Renderer {
+ public:
+  // A cascade_resolution of 0 leaves out the sun cascades, directional
+  // scenes then render without shadows.
+  Renderer(unsigned int width, unsigned int height, unsigned int shadow_resolution,
+           unsigned int cascade_resolution = 0, VirtualTextureCache* virtual_textures = nullptr);
+  ~Renderer();
+
+  Renderer(const Renderer &) = delete;
+  Renderer& operator=(const Renderer&) = delete;
+
+  bool is_valid();
+
+  void render(const FrameCommands& commands);
+
+  enum Stage : unsigned int {
+    ShadowStage,
+    ShadowMaskStage,
+    SceneStage,
+    FeedbackStage,
+    BrightPassStage,
+    DownsampleStage,
+    UpsampleStage,
+    CompositeStage
+  };
+  const GpuTimer& timer() const;
+
+  BloomSettings bloom;
+  // Fraction of the window resolution the scene renders at.
+  float render_scale;
+  // Where the composite lands, 0 for the window. Must be width x height.
+  GLuint output_framebuffer;
+  // Baked lightmap of the scene, 0 for none. Sampled by the instances
+  // FrameCommands::lightmaps places in it while the commands are lightmapped.
+  GLuint lightmap_texture;
+  // 0 filters the point light shadow in the lit pass, 2 or 4 into a shadow
+  // mask at half or quarter resolution.
+  unsigned int shadow_mask_divisor;
+
+ private:
+  void upload(const FrameCommands& commands);
+  // Sets virtual_location to the virtual texture id of each textured batch.
+  void draw(const Shader& shader, GLint offset_location, const FrameCommands& commands, unsigned int pass_index,
+            GLint virtual_location = -1);
+  void shadow_pass(const FrameCommands& commands);
+  void cascade_pass(const FrameCommands& commands);
+  // Depth prepass of the lit geometry, then the mask from its depth.
+  void shadow_mask_pass(const FrameCommands& commands);
+  // With prepassed set the scene depth is kept and only matched.
+  void main_pass(const FrameCommands& commands, bool prepassed);
+  void feedback_pass(const FrameCommands& commands);
+
+  unsigned int width_;
+  unsigned int height_;
+  unsigned int shadow_resolution_;
+  unsigned int cascade_resolution_;
+
+  Shader tex_shader_;
+  Shader cube_shadow_shader_;
+  Shader monocolor_shader_;
+  Shader cascade_shader_;
+  Shader feedback_shader_;
+  Shader prepass_shader_;
+  PostProcess post_;
+  ShadowMask shadow_mask_;
+  GpuTimer timer_;
+
+  GLint tex_offset_location_;
+  GLint cube_shadow_offset_location_;
+  GLint cube_shadow_face_location_;
+  GLint monocolor_offset_location_;
+  GLint cascade_offset_location_;
+  GLint cascade_matrix_location_;
+  GLint tex_virtual_location_;
+  GLint feedback_offset_location_;
+  GLint feedback_virtual_location_;
+  GLint prepass_offset_location_;
+
+  bool multi_draw_indirect_;
+  GLuint transformbuffer_;
+  GLuint transform_texture_;
+  GLuint lightmapbuffer_;
+  GLuint lightmap_rect_texture_;
+  GLuint indirectbuffer_;
+  // Byte offset of each pass in the indirect buffer: the shadow cube faces,
+  // lit, unlit, then the cascades.
+  size_t indirect_offsets_[FrameCommands::CubeFaces + 2 + FrameCommands::MaxCascades];
+
+  GLuint depth_map_fbo_;
+  GLuint depth_cubemap_;
+  GLuint cascade_fbo_;
+  GLuint cascade_texture_;
+
+  VirtualTextureCache* virtual_textures_;
+};
+
+#endif // _RENDERER_HPP_GP_
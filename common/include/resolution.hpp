@@ -0,0 +1,37 @@
+#ifndef _RESOLUTION_HPP_GP_
+#define _RESOLUTION_HPP_GP_
+
+// Picks the main pass resolution scale from measured GPU frame times.
+// Time is assumed to grow with the pixel count, so the next scale is
+// scale * sqrt(budget / time) of a smoothed time. Hysteresis comes from a
+// dead band between the lower and upper thresholds, a cooldown after every
+// change that outlasts the GPU timer latency, and scales snapped to steps.
+class ResolutionController {
+ public:
+  ResolutionController(float budget_ms, float min_scale = 0.5f, float max_scale = 1.0f);
+
+  // Feeds the latest GPU frame time and returns the scale to render with.
+  float update(double gpu_ms);
+
+  float scale() const;
+  double smoothed_ms() const;
+
+ private:
+  static const int Cooldown = 8;  // frames
+  static constexpr float Step = 0.05f;
+  static constexpr float MaxChange = 0.15f;
+  // Fractions of the budget. Above upper sheds resolution, only below
+  // lower there is enough headroom to raise it again.
+  static constexpr float Upper = 1.0f;
+  static constexpr float Lower = 0.85f;
+  static constexpr double Smoothing = 0.15;
+
+  float budget_ms_;
+  float min_scale_;
+  float max_scale_;
+  float scale_;
+  double smoothed_ms_;
+  int cooldown_;
+};
+
+#endif // _RESOLUTION_HPP_GP_
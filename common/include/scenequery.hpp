@@ -0,0 +1,98 @@
+#ifndef _SCENEQUERY_HPP_GP_
+#define _SCENEQUERY_HPP_GP_
+
+#include <glm/glm.hpp>
+
+#include <bvh.hpp>
+#include <frame.hpp>
+#include <jobs.hpp>
+
+#include <vector>
+
+// origin + t * direction for t in (0, max_t). A segment between two points
+// is the ray from the first with direction to the second and max_t 1.
+struct QueryRay {
+  glm::vec3 origin;
+  glm::vec3 direction;
+  float max_t;
+};
+
+struct SceneHit {
+  float t;
+  unsigned int instance;
+  unsigned int triangle;  // of LOD 0 of the instance's model
+  float u;
+  float v;
+};
+
+struct SceneTriangle {
+  unsigned int instance;
+  unsigned int triangle;
+};
+
+struct SceneQueryStats {
+  unsigned int instances;
+  unsigned int triangles;  // of LOD 0, summed over the instances
+  unsigned int models;     // whose BVH the build had to create
+  double build_ms;
+};
+
+// Ray, segment and frustum queries against the instances of a scene on the
+// CPU, for picking, line of sight and region selection. A BVH over the world
+// bounds of the instances sits on top of the TriangleBVH of each model, and
+// rays reaching an instance are taken into its model space, where their
+// distances stay the same. Read-only once built, so any number of threads may
+// query; the batched overloads spread their rays over the workers.
+class SceneQuery {
+ public:
+  static const unsigned int NoInstance = ~0u;
+
+  SceneQuery();
+
+  SceneQuery(const SceneQuery &) = delete;
+  SceneQuery& operator=(const SceneQuery&) = delete;
+
+  // Takes the instances with any of flags where the scene puts them, after
+  // building the BVHs their models lack. Keeps pointers to those BVHs, so
+  // the models must outlive the queries.
+  void build(JobSystem& jobs, const Scene& scene, unsigned int flags);
+
+  bool intersect(const QueryRay& ray, SceneHit& ret_hit) const;
+  bool occluded(const QueryRay& ray) const;
+  // Whether anything lies between the two points.
+  bool occluded(const glm::vec3& from, const glm::vec3& to) const;
+  // Triangles of the instances that may be inside the frustum of
+  // view_projection, see TriangleBVH::frustum.
+  void frustum(const glm::mat4& view_projection, std::vector<SceneTriangle>& ret_triangles) const;
+
+  // Missed rays get NoInstance.
+  void intersect(JobSystem& jobs, const QueryRay* rays, unsigned int count, SceneHit* ret_hits) const;
+  void occluded(JobSystem& jobs, const QueryRay* rays, unsigned int count, unsigned char* ret_occluded) const;
+
+  const SceneQueryStats& stats() const;
+
+ private:
+  struct Node {
+    glm::vec3 lower;
+    unsigned int index;  // second child, or first entry of a leaf
+    glm::vec3 upper;
+    unsigned int entries;  // 0 for inner nodes
+  };
+
+  struct Entry {
+    glm::mat4 transform;
+    glm::mat4 inverse;
+    const TriangleBVH* bvh;
+    unsigned int instance;
+    glm::vec3 lower;  // in world space
+    glm::vec3 upper;
+  };
+
+  unsigned int build_node(unsigned int begin, unsigned int end);
+
+  std::vector<Node> nodes_;
+  std::vector<Entry> entries_;
+  SceneQueryStats stats_;
+};
+
+#endif // _SCENEQUERY_HPP_GP_
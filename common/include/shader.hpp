@@ -4,6 +4,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <string>
+
 class Shader {
  public:
   Shader(const char* vertex_shader_path, const char* geometry_shader_path, const char* fragment_shader_path);
@@ -11,14 +13,19 @@ class Shader {
 
   void use();
 
-  void set_int(const std::string &, int ) const;
-  void set_float(const std::string &, float ) const;
-  void set_vec2(const std::string &, const glm::vec2 &) const;
-  void set_vec3(const std::string &, const glm::vec3 &) const;
-  void set_vec4(const std::string &, const glm::vec4 &) const;
-  void set_mat2(const std::string &, const glm::mat2 &) const;
-  void set_mat3(const std::string &, const glm::mat3 &) const;
-  void set_mat4(const std::string &, const glm::mat4 &) const;
+  void set_int(const char*, int ) const;
+  void set_float(const char*, float ) const;
+  void set_vec2(const char*, const glm::vec2 &) const;
+  void set_vec3(const char*, const glm::vec3 &) const;
+  void set_vec4(const char*, const glm::vec4 &) const;
+  void set_mat2(const char*, const glm::mat2 &) const;
+  void set_mat3(const char*, const glm::mat3 &) const;
+  void set_mat4(const char*, const glm::mat4 &) const;
+
+  // Location based setters for uniforms written every draw.
+  GLint location(const char*) const;
+  void set_int(GLint, int) const;
+  void set_mat4(GLint, const glm::mat4 &) const;
 
   bool is_valid();
 
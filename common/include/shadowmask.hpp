@@ -0,0 +1,53 @@
+#ifndef _SHADOWMASK_HPP_GP_
+#define _SHADOWMASK_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <frame.hpp>
+#include <shader.hpp>
+
+// Point light shadow of the visible surfaces, evaluated in screen space
+// ahead of the lit pass. The world position of each pixel is rebuilt from
+// the depth of a depth prepass and the cube map is filtered once per block
+// of divisor x divisor pixels. A bilateral filter brings the result back to
+// full resolution, weighting the four nearest blocks by bilinear distance
+// and by how close their depth is, so shadows do not bleed across depth
+// edges. The lit pass then reads a single texel of texture().
+class ShadowMask {
+ public:
+  static constexpr unsigned int MinDivisor = 2;
+  static constexpr unsigned int MaxDivisor = 4;
+
+  // Size of the scene target the mask covers.
+  ShadowMask(unsigned int width, unsigned int height);
+  ~ShadowMask();
+
+  ShadowMask(const ShadowMask &) = delete;
+  ShadowMask& operator=(const ShadowMask&) = delete;
+
+  bool is_valid();
+
+  // Fills the lower left scene_width x scene_height of texture() from the
+  // same part of depth, the divisor clamped to [MinDivisor, MaxDivisor].
+  // Binds a vertex array of its own.
+  void render(const FrameCommands& commands, GLuint depth, GLuint depth_cubemap, unsigned int scene_width,
+              unsigned int scene_height, unsigned int divisor);
+
+  GLuint texture() const;
+
+ private:
+  unsigned int width_;
+  unsigned int height_;
+
+  Shader mask_shader_;
+  Shader upsample_shader_;
+
+  GLuint low_texture_;  // shadow and distance to the camera per block
+  GLuint low_framebuffer_;
+  GLuint texture_;
+  GLuint framebuffer_;
+
+  GLuint fullscreen_vao_;
+};
+
+#endif // _SHADOWMASK_HPP_GP_
@@ -0,0 +1,31 @@
+#ifndef _SIMPLIFY_HPP_GP_
+#define _SIMPLIFY_HPP_GP_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Reduces an indexed triangle list to at most target_triangles triangles using
+// quadric error metric edge collapses. Vertices are never moved or created, so
+// the result indexes into the same vertex arrays as the input. Corners that
+// lose their vertex are remapped to the attribute vertex at the collapse
+// target that the triangles of the collapsed edge pair it with, so vertices
+// on a UV or normal seam only collapse along the seam.
+// Returns the geometric error introduced, in model units: the largest root
+// mean squared distance of a kept vertex to the planes of the triangles it
+// replaced.
+float SimplifyMesh(const std::vector<glm::vec3>& vertices,
+                   const std::vector<unsigned int>& indices,
+                   unsigned int target_triangles,
+                   std::vector<unsigned int>& ret_indices);
+
+// Simplifies to level_count levels of half the triangles of the one before,
+// each continuing from the last so the mesh is only welded once. The errors
+// are measured against the input and never decrease from level to level.
+void SimplifyMeshLevels(const std::vector<glm::vec3>& vertices,
+                        const std::vector<unsigned int>& indices,
+                        unsigned int level_count,
+                        std::vector<std::vector<unsigned int>>& ret_levels,
+                        std::vector<float>& ret_errors);
+
+#endif // _SIMPLIFY_HPP_GP_
@@ -0,0 +1,166 @@
+#ifndef _STREAMING_HPP_GP_
+#define _STREAMING_HPP_GP_
+
+#include <glm/glm.hpp>
+
+#include <frame.hpp>
+#include <model.hpp>
+#include <textures.hpp>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct StreamObject {
+  std::string mesh;    // OBJ
+  std::string albedo;  // PNG
+  std::string normal;  // PNG
+  glm::vec3 position;
+  float angle;         // degrees around +y
+  float scale;
+  unsigned int flags;  // Instance::Flags
+};
+
+// A spatial cell of the world, loaded and unloaded as a whole.
+struct StreamCell {
+  glm::vec3 center;
+  float radius;
+  std::vector<StreamObject> objects;
+};
+
+// Reads a world manifest. Each line is either
+//   cell <x> <y> <z> <radius>
+// starting a new cell, or
+//   object <mesh> <albedo> <normal> <x> <y> <z> <scale> <angle>
+// adding to the last one. Blank lines and lines starting with # are skipped.
+bool LoadWorld(const char* path, std::vector<StreamCell>& ret_cells);
+
+struct StreamSettings {
+  float load_radius;      // cells closer than this are wanted
+  float unload_radius;    // and dropped only beyond this one
+  float prediction_time;  // seconds of camera motion to look ahead
+  size_t memory_budget;   // bytes of resident GPU data
+  size_t upload_budget;   // bytes uploaded per update
+  unsigned int lod_levels;
+};
+
+struct StreamStats {
+  unsigned int resident_cells;
+  unsigned int loading_cells;
+  size_t resident_bytes;
+  size_t peak_resident_bytes;
+  // Loaded on the I/O thread and waiting for their upload.
+  size_t staged_bytes;
+  size_t peak_staged_bytes;
+  unsigned int loads;
+  unsigned int evictions;
+  // Maxima since the last take_stats(). The update time is what the GL
+  // thread pays, so it is the hitch to watch.
+  double max_load_ms;
+  double max_update_ms;
+};
+
+// Streams the cells of a world around the camera. A background I/O thread
+// loads and optimizes meshes and decodes textures, nearest cell first by
+// the camera position extrapolated from its motion. The GL thread uploads
+// at most upload_budget bytes per update and evicts the farthest cells once
+// the memory budget is exceeded.
+//
+// Streamed instances are appended to the scene after the instances it had
+// at construction.
+class WorldStreamer {
+ public:
+  WorldStreamer(Scene& scene, std::vector<StreamCell> cells, const StreamSettings& settings);
+  ~WorldStreamer();
+
+  WorldStreamer(const WorldStreamer &) = delete;
+  WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+  // GL thread, only while no frame is being built from the scene.
+  void update(const glm::vec3& camera, float dt);
+
+  // Returns the stats and restarts the maxima.
+  StreamStats take_stats();
+
+ private:
+  enum class State {
+    Unloaded,
+    Loading,  // queued or on the I/O thread
+    Staged,   // loaded, waiting for its upload
+    Resident
+  };
+
+  // CPU side of a cell, produced by the I/O thread.
+  struct LoadedCell {
+    unsigned int cell;
+    std::vector<MeshData> meshes;
+    std::vector<Texture::Images> textures;
+    // Mesh and texture index per object, NoMesh for meshes that failed to
+    // load.
+    std::vector<std::pair<unsigned int, unsigned int>> objects;
+    size_t bytes;
+    double load_ms;
+  };
+
+  struct ResidentCell {
+    std::vector<std::unique_ptr<Model>> models;
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::vector<std::pair<unsigned int, unsigned int>> objects;
+    size_t bytes;
+  };
+
+  // A cell waits this many updates after eviction before its buffers are
+  // released, frames built before the eviction may still draw it.
+  static const unsigned int RetireDelay = 2;
+  // The I/O thread stops once this many cells wait for their upload.
+  static const unsigned int MaxStaged = 2;
+  static const unsigned int NoMesh = ~0u;
+
+  void io_loop();
+  void load(unsigned int cell, LoadedCell& ret_loaded);
+
+  void collect_loaded();
+  void unload_distant();
+  void upload();
+  bool make_room(size_t bytes, float distance);
+  void evict(unsigned int cell);
+  void request();
+  void rebuild_instances();
+
+  Scene& scene_;
+  size_t static_instances_;
+  std::vector<StreamCell> cells_;
+  StreamSettings settings_;
+
+  // GL thread only.
+  std::vector<State> states_;
+  std::vector<float> distances_;  // to the predicted camera
+  std::vector<size_t> cell_bytes_;  // 0 until loaded once
+  std::vector<std::unique_ptr<ResidentCell>> resident_;
+  std::vector<std::unique_ptr<LoadedCell>> staged_;
+  // Partially uploaded cell and its resources so far.
+  std::unique_ptr<LoadedCell> uploading_;
+  std::unique_ptr<ResidentCell> uploaded_;
+  std::vector<std::pair<unsigned int, std::unique_ptr<ResidentCell>>> retired_;
+  glm::vec3 last_camera_;
+  bool has_camera_;
+  bool instances_dirty_;
+  unsigned int update_count_;
+  StreamStats stats_;
+
+  // Shared with the I/O thread.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::pair<float, unsigned int>> queue_;  // min-heap on distance
+  std::vector<std::unique_ptr<LoadedCell>> loaded_;
+  int in_flight_;
+  bool running_;
+  double max_load_ms_;
+  std::thread thread_;
+};
+
+#endif // _STREAMING_HPP_GP_
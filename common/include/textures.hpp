@@ -2,14 +2,42 @@
 #define _TEXTURE_HPP_GP_
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 class Texture {
  public:
   enum class Format {
     PNG
   };
+
+  // Decoded RGBA8 pixels of both maps. Decoding touches no GL state, so it
+  // can happen off the GL thread.
+  struct Images {
+    int albedo_width;
+    int albedo_height;
+    std::vector<unsigned char> albedo;
+    int normal_width;
+    int normal_height;
+    std::vector<unsigned char> normal;
+  };
+
+  // Unit use() binds the page table of a virtual texture to.
+  static const GLenum PageTableUnit = GL_TEXTURE5;
+
+  static bool Decode(Format, const char* albedo, const char* normal, Images& ret_images);
   
   Texture(Format, const char* albedo, const char* normal);
+  explicit Texture(const Images& images);
+  // A texture of a VirtualTextureCache, sampled through a page table the
+  // cache owns.
+  Texture(unsigned int virtual_id, GLuint page_table);
 
   Texture() = delete;
   Texture(const Texture &) = delete;
@@ -22,9 +50,44 @@ class Texture {
 
   void use();
 
+  // Size of both maps on the GPU.
+  size_t bytes() const;
+
+  // Id in its VirtualTextureCache, 0 for a regular texture.
+  unsigned int virtual_id() const;
+
  private:
+  void upload(const Images& images);
+
   GLuint albedo_texture_;
   GLuint normal_texture_;
+  size_t bytes_;
+  unsigned int virtual_id_;
+  GLuint page_table_;
+};
+
+// Shares one texture between every material and object naming the same
+// maps. A material without an albedo map gets a texture of its diffuse
+// colour, one without a normal map a flat normal map.
+class TextureCache {
+ public:
+  // Loads a pair of maps, normal may be null. Returns null to fall back to
+  // a regular texture.
+  typedef std::function<std::shared_ptr<Texture>(const char* albedo, const char* normal)> Loader;
+
+  explicit TextureCache(Loader loader = nullptr);
+
+  TextureCache(const TextureCache &) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+
+  // Owned by the cache, empty paths for missing maps.
+  Texture* get(const std::string& albedo, const std::string& normal, const glm::vec3& diffuse = glm::vec3(1.0f));
+
+  unsigned int size() const;
+
+ private:
+  Loader loader_;
+  std::map<std::string, std::shared_ptr<Texture>> textures_;
 };
 
-#endif // _TEXTURE_HPP_GP_
\ No newline at end of file
+#endif // _TEXTURE_HPP_GP_
@@ -0,0 +1,65 @@
+#ifndef _TRANSFORMS_HPP_GP_
+#define _TRANSFORMS_HPP_GP_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <jobs.hpp>
+
+#include <vector>
+
+// Local transforms kept as structure of arrays (position, rotation
+// quaternion, uniform scale) and composed into world matrices in SIMD
+// batches: 8 lanes with AVX, 4 with SSE2, one otherwise. Only transforms
+// changed since the last update and the subtrees below them recompute.
+//
+// A parent must have a lower index than its children, so parents are
+// always resolved first.
+class TransformSystem {
+ public:
+  static constexpr unsigned int NoParent = ~0u;
+
+  TransformSystem();
+
+  // Drops every transform and makes count identity roots.
+  void resize(unsigned int count);
+  unsigned int size() const;
+
+  // Not thread-safe against set_parent() or update(), but distinct indices
+  // may be set concurrently.
+  void set(unsigned int index, const glm::vec3& position, const glm::quat& rotation, float scale);
+  void set_parent(unsigned int index, unsigned int parent);
+  unsigned int parent(unsigned int index) const;
+
+  void update(JobSystem& jobs);
+
+  // Valid after update().
+  const glm::mat4& world(unsigned int index) const { return world_[index]; }
+
+  // Transforms whose world matrix changed in the last update.
+  unsigned int updated_count() const;
+
+ private:
+  void build_levels();
+  unsigned int compose(unsigned int begin, unsigned int end);
+  unsigned int propagate(const std::vector<unsigned int>& level, unsigned int begin, unsigned int end);
+
+  unsigned int size_;
+  // Padded to a whole number of batches.
+  std::vector<float> px_, py_, pz_;
+  std::vector<float> qx_, qy_, qz_, qw_;
+  std::vector<float> scale_;
+  std::vector<unsigned int> parent_;
+  // One byte per transform so jobs can write neighbours concurrently.
+  std::vector<unsigned char> dirty_;  // local transform changed
+  std::vector<unsigned char> moved_;  // world matrix changed this update
+
+  std::vector<glm::mat4> local_;  // relative to the parent, unused for roots
+  std::vector<glm::mat4> world_;
+  // Transforms with a parent, grouped by depth starting at 1.
+  std::vector<std::vector<unsigned int>> levels_;
+  bool hierarchy_dirty_;
+  unsigned int updated_count_;
+};
+
+#endif // _TRANSFORMS_HPP_GP_
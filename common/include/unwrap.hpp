@@ -0,0 +1,27 @@
+#ifndef _UNWRAP_HPP_GP_
+#define _UNWRAP_HPP_GP_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Triangles unwrapped on their own, as a LOD is.
+struct UnwrapRange {
+  unsigned int first;
+  unsigned int count;
+};
+
+// Lightmap UVs of indexed triangles. The triangles of each range are grouped
+// into charts of neighbours facing about the same way, every chart is
+// projected onto its plane at texels_per_unit and all of them are packed
+// with padding texels around each into one square of ret_size texels, at
+// most max_size, lowering the density when they do not fit. Vertices used by
+// several charts are duplicated: indices are rewritten to the new vertices,
+// ret_remap gives the original vertex of each and ret_uvs its UV in [0, 1].
+// Every index must lie in a range.
+void UnwrapLightmap(const std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices,
+                    const std::vector<UnwrapRange>& ranges, float texels_per_unit, unsigned int padding,
+                    unsigned int max_size, std::vector<unsigned int>& ret_remap, std::vector<glm::vec2>& ret_uvs,
+                    unsigned int& ret_size);
+
+#endif // _UNWRAP_HPP_GP_
@@ -0,0 +1,174 @@
+#ifndef _VIRTUALTEXTURE_HPP_GP_
+#define _VIRTUALTEXTURE_HPP_GP_
+
+#include <glad/glad.h>
+
+#include <textures.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A page file holds an albedo and normal map pair cut into pages. Both maps
+// are resampled to the same square power of two size of at least one page,
+// every mip level down to a single page is stored, and each page carries a
+// border of wrapped neighbouring texels for bilinear filtering. After the
+// header come the pages, finest level first and row by row, each as the
+// albedo then the normal texels of a PageSlot square, RGBA8.
+struct VirtualTextureHeader {
+  char magic[4];  // "GPVT"
+  uint32_t version;
+  uint32_t size;  // texels per side of level 0
+  uint32_t levels;
+};
+
+const uint32_t VirtualTextureVersion = 1;
+
+// Writes the page file of a pair of PNGs. Without a normal map the pages
+// get a flat one.
+bool BakeVirtualTexture(const char* albedo, const char* normal, const char* path);
+
+struct VirtualTextureSettings {
+  unsigned int cache_pages;  // physical pages per side of the cache textures
+  unsigned int feedback_width;
+  unsigned int feedback_height;
+  unsigned int uploads_per_frame;
+};
+
+struct VirtualTextureStats {
+  unsigned int textures;
+  unsigned int resident_pages;
+  unsigned int cache_pages;
+  size_t cache_bytes;  // both physical textures, fixed
+  // Since the last take_stats().
+  unsigned int requests;
+  unsigned int uploads;
+  unsigned int evictions;
+};
+
+// Fixed-size page cache behind virtual textures. A feedback pass renders
+// the lit geometry at low resolution, writing the texture, mip and page
+// each pixel samples. Read back a few frames later, missing pages are
+// queued for a background thread reading them from the page files, and are
+// uploaded into the least recently used slots of the physical albedo and
+// normal textures. A page table texture per virtual texture maps every page
+// of every level to its slot, or to the one of its closest resident
+// ancestor, so sampling never waits. The coarsest level stays resident.
+//
+// Everything but the I/O thread runs on the GL thread. Once the textures
+// are added the frame loop does not allocate.
+class VirtualTextureCache {
+ public:
+  static const unsigned int PageSize = 128;
+  static const unsigned int PageBorder = 4;
+  static const unsigned int PageSlot = PageSize + 2 * PageBorder;
+  // Units the lit shader samples the caches from, the page table of a
+  // texture goes on Texture::PageTableUnit.
+  static const GLenum AlbedoCacheUnit = GL_TEXTURE6;
+  static const GLenum NormalCacheUnit = GL_TEXTURE7;
+
+  explicit VirtualTextureCache(const VirtualTextureSettings& settings);
+  ~VirtualTextureCache();
+
+  VirtualTextureCache(const VirtualTextureCache &) = delete;
+  VirtualTextureCache& operator=(const VirtualTextureCache&) = delete;
+
+  // Bakes the page file next to the albedo map unless there is one already.
+  // Returns null when the texture can not be baked or the cache is full.
+  std::shared_ptr<Texture> add(const char* albedo, const char* normal);
+
+  // Reads back the feedback of an earlier frame, requests the missing pages
+  // and uploads those loaded since, at most uploads_per_frame.
+  void update();
+
+  // Binds and clears the feedback framebuffer, the feedback shader writes
+  // the page key of VirtualTextureCache::Key.
+  void begin_feedback();
+  // Starts the readback of the feedback.
+  void end_feedback();
+  unsigned int feedback_width() const;
+  unsigned int feedback_height() const;
+
+  void bind_caches() const;
+
+  VirtualTextureStats take_stats();
+
+ private:
+  // Page tables use (-1) for pages not in the cache and (-2) for pages on
+  // their way.
+  static const int Absent = -1;
+  static const int Loading = -2;
+  // Feedback frames in flight before a readback is mapped.
+  static const unsigned int FeedbackLatency = 3;
+  // Page reads queued or done but not yet uploaded.
+  static const unsigned int MaxInFlight = 32;
+
+  struct PageFile {
+    std::string path;
+    std::ifstream file;  // I/O thread once added
+    unsigned int levels;
+    unsigned int pages;  // per side of level 0
+    std::vector<unsigned int> level_offsets;  // first page of each level
+    std::vector<int> slots;  // per page of every level
+    std::vector<uint32_t> table;  // page table texels of every level
+    GLuint page_table;
+    bool dirty;
+  };
+
+  struct Slot {
+    uint32_t key;  // 0 when free
+    unsigned int last_used;
+    bool pinned;
+  };
+
+  // A page as the feedback shader writes it, texture ids start at 1.
+  static uint32_t Key(unsigned int texture, unsigned int level, unsigned int x, unsigned int y);
+  bool decode(uint32_t key, PageFile*& ret_file, unsigned int& ret_level, unsigned int& ret_page) const;
+
+  void read_feedback();
+  void request(uint32_t key);
+  void upload_loaded();
+  int allocate_slot();
+  void upload_page(int slot, const unsigned char* data);
+  void update_page_tables();
+
+  void io_loop();
+
+  VirtualTextureSettings settings_;
+  size_t page_bytes_;
+  std::vector<std::unique_ptr<PageFile>> files_;
+  std::vector<Slot> slots_;
+  unsigned int frame_;
+  VirtualTextureStats stats_;
+
+  GLuint albedo_cache_;
+  GLuint normal_cache_;
+  GLuint feedback_fbo_;
+  GLuint feedback_texture_;
+  GLuint feedback_depth_;
+  GLuint feedback_pbos_[FeedbackLatency];
+  bool feedback_issued_[FeedbackLatency];
+  unsigned int feedback_frame_;
+  std::vector<uint32_t> requests_;
+
+  // Page buffers, each in use by at most one read.
+  std::vector<unsigned char> buffers_;
+  std::vector<unsigned int> free_buffers_;
+
+  // Shared with the I/O thread.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::pair<uint32_t, unsigned int>> queue_;   // key and buffer
+  std::vector<std::pair<uint32_t, unsigned int>> loaded_;
+  std::vector<std::pair<uint32_t, unsigned int>> uploading_;  // GL thread only
+  bool running_;
+  std::thread thread_;
+};
+
+#endif // _VIRTUALTEXTURE_HPP_GP_
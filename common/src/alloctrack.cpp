@@ -0,0 +1,62 @@
+#include <alloctrack.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<size_t> allocation_count(0);
+std::atomic<size_t> allocated_bytes(0);
+
+}
+
+bool AllocationTrackingEnabled() {
+#ifdef GP_TRACK_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+size_t AllocationCount() {
+  return allocation_count.load(std::memory_order_relaxed);
+}
+
+size_t AllocatedBytes() {
+  return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+#ifdef GP_TRACK_ALLOCATIONS
+
+// Replacing the plain and array forms is enough, the nothrow and sized
+// variants forward to them by default.
+void* operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if(void* memory = std::malloc(size ? size : 1))
+    return memory;
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+  std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+  std::free(memory);
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include <arena.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}
+
+FrameArena::FrameArena(size_t capacity)
+  : block_(new char[capacity]), capacity_(capacity), offset_(0), overflow_bytes_(0), peak_(0) {}
+
+FrameArena::~FrameArena() {
+  for(char* block : overflow_)
+    delete[] block;
+  delete[] block_;
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+  uintptr_t base = reinterpret_cast<uintptr_t>(block_);
+  size_t offset = align_up(base + offset_, alignment) - base;
+  if(offset + bytes <= capacity_) {
+    offset_ = offset + bytes;
+    peak_ = std::max(peak_, used());
+    return block_ + offset;
+  }
+
+  char* block = new char[bytes + alignment];
+  overflow_.push_back(block);
+  overflow_bytes_ += bytes + alignment;
+  peak_ = std::max(peak_, used());
+  uintptr_t address = reinterpret_cast<uintptr_t>(block);
+  return block + (align_up(address, alignment) - address);
+}
+
+void FrameArena::reset() {
+  if(!overflow_.empty()) {
+    for(char* block : overflow_)
+      delete[] block;
+    overflow_.clear();
+    overflow_bytes_ = 0;
+
+    // Leave headroom so a frame slightly larger than the peak still fits.
+    capacity_ = std::max(capacity_ * 2, align_up(peak_ + peak_ / 4, 4096));
+    delete[] block_;
+    block_ = new char[capacity_];
+  }
+  offset_ = 0;
+}
+
+size_t FrameArena::used() const {
+  return offset_ + overflow_bytes_;
+}
+
+size_t FrameArena::capacity() const {
+  return capacity_;
+}
+
+size_t FrameArena::peak() const {
+  return peak_;
+}
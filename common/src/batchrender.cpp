@@ -0,0 +1,221 @@
+#include <batchrender.hpp>
+
+#include <imagewrite.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool signaled(GLsync fence) {
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+}
+
+bool LoadPoses(const char* path, std::vector<RenderPose>& ret_poses) {
+  std::ifstream ifs(path);
+  if(!ifs.is_open()) {
+    std::cout << "Could not open " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int number = 0;
+  while(std::getline(ifs, line)) {
+    number++;
+    std::istringstream in(line);
+    std::string keyword;
+    if(!(in >> keyword) || keyword[0] == '#')
+      continue;
+
+    if(keyword == "pose") {
+      RenderPose pose;
+      if(!(in >> pose.name >> pose.camera_position.x >> pose.camera_position.y >> pose.camera_position.z >>
+           pose.camera_target.x >> pose.camera_target.y >> pose.camera_target.z >> pose.light_position.x >>
+           pose.light_position.y >> pose.light_position.z)) {
+        std::cout << path << ":" << number << ": expected pose <name> <camera x> <y> <z> <target x> <y> <z> "
+                  << "<light x> <y> <z>" << std::endl;
+        return false;
+      }
+      ret_poses.push_back(pose);
+    } else {
+      std::cout << path << ":" << number << ": unknown keyword " << keyword << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+BatchOutput::BatchOutput(JobSystem& jobs, unsigned int width, unsigned int height, const std::string& directory,
+                         unsigned int ring_size, unsigned int encode_buffers)
+  : jobs_(jobs), width_(width), height_(height), directory_(directory), stats_(), ring_(std::max(1u, ring_size)),
+    ring_head_(0), ring_pending_(0), next_encode_(0) {
+  glGenRenderbuffers(1, &color_);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+  glGenFramebuffers(1, &fbo_);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  size_t image_bytes = (size_t)width_ * height_ * 4;
+  for(Readback& readback : ring_) {
+    glGenBuffers(1, &readback.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, image_bytes, NULL, GL_STREAM_READ);
+    readback.fence = 0;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if(encode_buffers == 0)
+    encode_buffers = jobs_.worker_count() + 1;
+  for(unsigned int i = 0; i < encode_buffers; i++) {
+    encodes_.emplace_back(new Encode());
+    Encode& encode = *encodes_.back();
+    encode.owner = this;
+    encode.pixels.resize(image_bytes);
+    encode.busy = false;
+  }
+}
+
+BatchOutput::~BatchOutput() {
+  finish();
+  for(Readback& readback : ring_)
+    glDeleteBuffers(1, &readback.pbo);
+  glDeleteFramebuffers(1, &fbo_);
+  glDeleteRenderbuffers(1, &color_);
+}
+
+bool BatchOutput::is_valid() {
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if(!complete)
+    std::cout << "Incomplete framebuffer: batch output" << std::endl;
+  return complete;
+}
+
+GLuint BatchOutput::framebuffer() const {
+  return fbo_;
+}
+
+void BatchOutput::capture(const std::string& name) {
+  if(ring_pending_ == ring_.size())
+    map_oldest();
+
+  Readback& readback = ring_[(ring_head_ + ring_pending_) % ring_.size()];
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+  glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.name = name;
+  ring_pending_++;
+
+  // Hands over what the GPU already finished, as long as it costs no wait.
+  while(ring_pending_ && encode_ready() && signaled(ring_[ring_head_].fence))
+    map_oldest();
+}
+
+void BatchOutput::finish() {
+  while(ring_pending_)
+    map_oldest();
+  for(auto& encode : encodes_) {
+    if(!encode->busy)
+      continue;
+    auto start = std::chrono::steady_clock::now();
+    jobs_.wait(encode->group);
+    stats_.encode_wait_ms += elapsed_ms(start);
+    collect(*encode);
+  }
+}
+
+const BatchStats& BatchOutput::stats() const {
+  return stats_;
+}
+
+void BatchOutput::EncodeJob(void* data, unsigned int, unsigned int) {
+  Encode& encode = *static_cast<Encode*>(data);
+  BatchOutput& owner = *encode.owner;
+  auto start = std::chrono::steady_clock::now();
+  encode.bytes = 0;
+  encode.written = WritePNG(encode.path.c_str(), encode.pixels.data(), owner.width_, owner.height_, 4, 3, true,
+                            &encode.bytes);
+  encode.ms = elapsed_ms(start);
+}
+
+bool BatchOutput::encode_ready() const {
+  const Encode& encode = *encodes_[next_encode_];
+  return !encode.busy || encode.group.done();
+}
+
+BatchOutput::Encode& BatchOutput::next_encode() {
+  // Round robin, the next buffer is the one encoded longest ago.
+  Encode& encode = *encodes_[next_encode_];
+  next_encode_ = (next_encode_ + 1) % encodes_.size();
+  if(encode.busy) {
+    if(!encode.group.done()) {
+      auto start = std::chrono::steady_clock::now();
+      jobs_.wait(encode.group);
+      stats_.encode_wait_ms += elapsed_ms(start);
+    }
+    collect(encode);
+  }
+  return encode;
+}
+
+void BatchOutput::collect(Encode& encode) {
+  encode.busy = false;
+  stats_.images++;
+  if(!encode.written)
+    stats_.failures++;
+  stats_.bytes += encode.bytes;
+  stats_.encode_ms += encode.ms;
+}
+
+void BatchOutput::map_oldest() {
+  Readback& readback = ring_[ring_head_];
+  if(!signaled(readback.fence)) {
+    stats_.readback_stalls++;
+    auto start = std::chrono::steady_clock::now();
+    GLenum status;
+    do
+      status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    while(status == GL_TIMEOUT_EXPIRED);
+    stats_.readback_wait_ms += elapsed_ms(start);
+  }
+  glDeleteSync(readback.fence);
+  readback.fence = 0;
+
+  Encode& encode = next_encode();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+  const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, encode.pixels.size(), GL_MAP_READ_BIT);
+  if(pixels) {
+    std::memcpy(encode.pixels.data(), pixels, encode.pixels.size());
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  ring_head_ = (ring_head_ + 1) % ring_.size();
+  ring_pending_--;
+
+  if(!pixels) {
+    std::cout << "Failed to map the readback of " << readback.name << std::endl;
+    stats_.images++;
+    stats_.failures++;
+    return;
+  }
+  encode.path = directory_ + "/" + readback.name + ".png";
+  encode.busy = true;
+  jobs_.run(encode.group, &BatchOutput::EncodeJob, &encode);
+}
@@ -0,0 +1,538 @@
+#include <bvh.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const unsigned int BlockWidth = 4;
+const unsigned int BinCount = 12;
+const unsigned int MaxLeafBlocks = 2;
+const unsigned int MaxDepth = 128;
+// Cost of visiting a node relative to testing a block of triangles.
+const float TraversalCost = 1.0f;
+// Triangles below which a build stays serial, and the least a job of a
+// parallel build gets.
+const unsigned int ParallelGrain = 4096;
+// Jobs per worker of a parallel build, more than one so that uneven
+// subtrees even out.
+const unsigned int TasksPerWorker = 4;
+// Node::blocks of a node standing in for a Task.
+const unsigned int Pending = ~0u;
+const unsigned int NoTriangle = ~0u;
+const float Miss = std::numeric_limits<float>::infinity();
+
+float half_area(const glm::vec3& lower, const glm::vec3& upper) {
+  glm::vec3 extent = glm::max(upper - lower, glm::vec3(0.0f));
+  return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+// Distance at which the ray enters the box within [0, max_t], infinity when
+// it misses it.
+float ray_box(const glm::vec3& lower, const glm::vec3& upper, const glm::vec3& origin,
+              const glm::vec3& inverse_direction, float max_t) {
+  glm::vec3 t0 = (lower - origin) * inverse_direction;
+  glm::vec3 t1 = (upper - origin) * inverse_direction;
+  glm::vec3 near = glm::min(t0, t1);
+  glm::vec3 far = glm::max(t0, t1);
+  float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+  float exit = std::min(std::min(far.x, far.y), std::min(far.z, max_t));
+  return enter <= exit ? enter : Miss;
+}
+
+// Axis-parallel rays get a huge instead of an infinite inverse, so slabs
+// the origin lies on do not produce NaNs.
+glm::vec3 inverse_of(const glm::vec3& direction) {
+  glm::vec3 inverse_direction;
+  for(int c = 0; c < 3; c++) {
+    float d = direction[c];
+    inverse_direction[c] = 1.0f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+  }
+  return inverse_direction;
+}
+
+// Whether the box is entirely behind the plane, or entirely in front of it
+// when testing inside.
+bool box_outside(const glm::vec4& plane, const glm::vec3& lower, const glm::vec3& upper) {
+  glm::vec3 farthest(plane.x > 0.0f ? upper.x : lower.x, plane.y > 0.0f ? upper.y : lower.y,
+                     plane.z > 0.0f ? upper.z : lower.z);
+  return glm::dot(glm::vec3(plane), farthest) + plane.w < 0.0f;
+}
+
+bool box_inside(const glm::vec4& plane, const glm::vec3& lower, const glm::vec3& upper) {
+  glm::vec3 nearest(plane.x > 0.0f ? lower.x : upper.x, plane.y > 0.0f ? lower.y : upper.y,
+                    plane.z > 0.0f ? lower.z : upper.z);
+  return glm::dot(glm::vec3(plane), nearest) + plane.w >= 0.0f;
+}
+
+}
+
+TriangleBVH::TriangleBVH() : triangle_count_(0) {}
+
+void TriangleBVH::build(const std::vector<glm::vec3>& triangles) {
+  build(nullptr, triangles);
+}
+
+void TriangleBVH::build(JobSystem& jobs, const std::vector<glm::vec3>& triangles) {
+  build(&jobs, triangles);
+}
+
+void TriangleBVH::build(JobSystem* jobs, const std::vector<glm::vec3>& triangles) {
+  triangle_count_ = triangles.size() / 3;
+  nodes_.clear();
+  blocks_.clear();
+
+  std::vector<Reference> references(triangle_count_);
+  auto make_references = [&](unsigned int begin, unsigned int end) {
+    for(unsigned int t = begin; t < end; t++) {
+      const glm::vec3* corners = &triangles[t * 3];
+      Reference& reference = references[t];
+      reference.lower = glm::min(corners[0], glm::min(corners[1], corners[2]));
+      reference.upper = glm::max(corners[0], glm::max(corners[1], corners[2]));
+      reference.centroid = (reference.lower + reference.upper) * 0.5f;
+      reference.triangle = t;
+    }
+  };
+  if(!triangle_count_)
+    return;
+
+  bool parallel = jobs && jobs->worker_count() && triangle_count_ > ParallelGrain;
+  if(!parallel) {
+    make_references(0, triangle_count_);
+    Subtree tree;
+    tree.nodes.reserve(triangle_count_ / 2 + 1);
+    tree.blocks.reserve(triangle_count_ / 2 + 1);
+    build_node(tree, references, 0, triangle_count_, 0, triangles, nullptr, 0);
+    nodes_.swap(tree.nodes);
+    blocks_.swap(tree.blocks);
+    return;
+  }
+
+  JobGroup group;
+  jobs->parallel_for(group, triangle_count_, ParallelGrain, make_references);
+  jobs->wait(group);
+
+  unsigned int task_size = std::max(ParallelGrain, triangle_count_ / ((jobs->worker_count() + 1) * TasksPerWorker));
+  Subtree top;
+  std::vector<Task> tasks;
+  build_node(top, references, 0, triangle_count_, 0, triangles, &tasks, task_size);
+  auto build_tasks = [&](unsigned int begin, unsigned int end) {
+    for(unsigned int t = begin; t < end; t++) {
+      Task& task = tasks[t];
+      unsigned int count = task.end - task.begin;
+      task.subtree.nodes.reserve(count / 2 + 1);
+      task.subtree.blocks.reserve(count / 2 + 1);
+      build_node(task.subtree, references, task.begin, task.end, task.depth, triangles, nullptr, 0);
+    }
+  };
+  jobs->parallel_for(group, tasks.size(), 1, build_tasks);
+  jobs->wait(group);
+
+  size_t node_total = top.nodes.size(), block_total = top.blocks.size();
+  for(const Task& task : tasks) {
+    node_total += task.subtree.nodes.size();
+    block_total += task.subtree.blocks.size();
+  }
+  nodes_.reserve(node_total);
+  blocks_.reserve(block_total);
+  splice(top, 0, tasks);
+}
+
+unsigned int TriangleBVH::splice(const Subtree& top, unsigned int node, const std::vector<Task>& tasks) {
+  const Node& source = top.nodes[node];
+  unsigned int index = nodes_.size();
+  if(source.blocks == Pending) {
+    const Subtree& subtree = tasks[source.index].subtree;
+    unsigned int block_offset = blocks_.size();
+    for(Node moved : subtree.nodes) {
+      moved.index += moved.blocks ? block_offset : index;
+      nodes_.push_back(moved);
+    }
+    blocks_.insert(blocks_.end(), subtree.blocks.begin(), subtree.blocks.end());
+    return index;
+  }
+
+  nodes_.push_back(source);
+  if(source.blocks) {
+    nodes_[index].index = blocks_.size();
+    blocks_.insert(blocks_.end(), top.blocks.begin() + source.index,
+                   top.blocks.begin() + source.index + source.blocks);
+    return index;
+  }
+  splice(top, node + 1, tasks);
+  unsigned int second = splice(top, source.index, tasks);
+  nodes_[index].index = second;
+  return index;
+}
+
+unsigned int TriangleBVH::build_node(Subtree& subtree, std::vector<Reference>& references, unsigned int begin,
+                                     unsigned int end, unsigned int depth, const std::vector<glm::vec3>& triangles,
+                                     std::vector<Task>* tasks, unsigned int task_size) {
+  std::vector<Node>& nodes = subtree.nodes;
+  unsigned int index = nodes.size();
+  nodes.push_back(Node());
+  glm::vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+  glm::vec3 centroid_lower = lower, centroid_upper = upper;
+  for(unsigned int i = begin; i < end; i++) {
+    lower = glm::min(lower, references[i].lower);
+    upper = glm::max(upper, references[i].upper);
+    centroid_lower = glm::min(centroid_lower, references[i].centroid);
+    centroid_upper = glm::max(centroid_upper, references[i].centroid);
+  }
+  nodes[index].lower = lower;
+  nodes[index].upper = upper;
+
+  unsigned int count = end - begin;
+  if(tasks && count <= task_size) {
+    nodes[index].index = tasks->size();
+    nodes[index].blocks = Pending;
+    tasks->push_back({begin, end, depth, Subtree()});
+    return index;
+  }
+
+  unsigned int split = begin;
+  if(count > BlockWidth) {
+    glm::vec3 extent = centroid_upper - centroid_lower;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    if(extent[axis] > 0.0f) {
+      struct Bin {
+        glm::vec3 lower;
+        glm::vec3 upper;
+        unsigned int count;
+      };
+      Bin bins[BinCount];
+      for(Bin& bin : bins)
+        bin = {glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()), 0};
+      float bin_scale = BinCount / extent[axis];
+      auto bin_of = [&](const Reference& reference) {
+        int b = (int)((reference.centroid[axis] - centroid_lower[axis]) * bin_scale);
+        return (unsigned int)std::min(std::max(b, 0), (int)BinCount - 1);
+      };
+      for(unsigned int i = begin; i < end; i++) {
+        Bin& bin = bins[bin_of(references[i])];
+        bin.lower = glm::min(bin.lower, references[i].lower);
+        bin.upper = glm::max(bin.upper, references[i].upper);
+        bin.count++;
+      }
+
+      // Sweeps from the right, then from the left evaluating each plane.
+      float right_cost[BinCount];
+      glm::vec3 sweep_lower = bins[BinCount - 1].lower, sweep_upper = bins[BinCount - 1].upper;
+      unsigned int sweep_count = 0;
+      for(unsigned int b = BinCount - 1; b > 0; b--) {
+        sweep_lower = glm::min(sweep_lower, bins[b].lower);
+        sweep_upper = glm::max(sweep_upper, bins[b].upper);
+        sweep_count += bins[b].count;
+        right_cost[b] = sweep_count ? half_area(sweep_lower, sweep_upper) * sweep_count : 0.0f;
+      }
+      float best_cost = std::numeric_limits<float>::max();
+      unsigned int best_plane = 0;
+      sweep_lower = bins[0].lower;
+      sweep_upper = bins[0].upper;
+      sweep_count = 0;
+      for(unsigned int b = 1; b < BinCount; b++) {
+        sweep_lower = glm::min(sweep_lower, bins[b - 1].lower);
+        sweep_upper = glm::max(sweep_upper, bins[b - 1].upper);
+        sweep_count += bins[b - 1].count;
+        if(!sweep_count || sweep_count == count)
+          continue;
+        float cost = half_area(sweep_lower, sweep_upper) * sweep_count + right_cost[b];
+        if(cost < best_cost) {
+          best_cost = cost;
+          best_plane = b;
+        }
+      }
+
+      float leaf_cost = half_area(lower, upper) * count;
+      bool small = count <= BlockWidth * MaxLeafBlocks;
+      if(best_plane && !(small && leaf_cost <= TraversalCost * half_area(lower, upper) * BlockWidth + best_cost)) {
+        auto left = [&](const Reference& reference) { return bin_of(reference) < best_plane; };
+        Reference* middle = std::partition(&references[begin], &references[0] + end, left);
+        split = middle - &references[0];
+      }
+    }
+    // Coincident centroids, halve the range unless it fits a leaf. Deep
+    // down halving also bounds the depth the traversal stack has to hold.
+    if(((split == begin || split == end) && count > BlockWidth * MaxLeafBlocks) || depth + 2 >= MaxDepth)
+      split = begin + count / 2;
+  }
+
+  if(split == begin || split == end) {
+    nodes[index].index = subtree.blocks.size();
+    nodes[index].blocks = (count + BlockWidth - 1) / BlockWidth;
+    for(unsigned int first = begin; first < end; first += BlockWidth) {
+      Block block = {};
+      for(unsigned int lane = 0; lane < BlockWidth; lane++)
+        block.triangle[lane] = NoTriangle;
+      for(unsigned int lane = 0; lane < BlockWidth && first + lane < end; lane++) {
+        block.triangle[lane] = references[first + lane].triangle;
+        const glm::vec3* corners = &triangles[references[first + lane].triangle * 3];
+        glm::vec3 e1 = corners[1] - corners[0];
+        glm::vec3 e2 = corners[2] - corners[0];
+        for(int c = 0; c < 3; c++) {
+          block.v0[c][lane] = corners[0][c];
+          block.e1[c][lane] = e1[c];
+          block.e2[c][lane] = e2[c];
+        }
+      }
+      subtree.blocks.push_back(block);
+    }
+    return index;
+  }
+
+  build_node(subtree, references, begin, split, depth + 1, triangles, tasks, task_size);
+  unsigned int second = build_node(subtree, references, split, end, depth + 1, triangles, tasks, task_size);
+  nodes[index].index = second;
+  nodes[index].blocks = 0;
+  return index;
+}
+
+bool TriangleBVH::occluded(const glm::vec3& origin, const glm::vec3& direction, float max_t) const {
+  if(nodes_.empty())
+    return false;
+  glm::vec3 inverse_direction = inverse_of(direction);
+
+  unsigned int stack[MaxDepth];
+  unsigned int size = 0;
+  unsigned int node = 0;
+  while(true) {
+    const Node& current = nodes_[node];
+    if(ray_box(current.lower, current.upper, origin, inverse_direction, max_t) != Miss) {
+      if(!current.blocks) {
+        stack[size++] = current.index;
+        node++;
+        continue;
+      }
+      for(unsigned int b = current.index; b < current.index + current.blocks; b++)
+        if(test_block(blocks_[b], origin, direction, max_t, nullptr, nullptr, nullptr))
+          return true;
+    }
+    if(!size)
+      return false;
+    node = stack[--size];
+  }
+}
+
+bool TriangleBVH::intersect(const glm::vec3& origin, const glm::vec3& direction, float max_t,
+                            RayHit& ret_hit) const {
+  ret_hit.t = max_t;
+  ret_hit.triangle = NoTriangle;
+  if(nodes_.empty())
+    return false;
+  glm::vec3 inverse_direction = inverse_of(direction);
+
+  // Subtrees are pushed with the distance at which the ray enters them.
+  struct Entry {
+    unsigned int node;
+    float enter;
+  };
+  Entry stack[MaxDepth];
+  unsigned int size = 0;
+  Entry entry = {0, ray_box(nodes_[0].lower, nodes_[0].upper, origin, inverse_direction, max_t)};
+  if(entry.enter == Miss)
+    return false;
+  while(true) {
+    if(entry.enter < ret_hit.t) {
+      const Node& current = nodes_[entry.node];
+      if(!current.blocks) {
+        const Node& first = nodes_[entry.node + 1];
+        const Node& second = nodes_[current.index];
+        float first_enter = ray_box(first.lower, first.upper, origin, inverse_direction, ret_hit.t);
+        float second_enter = ray_box(second.lower, second.upper, origin, inverse_direction, ret_hit.t);
+        Entry near = {entry.node + 1, first_enter}, far = {current.index, second_enter};
+        if(second_enter < first_enter)
+          std::swap(near, far);
+        if(near.enter != Miss) {
+          if(far.enter != Miss)
+            stack[size++] = far;
+          entry = near;
+          continue;
+        }
+      } else {
+        float t[BlockWidth], u[BlockWidth], v[BlockWidth];
+        for(unsigned int b = current.index; b < current.index + current.blocks; b++) {
+          unsigned int lanes = test_block(blocks_[b], origin, direction, ret_hit.t, t, u, v);
+          for(unsigned int lane = 0; lanes; lane++, lanes >>= 1) {
+            if(!(lanes & 1) || t[lane] >= ret_hit.t)
+              continue;
+            ret_hit = {t[lane], blocks_[b].triangle[lane], u[lane], v[lane]};
+          }
+        }
+      }
+    }
+    if(!size)
+      return ret_hit.triangle != NoTriangle;
+    entry = stack[--size];
+  }
+}
+
+void TriangleBVH::frustum(const glm::vec4* planes, unsigned int plane_count,
+                          std::vector<unsigned int>& ret_triangles) const {
+  if(nodes_.empty())
+    return;
+  plane_count = std::min(plane_count, MaxPlanes);
+
+  // Each subtree carries the planes it is not yet known to be inside of.
+  struct Entry {
+    unsigned int node;
+    unsigned int planes;
+  };
+  Entry stack[MaxDepth];
+  unsigned int size = 0;
+  Entry entry = {0, plane_count == 32 ? ~0u : (1u << plane_count) - 1};
+  while(true) {
+    const Node& current = nodes_[entry.node];
+    bool outside = false;
+    for(unsigned int p = 0; p < plane_count && !outside; p++) {
+      if(!(entry.planes & (1u << p)))
+        continue;
+      outside = box_outside(planes[p], current.lower, current.upper);
+      if(box_inside(planes[p], current.lower, current.upper))
+        entry.planes &= ~(1u << p);
+    }
+    if(!outside) {
+      if(!current.blocks) {
+        stack[size++] = {current.index, entry.planes};
+        entry.node++;
+        continue;
+      }
+      for(unsigned int b = current.index; b < current.index + current.blocks; b++) {
+        const Block& block = blocks_[b];
+        // A triangle is culled when its three corners are behind one plane.
+        unsigned int culled = 0;
+        for(unsigned int p = 0; p < plane_count; p++) {
+          if(!(entry.planes & (1u << p)))
+            continue;
+          const glm::vec4& plane = planes[p];
+#if defined(__SSE2__) || defined(_M_X64)
+          __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+          __m128 d0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(block.v0[0])),
+                                            _mm_mul_ps(ny, _mm_loadu_ps(block.v0[1]))),
+                                 _mm_add_ps(_mm_mul_ps(nz, _mm_loadu_ps(block.v0[2])), _mm_set1_ps(plane.w)));
+          __m128 d1 = _mm_add_ps(d0, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(block.e1[0])),
+                                                           _mm_mul_ps(ny, _mm_loadu_ps(block.e1[1]))),
+                                                _mm_mul_ps(nz, _mm_loadu_ps(block.e1[2]))));
+          __m128 d2 = _mm_add_ps(d0, _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(block.e2[0])),
+                                                           _mm_mul_ps(ny, _mm_loadu_ps(block.e2[1]))),
+                                                _mm_mul_ps(nz, _mm_loadu_ps(block.e2[2]))));
+          __m128 zero = _mm_setzero_ps();
+          culled |= _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(d0, zero),
+                                               _mm_and_ps(_mm_cmplt_ps(d1, zero), _mm_cmplt_ps(d2, zero))));
+#else
+          for(unsigned int lane = 0; lane < BlockWidth; lane++) {
+            glm::vec3 v0(block.v0[0][lane], block.v0[1][lane], block.v0[2][lane]);
+            glm::vec3 e1(block.e1[0][lane], block.e1[1][lane], block.e1[2][lane]);
+            glm::vec3 e2(block.e2[0][lane], block.e2[1][lane], block.e2[2][lane]);
+            float d0 = glm::dot(glm::vec3(plane), v0) + plane.w;
+            float d1 = d0 + glm::dot(glm::vec3(plane), e1);
+            float d2 = d0 + glm::dot(glm::vec3(plane), e2);
+            if(d0 < 0.0f && d1 < 0.0f && d2 < 0.0f)
+              culled |= 1u << lane;
+          }
+#endif
+        }
+        for(unsigned int lane = 0; lane < BlockWidth; lane++)
+          if(!(culled & (1u << lane)) && block.triangle[lane] != NoTriangle)
+            ret_triangles.push_back(block.triangle[lane]);
+      }
+    }
+    if(!size)
+      return;
+    entry = stack[--size];
+  }
+}
+
+// Moller-Trumbore on four triangles at once.
+unsigned int TriangleBVH::test_block(const Block& block, const glm::vec3& origin, const glm::vec3& direction,
+                                     float max_t, float* ret_t, float* ret_u, float* ret_v) const {
+  const float epsilon = 1e-9f;
+#if defined(__SSE2__) || defined(_M_X64)
+  __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+  __m128 e1x = _mm_loadu_ps(block.e1[0]), e1y = _mm_loadu_ps(block.e1[1]), e1z = _mm_loadu_ps(block.e1[2]);
+  __m128 e2x = _mm_loadu_ps(block.e2[0]), e2y = _mm_loadu_ps(block.e2[1]), e2z = _mm_loadu_ps(block.e2[2]);
+
+  // p = direction x e2
+  __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+  __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+  __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+  __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+  __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+  __m128 valid = _mm_cmpgt_ps(abs_det, _mm_set1_ps(epsilon));
+  __m128 inverse_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+  __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_loadu_ps(block.v0[0]));
+  __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_loadu_ps(block.v0[1]));
+  __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_loadu_ps(block.v0[2]));
+  __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)),
+                        inverse_det);
+
+  // q = s x e1
+  __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+  __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+  __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+  __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+                        inverse_det);
+  __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)),
+                        inverse_det);
+
+  __m128 zero = _mm_setzero_ps();
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+  valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, zero));
+  valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(max_t)));
+  unsigned int lanes = _mm_movemask_ps(valid);
+  if(lanes && ret_t) {
+    _mm_storeu_ps(ret_t, t);
+    _mm_storeu_ps(ret_u, u);
+    _mm_storeu_ps(ret_v, v);
+  }
+  return lanes;
+#else
+  unsigned int lanes = 0;
+  for(unsigned int lane = 0; lane < BlockWidth; lane++) {
+    glm::vec3 e1(block.e1[0][lane], block.e1[1][lane], block.e1[2][lane]);
+    glm::vec3 e2(block.e2[0][lane], block.e2[1][lane], block.e2[2][lane]);
+    glm::vec3 p = glm::cross(direction, e2);
+    float det = glm::dot(e1, p);
+    if(std::abs(det) <= epsilon)
+      continue;
+    float inverse_det = 1.0f / det;
+    glm::vec3 s = origin - glm::vec3(block.v0[0][lane], block.v0[1][lane], block.v0[2][lane]);
+    float u = glm::dot(s, p) * inverse_det;
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(direction, q) * inverse_det;
+    float t = glm::dot(e2, q) * inverse_det;
+    if(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < max_t) {
+      lanes |= 1u << lane;
+      if(ret_t) {
+        ret_t[lane] = t;
+        ret_u[lane] = u;
+        ret_v[lane] = v;
+      }
+    }
+  }
+  return lanes;
+#endif
+}
+
+glm::vec3 TriangleBVH::lower() const {
+  return nodes_.empty() ? glm::vec3(std::numeric_limits<float>::max()) : nodes_[0].lower;
+}
+
+glm::vec3 TriangleBVH::upper() const {
+  return nodes_.empty() ? glm::vec3(-std::numeric_limits<float>::max()) : nodes_[0].upper;
+}
+
+unsigned int TriangleBVH::triangle_count() const {
+  return triangle_count_;
+}
+
+unsigned int TriangleBVH::node_count() const {
+  return nodes_.size();
+}
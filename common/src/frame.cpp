@@ -0,0 +1,571 @@
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <frame.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+
+const unsigned int InstanceGrain = 256;
+// Cascades past the second one are rendered every 2nd, 4th, ... frame.
+const unsigned int FullRateCascades = 2;
+// How far the point light may be from where the lightmap was baked.
+const float LightmapTolerance = 1e-4f;
+
+// Gribb-Hartmann plane extraction, normals point inwards.
+void extract_frustum(const glm::mat4& m, glm::vec4 planes[6]) {
+  glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+  planes[0] = row3 + row0;
+  planes[1] = row3 - row0;
+  planes[2] = row3 + row1;
+  planes[3] = row3 - row1;
+  planes[4] = row3 + row2;
+  planes[5] = row3 - row2;
+  for(int i = 0; i < 6; i++)
+    planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool sphere_in_frustum(const glm::vec4 planes[6], const glm::vec3& center, float radius) {
+  for(int i = 0; i < 6; i++)
+    if(glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+      return false;
+  return true;
+}
+
+float max_scale(const glm::mat4& m) {
+  return std::max(glm::length(glm::vec3(m[0])),
+                  std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+}
+
+// Most ranges cull_meshlets writes for any level of the model.
+unsigned int max_ranges(const Model& model) {
+  unsigned int count = 1;
+  for(unsigned int lod = 0; lod < model.lod_count(); lod++)
+    count = std::max(count, std::max(model.lod(lod).meshlet_count, model.lod(lod).part_count));
+  return count;
+}
+
+// Writes the runs of consecutive meshlets of a level that intersect the
+// frustum and do not face away from the viewer to ret_ranges and returns
+// their number. Runs do not cross parts, so ranges come sorted by material.
+// viewer is a position, or the view direction when orthographic. Instances
+// are expected to scale uniformly.
+unsigned int cull_meshlets(const Model& model, unsigned int lod, const glm::mat4& transform, float scale,
+                           const glm::vec4 planes[6], const glm::vec3& viewer, bool orthographic,
+                           Model::Range* ret_ranges, CullStats& stats) {
+  const Model::Lod& level = model.lod(lod);
+  const Model::Part* parts = model.parts().data() + level.first_part;
+  stats.triangles += level.count / 3;
+  if(!level.meshlet_count) {
+    stats.meshlets++;
+    for(unsigned int p = 0; p < level.part_count; p++)
+      ret_ranges[p] = {parts[p].first, parts[p].count, parts[p].material};
+    return level.part_count;
+  }
+
+  stats.meshlets += level.meshlet_count;
+  const Meshlet* meshlets = model.meshlets().data();
+  unsigned int count = 0;
+  for(unsigned int p = 0; p < level.part_count; p++) {
+    const Model::Part& part = parts[p];
+    unsigned int part_start = count;
+    for(unsigned int m = part.first_meshlet; m < part.first_meshlet + part.meshlet_count; m++) {
+      const Meshlet& meshlet = meshlets[m];
+      glm::vec3 center = glm::vec3(transform * glm::vec4(meshlet.center, 1.0f));
+      if(!sphere_in_frustum(planes, center, meshlet.radius * scale)) {
+        stats.frustum_culled += meshlet.count / 3;
+        continue;
+      }
+      if(meshlet.cone_cutoff <= 1.0f) {
+        glm::vec3 axis = glm::mat3(transform) * meshlet.cone_axis / scale;
+        glm::vec3 direction = orthographic ? viewer :
+          glm::normalize(glm::vec3(transform * glm::vec4(meshlet.cone_apex, 1.0f)) - viewer);
+        if(glm::dot(direction, axis) >= meshlet.cone_cutoff) {
+          stats.backface_culled += meshlet.count / 3;
+          continue;
+        }
+      }
+      if(count > part_start && ret_ranges[count - 1].first + ret_ranges[count - 1].count == meshlet.first)
+        ret_ranges[count - 1].count += meshlet.count;
+      else
+        ret_ranges[count++] = {meshlet.first, meshlet.count, part.material};
+    }
+  }
+  return count;
+}
+
+}
+
+glm::quat InstanceRotation(const glm::vec3& axis, float angle) {
+  if(angle == 0.0f)
+    return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+  return glm::angleAxis(glm::radians(angle), glm::normalize(axis));
+}
+
+void InstanceTransforms(const Scene& scene, std::vector<glm::mat4>& ret_transforms) {
+  unsigned int count = scene.instances.size();
+  ret_transforms.resize(count);
+  for(unsigned int i = 0; i < count; i++) {
+    const Instance& instance = scene.instances[i];
+    glm::mat4 transform = glm::translate(glm::mat4(1.0f), instance.position);
+    if(instance.angle != 0.0f)
+      transform = glm::rotate(transform, glm::radians(instance.angle), glm::normalize(instance.axis));
+    transform = glm::scale(transform, glm::vec3(instance.scale));
+    if(instance.parent != TransformSystem::NoParent)
+      transform = ret_transforms[instance.parent] * transform;
+    ret_transforms[i] = transform;
+  }
+}
+
+FramePipeline::FramePipeline(JobSystem& jobs, Scene& scene, const FrameSettings& settings)
+  : jobs_(jobs), scene_(scene), settings_(settings), pending_commands_(nullptr), casters_baked_(false),
+    frame_index_(0), last_sun_direction_(0.0f), last_cascade_count_(0), scratch_(nullptr) {}
+
+FramePipeline::Scratch::Scratch(FrameArena& arena, const Scene& scene, bool point_light,
+                                unsigned int cascade_count)
+  : meshlet_offsets(scene.instances.size(), FrameAllocator<unsigned int>(arena)),
+    meshlet_total(0),
+    lit_total(0),
+    slots(scene.instances.size(), FrameAllocator<unsigned int>(arena)),
+    lit_pending(FrameAllocator<PendingDraw>(arena)),
+    unlit_pending(FrameAllocator<PendingDraw>(arena)) {
+  unsigned int count = scene.instances.size();
+  for(unsigned int i = 0; i < count; i++) {
+    meshlet_offsets[i] = meshlet_total;
+    meshlet_total += max_ranges(*scene.instances[i].model);
+    lit_total += scene.instances[i].materials ? scene.instances[i].model->material_count() : 1;
+  }
+
+  view.allocate(arena, count, meshlet_total);
+  lit_pending.reserve(lit_total);
+  unlit_pending.reserve(count);
+  for(unsigned int f = 0; f < FrameCommands::CubeFaces && point_light; f++) {
+    shadow[f].allocate(arena, count, meshlet_total);
+    shadow_pending[f] = FrameVector<PendingDraw>(FrameAllocator<PendingDraw>(arena));
+    shadow_pending[f].reserve(count);
+  }
+  for(unsigned int c = 0; c < cascade_count; c++) {
+    cascades[c].allocate(arena, count, meshlet_total);
+    cascade_pending[c] = FrameVector<PendingDraw>(FrameAllocator<PendingDraw>(arena));
+    cascade_pending[c].reserve(count);
+  }
+}
+
+void FramePipeline::Scratch::Visible::allocate(FrameArena& arena, unsigned int count, size_t range_capacity) {
+  ranges = FrameVector<Model::Range>(range_capacity, FrameAllocator<Model::Range>(arena));
+  range_counts = FrameVector<unsigned int>(count, 0u, FrameAllocator<unsigned int>(arena));
+}
+
+void FramePipeline::Scratch::Visible::add(const CullStats& stats) {
+  meshlets += stats.meshlets;
+  triangles += stats.triangles;
+  frustum_culled += stats.frustum_culled;
+  backface_culled += stats.backface_culled;
+}
+
+CullStats FramePipeline::Scratch::Visible::stats() const {
+  CullStats stats = {meshlets, triangles, frustum_culled, backface_culled};
+  return stats;
+}
+
+void FramePipeline::build(const FrameInput& input, FrameCommands& commands) {
+  auto start = std::chrono::steady_clock::now();
+
+  glm::mat4 rotate_camera =
+    glm::rotate(glm::mat4(1.0f), glm::radians(input.camera_angle), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 rotate_light =
+    glm::rotate(glm::mat4(1.0f), glm::radians(input.light_angle), glm::vec3(0.0f, 1.0f, 0.0f));
+
+  commands.camera_position = glm::vec3(rotate_camera * glm::vec4(scene_.camera_position, 1));
+  commands.light_position = glm::vec3(rotate_light * glm::vec4(scene_.light_position, 1));
+  commands.projection = glm::perspective(settings_.fov, settings_.aspect, settings_.near, settings_.far);
+  glm::vec3 target = glm::vec3(rotate_camera * glm::vec4(scene_.camera_target, 1));
+  commands.view = glm::lookAt(commands.camera_position, target, glm::vec3(0, 1, 0));
+  commands.shadow_far = settings_.shadow_far;
+
+  const glm::vec3& light = commands.light_position;
+  bool point_light = scene_.light == Scene::Light::Point;
+  commands.lightmapped = scene_.lightmap_baked && point_light &&
+    glm::distance(light, scene_.lightmap_light_position) < LightmapTolerance;
+  // Static casters only stay out of the shadow map while every lit instance
+  // finds their shadows in its lightmap.
+  casters_baked_ = commands.lightmapped &&
+    std::none_of(scene_.instances.begin(), scene_.instances.end(), [](const Instance& instance) {
+      return (instance.flags & Instance::Lit) && instance.lightmap.x <= 0.0f;
+    });
+  glm::mat4 shadow_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, settings_.shadow_far);
+  commands.shadow_transforms[0] = shadow_projection *
+    glm::lookAt(light, light + glm::vec3( 1.0, 0.0, 0.0), glm::vec3(0.0,-1.0, 0.0));
+  commands.shadow_transforms[1] = shadow_projection *
+    glm::lookAt(light, light + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0,-1.0, 0.0));
+  commands.shadow_transforms[2] = shadow_projection *
+    glm::lookAt(light, light + glm::vec3( 0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
+  commands.shadow_transforms[3] = shadow_projection *
+    glm::lookAt(light, light + glm::vec3( 0.0,-1.0, 0.0), glm::vec3(0.0, 0.0,-1.0));
+  commands.shadow_transforms[4] = shadow_projection *
+    glm::lookAt(light, light + glm::vec3( 0.0, 0.0, 1.0), glm::vec3(0.0,-1.0, 0.0));
+  commands.shadow_transforms[5] = shadow_projection *
+    glm::lookAt(light, light + glm::vec3( 0.0, 0.0,-1.0), glm::vec3(0.0,-1.0, 0.0));
+
+  extract_frustum(commands.projection * commands.view, frustum_);
+  for(unsigned int f = 0; f < FrameCommands::CubeFaces; f++)
+    extract_frustum(commands.shadow_transforms[f], shadow_frustums_[f]);
+  fit_cascades(input, commands);
+
+  unsigned int count = scene_.instances.size();
+  arena_.reset();
+  Scratch scratch(arena_, scene_, point_light, commands.cascade_count);
+  scratch_ = &scratch;
+
+  if(transforms_.size() != count) {
+    transforms_.resize(count);
+    Pose unset = {glm::vec3(0.0f), glm::vec3(0.0f), std::numeric_limits<float>::quiet_NaN(), 0.0f};
+    poses_.assign(count, unset);
+    parents_.assign(count, TransformSystem::NoParent);
+  }
+  for(unsigned int i = 0; i < count; i++) {
+    if(parents_[i] != scene_.instances[i].parent) {
+      parents_[i] = scene_.instances[i].parent;
+      transforms_.set_parent(i, parents_[i]);
+    }
+  }
+  {
+    JobGroup group;
+    auto sync = [this, &commands](unsigned int begin, unsigned int end) {
+      sync_transforms(commands, begin, end);
+    };
+    jobs_.parallel_for(group, count, InstanceGrain, sync);
+    jobs_.wait(group);
+  }
+  transforms_.update(jobs_);
+
+  {
+    JobGroup group;
+    auto update = [this, &commands](unsigned int begin, unsigned int end) {
+      update_instances(commands, begin, end);
+    };
+    jobs_.parallel_for(group, count, InstanceGrain, update);
+    jobs_.wait(group);
+  }
+  CullStats none = {0, 0, 0, 0};
+  commands.view_culling = scratch.view.stats();
+  for(unsigned int f = 0; f < FrameCommands::CubeFaces; f++)
+    commands.shadow_culling[f] = point_light ? scratch.shadow[f].stats() : none;
+  for(unsigned int c = 0; c < FrameCommands::MaxCascades; c++)
+    commands.cascade_culling[c] = c < commands.cascade_count ? scratch.cascades[c].stats() : none;
+
+  // Reserving the worst case keeps camera motion from growing the commands.
+  commands.transforms.clear();
+  commands.transforms.reserve(count);
+  commands.lightmaps.clear();
+  commands.lightmaps.reserve(count);
+  for(unsigned int i = 0; i < count; i++) {
+    bool drawn = scratch.view.range_counts[i] > 0;
+    for(unsigned int f = 0; f < FrameCommands::CubeFaces && point_light && !drawn; f++)
+      drawn = scratch.shadow[f].range_counts[i] > 0;
+    for(unsigned int c = 0; c < commands.cascade_count && !drawn; c++)
+      drawn = scratch.cascades[c].range_counts[i] > 0;
+    if(!drawn)
+      continue;
+    scratch.slots[i] = commands.transforms.size();
+    commands.transforms.push_back(transforms_.world(i));
+    commands.lightmaps.push_back(commands.lightmapped ? scene_.instances[i].lightmap : glm::vec4(0.0f));
+  }
+
+  {
+    JobGroup group;
+    const unsigned int faces = FrameCommands::CubeFaces;
+    auto compact = [this, &commands](unsigned int begin, unsigned int) {
+      if(begin < faces)
+        compact_shadow(commands, begin);
+      else if(begin == faces)
+        compact_visible(commands);
+      else
+        compact_cascade(commands, begin - faces - 1);
+    };
+    jobs_.parallel_for(group, faces + 1 + commands.cascade_count, 1, compact);
+    jobs_.wait(group);
+  }
+
+  scratch_ = nullptr;
+  frame_index_++;
+  commands.build_ms =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FramePipeline::build_async(const FrameInput& input, FrameCommands& commands) {
+  pending_input_ = input;
+  pending_commands_ = &commands;
+  jobs_.run(group_, &FramePipeline::build_job, this);
+}
+
+void FramePipeline::wait() {
+  jobs_.wait(group_);
+}
+
+void FramePipeline::build_job(void* data, unsigned int, unsigned int) {
+  FramePipeline* pipeline = static_cast<FramePipeline*>(data);
+  pipeline->build(pipeline->pending_input_, *pipeline->pending_commands_);
+}
+
+// Practical split scheme: a blend of logarithmic and uniform splits of the
+// view depth. Each slice of the view frustum is enclosed in a sphere so the
+// cascade size does not change as the camera turns, and the box center is
+// snapped to whole texels so the shadow edges do not shimmer when it moves.
+void FramePipeline::fit_cascades(const FrameInput& input, FrameCommands& commands) {
+  commands.directional = scene_.light == Scene::Light::Directional;
+  commands.cascade_count = commands.directional ? std::min(settings_.cascade_count, FrameCommands::MaxCascades) : 0;
+  if(!commands.directional)
+    return;
+
+  glm::mat4 rotate_light =
+    glm::rotate(glm::mat4(1.0f), glm::radians(input.light_angle), glm::vec3(0.0f, 1.0f, 0.0f));
+  commands.sun_direction = glm::normalize(glm::vec3(rotate_light * glm::vec4(scene_.sun_direction, 0.0f)));
+  bool invalidated = frame_index_ == 0 || commands.sun_direction != last_sun_direction_ ||
+    commands.cascade_count != last_cascade_count_;
+  last_sun_direction_ = commands.sun_direction;
+  last_cascade_count_ = commands.cascade_count;
+
+  glm::vec3 up = std::abs(commands.sun_direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  light_view_ = glm::lookAt(glm::vec3(0.0f), -commands.sun_direction, up);
+
+  glm::mat4 inverse_view = glm::inverse(commands.view);
+  float tan_y = std::tan(settings_.fov * 0.5f);
+  float tan_x = tan_y * settings_.aspect;
+  float near = settings_.near;
+  float far = std::min(settings_.far, settings_.cascade_distance);
+
+  float previous_split = near;
+  for(unsigned int c = 0; c < commands.cascade_count; c++) {
+    float t = (float)(c + 1) / commands.cascade_count;
+    float split = settings_.cascade_split_lambda * near * std::pow(far / near, t) +
+      (1.0f - settings_.cascade_split_lambda) * (near + (far - near) * t);
+
+    unsigned int interval = c < FullRateCascades ? 1 : 1u << (c - FullRateCascades + 1);
+    commands.cascade_updated[c] = invalidated || (frame_index_ + c) % interval == 0;
+    if(!commands.cascade_updated[c]) {
+      commands.cascade_matrices[c] = cascade_matrices_[c];
+      previous_split = split;
+      continue;
+    }
+
+    glm::vec3 corners[8];
+    glm::vec3 center(0.0f);
+    for(int i = 0; i < 8; i++) {
+      float depth = i < 4 ? previous_split : split;
+      glm::vec4 corner(depth * tan_x * (i & 1 ? 1.0f : -1.0f), depth * tan_y * (i & 2 ? 1.0f : -1.0f), -depth, 1.0f);
+      corners[i] = glm::vec3(inverse_view * corner);
+      center += corners[i] / 8.0f;
+    }
+    float radius = 0.0f;
+    for(const glm::vec3& corner : corners)
+      radius = std::max(radius, glm::distance(center, corner));
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    Cascade& cascade = cascades_[c];
+    float texel = 2.0f * radius / settings_.cascade_resolution;
+    cascade.center = glm::vec3(light_view_ * glm::vec4(center, 1.0f));
+    cascade.center.x = std::floor(cascade.center.x / texel) * texel;
+    cascade.center.y = std::floor(cascade.center.y / texel) * texel;
+    cascade.radius = radius;
+    // Casters between the slice and the sun still throw shadows into it.
+    cascade.depth = radius + settings_.cascade_distance;
+
+    glm::mat4 projection = glm::ortho(cascade.center.x - radius, cascade.center.x + radius,
+                                      cascade.center.y - radius, cascade.center.y + radius,
+                                      -(cascade.center.z + cascade.depth), -(cascade.center.z - radius));
+    cascade_matrices_[c] = commands.cascade_matrices[c] = projection * light_view_;
+    extract_frustum(cascade_matrices_[c], cascade_frustums_[c]);
+    previous_split = split;
+  }
+}
+
+void FramePipeline::sync_transforms(const FrameCommands& commands, unsigned int begin, unsigned int end) {
+  for(unsigned int i = begin; i < end; i++) {
+    const Instance& instance = scene_.instances[i];
+    Pose pose = {instance.flags & Instance::AtLight ? commands.light_position : instance.position,
+                 instance.axis, instance.angle, instance.scale};
+    Pose& last = poses_[i];
+    // NaN angles of unset poses never compare equal.
+    if(pose.position == last.position && pose.axis == last.axis && pose.angle == last.angle &&
+       pose.scale == last.scale)
+      continue;
+    last = pose;
+    transforms_.set(i, pose.position, InstanceRotation(pose.axis, pose.angle), pose.scale);
+  }
+}
+
+void FramePipeline::update_instances(const FrameCommands& commands, unsigned int begin, unsigned int end) {
+  Scratch& scratch = *scratch_;
+  float projection_scale = LodProjectionScale(settings_.fov, settings_.viewport_height);
+  float shadow_projection_scale = LodProjectionScale(glm::radians(90.0f), settings_.shadow_resolution);
+  bool point_light = !commands.directional;
+
+  // Summed over the range and added once, the counters are shared.
+  CullStats view_stats = {0, 0, 0, 0};
+  CullStats shadow_stats[FrameCommands::CubeFaces] = {};
+  CullStats cascade_stats[FrameCommands::MaxCascades] = {};
+
+  for(unsigned int i = begin; i < end; i++) {
+    const Instance& instance = scene_.instances[i];
+    const Model& model = *instance.model;
+    const glm::mat4& transform = transforms_.world(i);
+    unsigned int first_range = scratch.meshlet_offsets[i];
+
+    // A model whose upload failed has no levels to draw.
+    if(!model.lod_count()) {
+      scratch.view.range_counts[i] = 0;
+      for(unsigned int f = 0; f < FrameCommands::CubeFaces && point_light; f++)
+        scratch.shadow[f].range_counts[i] = 0;
+      for(unsigned int c = 0; c < commands.cascade_count; c++)
+        if(commands.cascade_updated[c])
+          scratch.cascades[c].range_counts[i] = 0;
+      continue;
+    }
+
+    float scale = max_scale(transform);
+    glm::vec3 center = glm::vec3(transform * glm::vec4(model.center_, 1.0f));
+    float radius = model.radius_ * scale;
+
+    // One LOD for all six faces, the faces only differ in their frustum.
+    // Baked casters are already in the lightmaps.
+    if(point_light) {
+      int lod = -1;
+      bool baked = casters_baked_ && (instance.flags & Instance::Static);
+      if((instance.flags & Instance::CastsShadow) && !baked &&
+         glm::distance(center, commands.light_position) - radius < settings_.shadow_far)
+        lod = model.select_lod(transform, commands.light_position, shadow_projection_scale,
+                               settings_.shadow_lod_pixel_error);
+      for(unsigned int f = 0; f < FrameCommands::CubeFaces; f++) {
+        Scratch::Visible& visible = scratch.shadow[f];
+        visible.range_counts[i] = 0;
+        if(lod >= 0 && sphere_in_frustum(shadow_frustums_[f], center, radius))
+          visible.range_counts[i] = cull_meshlets(model, lod, transform, scale, shadow_frustums_[f],
+                                                  commands.light_position, false, &visible.ranges[first_range],
+                                                  shadow_stats[f]);
+      }
+    }
+
+    scratch.view.range_counts[i] = 0;
+    if((instance.flags & (Instance::Lit | Instance::Unlit)) && sphere_in_frustum(frustum_, center, radius)) {
+      unsigned int lod = model.select_lod(transform, commands.camera_position, projection_scale,
+                                          settings_.lod_pixel_error);
+      scratch.view.range_counts[i] = cull_meshlets(model, lod, transform, scale, frustum_, commands.camera_position,
+                                                   false, &scratch.view.ranges[first_range], view_stats);
+    }
+
+    for(unsigned int c = 0; c < commands.cascade_count; c++) {
+      if(!commands.cascade_updated[c])
+        continue;
+      const Cascade& cascade = cascades_[c];
+      Scratch::Visible& visible = scratch.cascades[c];
+      visible.range_counts[i] = 0;
+      glm::vec3 offset = glm::vec3(light_view_ * glm::vec4(center, 1.0f)) - cascade.center;
+      if(!(instance.flags & Instance::CastsShadow) ||
+         std::abs(offset.x) > cascade.radius + radius || std::abs(offset.y) > cascade.radius + radius ||
+         offset.z - radius > cascade.depth || offset.z + radius < -cascade.radius)
+        continue;
+      float pixels_per_unit = settings_.cascade_resolution / (2.0f * cascade.radius);
+      unsigned int lod = model.select_lod_ortho(transform, pixels_per_unit, settings_.shadow_lod_pixel_error);
+      visible.range_counts[i] = cull_meshlets(model, lod, transform, scale, cascade_frustums_[c],
+                                              -commands.sun_direction, true,
+                                              &visible.ranges[first_range], cascade_stats[c]);
+    }
+  }
+
+  scratch.view.add(view_stats);
+  for(unsigned int f = 0; f < FrameCommands::CubeFaces && point_light; f++)
+    scratch.shadow[f].add(shadow_stats[f]);
+  for(unsigned int c = 0; c < commands.cascade_count; c++)
+    scratch.cascades[c].add(cascade_stats[c]);
+}
+
+void FramePipeline::compact_shadow(FrameCommands& commands, unsigned int face) {
+  Scratch& scratch = *scratch_;
+  FrameVector<PendingDraw>& pending = scratch.shadow_pending[face];
+  if(!commands.directional) {
+    const Scratch::Visible& visible = scratch.shadow[face];
+    for(unsigned int i = 0; i < scene_.instances.size(); i++) {
+      if(!visible.range_counts[i])
+        continue;
+      // Depth only, textures do not split batches.
+      pending.push_back({nullptr, scene_.instances[i].model, &visible.ranges[scratch.meshlet_offsets[i]],
+                         visible.range_counts[i], scratch.slots[i]});
+    }
+  }
+  emit(pending, scratch.meshlet_total, commands.shadow[face]);
+}
+
+void FramePipeline::compact_visible(FrameCommands& commands) {
+  Scratch& scratch = *scratch_;
+  const Scratch::Visible& visible = scratch.view;
+  for(unsigned int i = 0; i < scene_.instances.size(); i++) {
+    if(!visible.range_counts[i])
+      continue;
+    const Instance& instance = scene_.instances[i];
+    PendingDraw draw = {instance.texture, instance.model, &visible.ranges[scratch.meshlet_offsets[i]],
+                        visible.range_counts[i], scratch.slots[i]};
+    if((instance.flags & Instance::Lit) && instance.materials) {
+      // One draw per material, emit then batches them with every other
+      // instance using the same texture.
+      const Model::Range* ranges = draw.ranges;
+      unsigned int start = 0;
+      for(unsigned int r = 1; r <= visible.range_counts[i]; r++) {
+        if(r < visible.range_counts[i] && ranges[r].material == ranges[start].material)
+          continue;
+        draw.texture = instance.materials[ranges[start].material];
+        draw.ranges = ranges + start;
+        draw.range_count = r - start;
+        scratch.lit_pending.push_back(draw);
+        start = r;
+      }
+    } else if(instance.flags & Instance::Lit) {
+      scratch.lit_pending.push_back(draw);
+    } else {
+      draw.texture = nullptr;
+      scratch.unlit_pending.push_back(draw);
+    }
+  }
+  emit(scratch.lit_pending, scratch.meshlet_total, commands.lit);
+  emit(scratch.unlit_pending, scratch.meshlet_total, commands.unlit);
+}
+
+void FramePipeline::compact_cascade(FrameCommands& commands, unsigned int cascade) {
+  Scratch& scratch = *scratch_;
+  FrameVector<PendingDraw>& pending = scratch.cascade_pending[cascade];
+  if(commands.cascade_updated[cascade]) {
+    const Scratch::Visible& visible = scratch.cascades[cascade];
+    for(unsigned int i = 0; i < scene_.instances.size(); i++) {
+      if(!visible.range_counts[i])
+        continue;
+      pending.push_back({nullptr, scene_.instances[i].model, &visible.ranges[scratch.meshlet_offsets[i]],
+                         visible.range_counts[i], scratch.slots[i]});
+    }
+  }
+  emit(pending, scratch.meshlet_total, commands.cascades[cascade]);
+}
+
+void FramePipeline::emit(FrameVector<PendingDraw>& pending, size_t range_capacity, DrawPass& pass) {
+  std::sort(pending.begin(), pending.end(), [](const PendingDraw& a, const PendingDraw& b) {
+    if(a.texture != b.texture)
+      return a.texture < b.texture;
+    return a.model < b.model;
+  });
+
+  pass.draws.clear();
+  pass.batches.clear();
+  pass.draws.reserve(range_capacity);
+  pass.batches.reserve(pending.capacity());
+  for(const PendingDraw& draw : pending) {
+    if(pass.batches.empty() || pass.batches.back().texture != draw.texture)
+      pass.batches.push_back({draw.texture, (unsigned int)pass.draws.size(), 0});
+    for(unsigned int r = 0; r < draw.range_count; r++)
+      pass.draws.push_back(draw.model->indirect(draw.ranges[r], draw.slot));
+    pass.batches.back().count += draw.range_count;
+  }
+}
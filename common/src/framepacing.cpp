@@ -0,0 +1,139 @@
+#include <framepacing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+// Left to spinning at the end of a capped frame.
+const std::chrono::microseconds SpinTime(2000);
+const GLuint64 FenceTimeout = 1000000;  // ns
+
+double elapsed_ms(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void sleep_until(std::chrono::steady_clock::time_point deadline) {
+  if(deadline - std::chrono::steady_clock::now() > SpinTime)
+    std::this_thread::sleep_until(deadline - SpinTime);
+  while(std::chrono::steady_clock::now() < deadline)
+    std::this_thread::yield();
+}
+
+}
+
+FramePacer::FramePacer(const PacingSettings& settings)
+  : fence_head_(0), fence_count_(0), started_(false), frames_(0), frame_sum_(0.0), frame_square_sum_(0.0),
+    max_frame_(0.0), latency_frames_(0), latency_sum_(0.0), max_latency_(0.0), fence_wait_(0.0), sleep_(0.0) {
+  set_settings(settings);
+}
+
+FramePacer::~FramePacer() {
+  for(unsigned int i = 0; i < fence_count_; i++)
+    glDeleteSync(fences_[(fence_head_ + i) % MaxFences].sync);
+}
+
+void FramePacer::set_settings(const PacingSettings& settings) {
+  settings_ = settings;
+  settings_.frames_in_flight = std::min(settings_.frames_in_flight, MaxFramesInFlight);
+  settings_.max_fps = std::max(settings_.max_fps, 0.0f);
+  // The schedule restarts from the next frame.
+  next_start_ = std::chrono::steady_clock::time_point();
+}
+
+const PacingSettings& FramePacer::settings() const {
+  return settings_;
+}
+
+std::chrono::steady_clock::time_point FramePacer::wait() {
+  auto start = std::chrono::steady_clock::now();
+  if(settings_.max_fps > 0.0f) {
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / settings_.max_fps));
+    // A frame that ran late moves the schedule instead of letting the
+    // following ones catch up in a burst.
+    next_start_ = std::max(next_start_ + period, start);
+    sleep_until(next_start_);
+  }
+  auto slept = std::chrono::steady_clock::now();
+  sleep_ += elapsed_ms(start, slept);
+
+  while(fence_count_ && retire(false))
+    ;
+  if(settings_.frames_in_flight)
+    while(fence_count_ >= settings_.frames_in_flight)
+      retire(true);
+  auto now = std::chrono::steady_clock::now();
+  fence_wait_ += elapsed_ms(slept, now);
+
+  if(started_) {
+    double frame = elapsed_ms(last_start_, now);
+    frames_++;
+    frame_sum_ += frame;
+    frame_square_sum_ += frame * frame;
+    max_frame_ = std::max(max_frame_, frame);
+  }
+  started_ = true;
+  last_start_ = now;
+  return now;
+}
+
+void FramePacer::end_frame(std::chrono::steady_clock::time_point input_time) {
+  // Without a limit the driver may queue more frames than there are slots,
+  // the oldest of them then goes untimed.
+  if(fence_count_ == MaxFences) {
+    glDeleteSync(fences_[fence_head_].sync);
+    fence_head_ = (fence_head_ + 1) % MaxFences;
+    fence_count_--;
+  }
+  Fence& fence = fences_[(fence_head_ + fence_count_) % MaxFences];
+  fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  fence.input_time = input_time;
+  fence_count_++;
+}
+
+bool FramePacer::retire(bool wait) {
+  Fence& fence = fences_[fence_head_];
+  GLenum status = glClientWaitSync(fence.sync, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? FenceTimeout : 0);
+  while(wait && status == GL_TIMEOUT_EXPIRED)
+    status = glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, FenceTimeout);
+  if(status == GL_TIMEOUT_EXPIRED)
+    return false;
+
+  if(status != GL_WAIT_FAILED) {
+    double latency = elapsed_ms(fence.input_time, std::chrono::steady_clock::now());
+    latency_frames_++;
+    latency_sum_ += latency;
+    max_latency_ = std::max(max_latency_, latency);
+  }
+  glDeleteSync(fence.sync);
+  fence_head_ = (fence_head_ + 1) % MaxFences;
+  fence_count_--;
+  return true;
+}
+
+PacingStats FramePacer::take_stats() {
+  PacingStats stats = {};
+  stats.frames = frames_;
+  if(frames_) {
+    stats.frame_ms = frame_sum_ / frames_;
+    double variance = frame_square_sum_ / frames_ - stats.frame_ms * stats.frame_ms;
+    stats.frame_deviation_ms = std::sqrt(std::max(variance, 0.0));
+    stats.max_frame_ms = max_frame_;
+    stats.fence_wait_ms = fence_wait_ / frames_;
+    stats.sleep_ms = sleep_ / frames_;
+  }
+  stats.latency_frames = latency_frames_;
+  if(latency_frames_) {
+    stats.latency_ms = latency_sum_ / latency_frames_;
+    stats.max_latency_ms = max_latency_;
+  }
+
+  frames_ = 0;
+  frame_sum_ = frame_square_sum_ = max_frame_ = 0.0;
+  latency_frames_ = 0;
+  latency_sum_ = max_latency_ = 0.0;
+  fence_wait_ = sleep_ = 0.0;
+  return stats;
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cstddef>
+#include <geometry.hpp>
+
+namespace {
+
+GeometryArena* g_current_arena = nullptr;
+
+// Creates a buffer of new_size bytes holding the first old_size bytes of
+// buffer, which is deleted.
+GLuint grow_buffer(GLuint buffer, size_t old_size, size_t new_size) {
+  GLuint grown;
+  glGenBuffers(1, &grown);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+  glBufferData(GL_COPY_WRITE_BUFFER, new_size, NULL, GL_STATIC_DRAW);
+  if(buffer) {
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+    glDeleteBuffers(1, &buffer);
+  }
+  return grown;
+}
+
+}
+
+RangeAllocator::RangeAllocator(unsigned int capacity) : capacity_(capacity), used_(0) {
+  if(capacity)
+    free_.push_back({0, capacity});
+}
+
+bool RangeAllocator::allocate(unsigned int size, unsigned int& offset) {
+  if(size == 0) {
+    offset = 0;
+    return true;
+  }
+  for(auto it = free_.begin(); it != free_.end(); ++it) {
+    if(it->size < size)
+      continue;
+    offset = it->offset;
+    it->offset += size;
+    it->size -= size;
+    if(it->size == 0)
+      free_.erase(it);
+    used_ += size;
+    return true;
+  }
+  return false;
+}
+
+void RangeAllocator::free(unsigned int offset, unsigned int size) {
+  if(size == 0)
+    return;
+  used_ -= size;
+  auto it = std::lower_bound(free_.begin(), free_.end(), offset,
+                             [](const Range& r, unsigned int o) { return r.offset < o; });
+  it = free_.insert(it, {offset, size});
+
+  auto next = it + 1;
+  if(next != free_.end() && it->offset + it->size == next->offset) {
+    it->size += next->size;
+    free_.erase(next);
+  }
+  if(it != free_.begin()) {
+    auto previous = it - 1;
+    if(previous->offset + previous->size == it->offset) {
+      previous->size += it->size;
+      free_.erase(it);
+    }
+  }
+}
+
+void RangeAllocator::grow(unsigned int capacity) {
+  if(capacity <= capacity_)
+    return;
+  free(capacity_, capacity - capacity_);
+  used_ += capacity - capacity_;
+  capacity_ = capacity;
+}
+
+unsigned int RangeAllocator::capacity() const {
+  return capacity_;
+}
+
+unsigned int RangeAllocator::used() const {
+  return used_;
+}
+
+GeometryArena::GeometryArena(unsigned int vertex_capacity, unsigned int index_capacity)
+  : VAO_(0), vertexbuffer_(0), elementbuffer_(0), drawidbuffer_(0), draw_id_capacity_(0),
+    vertices_(vertex_capacity), indices_(index_capacity) {
+  glGenVertexArrays(1, &VAO_);
+  vertexbuffer_ = grow_buffer(0, 0, (size_t)vertex_capacity * sizeof(ArenaVertex));
+  elementbuffer_ = grow_buffer(0, 0, (size_t)index_capacity * sizeof(unsigned int));
+  reserve_draw_ids(1024);
+  setup_attributes();
+
+  g_current_arena = this;
+}
+
+GeometryArena::~GeometryArena() {
+  glDeleteBuffers(1, &vertexbuffer_);
+  glDeleteBuffers(1, &elementbuffer_);
+  glDeleteBuffers(1, &drawidbuffer_);
+  glDeleteVertexArrays(1, &VAO_);
+
+  if(g_current_arena == this)
+    g_current_arena = nullptr;
+}
+
+GeometryArena* GeometryArena::current() {
+  return g_current_arena;
+}
+
+void GeometryArena::allocate(const std::vector<ArenaVertex>& vertices, const std::vector<unsigned int>& indices,
+                             unsigned int& base_vertex, unsigned int& first_index) {
+  while(!vertices_.allocate(vertices.size(), base_vertex))
+    grow_vertices(std::max(vertices_.capacity() * 2, vertices_.capacity() + (unsigned int)vertices.size()));
+  while(!indices_.allocate(indices.size(), first_index))
+    grow_indices(std::max(indices_.capacity() * 2, indices_.capacity() + (unsigned int)indices.size()));
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
+  glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)base_vertex * sizeof(ArenaVertex),
+                  vertices.size() * sizeof(ArenaVertex), vertices.data());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, elementbuffer_);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)first_index * sizeof(unsigned int),
+                  indices.size() * sizeof(unsigned int), indices.data());
+}
+
+void GeometryArena::free(unsigned int base_vertex, unsigned int vertex_count,
+                         unsigned int first_index, unsigned int index_count) {
+  vertices_.free(base_vertex, vertex_count);
+  indices_.free(first_index, index_count);
+}
+
+void GeometryArena::reserve_draw_ids(unsigned int count) {
+  if(count <= draw_id_capacity_)
+    return;
+  unsigned int capacity = std::max(count, draw_id_capacity_ * 2);
+  std::vector<GLuint> ids(capacity);
+  for(unsigned int i = 0; i < capacity; i++)
+    ids[i] = i;
+
+  if(!drawidbuffer_)
+    glGenBuffers(1, &drawidbuffer_);
+  glBindBuffer(GL_ARRAY_BUFFER, drawidbuffer_);
+  glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+  draw_id_capacity_ = capacity;
+}
+
+void GeometryArena::bind() {
+  GLint value;
+
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+  if(value != VAO_) {
+    glBindVertexArray(VAO_);
+  }
+}
+
+GLuint GeometryArena::vao() const {
+  return VAO_;
+}
+
+unsigned int GeometryArena::vertex_bytes() const {
+  return vertices_.used() * sizeof(ArenaVertex);
+}
+
+unsigned int GeometryArena::index_bytes() const {
+  return indices_.used() * sizeof(unsigned int);
+}
+
+void GeometryArena::grow_vertices(unsigned int capacity) {
+  vertexbuffer_ = grow_buffer(vertexbuffer_, (size_t)vertices_.capacity() * sizeof(ArenaVertex),
+                              (size_t)capacity * sizeof(ArenaVertex));
+  vertices_.grow(capacity);
+  setup_attributes();
+}
+
+void GeometryArena::grow_indices(unsigned int capacity) {
+  elementbuffer_ = grow_buffer(elementbuffer_, (size_t)indices_.capacity() * sizeof(unsigned int),
+                               (size_t)capacity * sizeof(unsigned int));
+  indices_.grow(capacity);
+  setup_attributes();
+}
+
+void GeometryArena::setup_attributes() {
+  glBindVertexArray(VAO_);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, position));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, uv));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, normal));
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, tangent));
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, bitangent));
+  glEnableVertexAttribArray(6);
+  glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), (void*)offsetof(ArenaVertex, lightmap_uv));
+
+  glBindBuffer(GL_ARRAY_BUFFER, drawidbuffer_);
+  glEnableVertexAttribArray(5);
+  glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+  glVertexAttribDivisor(5, 1);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer_);
+}
@@ -0,0 +1,379 @@
+#include <glcapture.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+TraceWriter* writer = nullptr;
+// In a frame before the first captured one.
+bool skipping = false;
+
+void* real_functions[(int)TraceCall::Count];
+
+struct Hook {
+  void** pointer;  // glad's function pointer
+  void* original;
+};
+std::vector<Hook> hooks;
+
+template <typename F>
+F Real(TraceCall call) {
+  return reinterpret_cast<F>(real_functions[(int)call]);
+}
+
+// Work skipped in frames before the capture, it leaves no state behind.
+bool IsFrameWork(TraceCall call) {
+  switch(call) {
+    case TraceCall::Clear:
+    case TraceCall::ClearBufferuiv:
+    case TraceCall::ReadPixels:
+    case TraceCall::DrawArrays:
+    case TraceCall::DrawElementsBaseVertex:
+    case TraceCall::MultiDrawElementsIndirect:
+    case TraceCall::BeginQuery:
+    case TraceCall::EndQuery:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool Recording(TraceCall call) {
+  return writer && !(skipping && IsFrameWork(call));
+}
+
+// Calls taking scalars only.
+template <TraceCall Call, typename... Args>
+void APIENTRY RecordCall(Args... args) {
+  if(Recording(Call)) {
+    writer->call(Call);
+    int unused[] = {0, (writer->write(args), 0)...};
+    (void)unused;
+  }
+  Real<void (APIENTRYP)(Args...)>(Call)(args...);
+}
+
+template <TraceCall Call>
+void APIENTRY RecordGen(GLsizei n, GLuint* names) {
+  Real<void (APIENTRYP)(GLsizei, GLuint*)>(Call)(n, names);
+  writer->call(Call);
+  writer->write((int32_t)n);
+  for(GLsizei i = 0; i < n; i++)
+    writer->write((uint32_t)names[i]);
+}
+
+template <TraceCall Call>
+void APIENTRY RecordDelete(GLsizei n, const GLuint* names) {
+  writer->call(Call);
+  writer->write((int32_t)n);
+  for(GLsizei i = 0; i < n; i++)
+    writer->write((uint32_t)names[i]);
+  Real<void (APIENTRYP)(GLsizei, const GLuint*)>(Call)(n, names);
+}
+
+template <TraceCall Call, int N>
+void APIENTRY RecordUniformv(GLint location, GLsizei count, const GLfloat* value) {
+  writer->call(Call);
+  writer->write((int32_t)location);
+  writer->write((int32_t)count);
+  writer->write_blob(value, count * N * sizeof(GLfloat));
+  Real<void (APIENTRYP)(GLint, GLsizei, const GLfloat*)>(Call)(location, count, value);
+}
+
+template <TraceCall Call, int N>
+void APIENTRY RecordUniformMatrixv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+  writer->call(Call);
+  writer->write((int32_t)location);
+  writer->write((int32_t)count);
+  writer->write((unsigned char)transpose);
+  writer->write_blob(value, count * N * N * sizeof(GLfloat));
+  Real<void (APIENTRYP)(GLint, GLsizei, GLboolean, const GLfloat*)>(Call)(location, count, transpose, value);
+}
+
+void APIENTRY RecordBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+  writer->call(TraceCall::BufferData);
+  writer->write((uint32_t)target);
+  writer->write((int64_t)size);
+  writer->write((unsigned char)(data != nullptr));
+  if(data)
+    writer->write_blob(data, size);
+  writer->write((uint32_t)usage);
+  Real<PFNGLBUFFERDATAPROC>(TraceCall::BufferData)(target, size, data, usage);
+}
+
+void APIENTRY RecordBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+  writer->call(TraceCall::BufferSubData);
+  writer->write((uint32_t)target);
+  writer->write((int64_t)offset);
+  writer->write_blob(data, size);
+  Real<PFNGLBUFFERSUBDATAPROC>(TraceCall::BufferSubData)(target, offset, size, data);
+}
+
+void APIENTRY RecordClearBufferuiv(GLenum buffer, GLint drawbuffer, const GLuint* value) {
+  if(Recording(TraceCall::ClearBufferuiv)) {
+    writer->call(TraceCall::ClearBufferuiv);
+    writer->write((uint32_t)buffer);
+    writer->write((int32_t)drawbuffer);
+    writer->write_blob(value, 4 * sizeof(GLuint));
+  }
+  Real<PFNGLCLEARBUFFERUIVPROC>(TraceCall::ClearBufferuiv)(buffer, drawbuffer, value);
+}
+
+void* APIENTRY RecordMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+  writer->call(TraceCall::MapBufferRange);
+  writer->write((uint32_t)target);
+  writer->write((int64_t)offset);
+  writer->write((int64_t)length);
+  writer->write((uint32_t)access);
+  return Real<PFNGLMAPBUFFERRANGEPROC>(TraceCall::MapBufferRange)(target, offset, length, access);
+}
+
+GLboolean APIENTRY RecordUnmapBuffer(GLenum target) {
+  writer->call(TraceCall::UnmapBuffer);
+  writer->write((uint32_t)target);
+  return Real<PFNGLUNMAPBUFFERPROC>(TraceCall::UnmapBuffer)(target);
+}
+
+void APIENTRY RecordTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                               GLint border, GLenum format, GLenum type, const void* pixels) {
+  writer->call(TraceCall::TexImage2D);
+  writer->write((uint32_t)target);
+  writer->write((int32_t)level);
+  writer->write((int32_t)internalformat);
+  writer->write((int32_t)width);
+  writer->write((int32_t)height);
+  writer->write((int32_t)border);
+  writer->write((uint32_t)format);
+  writer->write((uint32_t)type);
+  writer->write((unsigned char)(pixels != nullptr));
+  if(pixels)
+    writer->write_blob(pixels, ImageBytes(format, type, width, height, 1));
+  Real<PFNGLTEXIMAGE2DPROC>(TraceCall::TexImage2D)(target, level, internalformat, width, height, border, format,
+                                                   type, pixels);
+}
+
+void APIENTRY RecordTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                               GLsizei depth, GLint border, GLenum format, GLenum type, const void* pixels) {
+  writer->call(TraceCall::TexImage3D);
+  writer->write((uint32_t)target);
+  writer->write((int32_t)level);
+  writer->write((int32_t)internalformat);
+  writer->write((int32_t)width);
+  writer->write((int32_t)height);
+  writer->write((int32_t)depth);
+  writer->write((int32_t)border);
+  writer->write((uint32_t)format);
+  writer->write((uint32_t)type);
+  writer->write((unsigned char)(pixels != nullptr));
+  if(pixels)
+    writer->write_blob(pixels, ImageBytes(format, type, width, height, depth));
+  Real<PFNGLTEXIMAGE3DPROC>(TraceCall::TexImage3D)(target, level, internalformat, width, height, depth, border,
+                                                   format, type, pixels);
+}
+
+void APIENTRY RecordTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width,
+                                  GLsizei height, GLenum format, GLenum type, const void* pixels) {
+  writer->call(TraceCall::TexSubImage2D);
+  writer->write((uint32_t)target);
+  writer->write((int32_t)level);
+  writer->write((int32_t)xoffset);
+  writer->write((int32_t)yoffset);
+  writer->write((int32_t)width);
+  writer->write((int32_t)height);
+  writer->write((uint32_t)format);
+  writer->write((uint32_t)type);
+  writer->write_blob(pixels, ImageBytes(format, type, width, height, 1));
+  Real<PFNGLTEXSUBIMAGE2DPROC>(TraceCall::TexSubImage2D)(target, level, xoffset, yoffset, width, height, format,
+                                                         type, pixels);
+}
+
+void APIENTRY RecordShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length) {
+  writer->call(TraceCall::ShaderSource);
+  writer->write((uint32_t)shader);
+  writer->write((int32_t)count);
+  for(GLsizei i = 0; i < count; i++)
+    writer->write_blob(string[i], length && length[i] >= 0 ? length[i] : std::strlen(string[i]));
+  Real<PFNGLSHADERSOURCEPROC>(TraceCall::ShaderSource)(shader, count, string, length);
+}
+
+GLuint APIENTRY RecordCreateShader(GLenum type) {
+  GLuint shader = Real<PFNGLCREATESHADERPROC>(TraceCall::CreateShader)(type);
+  writer->call(TraceCall::CreateShader);
+  writer->write((uint32_t)type);
+  writer->write((uint32_t)shader);
+  return shader;
+}
+
+GLuint APIENTRY RecordCreateProgram() {
+  GLuint program = Real<PFNGLCREATEPROGRAMPROC>(TraceCall::CreateProgram)();
+  writer->call(TraceCall::CreateProgram);
+  writer->write((uint32_t)program);
+  return program;
+}
+
+GLint APIENTRY RecordGetUniformLocation(GLuint program, const GLchar* name) {
+  GLint location = Real<PFNGLGETUNIFORMLOCATIONPROC>(TraceCall::GetUniformLocation)(program, name);
+  writer->call(TraceCall::GetUniformLocation);
+  writer->write((uint32_t)program);
+  writer->write_blob(name, std::strlen(name));
+  writer->write((int32_t)location);
+  return location;
+}
+
+template <typename F>
+void Install(TraceCall call, F& pointer, F wrapper) {
+  if(!pointer)
+    return;
+  real_functions[(int)call] = (void*)pointer;
+  hooks.push_back({(void**)&pointer, (void*)pointer});
+  pointer = wrapper;
+}
+
+template <TraceCall Call, typename... Args>
+void InstallScalar(void (APIENTRYP& pointer)(Args...)) {
+  Install(Call, pointer, &RecordCall<Call, Args...>);
+}
+
+void InstallHooks() {
+  InstallScalar<TraceCall::ActiveTexture>(glad_glActiveTexture);
+  InstallScalar<TraceCall::AttachShader>(glad_glAttachShader);
+  InstallScalar<TraceCall::BeginQuery>(glad_glBeginQuery);
+  InstallScalar<TraceCall::BindBuffer>(glad_glBindBuffer);
+  InstallScalar<TraceCall::BindFramebuffer>(glad_glBindFramebuffer);
+  InstallScalar<TraceCall::BindRenderbuffer>(glad_glBindRenderbuffer);
+  InstallScalar<TraceCall::BindTexture>(glad_glBindTexture);
+  InstallScalar<TraceCall::BindVertexArray>(glad_glBindVertexArray);
+  InstallScalar<TraceCall::BlendFunc>(glad_glBlendFunc);
+  Install(TraceCall::BufferData, glad_glBufferData, &RecordBufferData);
+  Install(TraceCall::BufferSubData, glad_glBufferSubData, &RecordBufferSubData);
+  InstallScalar<TraceCall::Clear>(glad_glClear);
+  Install(TraceCall::ClearBufferuiv, glad_glClearBufferuiv, &RecordClearBufferuiv);
+  InstallScalar<TraceCall::ClearColor>(glad_glClearColor);
+  InstallScalar<TraceCall::ColorMask>(glad_glColorMask);
+  InstallScalar<TraceCall::CompileShader>(glad_glCompileShader);
+  InstallScalar<TraceCall::CopyBufferSubData>(glad_glCopyBufferSubData);
+  Install(TraceCall::CreateProgram, glad_glCreateProgram, &RecordCreateProgram);
+  Install(TraceCall::CreateShader, glad_glCreateShader, &RecordCreateShader);
+  Install(TraceCall::DeleteBuffers, glad_glDeleteBuffers, &RecordDelete<TraceCall::DeleteBuffers>);
+  Install(TraceCall::DeleteFramebuffers, glad_glDeleteFramebuffers, &RecordDelete<TraceCall::DeleteFramebuffers>);
+  InstallScalar<TraceCall::DeleteProgram>(glad_glDeleteProgram);
+  Install(TraceCall::DeleteQueries, glad_glDeleteQueries, &RecordDelete<TraceCall::DeleteQueries>);
+  Install(TraceCall::DeleteRenderbuffers, glad_glDeleteRenderbuffers,
+          &RecordDelete<TraceCall::DeleteRenderbuffers>);
+  InstallScalar<TraceCall::DeleteShader>(glad_glDeleteShader);
+  Install(TraceCall::DeleteTextures, glad_glDeleteTextures, &RecordDelete<TraceCall::DeleteTextures>);
+  Install(TraceCall::DeleteVertexArrays, glad_glDeleteVertexArrays, &RecordDelete<TraceCall::DeleteVertexArrays>);
+  InstallScalar<TraceCall::DepthFunc>(glad_glDepthFunc);
+  InstallScalar<TraceCall::DetachShader>(glad_glDetachShader);
+  InstallScalar<TraceCall::Disable>(glad_glDisable);
+  InstallScalar<TraceCall::DrawArrays>(glad_glDrawArrays);
+  InstallScalar<TraceCall::DrawBuffer>(glad_glDrawBuffer);
+  InstallScalar<TraceCall::DrawElementsBaseVertex>(glad_glDrawElementsBaseVertex);
+  InstallScalar<TraceCall::Enable>(glad_glEnable);
+  InstallScalar<TraceCall::EnableVertexAttribArray>(glad_glEnableVertexAttribArray);
+  InstallScalar<TraceCall::EndQuery>(glad_glEndQuery);
+  InstallScalar<TraceCall::FramebufferRenderbuffer>(glad_glFramebufferRenderbuffer);
+  InstallScalar<TraceCall::FramebufferTexture>(glad_glFramebufferTexture);
+  InstallScalar<TraceCall::FramebufferTexture2D>(glad_glFramebufferTexture2D);
+  InstallScalar<TraceCall::FramebufferTextureLayer>(glad_glFramebufferTextureLayer);
+  Install(TraceCall::GenBuffers, glad_glGenBuffers, &RecordGen<TraceCall::GenBuffers>);
+  Install(TraceCall::GenFramebuffers, glad_glGenFramebuffers, &RecordGen<TraceCall::GenFramebuffers>);
+  Install(TraceCall::GenQueries, glad_glGenQueries, &RecordGen<TraceCall::GenQueries>);
+  Install(TraceCall::GenRenderbuffers, glad_glGenRenderbuffers, &RecordGen<TraceCall::GenRenderbuffers>);
+  Install(TraceCall::GenTextures, glad_glGenTextures, &RecordGen<TraceCall::GenTextures>);
+  Install(TraceCall::GenVertexArrays, glad_glGenVertexArrays, &RecordGen<TraceCall::GenVertexArrays>);
+  Install(TraceCall::GetUniformLocation, glad_glGetUniformLocation, &RecordGetUniformLocation);
+  InstallScalar<TraceCall::LinkProgram>(glad_glLinkProgram);
+  Install(TraceCall::MapBufferRange, glad_glMapBufferRange, &RecordMapBufferRange);
+  InstallScalar<TraceCall::MultiDrawElementsIndirect>(glad_glMultiDrawElementsIndirect);
+  InstallScalar<TraceCall::PolygonOffset>(glad_glPolygonOffset);
+  InstallScalar<TraceCall::ReadBuffer>(glad_glReadBuffer);
+  InstallScalar<TraceCall::ReadPixels>(glad_glReadPixels);
+  InstallScalar<TraceCall::RenderbufferStorage>(glad_glRenderbufferStorage);
+  Install(TraceCall::ShaderSource, glad_glShaderSource, &RecordShaderSource);
+  InstallScalar<TraceCall::TexBuffer>(glad_glTexBuffer);
+  Install(TraceCall::TexImage2D, glad_glTexImage2D, &RecordTexImage2D);
+  Install(TraceCall::TexImage3D, glad_glTexImage3D, &RecordTexImage3D);
+  InstallScalar<TraceCall::TexParameteri>(glad_glTexParameteri);
+  Install(TraceCall::TexSubImage2D, glad_glTexSubImage2D, &RecordTexSubImage2D);
+  InstallScalar<TraceCall::Uniform1f>(glad_glUniform1f);
+  InstallScalar<TraceCall::Uniform1i>(glad_glUniform1i);
+  Install(TraceCall::Uniform2fv, glad_glUniform2fv, &RecordUniformv<TraceCall::Uniform2fv, 2>);
+  Install(TraceCall::Uniform3fv, glad_glUniform3fv, &RecordUniformv<TraceCall::Uniform3fv, 3>);
+  Install(TraceCall::Uniform4fv, glad_glUniform4fv, &RecordUniformv<TraceCall::Uniform4fv, 4>);
+  Install(TraceCall::UniformMatrix2fv, glad_glUniformMatrix2fv,
+          &RecordUniformMatrixv<TraceCall::UniformMatrix2fv, 2>);
+  Install(TraceCall::UniformMatrix3fv, glad_glUniformMatrix3fv,
+          &RecordUniformMatrixv<TraceCall::UniformMatrix3fv, 3>);
+  Install(TraceCall::UniformMatrix4fv, glad_glUniformMatrix4fv,
+          &RecordUniformMatrixv<TraceCall::UniformMatrix4fv, 4>);
+  Install(TraceCall::UnmapBuffer, glad_glUnmapBuffer, &RecordUnmapBuffer);
+  InstallScalar<TraceCall::UseProgram>(glad_glUseProgram);
+  InstallScalar<TraceCall::VertexAttribDivisor>(glad_glVertexAttribDivisor);
+  InstallScalar<TraceCall::VertexAttribIPointer>(glad_glVertexAttribIPointer);
+  InstallScalar<TraceCall::VertexAttribPointer>(glad_glVertexAttribPointer);
+  InstallScalar<TraceCall::Viewport>(glad_glViewport);
+}
+
+void UninstallHooks() {
+  for(const Hook& hook : hooks)
+    *hook.pointer = hook.original;
+  hooks.clear();
+}
+
+}
+
+GLCapture::GLCapture(const char* path, unsigned int width, unsigned int height, unsigned int first_frame,
+                     unsigned int frame_count)
+  : writer_(path, width, height), path_(path), first_frame_(first_frame), frame_count_(frame_count), frame_(0),
+    active_(false) {
+  if(!writer_.is_valid())
+    return;
+  if(writer) {
+    std::cout << "Only one GL capture can be active" << std::endl;
+    return;
+  }
+  writer = &writer_;
+  skipping = false;
+  InstallHooks();
+  active_ = true;
+}
+
+GLCapture::~GLCapture() {
+  if(active_)
+    finish();
+}
+
+void GLCapture::begin_frame() {
+  if(!active_)
+    return;
+  skipping = frame_ < first_frame_;
+  writer_.call(TraceCall::FrameBegin);
+  writer_.write((uint32_t)frame_);
+  writer_.write((unsigned char)!skipping);
+}
+
+void GLCapture::end_frame() {
+  if(!active_)
+    return;
+  writer_.call(TraceCall::FrameEnd);
+  skipping = false;
+  if(++frame_ >= first_frame_ + frame_count_)
+    finish();
+}
+
+bool GLCapture::active() const {
+  return active_;
+}
+
+void GLCapture::finish() {
+  UninstallHooks();
+  writer = nullptr;
+  writer_.close();
+  active_ = false;
+  unsigned int captured = frame_ > first_frame_ ? frame_ - first_frame_ : 0;
+  std::cout << "Captured " << captured << " frames from frame " << first_frame_ << " into " << path_ << " ("
+            << (writer_.bytes() >> 10) << " KB)" << std::endl;
+}
@@ -0,0 +1,184 @@
+#include <gltrace.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+const char* CallNames[] = {
+#define GP_TRACE_NAME(name) #name,
+  GP_TRACE_CALLS(GP_TRACE_NAME)
+#undef GP_TRACE_NAME
+};
+
+unsigned int components(GLenum format) {
+  switch(format) {
+    case GL_RED:
+    case GL_RED_INTEGER:
+    case GL_DEPTH_COMPONENT:
+    case GL_STENCIL_INDEX:
+      return 1;
+    case GL_RG:
+    case GL_RG_INTEGER:
+    case GL_DEPTH_STENCIL:
+      return 2;
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGB_INTEGER:
+      return 3;
+    default:
+      return 4;
+  }
+}
+
+}
+
+const char* TraceCallName(TraceCall call) {
+  return call < TraceCall::Count ? CallNames[(int)call] : "Unknown";
+}
+
+size_t ImageBytes(GLenum format, GLenum type, GLsizei width, GLsizei height, GLsizei depth) {
+  size_t pixel;
+  switch(type) {
+    case GL_UNSIGNED_BYTE:
+    case GL_BYTE:
+      pixel = components(format);
+      break;
+    case GL_UNSIGNED_SHORT:
+    case GL_SHORT:
+    case GL_HALF_FLOAT:
+      pixel = 2 * components(format);
+      break;
+    case GL_UNSIGNED_INT_24_8:
+    case GL_UNSIGNED_INT_10F_11F_11F_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+      pixel = 4;
+      break;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+      pixel = 8;
+      break;
+    default:  // GL_FLOAT, GL_INT, GL_UNSIGNED_INT
+      pixel = 4 * components(format);
+      break;
+  }
+  size_t row = (pixel * width + 3) & ~(size_t)3;
+  return row * height * depth;
+}
+
+TraceWriter::TraceWriter(const char* path, unsigned int width, unsigned int height)
+  : file_(path, std::ios::binary | std::ios::trunc), bytes_(0) {
+  if(!file_) {
+    std::cout << "Can not write trace " << path << std::endl;
+    return;
+  }
+  TraceHeader header = {{'G', 'P', 'T', 'R'}, TraceVersion, width, height};
+  put(&header, sizeof(header));
+}
+
+bool TraceWriter::is_valid() const {
+  return (bool)file_;
+}
+
+void TraceWriter::call(TraceCall call) {
+  put(&call, 1);
+}
+
+void TraceWriter::write(uint32_t value) {
+  put(&value, sizeof(value));
+}
+
+void TraceWriter::write(int32_t value) {
+  put(&value, sizeof(value));
+}
+
+void TraceWriter::write(int64_t value) {
+  put(&value, sizeof(value));
+}
+
+void TraceWriter::write(float value) {
+  put(&value, sizeof(value));
+}
+
+void TraceWriter::write(unsigned char value) {
+  put(&value, sizeof(value));
+}
+
+void TraceWriter::write(const void* offset) {
+  uint64_t value = (uint64_t)(uintptr_t)offset;
+  put(&value, sizeof(value));
+}
+
+void TraceWriter::write_blob(const void* data, size_t bytes) {
+  write((uint32_t)bytes);
+  put(data, bytes);
+}
+
+void TraceWriter::close() {
+  file_.close();
+}
+
+size_t TraceWriter::bytes() const {
+  return bytes_;
+}
+
+void TraceWriter::put(const void* data, size_t bytes) {
+  file_.write(static_cast<const char*>(data), bytes);
+  bytes_ += bytes;
+}
+
+TraceReader::TraceReader(const char* path) : offset_(0), valid_(false), truncated_(false) {
+  std::ifstream file(path, std::ios::binary);
+  if(!file) {
+    std::cout << "Can not open trace " << path << std::endl;
+    return;
+  }
+  data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  get(&header_, sizeof(header_));
+  if(truncated_ || std::memcmp(header_.magic, "GPTR", 4) != 0 || header_.version != TraceVersion) {
+    std::cout << path << " is not a version " << TraceVersion << " trace" << std::endl;
+    return;
+  }
+  valid_ = true;
+}
+
+bool TraceReader::is_valid() const {
+  return valid_;
+}
+
+const TraceHeader& TraceReader::header() const {
+  return header_;
+}
+
+bool TraceReader::next(TraceCall& ret_call) {
+  if(offset_ >= data_.size() || truncated_)
+    return false;
+  ret_call = (TraceCall)data_[offset_++];
+  return true;
+}
+
+const void* TraceReader::read_blob(uint32_t& ret_bytes) {
+  ret_bytes = read<uint32_t>();
+  if(offset_ + ret_bytes > data_.size()) {
+    truncated_ = true;
+    ret_bytes = 0;
+    return nullptr;
+  }
+  const void* data = data_.data() + offset_;
+  offset_ += ret_bytes;
+  return data;
+}
+
+bool TraceReader::truncated() const {
+  return truncated_;
+}
+
+void TraceReader::get(void* data, size_t bytes) {
+  if(offset_ + bytes > data_.size()) {
+    truncated_ = true;
+    std::memset(data, 0, bytes);
+    return;
+  }
+  std::memcpy(data, data_.data() + offset_, bytes);
+  offset_ += bytes;
+}
@@ -0,0 +1,57 @@
+#include <gputimer.hpp>
+
+GpuTimer::GpuTimer(const std::vector<std::string>& stages)
+  : stages_(stages), queries_(stages.size() * Latency, 0), issued_(stages.size() * Latency, false),
+    milliseconds_(stages.size(), 0.0), frame_(0) {
+  glGenQueries(queries_.size(), queries_.data());
+}
+
+GpuTimer::~GpuTimer() {
+  glDeleteQueries(queries_.size(), queries_.data());
+}
+
+void GpuTimer::begin(unsigned int stage) {
+  unsigned int query = frame_ * stages_.size() + stage;
+  glBeginQuery(GL_TIME_ELAPSED, queries_[query]);
+  issued_[query] = true;
+}
+
+void GpuTimer::end() {
+  glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GpuTimer::next_frame() {
+  frame_ = (frame_ + 1) % Latency;
+  for(unsigned int stage = 0; stage < stages_.size(); stage++) {
+    unsigned int query = frame_ * stages_.size() + stage;
+    if(!issued_[query])
+      continue;
+    GLint available = 0;
+    glGetQueryObjectiv(queries_[query], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+      continue;
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries_[query], GL_QUERY_RESULT, &elapsed);
+    milliseconds_[stage] = elapsed / 1e6;
+    issued_[query] = false;
+  }
+}
+
+double GpuTimer::milliseconds(unsigned int stage) const {
+  return milliseconds_[stage];
+}
+
+double GpuTimer::total_milliseconds() const {
+  double total = 0.0;
+  for(double ms : milliseconds_)
+    total += ms;
+  return total;
+}
+
+const std::string& GpuTimer::name(unsigned int stage) const {
+  return stages_[stage];
+}
+
+unsigned int GpuTimer::stage_count() const {
+  return stages_.size();
+}
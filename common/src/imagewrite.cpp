@@ -0,0 +1,282 @@
+#include <imagewrite.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const unsigned int WindowSize = 32768;
+const unsigned int HashBits = 15;
+const unsigned int MaxChain = 16;
+const unsigned int MinMatch = 3;
+const unsigned int MaxMatch = 258;
+
+const unsigned short LengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+                                       99, 115, 131, 163, 195, 227, 258};
+const unsigned char LengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5,
+                                       5, 5, 0};
+const unsigned short DistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+                                         769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const unsigned char DistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11,
+                                         11, 12, 12, 13, 13};
+
+// Deflate packs bits from the least significant end.
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<unsigned char>& out) : out_(out), bits_(0), count_(0) {}
+
+  void put(uint32_t value, unsigned int count) {
+    bits_ |= value << count_;
+    count_ += count;
+    while(count_ >= 8) {
+      out_.push_back(bits_ & 0xff);
+      bits_ >>= 8;
+      count_ -= 8;
+    }
+  }
+
+  void flush() {
+    if(count_)
+      out_.push_back(bits_ & 0xff);
+    bits_ = 0;
+    count_ = 0;
+  }
+
+ private:
+  std::vector<unsigned char>& out_;
+  uint32_t bits_;
+  unsigned int count_;
+};
+
+// The fixed Huffman codes, bit reversed for the writer.
+struct FixedCodes {
+  uint16_t literals[288];
+  uint8_t literal_bits[288];
+  uint8_t distances[30];
+
+  FixedCodes() {
+    for(unsigned int symbol = 0; symbol < 288; symbol++) {
+      if(symbol < 144)
+        set(symbol, 0x30 + symbol, 8);
+      else if(symbol < 256)
+        set(symbol, 0x190 + symbol - 144, 9);
+      else if(symbol < 280)
+        set(symbol, symbol - 256, 7);
+      else
+        set(symbol, 0xc0 + symbol - 280, 8);
+    }
+    for(unsigned int d = 0; d < 30; d++)
+      distances[d] = reverse(d, 5);
+  }
+
+  void set(unsigned int symbol, uint32_t code, unsigned int bits) {
+    literals[symbol] = reverse(code, bits);
+    literal_bits[symbol] = bits;
+  }
+
+  static uint32_t reverse(uint32_t code, unsigned int bits) {
+    uint32_t reversed = 0;
+    for(unsigned int i = 0; i < bits; i++)
+      reversed |= ((code >> i) & 1) << (bits - 1 - i);
+    return reversed;
+  }
+};
+
+const FixedCodes Codes;
+
+void literal(BitWriter& writer, unsigned int symbol) {
+  writer.put(Codes.literals[symbol], Codes.literal_bits[symbol]);
+}
+
+void match(BitWriter& writer, unsigned int length, unsigned int distance) {
+  unsigned int l = 28;
+  while(LengthBase[l] > length)
+    l--;
+  literal(writer, 257 + l);
+  writer.put(length - LengthBase[l], LengthExtra[l]);
+
+  unsigned int d = 29;
+  while(DistanceBase[d] > distance)
+    d--;
+  writer.put(Codes.distances[d], 5);
+  writer.put(distance - DistanceBase[d], DistanceExtra[d]);
+}
+
+uint32_t hash3(const unsigned char* p) {
+  return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HashBits);
+}
+
+void deflate(const std::vector<unsigned char>& data, std::vector<unsigned char>& ret_out) {
+  BitWriter writer(ret_out);
+  writer.put(1, 1);  // final block
+  writer.put(1, 2);  // fixed Huffman codes
+
+  std::vector<int> head(1 << HashBits, -1);
+  std::vector<int> prev(WindowSize, -1);
+  size_t size = data.size();
+  auto insert = [&](size_t position) {
+    if(position + MinMatch > size)
+      return;
+    uint32_t h = hash3(&data[position]);
+    prev[position & (WindowSize - 1)] = head[h];
+    head[h] = position;
+  };
+
+  size_t i = 0;
+  while(i < size) {
+    unsigned int best_length = 0;
+    unsigned int best_distance = 0;
+    if(i + MinMatch <= size) {
+      unsigned int limit = std::min<size_t>(MaxMatch, size - i);
+      int candidate = head[hash3(&data[i])];
+      for(unsigned int chain = 0; candidate >= 0 && i - candidate <= WindowSize && chain < MaxChain; chain++) {
+        unsigned int length = 0;
+        while(length < limit && data[candidate + length] == data[i + length])
+          length++;
+        if(length > best_length) {
+          best_length = length;
+          best_distance = i - candidate;
+          if(length == limit)
+            break;
+        }
+        // Slots of the window get reused, chains only ever go back.
+        int next = prev[candidate & (WindowSize - 1)];
+        if(next >= candidate)
+          break;
+        candidate = next;
+      }
+    }
+
+    if(best_length >= MinMatch) {
+      match(writer, best_length, best_distance);
+      for(unsigned int k = 0; k < best_length; k++)
+        insert(i + k);
+      i += best_length;
+    } else {
+      literal(writer, data[i]);
+      insert(i);
+      i++;
+    }
+  }
+  literal(writer, 256);
+  writer.flush();
+}
+
+uint32_t adler32(const std::vector<unsigned char>& data) {
+  uint32_t a = 1, b = 0;
+  size_t i = 0;
+  while(i < data.size()) {
+    // Largest run before the sums can overflow.
+    size_t end = std::min<size_t>(data.size(), i + 5552);
+    for(; i < end; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return b << 16 | a;
+}
+
+uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+  static uint32_t table[256];
+  static bool initialized = [] {
+    for(uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for(int k = 0; k < 8; k++)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    }
+    return true;
+  }();
+  (void)initialized;
+  crc = ~crc;
+  for(size_t i = 0; i < size; i++)
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+void put32(std::vector<unsigned char>& out, uint32_t value) {
+  out.push_back(value >> 24);
+  out.push_back(value >> 16);
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+void chunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data) {
+  put32(out, data.size());
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put32(out, crc32(&out[start], out.size() - start));
+}
+
+unsigned char paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if(pa <= pb && pa <= pc)
+    return a;
+  return pb <= pc ? b : c;
+}
+
+}
+
+void EncodePNG(const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int source_channels,
+               unsigned int channels, bool bottom_up, std::vector<unsigned char>& ret_png) {
+  size_t row_bytes = (size_t)width * channels;
+  std::vector<unsigned char> filtered((row_bytes + 1) * height);
+  std::vector<unsigned char> row(row_bytes);
+  std::vector<unsigned char> above(row_bytes, 0);
+  for(unsigned int y = 0; y < height; y++) {
+    const unsigned char* source = pixels + (size_t)(bottom_up ? height - 1 - y : y) * width * source_channels;
+    for(unsigned int x = 0; x < width; x++)
+      for(unsigned int c = 0; c < channels; c++)
+        row[x * channels + c] = source[x * source_channels + c];
+
+    unsigned char* out = &filtered[y * (row_bytes + 1)];
+    out[0] = 4;  // Paeth
+    for(size_t i = 0; i < row_bytes; i++) {
+      int left = i >= channels ? row[i - channels] : 0;
+      int upper_left = i >= channels ? above[i - channels] : 0;
+      out[i + 1] = row[i] - paeth(left, above[i], upper_left);
+    }
+    row.swap(above);
+  }
+
+  std::vector<unsigned char> compressed = {0x78, 0x01};
+  deflate(filtered, compressed);
+  put32(compressed, adler32(filtered));
+
+  static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  ret_png.assign(signature, signature + 8);
+  std::vector<unsigned char> header;
+  put32(header, width);
+  put32(header, height);
+  header.push_back(8);
+  header.push_back(channels == 4 ? 6 : 2);
+  header.push_back(0);
+  header.push_back(0);
+  header.push_back(0);
+  chunk(ret_png, "IHDR", header);
+  chunk(ret_png, "IDAT", compressed);
+  chunk(ret_png, "IEND", {});
+}
+
+bool WritePNG(const char* path, const unsigned char* pixels, unsigned int width, unsigned int height,
+              unsigned int source_channels, unsigned int channels, bool bottom_up, size_t* ret_bytes) {
+  std::vector<unsigned char> png;
+  EncodePNG(pixels, width, height, source_channels, channels, bottom_up, png);
+  std::ofstream file(path, std::ios::binary);
+  file.write((const char*)png.data(), png.size());
+  if(!file) {
+    std::cout << "Failed to write " << path << std::endl;
+    return false;
+  }
+  if(ret_bytes)
+    *ret_bytes = png.size();
+  return true;
+}
@@ -0,0 +1,137 @@
+#include <jobs.hpp>
+
+namespace {
+
+// The system the calling thread works for and the deque it owns there, a
+// worker of one system submitting to another is not a worker of the latter.
+struct WorkerThread {
+  const JobSystem* system;
+  unsigned int index;
+};
+
+thread_local WorkerThread t_worker = {nullptr, 0};
+
+}
+
+JobSystem::Deque::Deque() : head_(0), tail_(0) {}
+
+bool JobSystem::Deque::push(const Job& job) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(tail_ - head_ == Capacity)
+    return false;
+  jobs_[tail_++ % Capacity] = job;
+  return true;
+}
+
+bool JobSystem::Deque::pop(Job& job) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(tail_ == head_)
+    return false;
+  job = jobs_[--tail_ % Capacity];
+  return true;
+}
+
+bool JobSystem::Deque::steal(Job& job) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(tail_ == head_)
+    return false;
+  job = jobs_[head_++ % Capacity];
+  return true;
+}
+
+JobSystem::JobSystem(int workers) : running_(true), queued_(0) {
+  if(workers < 0)
+    workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+  for(int i = 0; i <= workers; i++)
+    deques_.emplace_back(new Deque());
+  for(int i = 1; i <= workers; i++)
+    threads_.emplace_back(&JobSystem::worker_loop, this, i);
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    running_ = false;
+  }
+  sleep_cv_.notify_all();
+  for(std::thread& thread : threads_)
+    thread.join();
+}
+
+void JobSystem::run(JobGroup& group, Function function, void* data, unsigned int begin, unsigned int end) {
+  Job job = {function, data, begin, end, &group};
+  group.pending_.fetch_add(1, std::memory_order_relaxed);
+
+  unsigned int index = deque_index();
+  queued_.fetch_add(1, std::memory_order_release);
+  if(threads_.empty() || !deques_[index]->push(job)) {
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    execute(job);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  sleep_cv_.notify_one();
+}
+
+// Sleeps alongside the idle workers once nothing is left to help with, the
+// last job of the group or new work wakes it up.
+void JobSystem::wait(JobGroup& group) {
+  unsigned int index = deque_index();
+  Job job;
+  while(!group.done()) {
+    if(acquire(index, job)) {
+      execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.wait(lock, [this, &group] { return group.done() || queued_.load() > 0; });
+  }
+}
+
+unsigned int JobSystem::worker_count() const {
+  return threads_.size();
+}
+
+// Deque 0 for threads that are not workers of this system.
+unsigned int JobSystem::deque_index() const {
+  return t_worker.system == this ? t_worker.index : 0;
+}
+
+bool JobSystem::acquire(unsigned int index, Job& job) {
+  if(queued_.load(std::memory_order_acquire) == 0)
+    return false;
+  bool found = deques_[index]->pop(job);
+  for(unsigned int i = 1; !found && i < deques_.size(); i++)
+    found = deques_[(index + i) % deques_.size()]->steal(job);
+  if(found)
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+  return found;
+}
+
+void JobSystem::execute(const Job& job) {
+  job.function(job.data, job.begin, job.end);
+  if(job.group->pending_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+  // Waiters check the group under the lock, so they can not miss this.
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  sleep_cv_.notify_all();
+}
+
+void JobSystem::worker_loop(unsigned int index) {
+  t_worker = {this, index};
+  Job job;
+  while(running_) {
+    if(acquire(index, job)) {
+      execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.wait(lock, [this] { return !running_ || queued_.load() > 0; });
+  }
+}
@@ -0,0 +1,322 @@
+#include <lightmap.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const unsigned int TraceGrain = 256;
+// Texels at most this far from a triangle still bake it, so slivers
+// thinner than a texel get one.
+const float MaxSampleDistance = 1.0f;
+// Passes filling the texels around the charts, as wide as their padding.
+const unsigned int DilatePasses = 2;
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Point of the triangle abc closest to p, as barycentric weights.
+glm::vec3 closest_point(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+  glm::vec2 ab = b - a, ac = c - a, ap = p - a;
+  float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+  if(d1 <= 0.0f && d2 <= 0.0f)
+    return glm::vec3(1.0f, 0.0f, 0.0f);
+  glm::vec2 bp = p - b;
+  float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+  if(d3 >= 0.0f && d4 <= d3)
+    return glm::vec3(0.0f, 1.0f, 0.0f);
+  float vc = d1 * d4 - d3 * d2;
+  if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    float v = d1 / (d1 - d3);
+    return glm::vec3(1.0f - v, v, 0.0f);
+  }
+  glm::vec2 cp = p - c;
+  float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+  if(d6 >= 0.0f && d5 <= d6)
+    return glm::vec3(0.0f, 0.0f, 1.0f);
+  float vb = d5 * d2 - d1 * d6;
+  if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    float w = d2 / (d2 - d6);
+    return glm::vec3(1.0f - w, 0.0f, w);
+  }
+  float va = d3 * d6 - d5 * d4;
+  if(va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+    float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    return glm::vec3(0.0f, 1.0f - w, w);
+  }
+  float denominator = 1.0f / (va + vb + vc);
+  float v = vb * denominator, w = vc * denominator;
+  return glm::vec3(1.0f - v - w, v, w);
+}
+
+}
+
+Lightmap::Lightmap(const LightmapSettings& settings) : settings_(settings), stats_(), texture_(0) {
+  // Fibonacci spiral over the unit disc, the light is seen as a disc from
+  // every texel.
+  const float golden_angle = 2.39996323f;
+  for(unsigned int k = 0; k < std::max(1u, settings_.samples); k++) {
+    float radius = std::sqrt((k + 0.5f) / std::max(1u, settings_.samples));
+    disc_.push_back(radius * glm::vec2(std::cos(k * golden_angle), std::sin(k * golden_angle)));
+  }
+}
+
+Lightmap::~Lightmap() {
+  glDeleteTextures(1, &texture_);
+}
+
+void Lightmap::bake(JobSystem& jobs, Scene& scene, const glm::vec3& light_position) {
+  stats_ = LightmapStats();
+  stats_.workers = jobs.worker_count() + 1;
+
+  unsigned int count = scene.instances.size();
+  std::vector<glm::mat4> transforms;
+  InstanceTransforms(scene, transforms);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<glm::vec3> occluders;
+  for(unsigned int i = 0; i < count; i++) {
+    const Instance& instance = scene.instances[i];
+    const MeshData* mesh = instance.model->mesh();
+    if(!(instance.flags & Instance::Static) || !(instance.flags & Instance::CastsShadow) || !mesh)
+      continue;
+    const Model::Lod& lod = mesh->lods[0];
+    for(unsigned int k = lod.first; k < lod.first + lod.count; k++)
+      occluders.push_back(glm::vec3(transforms[i] * glm::vec4(mesh->vertices[mesh->indices[k]], 1.0f)));
+  }
+  bvh_.build(occluders);
+  stats_.occluders = bvh_.triangle_count();
+  stats_.bvh_ms = elapsed_ms(start);
+
+  // Largest squares first on shelves, the atlas doubles until they fit.
+  regions_.clear();
+  size_t area = 0;
+  for(unsigned int i = 0; i < count; i++) {
+    Instance& instance = scene.instances[i];
+    instance.lightmap = glm::vec4(0.0f);
+    unsigned int size = instance.model->lightmap_size();
+    if(!(instance.flags & Instance::Static) || !(instance.flags & Instance::Lit) || !size)
+      continue;
+    regions_.push_back({i, 0, 0, size, 0});
+    area += (size_t)size * size;
+  }
+  std::stable_sort(regions_.begin(), regions_.end(), [](const Region& a, const Region& b) {
+    return a.size > b.size;
+  });
+  unsigned int atlas = 1;
+  while(atlas < settings_.max_size && (size_t)atlas * atlas < area)
+    atlas *= 2;
+  std::vector<Region> placed;
+  while(true) {
+    placed.clear();
+    unsigned int x = 0, y = 0, shelf = 0;
+    for(const Region& region : regions_) {
+      if(x + region.size > atlas) {
+        y += shelf;
+        x = shelf = 0;
+      }
+      if(region.size > atlas || y + region.size > atlas)
+        continue;
+      placed.push_back(region);
+      placed.back().x = x;
+      placed.back().y = y;
+      x += region.size;
+      shelf = std::max(shelf, region.size);
+    }
+    if(placed.size() == regions_.size() || atlas >= settings_.max_size)
+      break;
+    atlas *= 2;
+  }
+  stats_.skipped = regions_.size() - placed.size();
+  regions_.swap(placed);
+  stats_.size = atlas;
+  stats_.instances = regions_.size();
+
+  unsigned int texels = 0;
+  for(Region& region : regions_) {
+    region.first_sample = texels;
+    texels += region.size * region.size;
+    scene.instances[region.instance].lightmap =
+      glm::vec4(glm::vec2((float)region.size / atlas), glm::vec2(region.x, region.y) / (float)atlas);
+  }
+  Sample none = {glm::vec3(0.0f), glm::vec3(0.0f), std::numeric_limits<float>::max()};
+  samples_.assign(texels, none);
+  texels_.assign((size_t)atlas * atlas, glm::vec4(0.0f));
+
+  start = std::chrono::steady_clock::now();
+  {
+    JobGroup group;
+    auto rasterize_regions = [&](unsigned int begin, unsigned int end) {
+      for(unsigned int r = begin; r < end; r++)
+        rasterize(scene, regions_[r], transforms[regions_[r].instance]);
+    };
+    jobs.parallel_for(group, regions_.size(), 1, rasterize_regions);
+    jobs.wait(group);
+  }
+  std::atomic<size_t> rays(0);
+  {
+    JobGroup group;
+    auto trace_samples = [&](unsigned int begin, unsigned int end) {
+      size_t traced = 0;
+      trace(light_position, begin, end, traced);
+      rays += traced;
+    };
+    jobs.parallel_for(group, texels, TraceGrain, trace_samples);
+    jobs.wait(group);
+  }
+  for(const Region& region : regions_)
+    dilate(region);
+  stats_.trace_ms = elapsed_ms(start);
+  stats_.rays = rays;
+  for(const Sample& sample : samples_)
+    stats_.texels += sample.distance <= MaxSampleDistance;
+
+  scene.lightmap_baked = true;
+  scene.lightmap_light_position = light_position;
+}
+
+// Walks the texels around every triangle of every LOD and keeps, per texel,
+// the surface point closest to its center.
+void Lightmap::rasterize(const Scene& scene, const Region& region, const glm::mat4& transform) {
+  const MeshData& mesh = *scene.instances[region.instance].model->mesh();
+  glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+  Sample* samples = &samples_[region.first_sample];
+  int size = region.size;
+
+  for(unsigned int t = 0; t + 2 < mesh.indices.size(); t += 3) {
+    const unsigned int* corners = &mesh.indices[t];
+    glm::vec2 a = mesh.lightmap_uvs[corners[0]] * (float)size;
+    glm::vec2 b = mesh.lightmap_uvs[corners[1]] * (float)size;
+    glm::vec2 c = mesh.lightmap_uvs[corners[2]] * (float)size;
+    glm::vec3 face_normal = glm::cross(mesh.vertices[corners[1]] - mesh.vertices[corners[0]],
+                                       mesh.vertices[corners[2]] - mesh.vertices[corners[0]]);
+
+    glm::vec2 lower = glm::floor(glm::min(a, glm::min(b, c)) - MaxSampleDistance);
+    glm::vec2 upper = glm::ceil(glm::max(a, glm::max(b, c)) + MaxSampleDistance);
+    for(int y = std::max(0, (int)lower.y); y < std::min(size, (int)upper.y); y++) {
+      for(int x = std::max(0, (int)lower.x); x < std::min(size, (int)upper.x); x++) {
+        glm::vec2 center(x + 0.5f, y + 0.5f);
+        glm::vec3 weights = closest_point(center, a, b, c);
+        float distance = glm::distance(center, weights.x * a + weights.y * b + weights.z * c);
+        Sample& sample = samples[y * size + x];
+        if(distance > MaxSampleDistance || distance >= sample.distance)
+          continue;
+
+        glm::vec3 position = weights.x * mesh.vertices[corners[0]] + weights.y * mesh.vertices[corners[1]] +
+          weights.z * mesh.vertices[corners[2]];
+        glm::vec3 normal = face_normal;
+        if(mesh.normals.size())
+          normal = weights.x * mesh.normals[corners[0]] + weights.y * mesh.normals[corners[1]] +
+            weights.z * mesh.normals[corners[2]];
+        normal = normal_matrix * normal;
+        if(glm::dot(normal, normal) == 0.0f)
+          continue;
+        sample.position = glm::vec3(transform * glm::vec4(position, 1.0f));
+        sample.normal = glm::normalize(normal);
+        sample.distance = distance;
+      }
+    }
+  }
+}
+
+void Lightmap::trace(const glm::vec3& light_position, unsigned int begin, unsigned int end, size_t& rays) {
+  unsigned int atlas = stats_.size;
+  auto region = std::upper_bound(regions_.begin(), regions_.end(), begin, [](unsigned int i, const Region& r) {
+    return i < r.first_sample;
+  }) - 1;
+
+  for(unsigned int i = begin; i < end; i++) {
+    while(i >= region->first_sample + region->size * region->size)
+      ++region;
+    const Sample& sample = samples_[i];
+    if(sample.distance > MaxSampleDistance)
+      continue;
+
+    glm::vec3 to_light = light_position - sample.position;
+    float light_distance = glm::length(to_light);
+    glm::vec3 axis = to_light / light_distance;
+    glm::vec3 helper = std::abs(axis.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 tangent = glm::normalize(glm::cross(helper, axis));
+    glm::vec3 bitangent = glm::cross(axis, tangent);
+
+    glm::vec3 origin = sample.position + sample.normal * settings_.bias;
+    unsigned int visible = 0;
+    for(const glm::vec2& offset : disc_) {
+      glm::vec3 target = light_position + settings_.light_radius * (offset.x * tangent + offset.y * bitangent);
+      glm::vec3 direction = target - origin;
+      float length = glm::length(direction);
+      direction /= length;
+      if(glm::dot(direction, sample.normal) <= 0.0f)
+        continue;
+      rays++;
+      if(!bvh_.occluded(origin, direction, length))
+        visible++;
+    }
+
+    float visibility = (float)visible / disc_.size();
+    float irradiance = settings_.light_power * std::max(0.0f, glm::dot(sample.normal, axis)) /
+      (light_distance * light_distance);
+    unsigned int local = i - region->first_sample;
+    unsigned int x = region->x + local % region->size;
+    unsigned int y = region->y + local / region->size;
+    texels_[(size_t)y * atlas + x] = glm::vec4(glm::vec3(irradiance), visibility);
+  }
+}
+
+void Lightmap::dilate(const Region& region) {
+  unsigned int atlas = stats_.size;
+  int size = region.size;
+  std::vector<unsigned char> covered(size * size);
+  for(int i = 0; i < size * size; i++)
+    covered[i] = samples_[region.first_sample + i].distance <= MaxSampleDistance;
+
+  std::vector<unsigned char> next;
+  for(unsigned int pass = 0; pass < DilatePasses; pass++) {
+    next = covered;
+    for(int y = 0; y < size; y++) {
+      for(int x = 0; x < size; x++) {
+        if(covered[y * size + x])
+          continue;
+        glm::vec4 sum(0.0f);
+        int neighbours = 0;
+        for(int dy = -1; dy <= 1; dy++) {
+          for(int dx = -1; dx <= 1; dx++) {
+            int nx = x + dx, ny = y + dy;
+            if(nx < 0 || ny < 0 || nx >= size || ny >= size || !covered[ny * size + nx])
+              continue;
+            sum += texels_[(size_t)(region.y + ny) * atlas + region.x + nx];
+            neighbours++;
+          }
+        }
+        if(!neighbours)
+          continue;
+        texels_[(size_t)(region.y + y) * atlas + region.x + x] = sum / (float)neighbours;
+        next[y * size + x] = 1;
+      }
+    }
+    covered.swap(next);
+  }
+}
+
+void Lightmap::upload() {
+  if(!texture_)
+    glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, stats_.size, stats_.size, 0, GL_RGBA, GL_FLOAT, texels_.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+GLuint Lightmap::texture() const {
+  return texture_;
+}
+
+const LightmapStats& Lightmap::stats() const {
+  return stats_;
+}
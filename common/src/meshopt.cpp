@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <cmath>
+#include <meshopt.hpp>
+
+namespace {
+
+class FifoCache {
+ public:
+  FifoCache(unsigned int vertex_count, unsigned int cache_size)
+    : timestamps_(vertex_count, 0), time_(cache_size + 1), cache_size_(cache_size) {}
+
+  // Returns true on a miss.
+  bool access(unsigned int v) {
+    if(time_ - timestamps_[v] > cache_size_) {
+      timestamps_[v] = time_++;
+      return true;
+    }
+    return false;
+  }
+
+  void reset() {
+    time_ += cache_size_ + 1;
+  }
+
+ private:
+  std::vector<unsigned int> timestamps_;
+  unsigned int time_;
+  unsigned int cache_size_;
+};
+
+unsigned int vertex_count_of(const std::vector<unsigned int>& indices) {
+  unsigned int count = 0;
+  for(unsigned int index : indices)
+    count = std::max(count, index + 1);
+  return count;
+}
+
+// Orders the clusters of triangles between consecutive entries of clusters
+// by how far they face out of the mesh centroid, outermost first.
+void outward_order(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& vertices,
+                   const std::vector<unsigned int>& clusters, std::vector<unsigned int>& ret_order) {
+  glm::vec3 mesh_centroid(0.0f);
+  float mesh_area = 0.0f;
+  std::vector<float> keys(clusters.size() - 1);
+  std::vector<glm::vec3> centroids(keys.size()), normals(keys.size());
+
+  for(unsigned int k = 0; k < keys.size(); k++) {
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for(unsigned int t = clusters[k]; t < clusters[k + 1]; t++) {
+      const glm::vec3& p0 = vertices[indices[t * 3]];
+      const glm::vec3& p1 = vertices[indices[t * 3 + 1]];
+      const glm::vec3& p2 = vertices[indices[t * 3 + 2]];
+      glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      float a = glm::length(n);
+      centroid += (p0 + p1 + p2) * (a / 3.0f);
+      normal += n;
+      area += a;
+    }
+    mesh_centroid += centroid;
+    mesh_area += area;
+    centroids[k] = area > 0.0f ? centroid / area : vertices[indices[clusters[k] * 3]];
+    normals[k] = normal;
+  }
+  if(mesh_area > 0.0f)
+    mesh_centroid /= mesh_area;
+
+  for(unsigned int k = 0; k < keys.size(); k++) {
+    float length = glm::length(normals[k]);
+    keys[k] = length > 0.0f ? glm::dot(centroids[k] - mesh_centroid, normals[k] / length) : 0.0f;
+  }
+
+  ret_order.resize(keys.size());
+  for(unsigned int k = 0; k < ret_order.size(); k++)
+    ret_order[k] = k;
+  std::stable_sort(ret_order.begin(), ret_order.end(),
+                   [&keys](unsigned int a, unsigned int b) { return keys[a] > keys[b]; });
+}
+
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices,
+                                    unsigned int vertex_count,
+                                    unsigned int cache_size) {
+  FifoCache cache(vertex_count, cache_size);
+  std::vector<bool> referenced(vertex_count, false);
+  unsigned int misses = 0, unique = 0;
+
+  for(unsigned int index : indices) {
+    if(cache.access(index))
+      misses++;
+    if(!referenced[index]) {
+      referenced[index] = true;
+      unique++;
+    }
+  }
+
+  VertexCacheStats stats = {0.0f, 0.0f};
+  if(indices.size() >= 3)
+    stats.acmr = (float)misses / (indices.size() / 3);
+  if(unique)
+    stats.atvr = (float)misses / unique;
+  return stats;
+}
+
+void OptimizeVertexCache(std::vector<unsigned int>& indices,
+                         unsigned int vertex_count,
+                         unsigned int cache_size) {
+  unsigned int triangle_count = indices.size() / 3;
+  if(triangle_count == 0)
+    return;
+
+  // Vertex to triangle adjacency in compressed form.
+  std::vector<unsigned int> live(vertex_count, 0), offsets(vertex_count + 1, 0);
+  for(unsigned int index : indices)
+    live[index]++;
+  for(unsigned int v = 0; v < vertex_count; v++)
+    offsets[v + 1] = offsets[v] + live[v];
+  std::vector<unsigned int> adjacency(offsets.back()), fill(offsets.begin(), offsets.end() - 1);
+  for(unsigned int t = 0; t < triangle_count; t++)
+    for(int c = 0; c < 3; c++)
+      adjacency[fill[indices[t * 3 + c]]++] = t;
+
+  std::vector<unsigned int> timestamps(vertex_count, 0);
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<unsigned int> dead_end, candidates, result;
+  result.reserve(indices.size());
+
+  unsigned int time = cache_size + 1;
+  unsigned int cursor = 0;
+  int fanning = indices[0];
+
+  while(fanning >= 0) {
+    candidates.clear();
+    for(unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+      unsigned int t = adjacency[a];
+      if(emitted[t])
+        continue;
+      emitted[t] = true;
+      for(int c = 0; c < 3; c++) {
+        unsigned int v = indices[t * 3 + c];
+        result.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if(time - timestamps[v] > cache_size)
+          timestamps[v] = time++;
+      }
+    }
+
+    // Prefer the candidate that will still be in the cache once its whole
+    // fan has been emitted, the oldest one first.
+    int best = -1, best_priority = -1;
+    for(unsigned int v : candidates) {
+      if(live[v] == 0)
+        continue;
+      int priority = 0;
+      if(time - timestamps[v] + 2 * live[v] <= cache_size)
+        priority = time - timestamps[v];
+      if(priority > best_priority) {
+        best_priority = priority;
+        best = v;
+      }
+    }
+
+    if(best < 0) {
+      while(!dead_end.empty()) {
+        unsigned int v = dead_end.back();
+        dead_end.pop_back();
+        if(live[v] > 0) {
+          best = v;
+          break;
+        }
+      }
+    }
+    if(best < 0) {
+      while(cursor < vertex_count && live[cursor] == 0)
+        cursor++;
+      if(cursor < vertex_count)
+        best = cursor;
+    }
+    fanning = best;
+  }
+
+  indices.swap(result);
+}
+
+void OptimizeOverdraw(std::vector<unsigned int>& indices,
+                      const std::vector<glm::vec3>& vertices,
+                      float threshold,
+                      unsigned int cache_size) {
+  unsigned int triangle_count = indices.size() / 3;
+  if(triangle_count == 0)
+    return;
+  unsigned int vertex_count = std::max<unsigned int>(vertices.size(), vertex_count_of(indices));
+
+  // Hard boundaries are where the cache-ordered stream restarts with three
+  // misses, splitting there costs nothing.
+  std::vector<unsigned int> hard = {0};
+  {
+    FifoCache cache(vertex_count, cache_size);
+    for(unsigned int t = 0; t < triangle_count; t++) {
+      unsigned int misses = 0;
+      for(int c = 0; c < 3; c++)
+        misses += cache.access(indices[t * 3 + c]);
+      if(misses == 3 && t > 0)
+        hard.push_back(t);
+    }
+    hard.push_back(triangle_count);
+  }
+
+  // Soft boundaries split hard clusters wherever the ACMR of the piece so far
+  // stays within threshold of the ACMR of the whole cluster.
+  std::vector<unsigned int> clusters;
+  for(unsigned int h = 0; h + 1 < hard.size(); h++) {
+    unsigned int begin = hard[h], end = hard[h + 1];
+    FifoCache cache(vertex_count, cache_size);
+    unsigned int cluster_misses = 0;
+    for(unsigned int t = begin; t < end; t++)
+      for(int c = 0; c < 3; c++)
+        cluster_misses += cache.access(indices[t * 3 + c]);
+    float cluster_acmr = (float)cluster_misses / (end - begin);
+
+    cache.reset();
+    unsigned int start = begin, misses = 0;
+    clusters.push_back(begin);
+    for(unsigned int t = begin; t < end; t++) {
+      for(int c = 0; c < 3; c++)
+        misses += cache.access(indices[t * 3 + c]);
+      unsigned int count = t - start + 1;
+      if(t + 1 < end && count >= 8 && (float)misses / count <= cluster_acmr * threshold) {
+        clusters.push_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.reset();
+      }
+    }
+  }
+  clusters.push_back(triangle_count);
+
+  std::vector<unsigned int> order;
+  outward_order(indices, vertices, clusters, order);
+
+  std::vector<unsigned int> result;
+  result.reserve(triangle_count * 3);
+  for(unsigned int k : order)
+    result.insert(result.end(), indices.begin() + clusters[k] * 3, indices.begin() + clusters[k + 1] * 3);
+  result.insert(result.end(), indices.begin() + triangle_count * 3, indices.end());
+  indices.swap(result);
+}
+
+void OptimizeVertexFetch(std::vector<unsigned int>& indices,
+                         unsigned int vertex_count,
+                         std::vector<unsigned int>& ret_remap) {
+  const unsigned int unassigned = ~0u;
+  ret_remap.assign(vertex_count, unassigned);
+
+  unsigned int next = 0;
+  for(unsigned int& index : indices) {
+    if(ret_remap[index] == unassigned)
+      ret_remap[index] = next++;
+    index = ret_remap[index];
+  }
+  for(unsigned int& slot : ret_remap)
+    if(slot == unassigned)
+      slot = next++;
+}
+
+namespace {
+
+// Triangles joining a meshlet keep its normals within about 45 degrees of the
+// average, wider cones would rarely face away from any viewer.
+const float MeshletNormalSpread = 0.7f;
+// Triangles after the seed, in cache order, searched for a close one when no
+// triangle shares a vertex with the meshlet, as on meshes with hard edges.
+// Those must be almost parallel to the meshlet.
+const unsigned int MeshletSearchWindow = 256;
+const float MeshletDisjointSpread = 0.95f;
+
+void meshlet_bounds(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& vertices,
+                    const std::vector<glm::vec3>& normals, Meshlet& meshlet) {
+  unsigned int end = meshlet.first + meshlet.count;
+  glm::vec3 lower = vertices[indices[meshlet.first]], upper = lower;
+  glm::vec3 axis(0.0f);
+  for(unsigned int i = meshlet.first; i < end; i++) {
+    lower = glm::min(lower, vertices[indices[i]]);
+    upper = glm::max(upper, vertices[indices[i]]);
+    if(i % 3 == 0)
+      axis += normals[i / 3];
+  }
+  meshlet.center = (lower + upper) * 0.5f;
+  meshlet.radius = 0.0f;
+  for(unsigned int i = meshlet.first; i < end; i++)
+    meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, vertices[indices[i]]));
+
+  meshlet.cone_apex = meshlet.center;
+  meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+  meshlet.cone_cutoff = 2.0f;
+  if(glm::dot(axis, axis) == 0.0f)
+    return;
+  axis = glm::normalize(axis);
+
+  float min_dot = 1.0f;
+  for(unsigned int i = meshlet.first; i < end; i += 3)
+    if(glm::dot(normals[i / 3], normals[i / 3]) > 0.0f)
+      min_dot = std::min(min_dot, glm::dot(axis, normals[i / 3]));
+  if(min_dot <= 0.1f)
+    return;
+
+  // Moves the apex back along the axis until every triangle plane passes in
+  // front of it, so the test holds for viewers close to the meshlet too.
+  float back = 0.0f;
+  for(unsigned int i = meshlet.first; i < end; i += 3) {
+    const glm::vec3& normal = normals[i / 3];
+    if(glm::dot(normal, normal) == 0.0f)
+      continue;
+    back = std::max(back, glm::dot(meshlet.center - vertices[indices[i]], normal) / glm::dot(axis, normal));
+  }
+  meshlet.cone_apex = meshlet.center - axis * back;
+  meshlet.cone_axis = axis;
+  meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+}
+
+void BuildMeshlets(std::vector<unsigned int>& indices,
+                   const std::vector<glm::vec3>& vertices,
+                   std::vector<Meshlet>& ret_meshlets,
+                   unsigned int max_triangles,
+                   unsigned int max_vertices) {
+  unsigned int triangle_count = indices.size() / 3;
+  unsigned int vertex_count = vertex_count_of(indices);
+
+  std::vector<glm::vec3> normals(triangle_count), centroids(triangle_count);
+  for(unsigned int t = 0; t < triangle_count; t++) {
+    const glm::vec3& a = vertices[indices[3 * t]];
+    const glm::vec3& b = vertices[indices[3 * t + 1]];
+    const glm::vec3& c = vertices[indices[3 * t + 2]];
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float length = glm::length(normal);
+    normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    centroids[t] = (a + b + c) / 3.0f;
+  }
+
+  // Triangles around each vertex.
+  std::vector<unsigned int> offsets(vertex_count + 1, 0);
+  for(unsigned int index : indices)
+    offsets[index + 1]++;
+  for(unsigned int v = 0; v < vertex_count; v++)
+    offsets[v + 1] += offsets[v];
+  std::vector<unsigned int> adjacency(indices.size());
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for(unsigned int i = 0; i < indices.size(); i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+
+  const unsigned int none = ~0u;
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<unsigned int> vertex_meshlet(vertex_count, none);
+  std::vector<unsigned int> members, meshlet_vertices;
+  std::vector<unsigned int> result, order;
+  result.reserve(indices.size());
+  order.reserve(triangle_count);
+  size_t first_meshlet = ret_meshlets.size();
+  unsigned int seed = 0;
+  unsigned int meshlet_id = 0;
+
+  while(result.size() < triangle_count * 3) {
+    while(emitted[seed])
+      seed++;
+
+    members.clear();
+    meshlet_vertices.clear();
+    glm::vec3 normal_sum(0.0f), centroid_sum(0.0f);
+    unsigned int next = seed;
+    // Greedily grows the meshlet from the seed over shared vertices,
+    // preferring triangles that add few vertices and bend the cone least.
+    while(next != none) {
+      emitted[next] = true;
+      members.push_back(next);
+      normal_sum += normals[next];
+      centroid_sum += centroids[next];
+      for(unsigned int k = 0; k < 3; k++) {
+        unsigned int v = indices[3 * next + k];
+        if(vertex_meshlet[v] != meshlet_id) {
+          vertex_meshlet[v] = meshlet_id;
+          meshlet_vertices.push_back(v);
+        }
+      }
+      if(members.size() >= max_triangles)
+        break;
+
+      glm::vec3 axis = glm::dot(normal_sum, normal_sum) > 0.0f ? glm::normalize(normal_sum) : glm::vec3(0.0f);
+      auto alignment = [&](unsigned int t) {
+        return glm::dot(normals[t], normals[t]) > 0.0f && glm::dot(axis, axis) > 0.0f ?
+          glm::dot(normals[t], axis) : 1.0f;
+      };
+      auto added_vertices = [&](unsigned int t) {
+        unsigned int added = 0;
+        for(unsigned int k = 0; k < 3; k++)
+          added += vertex_meshlet[indices[3 * t + k]] != meshlet_id;
+        return added;
+      };
+
+      float best_score = 0.0f;
+      next = none;
+      for(unsigned int v : meshlet_vertices) {
+        for(unsigned int a = offsets[v]; a < offsets[v + 1]; a++) {
+          unsigned int t = adjacency[a];
+          if(emitted[t])
+            continue;
+          unsigned int added = added_vertices(t);
+          float aligned = alignment(t);
+          if(meshlet_vertices.size() + added > max_vertices || aligned < MeshletNormalSpread)
+            continue;
+          float score = added + 2.0f * (1.0f - aligned);
+          if(next == none || score < best_score) {
+            next = t;
+            best_score = score;
+          }
+        }
+      }
+      if(next != none)
+        continue;
+
+      glm::vec3 center = centroid_sum / (float)members.size();
+      unsigned int window_end = std::min(triangle_count, seed + MeshletSearchWindow);
+      for(unsigned int t = seed + 1; t < window_end; t++) {
+        if(emitted[t] || meshlet_vertices.size() + added_vertices(t) > max_vertices ||
+           alignment(t) < MeshletDisjointSpread)
+          continue;
+        float score = glm::distance(center, centroids[t]);
+        if(next == none || score < best_score) {
+          next = t;
+          best_score = score;
+        }
+      }
+    }
+
+    std::sort(members.begin(), members.end());
+    Meshlet meshlet;
+    meshlet.first = result.size();
+    meshlet.count = members.size() * 3;
+    for(unsigned int t : members) {
+      result.insert(result.end(), indices.begin() + 3 * t, indices.begin() + 3 * t + 3);
+      order.push_back(t);
+    }
+    ret_meshlets.push_back(meshlet);
+    meshlet_id++;
+  }
+
+  std::vector<glm::vec3> ordered_normals;
+  ordered_normals.reserve(triangle_count);
+  for(unsigned int t : order)
+    ordered_normals.push_back(normals[t]);
+  for(size_t i = first_meshlet; i < ret_meshlets.size(); i++)
+    meshlet_bounds(result, vertices, ordered_normals, ret_meshlets[i]);
+  indices.swap(result);
+}
+
+void OptimizeMeshletOverdraw(std::vector<unsigned int>& indices,
+                             const std::vector<glm::vec3>& vertices,
+                             std::vector<Meshlet>& meshlets,
+                             size_t first_meshlet) {
+  if(first_meshlet >= meshlets.size())
+    return;
+  std::vector<unsigned int> clusters;
+  for(size_t i = first_meshlet; i < meshlets.size(); i++)
+    clusters.push_back(meshlets[i].first / 3);
+  clusters.push_back(indices.size() / 3);
+
+  std::vector<unsigned int> order;
+  outward_order(indices, vertices, clusters, order);
+
+  std::vector<unsigned int> result;
+  std::vector<Meshlet> sorted;
+  result.reserve(indices.size());
+  sorted.reserve(order.size());
+  for(unsigned int k : order) {
+    Meshlet meshlet = meshlets[first_meshlet + k];
+    result.insert(result.end(), indices.begin() + meshlet.first, indices.begin() + meshlet.first + meshlet.count);
+    meshlet.first = result.size() - meshlet.count;
+    sorted.push_back(meshlet);
+  }
+  indices.swap(result);
+  std::copy(sorted.begin(), sorted.end(), meshlets.begin() + first_meshlet);
+}
@@ -3,116 +3,208 @@
 #include <sstream>
 #include <fstream>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
 #include <model.hpp>
+#include <simplify.hpp>
+#include <unwrap.hpp>
+
+namespace {
+
+// Texels kept empty around each chart so bilinear filtering and mips of a
+// lightmap do not bleed between charts, and the largest lightmap a model
+// gets before its density is lowered.
+const unsigned int LightmapPadding = 2;
+const unsigned int MaxLightmapSize = 512;
+
+// Vertex i of the result is vertex remap[i] of stream.
+template <typename T>
+void gather_vertices(std::vector<T>& stream, const std::vector<unsigned int>& remap) {
+  if(stream.empty())
+    return;
+  std::vector<T> gathered(remap.size());
+  for(unsigned int i = 0; i < remap.size(); i++)
+    gathered[i] = stream[remap[i]];
+  stream.swap(gathered);
+}
+
+std::string directory_of(const std::string& path) {
+  size_t slash = path.find_last_of("/\\");
+  return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// Map statements may carry options before the file name, which comes last.
+std::string map_path(std::istringstream& in, const std::string& directory) {
+  std::string token, last;
+  while(in >> token)
+    last = token;
+  return last.empty() ? last : directory + last;
+}
+
+void load_mtl(const std::string& path, std::vector<Material>& ret_materials) {
+  std::ifstream ifs(path);
+  if(!ifs.is_open()) {
+    std::cout << "Could not open " << path << std::endl;
+    return;
+  }
+
+  std::string directory = directory_of(path);
+  std::string line;
+  while(std::getline(ifs, line)) {
+    std::istringstream in(line);
+    std::string keyword;
+    if(!(in >> keyword) || keyword[0] == '#')
+      continue;
+    if(keyword == "newmtl") {
+      Material material = {"", "", "", glm::vec3(1.0f)};
+      in >> material.name;
+      ret_materials.push_back(material);
+    } else if(ret_materials.empty()) {
+      continue;
+    } else if(keyword == "Kd") {
+      glm::vec3& diffuse = ret_materials.back().diffuse;
+      in >> diffuse.x >> diffuse.y >> diffuse.z;
+    } else if(keyword == "map_Kd") {
+      ret_materials.back().albedo = map_path(in, directory);
+    } else if(keyword == "map_Bump" || keyword == "map_bump" || keyword == "bump" || keyword == "norm") {
+      ret_materials.back().normal = map_path(in, directory);
+    }
+  }
+}
+
+// OBJ indices start at 1, negative ones are relative to the end. Returns -1
+// for missing or out of range indices.
+int resolve_index(const std::string& token, size_t count) {
+  if(token.empty())
+    return -1;
+  long index = std::strtol(token.c_str(), nullptr, 10);
+  if(index < 0)
+    index += count;
+  else
+    index -= 1;
+  return index >= 0 && (size_t)index < count ? (int)index : -1;
+}
+
+}
 
 bool LoadOBJ(const char* path,
              std::vector<glm::vec3>& ret_vertices,
              std::vector<glm::vec2>& ret_uvs,
              std::vector<glm::vec3>& ret_normals) {
-  std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-  std::vector<glm::vec3> vertices;
-  std::vector<glm::vec2> uvs;
-  std::vector<glm::vec3> normals;
+  std::vector<unsigned int> triangle_materials;
+  std::vector<Material> materials;
+  return LoadOBJ(path, ret_vertices, ret_uvs, ret_normals, triangle_materials, materials);
+}
 
+bool LoadOBJ(const char* path,
+             std::vector<glm::vec3>& ret_vertices,
+             std::vector<glm::vec2>& ret_uvs,
+             std::vector<glm::vec3>& ret_normals,
+             std::vector<unsigned int>& ret_triangle_materials,
+             std::vector<Material>& ret_materials) {
   std::ifstream ifs(path, std::ios::in);
   if(!ifs.is_open()) {
     std::cout << "Could not open " << path << std::endl;
     return false;
   }
 
-  std::string line;
-  std::stringstream sstr;
-  sstr << ifs.rdbuf();
-  ifs.close();
+  // Position, uv and normal index of each triangle corner.
+  struct Corner {
+    int vertex;
+    int uv;
+    int normal;
+  };
+  std::vector<Corner> corners;
+  std::vector<glm::vec3> vertices;
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+  std::string directory = directory_of(path);
+  int material = -1;
 
-  bool has_normals = false;
-  bool uses_quads = false;
-  bool first_face = true;
+  auto find_material = [&](const std::string& name) {
+    for(unsigned int i = 0; i < ret_materials.size(); i++)
+      if(ret_materials[i].name == name)
+        return (int)i;
+    Material untextured = {name, "", "", glm::vec3(1.0f)};
+    ret_materials.push_back(untextured);
+    return (int)ret_materials.size() - 1;
+  };
 
-  while(std::getline(sstr, line)) {
-    std::stringstream line_sstr;
-    line_sstr << line;
+  std::string line;
+  std::vector<Corner> face;
+  while(std::getline(ifs, line)) {
+    std::istringstream in(line);
     std::string header;
-    line_sstr >> header;
+    if(!(in >> header))
+      continue;
     if(header == "v") {
       glm::vec3 vertex;
-      line_sstr >> vertex.x >> vertex.y >> vertex.z;
+      in >> vertex.x >> vertex.y >> vertex.z;
       vertices.push_back(vertex);
     } else if(header == "vt") {
       glm::vec2 uv;
-      line_sstr >> uv.x >> uv.y;
+      in >> uv.x >> uv.y;
       uvs.push_back(glm::vec2(uv.x, 1.0 - uv.y));
     } else if(header == "vn") {
-      has_normals = true;
       glm::vec3 normal;
-      line_sstr >> normal.x >> normal.y >> normal.z;
+      in >> normal.x >> normal.y >> normal.z;
       normals.push_back(normal);
+    } else if(header == "mtllib") {
+      // Exporters write file names with spaces unquoted.
+      std::string name;
+      std::getline(in >> std::ws, name);
+      name.erase(name.find_last_not_of(" \t\r") + 1);
+      load_mtl(directory + name, ret_materials);
+    } else if(header == "usemtl") {
+      std::string name;
+      in >> name;
+      material = find_material(name);
     } else if(header == "f") {
-      if(first_face) {
-        first_face = false;
-        std::string defs[4];
-        int cnt = 0;
-        while(line_sstr >> defs[cnt])
-          cnt++;
-        if(cnt == 4)
-          uses_quads = true;
-        std::stringstream swap_sstr;
-        for(int i = 0; i < cnt; i++)
-          swap_sstr << defs[i] << " ";
-        line_sstr.swap(swap_sstr);
-      }
-      char ch;
-      unsigned int vertexIndex[4], uvIndex[4], normalIndex[4];
-
-      int limit = uses_quads ? 4 : 3;
-      for(int i = 0; i < limit; i++) {
-        line_sstr >> vertexIndex[i] >> ch >> uvIndex[i];
-        if(has_normals)
-          line_sstr >> ch >> normalIndex[i];
-      }
-
-      vertexIndices.push_back(vertexIndex[0]);
-      vertexIndices.push_back(vertexIndex[1]);
-      vertexIndices.push_back(vertexIndex[2]);
-      uvIndices.push_back(uvIndex[0]);
-      uvIndices.push_back(uvIndex[1]);
-      uvIndices.push_back(uvIndex[2]);
-      if(has_normals) {
-        normalIndices.push_back(normalIndex[0]);
-        normalIndices.push_back(normalIndex[1]);
-        normalIndices.push_back(normalIndex[2]);
-      }
-
-      if(uses_quads) {
-        vertexIndices.push_back(vertexIndex[2]);
-        vertexIndices.push_back(vertexIndex[3]);
-        vertexIndices.push_back(vertexIndex[0]);
-        uvIndices.push_back(uvIndex[2]);
-        uvIndices.push_back(uvIndex[3]);
-        uvIndices.push_back(uvIndex[0]);
-        if(has_normals) {
-          normalIndices.push_back(normalIndex[2]);
-          normalIndices.push_back(normalIndex[3]);
-          normalIndices.push_back(normalIndex[0]);
+      face.clear();
+      std::string token;
+      while(in >> token) {
+        size_t first_slash = token.find('/');
+        size_t second_slash = first_slash == std::string::npos ? first_slash : token.find('/', first_slash + 1);
+        Corner corner = {resolve_index(token.substr(0, first_slash), vertices.size()), -1, -1};
+        if(first_slash != std::string::npos)
+          corner.uv = resolve_index(token.substr(first_slash + 1, second_slash - first_slash - 1), uvs.size());
+        if(second_slash != std::string::npos)
+          corner.normal = resolve_index(token.substr(second_slash + 1), normals.size());
+        if(corner.vertex < 0) {
+          std::cout << path << ": bad face index " << token << std::endl;
+          return false;
         }
+        face.push_back(corner);
+      }
+      if(material < 0)
+        material = find_material("");
+      for(size_t i = 1; i + 1 < face.size(); i++) {
+        corners.push_back(face[0]);
+        corners.push_back(face[i]);
+        corners.push_back(face[i + 1]);
+        ret_triangle_materials.push_back(material);
       }
-      
     }
   }
 
-  for(int i=0; i < vertexIndices.size(); i++ ) {
-    int vertexIndex = vertexIndices[i];
-    glm::vec3 vertex = vertices[vertexIndex - 1];
-    ret_vertices.push_back(vertex);
-
-    int uvIndex = uvIndices[i];
-    glm::vec2 uv = uvs[uvIndex - 1];
-    ret_uvs.push_back(uv);
-
-    if(has_normals) {
-      int normalIndex = normalIndices[i];
-      glm::vec3 normal = normals[normalIndex - 1];
-      ret_normals.push_back(normal);
+  ret_vertices.reserve(ret_vertices.size() + corners.size());
+  for(size_t i = 0; i < corners.size(); i += 3) {
+    glm::vec3 face_normal(0.0f);
+    if(normals.size()) {
+      const glm::vec3& v0 = vertices[corners[i].vertex];
+      glm::vec3 n = glm::cross(vertices[corners[i + 1].vertex] - v0, vertices[corners[i + 2].vertex] - v0);
+      if(glm::length(n) > 0.0f)
+        face_normal = glm::normalize(n);
+    }
+    for(size_t c = i; c < i + 3; c++) {
+      ret_vertices.push_back(vertices[corners[c].vertex]);
+      if(uvs.size())
+        ret_uvs.push_back(corners[c].uv >= 0 ? uvs[corners[c].uv] : glm::vec2(0.0f));
+      if(normals.size())
+        ret_normals.push_back(corners[c].normal >= 0 ? normals[corners[c].normal] : face_normal);
     }
   }
   return true;
@@ -165,117 +257,389 @@ void ComputeTangents(std::vector<glm::vec3>& vertices,
 	}
 }
 
-Model::Model(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals)
-  : vertexbuffer_(0), uvbuffer_(0), normalbuffer_(0), tangentbuffer_(0), bitangentbuffer_(0) {
-  glGenVertexArrays(1, &VAO_);
-  glBindVertexArray(VAO_);
-  
-  glGenBuffers(1, &vertexbuffer_);
-  glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
-
-  glEnableVertexAttribArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-  glVertexAttribPointer(
-    0,
-    3,
-    GL_FLOAT,
-    GL_FALSE,
-    0,
-    (void*)0
-  );
-
-  if(uvs.size()) {
-    glGenBuffers(1, &uvbuffer_);
-    glBindBuffer(GL_ARRAY_BUFFER, uvbuffer_);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(), GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uvbuffer_);
-    glVertexAttribPointer(
-      1,
-      2,
-      GL_FLOAT,
-      GL_FALSE,
-      0,
-      (void*)0
-    );
+void ComputeTangents(const std::vector<glm::vec3>& vertices,
+                     const std::vector<glm::vec2>& uvs,
+                     const std::vector<glm::vec3>& normals,
+                     const std::vector<unsigned int>& indices,
+                     std::vector<glm::vec3>& tangents,
+                     std::vector<glm::vec3>& bitangents) {
+  tangents.assign(vertices.size(), glm::vec3(0.0f));
+  bitangents.assign(vertices.size(), glm::vec3(0.0f));
+
+  for (int i = 0; i + 2 < indices.size(); i += 3) {
+    unsigned int i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+
+    glm::vec3 deltaPos1 = vertices[i1] - vertices[i0];
+    glm::vec3 deltaPos2 = vertices[i2] - vertices[i0];
+
+    glm::vec2 deltaUV1 = uvs[i1] - uvs[i0];
+    glm::vec2 deltaUV2 = uvs[i2] - uvs[i0];
+
+    float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+    glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+    glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+
+    tangents[i0] += tangent;
+    tangents[i1] += tangent;
+    tangents[i2] += tangent;
+
+    bitangents[i0] += bitangent;
+    bitangents[i1] += bitangent;
+    bitangents[i2] += bitangent;
+  }
+
+  for (int i = 0; i < vertices.size(); i++) {
+    const glm::vec3& n = normals[i];
+    glm::vec3& t = tangents[i];
+    glm::vec3& b = bitangents[i];
+
+    t = glm::normalize(t - n * glm::dot(n, t));
+
+    if (glm::dot(glm::cross(n, t), b) < 0.0f){
+      t = t * -1.0f;
+    }
+  }
+}
+
+namespace {
+
+struct VertexKey {
+  glm::vec3 position;
+  glm::vec2 uv;
+  glm::vec3 normal;
+
+  bool operator==(const VertexKey& o) const {
+    return position == o.position && uv == o.uv && normal == o.normal;
   }
+};
 
-  if(normals.size()) {
-    glGenBuffers(1, &normalbuffer_);
-    glBindBuffer(GL_ARRAY_BUFFER, normalbuffer_);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec2), normals.data(), GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, normalbuffer_);
-    glVertexAttribPointer(
-      2,
-      3,
-      GL_FLOAT,
-      GL_FALSE,
-      0,
-      (void*)0
-    );
+struct VertexKeyHash {
+  size_t operator()(const VertexKey& key) const {
+    uint32_t h[8];
+    std::memcpy(h, &key.position, sizeof(float) * 3);
+    std::memcpy(h + 3, &key.uv, sizeof(float) * 2);
+    std::memcpy(h + 5, &key.normal, sizeof(float) * 3);
+    size_t hash = 0;
+    for(uint32_t x : h)
+      hash = hash * 31 + x;
+    return hash;
   }
+};
 
-  if(normals.size() && uvs.size()) {
-    std::vector<glm::vec3> tangents, bitangents;
-    ComputeTangents(vertices, uvs, normals, tangents, bitangents);
-
-    glGenBuffers(1, &tangentbuffer_);
-    glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer_);
-    glBufferData(GL_ARRAY_BUFFER, tangents.size() * sizeof(glm::vec2), tangents.data(), GL_STATIC_DRAW);
-
-    glGenBuffers(1, &bitangentbuffer_);
-    glBindBuffer(GL_ARRAY_BUFFER, bitangentbuffer_);
-    glBufferData(GL_ARRAY_BUFFER, bitangents.size() * sizeof(glm::vec2), bitangents.data(), GL_STATIC_DRAW);
-
-    
-
-    glEnableVertexAttribArray(3);
-    glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer_);
-    glVertexAttribPointer(
-      3,
-      3,
-      GL_FLOAT,
-      GL_FALSE,
-      0,
-      (void*)0
-    );
-
-    glEnableVertexAttribArray(4);
-    glBindBuffer(GL_ARRAY_BUFFER, bitangentbuffer_);
-    glVertexAttribPointer(
-      4,
-      3,
-      GL_FLOAT,
-      GL_FALSE,
-      0,
-      (void*)0
-    );
+// Appends a chain of halving LODs of indices to indices, stopping once the
+// simplifier cannot make meaningful progress. parts holds those of the base
+// level, or nothing for a single material, and gets those of every level.
+// Each part is simplified on its own, by one simplifier for all levels, a
+// part too small to simplify is kept as it is.
+void append_lods(const std::vector<glm::vec3>& vertices,
+                 unsigned int lod_levels,
+                 std::vector<unsigned int>& indices,
+                 std::vector<Model::Lod>& lods,
+                 std::vector<Model::Part>& parts) {
+  if(parts.empty())
+    parts.push_back({0, 0, (unsigned int)indices.size()});
+  unsigned int part_count = parts.size();
+  lods.push_back({0, (unsigned int)indices.size(), 0.0f, 0, 0, 0, part_count});
+
+  std::vector<std::vector<std::vector<unsigned int>>> part_levels(part_count);
+  std::vector<std::vector<float>> part_errors(part_count);
+  for(unsigned int p = 0; p < part_count; p++) {
+    std::vector<unsigned int> source(indices.begin() + parts[p].first,
+                                     indices.begin() + parts[p].first + parts[p].count);
+    SimplifyMeshLevels(vertices, source, lod_levels, part_levels[p], part_errors[p]);
+  }
+
+  for(unsigned int level = 1; level <= lod_levels; level++) {
+    const Model::Lod previous = lods.back();
+    Model::Lod lod = {(unsigned int)indices.size(), 0, previous.error, 0, 0, (unsigned int)parts.size(),
+                      part_count};
+    std::vector<unsigned int> simplified;
+    for(unsigned int p = 0; p < part_count; p++) {
+      Model::Part part = parts[previous.first_part + p];
+      simplified = part_levels[p][level - 1];
+      if(simplified.empty() || simplified.size() >= part.count)
+        simplified.assign(indices.begin() + part.first, indices.begin() + part.first + part.count);
+      else
+        lod.error = std::max(lod.error, part_errors[p][level - 1]);
+      part.first = lod.first + lod.count;
+      part.count = simplified.size();
+      lod.count += part.count;
+      indices.insert(indices.end(), simplified.begin(), simplified.end());
+      parts.push_back(part);
+    }
+
+    if(lod.count > previous.count * 9 / 10) {
+      indices.resize(lod.first);
+      parts.resize(lod.first_part);
+      break;
+    }
+    lods.push_back(lod);
+  }
+}
+
+template <typename T>
+void reorder_triangles(const std::vector<unsigned int>& order, std::vector<T>& corners) {
+  if(corners.empty())
+    return;
+  std::vector<T> sorted;
+  sorted.reserve(corners.size());
+  for(unsigned int triangle : order)
+    sorted.insert(sorted.end(), corners.begin() + triangle * 3, corners.begin() + triangle * 3 + 3);
+  corners.swap(sorted);
+}
+
+// Reorders the triangles of a soup by material, keeping their order within
+// a material, and returns the parts of the result.
+void sort_by_material(std::vector<glm::vec3>& vertices,
+                      std::vector<glm::vec2>& uvs,
+                      std::vector<glm::vec3>& normals,
+                      std::vector<unsigned int>& triangle_materials,
+                      std::vector<Model::Part>& ret_parts) {
+  std::vector<unsigned int> order(triangle_materials.size());
+  for(unsigned int i = 0; i < order.size(); i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+    return triangle_materials[a] < triangle_materials[b];
+  });
+
+  reorder_triangles(order, vertices);
+  reorder_triangles(order, uvs);
+  reorder_triangles(order, normals);
+
+  for(unsigned int i = 0; i < order.size(); i++) {
+    unsigned int material = triangle_materials[order[i]];
+    if(ret_parts.empty() || ret_parts.back().material != material)
+      ret_parts.push_back({material, i * 3, 0});
+    ret_parts.back().count += 3;
   }
+  std::sort(triangle_materials.begin(), triangle_materials.end());
+}
 
-  size_ = vertices.size();
-  my_v = vertices;
+}
+
+void IndexVertices(const std::vector<glm::vec3>& vertices,
+                   const std::vector<glm::vec2>& uvs,
+                   const std::vector<glm::vec3>& normals,
+                   std::vector<glm::vec3>& ret_vertices,
+                   std::vector<glm::vec2>& ret_uvs,
+                   std::vector<glm::vec3>& ret_normals,
+                   std::vector<unsigned int>& ret_indices) {
+  std::unordered_map<VertexKey, unsigned int, VertexKeyHash> unique;
+  unique.reserve(vertices.size());
+  ret_indices.reserve(vertices.size());
+
+  for(int i = 0; i < vertices.size(); i++) {
+    VertexKey key = {vertices[i],
+                     uvs.size() ? uvs[i] : glm::vec2(0.0f),
+                     normals.size() ? normals[i] : glm::vec3(0.0f)};
+    auto it = unique.emplace(key, (unsigned int)ret_vertices.size());
+    if(it.second) {
+      ret_vertices.push_back(vertices[i]);
+      if(uvs.size())
+        ret_uvs.push_back(uvs[i]);
+      if(normals.size())
+        ret_normals.push_back(normals[i]);
+    }
+    ret_indices.push_back(it.first->second);
+  }
+}
+
+float LodProjectionScale(float fovy, float viewport_height) {
+  return viewport_height / (2.0f * std::tan(fovy * 0.5f));
+}
+
+void OptimizeMesh(MeshData& mesh) {
+  const Model::Lod& base_lod = mesh.lods[0];
+  std::vector<unsigned int> base(mesh.indices.begin() + base_lod.first,
+                                 mesh.indices.begin() + base_lod.first + base_lod.count);
+  mesh.cache_before = AnalyzeVertexCache(base, mesh.vertices.size());
+
+  if(mesh.parts.empty()) {
+    for(Model::Lod& lod : mesh.lods) {
+      lod.first_part = mesh.parts.size();
+      lod.part_count = 1;
+      mesh.parts.push_back({0, lod.first, lod.count});
+    }
+  }
+
+  // Parts are optimized on their own so their triangles never mix.
+  mesh.meshlets.clear();
+  for(Model::Lod& lod : mesh.lods) {
+    lod.first_meshlet = mesh.meshlets.size();
+    for(unsigned int p = lod.first_part; p < lod.first_part + lod.part_count; p++) {
+      Model::Part& part = mesh.parts[p];
+      std::vector<unsigned int> range(mesh.indices.begin() + part.first,
+                                      mesh.indices.begin() + part.first + part.count);
+      // Meshlets regroup the triangles, so they are sorted for overdraw as
+      // a whole rather than the cache-ordered clusters before them.
+      OptimizeVertexCache(range, mesh.vertices.size());
+      part.first_meshlet = mesh.meshlets.size();
+      BuildMeshlets(range, mesh.vertices, mesh.meshlets);
+      OptimizeMeshletOverdraw(range, mesh.vertices, mesh.meshlets, part.first_meshlet);
+      part.meshlet_count = mesh.meshlets.size() - part.first_meshlet;
+      for(unsigned int i = part.first_meshlet; i < mesh.meshlets.size(); i++)
+        mesh.meshlets[i].first += part.first;
+      std::copy(range.begin(), range.end(), mesh.indices.begin() + part.first);
+    }
+    lod.meshlet_count = mesh.meshlets.size() - lod.first_meshlet;
+  }
+
+  std::vector<unsigned int> remap;
+  OptimizeVertexFetch(mesh.indices, mesh.vertices.size(), remap);
+  RemapVertexStream(mesh.vertices, remap);
+  RemapVertexStream(mesh.uvs, remap);
+  RemapVertexStream(mesh.normals, remap);
+  RemapVertexStream(mesh.lightmap_uvs, remap);
+
+  base.assign(mesh.indices.begin() + base_lod.first, mesh.indices.begin() + base_lod.first + base_lod.count);
+  mesh.cache_after = AnalyzeVertexCache(base, mesh.vertices.size());
+}
+
+void UnwrapLightmap(MeshData& mesh, float texels_per_unit) {
+  std::vector<UnwrapRange> ranges;
+  for(const Model::Lod& lod : mesh.lods)
+    ranges.push_back({lod.first, lod.count});
+  std::vector<unsigned int> remap;
+  UnwrapLightmap(mesh.vertices, mesh.indices, ranges, texels_per_unit, LightmapPadding, MaxLightmapSize, remap,
+                 mesh.lightmap_uvs, mesh.lightmap_size);
+  gather_vertices(mesh.vertices, remap);
+  gather_vertices(mesh.uvs, remap);
+  gather_vertices(mesh.normals, remap);
+}
+
+bool LoadMesh(const char* path, unsigned int lod_levels, MeshData& ret_mesh, float lightmap_texels_per_unit) {
+  std::vector<glm::vec3> vertices, normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<unsigned int> triangle_materials;
+  if(!LoadOBJ(path, vertices, uvs, normals, triangle_materials, ret_mesh.materials))
+    return false;
+  if(vertices.empty()) {
+    std::cout << path << ": no faces" << std::endl;
+    return false;
+  }
+
+  // Indexing keeps the triangle order, so the parts of the soup are those of
+  // the base level.
+  sort_by_material(vertices, uvs, normals, triangle_materials, ret_mesh.parts);
+  IndexVertices(vertices, uvs, normals, ret_mesh.vertices, ret_mesh.uvs, ret_mesh.normals, ret_mesh.indices);
+  append_lods(ret_mesh.vertices, lod_levels, ret_mesh.indices, ret_mesh.lods, ret_mesh.parts);
+  if(lightmap_texels_per_unit > 0.0f)
+    UnwrapLightmap(ret_mesh, lightmap_texels_per_unit);
+  OptimizeMesh(ret_mesh);
+  return true;
+}
+
+size_t MeshData::gpu_bytes() const {
+  return vertices.size() * sizeof(ArenaVertex) + indices.size() * sizeof(unsigned int);
+}
+
+Model::Model(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals,
+             unsigned int lod_levels, float lightmap_texels_per_unit)
+  : base_vertex_(0), vertex_count_(0), first_index_(0), size_(0), lightmap_size_(0) {
+  MeshData mesh;
+  IndexVertices(vertices, uvs, normals, mesh.vertices, mesh.uvs, mesh.normals, mesh.indices);
+  append_lods(mesh.vertices, lod_levels, mesh.indices, mesh.lods, mesh.parts);
+  if(lightmap_texels_per_unit > 0.0f)
+    UnwrapLightmap(mesh, lightmap_texels_per_unit);
+  OptimizeMesh(mesh);
+  adopt(mesh);
+}
+
+Model::Model(std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals,
+             std::vector<unsigned int>& indices, std::vector<Lod>& lods)
+  : base_vertex_(0), vertex_count_(0), first_index_(0), size_(0), lightmap_size_(0) {
+  MeshData mesh = {vertices, uvs, normals, indices, lods};
+  if(mesh.lods.empty())
+    mesh.lods.push_back({0, (unsigned int)indices.size(), 0.0f});
+  OptimizeMesh(mesh);
+  adopt(mesh);
+}
+
+Model::Model(const MeshData& mesh)
+  : base_vertex_(0), vertex_count_(0), first_index_(0), size_(0), lightmap_size_(0) {
+  adopt(mesh);
+}
+
+void Model::adopt(const MeshData& mesh) {
+  lods_ = mesh.lods;
+  meshlets_ = mesh.meshlets;
+  parts_ = mesh.parts;
+  materials_ = mesh.materials;
+  cache_before_ = mesh.cache_before;
+  cache_after_ = mesh.cache_after;
+  lightmap_size_ = mesh.lightmap_uvs.empty() ? 0 : mesh.lightmap_size;
+  if(lightmap_size_)
+    mesh_ = std::make_shared<MeshData>(mesh);
+  upload(mesh.vertices, mesh.uvs, mesh.normals, mesh.lightmap_uvs, mesh.indices);
+}
+
+void Model::upload(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec2>& uvs,
+                   const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& lightmap_uvs,
+                   const std::vector<unsigned int>& indices) {
+  GeometryArena* arena = GeometryArena::current();
+  if(!arena) {
+    std::cout << "No geometry arena to upload the model to" << std::endl;
+    lods_.clear();
+    return;
+  }
+
+  std::vector<glm::vec3> tangents, bitangents;
+  if(normals.size() && uvs.size())
+    ComputeTangents(vertices, uvs, normals, indices, tangents, bitangents);
+
+  std::vector<ArenaVertex> interleaved(vertices.size());
+  for(int i = 0; i < vertices.size(); i++) {
+    ArenaVertex& v = interleaved[i];
+    v.position = vertices[i];
+    v.uv = uvs.size() ? uvs[i] : glm::vec2(0.0f);
+    v.normal = normals.size() ? normals[i] : glm::vec3(0.0f);
+    v.tangent = tangents.size() ? tangents[i] : glm::vec3(0.0f);
+    v.bitangent = bitangents.size() ? bitangents[i] : glm::vec3(0.0f);
+    v.lightmap_uv = lightmap_uvs.size() ? lightmap_uvs[i] : glm::vec2(0.0f);
+  }
+  arena->allocate(interleaved, indices, base_vertex_, first_index_);
+  vertex_count_ = vertices.size();
+
+  glm::vec3 lower(0.0f), upper(0.0f);
+  if(vertices.size())
+    lower = upper = vertices[0];
+  for(const glm::vec3& v : vertices) {
+    lower = glm::min(lower, v);
+    upper = glm::max(upper, v);
+  }
+  center_ = (lower + upper) * 0.5f;
+  radius_ = 0.0f;
+  for(const glm::vec3& v : vertices)
+    radius_ = std::max(radius_, glm::distance(center_, v));
+
+  size_ = indices.size();
+  query_vertices_ = vertices;
+  if(lods_.size())
+    query_indices_.assign(indices.begin() + lods_[0].first, indices.begin() + lods_[0].first + lods_[0].count);
 }
 
 Model::Model(Model &&other)
 {
+  base_vertex_ = other.base_vertex_;
+  vertex_count_ = other.vertex_count_;
+  first_index_ = other.first_index_;
   size_ = other.size_;
-  VAO_ = other.VAO_;
-  vertexbuffer_ = other.vertexbuffer_;
-  uvbuffer_ = other.uvbuffer_;
-  normalbuffer_ = other.normalbuffer_;
-  tangentbuffer_ = other.tangentbuffer_;
-  bitangentbuffer_ = other.bitangentbuffer_;
+  lods_ = std::move(other.lods_);
+  meshlets_ = std::move(other.meshlets_);
+  parts_ = std::move(other.parts_);
+  materials_ = std::move(other.materials_);
+  cache_before_ = other.cache_before_;
+  cache_after_ = other.cache_after_;
+  lightmap_size_ = other.lightmap_size_;
+  mesh_ = std::move(other.mesh_);
+  center_ = other.center_;
+  radius_ = other.radius_;
+  query_vertices_ = std::move(other.query_vertices_);
+  query_indices_ = std::move(other.query_indices_);
+  bvh_ = std::move(other.bvh_);
+  other.vertex_count_ = 0;
   other.size_ = 0;
-  other.VAO_ = 0;
-  other.vertexbuffer_ = 0;
-  other.uvbuffer_ = 0;
-  other.normalbuffer_ = 0;
-  other.tangentbuffer_ = 0;
-  other.bitangentbuffer_ = 0;
+  other.lods_.clear();
 }
 
 Model& Model::operator=(Model &&other)
@@ -283,59 +647,167 @@ Model& Model::operator=(Model &&other)
   if(this == &other)
     return *this;
   
-  glDeleteBuffers(1, &vertexbuffer_);
-	glDeleteBuffers(1, &uvbuffer_);
-  glDeleteBuffers(1, &normalbuffer_);
-  glDeleteBuffers(1, &tangentbuffer_);
-  glDeleteBuffers(1, &bitangentbuffer_);
-	glDeleteVertexArrays(1, &VAO_);
+  release();
 
+  base_vertex_ = other.base_vertex_;
+  vertex_count_ = other.vertex_count_;
+  first_index_ = other.first_index_;
   size_ = other.size_;
-  VAO_ = other.VAO_;
-  vertexbuffer_ = other.vertexbuffer_;
-  uvbuffer_ = other.uvbuffer_;
-  normalbuffer_ = other.normalbuffer_;
-  tangentbuffer_ = other.tangentbuffer_;
-  bitangentbuffer_ = other.bitangentbuffer_;
+  lods_ = std::move(other.lods_);
+  meshlets_ = std::move(other.meshlets_);
+  parts_ = std::move(other.parts_);
+  materials_ = std::move(other.materials_);
+  cache_before_ = other.cache_before_;
+  cache_after_ = other.cache_after_;
+  lightmap_size_ = other.lightmap_size_;
+  mesh_ = std::move(other.mesh_);
+  center_ = other.center_;
+  radius_ = other.radius_;
+  query_vertices_ = std::move(other.query_vertices_);
+  query_indices_ = std::move(other.query_indices_);
+  bvh_ = std::move(other.bvh_);
+  other.vertex_count_ = 0;
   other.size_ = 0;
-  other.VAO_ = 0;
-  other.vertexbuffer_ = 0;
-  other.uvbuffer_ = 0;
-  other.normalbuffer_ = 0;
-  other.tangentbuffer_ = 0;
-  other.bitangentbuffer_ = 0;
+  other.lods_.clear();
   return *this;
 }
 
-std::shared_ptr<Model> Model::FromOBJ(const char* path) {
-  std::vector<glm::vec3> vertices, normals;
-  std::vector<glm::vec2> uvs;
-  LoadOBJ(path, vertices, uvs, normals);
+std::shared_ptr<Model> Model::FromOBJ(const char* path, unsigned int lod_levels, float lightmap_texels_per_unit) {
+  MeshData mesh;
+  if(!LoadMesh(path, lod_levels, mesh, lightmap_texels_per_unit))
+    return nullptr;
 
-  return std::make_shared<Model>(vertices, uvs, normals);
+  return std::make_shared<Model>(mesh);
 }
 
 Model::~Model() {
-  glDeleteBuffers(1, &vertexbuffer_);
-	glDeleteBuffers(1, &uvbuffer_);
-  glDeleteBuffers(1, &normalbuffer_);
-  glDeleteBuffers(1, &tangentbuffer_);
-  glDeleteBuffers(1, &bitangentbuffer_);
-  
-	glDeleteVertexArrays(1, &VAO_);
+  release();
+}
+
+void Model::release() {
+  GeometryArena* arena = GeometryArena::current();
+  if(arena && (vertex_count_ || size_))
+    arena->free(base_vertex_, vertex_count_, first_index_, size_);
+  vertex_count_ = 0;
+  size_ = 0;
 }
 
 void Model::render() {
-  GLint value;
-  
-  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
-  if(value != VAO_) {
-    glBindVertexArray(VAO_);
-  }  
-  glDrawArrays(GL_TRIANGLES, 0, size_ * 3);
+  render(0);
+}
+
+void Model::render(unsigned int lod) {
+  if(lods_.empty())
+    return;
+
+  GeometryArena::current()->bind();
+  const Lod& level = lods_[std::min<size_t>(lod, lods_.size() - 1)];
+  glDrawElementsBaseVertex(GL_TRIANGLES, level.count, GL_UNSIGNED_INT,
+                           (void*)((size_t)(first_index_ + level.first) * sizeof(unsigned int)), base_vertex_);
+}
+
+DrawElementsIndirectCommand Model::indirect(unsigned int lod, unsigned int base_instance) const {
+  const Lod& level = lods_[std::min<size_t>(lod, lods_.size() - 1)];
+  DrawElementsIndirectCommand command = {level.count, 1, first_index_ + level.first,
+                                         (GLint)base_vertex_, base_instance};
+  return command;
+}
+
+DrawElementsIndirectCommand Model::indirect(const Range& range, unsigned int base_instance) const {
+  DrawElementsIndirectCommand command = {range.count, 1, first_index_ + range.first, (GLint)base_vertex_,
+                                         base_instance};
+  return command;
+}
+
+const Model::Lod& Model::lod(unsigned int lod) const {
+  return lods_[std::min<size_t>(lod, lods_.size() - 1)];
+}
+
+const std::vector<Meshlet>& Model::meshlets() const {
+  return meshlets_;
+}
+
+const std::vector<Model::Part>& Model::parts() const {
+  return parts_;
+}
+
+const std::vector<Material>& Model::materials() const {
+  return materials_;
+}
+
+unsigned int Model::material_count() const {
+  return std::max<size_t>(1, materials_.size());
+}
+
+const VertexCacheStats& Model::cache_before() const {
+  return cache_before_;
+}
+
+const VertexCacheStats& Model::cache_after() const {
+  return cache_after_;
+}
+
+unsigned int Model::lightmap_size() const {
+  return lightmap_size_;
+}
+
+const MeshData* Model::mesh() const {
+  return mesh_.get();
+}
+
+void Model::build_bvh(JobSystem& jobs) {
+  if(bvh_)
+    return;
+  std::vector<glm::vec3> triangles(query_indices_.size());
+  for(size_t i = 0; i < query_indices_.size(); i++)
+    triangles[i] = query_vertices_[query_indices_[i]];
+  std::shared_ptr<TriangleBVH> bvh = std::make_shared<TriangleBVH>();
+  bvh->build(jobs, triangles);
+  bvh_ = bvh;
+  std::vector<glm::vec3>().swap(query_vertices_);
+  std::vector<unsigned int>().swap(query_indices_);
+}
+
+const TriangleBVH* Model::bvh() const {
+  return bvh_.get();
 }
 
-std::shared_ptr<Model> Model::FlatModel(float base_x, float base_y, glm::vec3 lower_left, glm::vec3 lower_right, glm::vec3 upper_right) {
+unsigned int Model::select_lod(const glm::mat4& model, const glm::vec3& eye,
+                               float projection_scale, float max_pixel_error) const {
+  float scale = std::max(glm::length(glm::vec3(model[0])),
+                         std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  glm::vec3 center = glm::vec3(model * glm::vec4(center_, 1.0f));
+  float distance = glm::distance(eye, center) - radius_ * scale;
+  if(distance <= 0.0f)
+    return 0;
+
+  unsigned int lod = 0;
+  for(unsigned int i = 1; i < lods_.size(); i++) {
+    if(lods_[i].error * scale * projection_scale / distance > max_pixel_error)
+      break;
+    lod = i;
+  }
+  return lod;
+}
+
+unsigned int Model::select_lod_ortho(const glm::mat4& model, float pixels_per_unit, float max_pixel_error) const {
+  float scale = std::max(glm::length(glm::vec3(model[0])),
+                         std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  unsigned int lod = 0;
+  for(unsigned int i = 1; i < lods_.size(); i++) {
+    if(lods_[i].error * scale * pixels_per_unit > max_pixel_error)
+      break;
+    lod = i;
+  }
+  return lod;
+}
+
+unsigned int Model::lod_count() const {
+  return lods_.size();
+}
+
+std::shared_ptr<Model> Model::FlatModel(float base_x, float base_y, glm::vec3 lower_left, glm::vec3 lower_right, glm::vec3 upper_right,
+                                        float lightmap_texels_per_unit) {
   glm::vec3 upper_left = lower_left + (upper_right - lower_right);
 
   std::vector<glm::vec3> vertices, normals;
@@ -363,86 +835,243 @@ std::shared_ptr<Model> Model::FlatModel(float base_x, float base_y, glm::vec3 lo
   for(int i = 0; i < 6; i++)
     normals.push_back(normal);
 
-  return std::make_shared<Model>(vertices, uvs, normals);
+  return std::make_shared<Model>(vertices, uvs, normals, 0, lightmap_texels_per_unit);
 }
 
 namespace {
 
-std::vector<glm::vec3> generate_icosahedron() {
-  float phi = (1.0f + sqrt(5.0f)) * 0.5f;
-  float a = 1.0f;
-  float b = 1.0f / phi;
-
-  glm::vec3 v1 = glm::normalize(glm::vec3(0, b, -a));
-  glm::vec3 v2 = glm::normalize(glm::vec3(b, a, 0));
-  glm::vec3 v3 = glm::normalize(glm::vec3(-b, a, 0));
-  glm::vec3 v4 = glm::normalize(glm::vec3(0, b, a));
-  glm::vec3 v5 = glm::normalize(glm::vec3(0, -b, a));
-  glm::vec3 v6 = glm::normalize(glm::vec3(-a, 0, b));
-  glm::vec3 v7 = glm::normalize(glm::vec3(0, -b, -a));
-  glm::vec3 v8 = glm::normalize(glm::vec3(a, 0, -b));
-  glm::vec3 v9 = glm::normalize(glm::vec3(a, 0, b));
-  glm::vec3 v10 = glm::normalize(glm::vec3(-a, 0, -b));
-  glm::vec3 v11 = glm::normalize(glm::vec3(b, -a, 0));
-  glm::vec3 v12 = glm::normalize(glm::vec3(-b, -a, 0));
-
-  std::vector<glm::vec3> v = {
-    v3, v2, v1,
-    v2, v3, v4,
-    v6, v5, v4,
-    v5, v9, v4,
-    v8, v7, v1,
-    v7, v10, v1,
-    v12, v11, v5,
-    v11, v12, v7,
-    v10, v6, v3,
-    v6, v10, v12,
-    v9, v8, v2,
-    v8, v9, v11,
-    v3, v6, v4,
-    v9, v2, v4,
-    v10, v3, v1,
-    v2, v8, v1,
-    v12, v10, v7,
-    v8, v11, v7,
-    v6, v12, v5,
-    v11, v9, v5
+// Builds every subdivision level of an icosphere over one shared vertex array.
+// Each level only appends the midpoints of the edges of the previous one.
+class Icosphere {
+ public:
+  explicit Icosphere(uint16_t divisions) {
+    // With room for the copies add_sphere_attributes makes along the u seam,
+    // up to 5 * 2^divisions of them when it maps every level.
+    vertices_.reserve(10 * ((size_t)1 << (2 * divisions)) + 2 + ((size_t)6 << divisions));
+    levels_.reserve(divisions + 1);
+    if(divisions)
+      edges_.reserve((10 * ((size_t)1 << (2 * divisions - 2)) + 2) * MaxValence);
+
+    float phi = (1.0f + sqrt(5.0f)) * 0.5f;
+    float a = 1.0f;
+    float b = 1.0f / phi;
+
+    vertices_ = {
+      glm::normalize(glm::vec3(0, b, -a)),
+      glm::normalize(glm::vec3(b, a, 0)),
+      glm::normalize(glm::vec3(-b, a, 0)),
+      glm::normalize(glm::vec3(0, b, a)),
+      glm::normalize(glm::vec3(0, -b, a)),
+      glm::normalize(glm::vec3(-a, 0, b)),
+      glm::normalize(glm::vec3(0, -b, -a)),
+      glm::normalize(glm::vec3(a, 0, -b)),
+      glm::normalize(glm::vec3(a, 0, b)),
+      glm::normalize(glm::vec3(-a, 0, -b)),
+      glm::normalize(glm::vec3(b, -a, 0)),
+      glm::normalize(glm::vec3(-b, -a, 0))
+    };
+
+    levels_.push_back({
+      2, 1, 0,
+      1, 2, 3,
+      5, 4, 3,
+      4, 8, 3,
+      7, 6, 0,
+      6, 9, 0,
+      11, 10, 4,
+      10, 11, 6,
+      9, 5, 2,
+      5, 9, 11,
+      8, 7, 1,
+      7, 8, 10,
+      2, 5, 3,
+      8, 1, 3,
+      9, 2, 0,
+      1, 7, 0,
+      11, 9, 6,
+      7, 10, 6,
+      5, 11, 4,
+      10, 8, 4
+    });
+
+    while(divisions-- > 0)
+      subdivide();
+  }
+
+  std::vector<glm::vec3> vertices_;
+  // Index lists of all levels, coarsest first.
+  std::vector<std::vector<unsigned int>> levels_;
+
+ private:
+  // Vertices of an icosphere have five or six neighbours.
+  static const unsigned int MaxValence = 6;
+
+  struct Edge {
+    unsigned int other;
+    unsigned int midpoint;
   };
 
-  return v;
-}
+  // Edges are kept with their lower vertex, a handful of slots each.
+  unsigned int midpoint(unsigned int a, unsigned int b) {
+    if(a > b)
+      std::swap(a, b);
+    Edge* slots = &edges_[(size_t)a * MaxValence];
+    for(unsigned int i = 0; i < edge_counts_[a]; i++)
+      if(slots[i].other == b)
+        return slots[i].midpoint;
+    unsigned int index = vertices_.size();
+    slots[edge_counts_[a]++] = {b, index};
+    vertices_.push_back(glm::normalize((vertices_[a] + vertices_[b]) * 0.5f));
+    return index;
+  }
 
-}
+  void subdivide() {
+    std::vector<unsigned int> fine;
+    fine.reserve(levels_.back().size() * 4);
+    edges_.resize(vertices_.size() * MaxValence);
+    edge_counts_.assign(vertices_.size(), 0);
 
-std::shared_ptr<Model> Model::Sphere(uint16_t divisions) {
-  std::vector<glm::vec3> v = generate_icosahedron();
-  
-  while(divisions-- > 0) {
-    std::vector<glm::vec3> new_v;
-
-    for(int i = 0; i < v.size(); i += 3) {
-      glm::vec3 v1 = v[i], v2 = v[i + 1], v3 = v[i + 2];
-      glm::vec3 w1 = (v1 + v2) / 2.0f,
-                w2 = (v2 + v3) / 2.0f,
-                w3 = (v3 + v1) / 2.0f;
-      w1 = glm::normalize(w1);
-      w2 = glm::normalize(w2);
-      w3 = glm::normalize(w3);
-      std::vector<glm::vec3> new_triangles = {
+    const std::vector<unsigned int>& coarse = levels_.back();
+    for(int i = 0; i < coarse.size(); i += 3) {
+      unsigned int v1 = coarse[i], v2 = coarse[i + 1], v3 = coarse[i + 2];
+      unsigned int w1 = midpoint(v1, v2),
+                   w2 = midpoint(v2, v3),
+                   w3 = midpoint(v3, v1);
+      unsigned int new_triangles[] = {
         v1, w1, w3,
         w1, v2, w2,
         w1, w2, w3,
         w2, v3, w3
       };
+      fine.insert(fine.end(), std::begin(new_triangles), std::end(new_triangles));
+    }
+
+    levels_.push_back(std::move(fine));
+  }
+
+  std::vector<Edge> edges_;
+  std::vector<unsigned char> edge_counts_;
+};
+
+// Deviation of a level from the unit sphere is the sagitta of its flattest
+// face.
+float sphere_error(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices) {
+  float error = 0.0f;
+  for(int i = 0; i + 2 < indices.size(); i += 3) {
+    const glm::vec3& v0 = vertices[indices[i]];
+    glm::vec3 n = glm::normalize(glm::cross(vertices[indices[i + 1]] - v0, vertices[indices[i + 2]] - v0));
+    error = std::max(error, 1.0f - std::abs(glm::dot(n, v0)));
+  }
+  return error;
+}
+
+// Spherical mapping. Triangles straddling the u seam get copies of their
+// low-u vertices shifted by one so that u does not wrap back across them.
+// The copies are counted first, vertices of an Icosphere have room for them
+// and the attributes get as much.
+void add_sphere_attributes(std::vector<glm::vec3>& vertices,
+                           std::vector<glm::vec2>& uvs,
+                           std::vector<glm::vec3>& normals,
+                           std::vector<unsigned int>& indices) {
+  const float pi = 3.14159265358979f;
+  const unsigned int NoCopy = ~0u;
+  uvs.reserve(vertices.capacity());
+  normals.reserve(vertices.capacity());
+  for(const glm::vec3& v : vertices) {
+    uvs.push_back(glm::vec2(0.5f + std::atan2(v.z, v.x) / (2.0f * pi),
+                            0.5f - std::asin(glm::clamp(v.y, -1.0f, 1.0f)) / pi));
+    normals.push_back(v);
+  }
+
+  auto straddles = [&](int i) {
+    float low = std::min(uvs[indices[i]].x, std::min(uvs[indices[i + 1]].x, uvs[indices[i + 2]].x));
+    float high = std::max(uvs[indices[i]].x, std::max(uvs[indices[i + 1]].x, uvs[indices[i + 2]].x));
+    return high - low > 0.5f;
+  };
+  std::vector<unsigned int> wrapped(vertices.size(), NoCopy);
+  unsigned int count = vertices.size();
+  for(int i = 0; i + 2 < indices.size(); i += 3) {
+    if(!straddles(i))
+      continue;
+    for(int c = 0; c < 3; c++) {
+      unsigned int index = indices[i + c];
+      if(uvs[index].x < 0.5f && wrapped[index] == NoCopy)
+        wrapped[index] = count++;
+    }
+  }
+  vertices.reserve(count);
+  uvs.reserve(count);
+  normals.reserve(count);
 
-      for(auto vertex : new_triangles)
-        new_v.push_back(vertex);
+  for(int i = 0; i + 2 < indices.size(); i += 3) {
+    if(!straddles(i))
+      continue;
+    for(int c = 0; c < 3; c++) {
+      unsigned int& index = indices[i + c];
+      if(wrapped[index] == NoCopy)
+        continue;
+      if(wrapped[index] == vertices.size()) {
+        vertices.push_back(vertices[index]);
+        normals.push_back(normals[index]);
+        uvs.push_back(uvs[index] + glm::vec2(1.0f, 0.0f));
+      }
+      index = wrapped[index];
     }
+  }
+}
 
-    v = new_v;
+// Lays the levels out finest first, as LODs of a single index buffer.
+void sphere_lods(const Icosphere& sphere, std::vector<unsigned int>& indices, std::vector<Model::Lod>& lods) {
+  size_t total = 0;
+  for(const std::vector<unsigned int>& level : sphere.levels_)
+    total += level.size();
+  indices.reserve(total);
+
+  for(auto level = sphere.levels_.rbegin(); level != sphere.levels_.rend(); ++level) {
+    lods.push_back({(unsigned int)indices.size(), (unsigned int)level->size(),
+                    sphere_error(sphere.vertices_, *level)});
+    indices.insert(indices.end(), level->begin(), level->end());
   }
+}
 
-  std::vector<glm::vec2> uv;
+}
+
+void GenerateIcosphere(uint16_t divisions,
+                       std::vector<glm::vec3>& ret_vertices,
+                       std::vector<unsigned int>& ret_indices) {
+  Icosphere sphere(divisions);
+  ret_vertices.swap(sphere.vertices_);
+  ret_indices.swap(sphere.levels_.back());
+}
+
+void GenerateIcosphere(uint16_t divisions,
+                       std::vector<glm::vec3>& ret_vertices,
+                       std::vector<glm::vec2>& ret_uvs,
+                       std::vector<glm::vec3>& ret_normals,
+                       std::vector<unsigned int>& ret_indices) {
+  GenerateIcosphere(divisions, ret_vertices, ret_indices);
+  add_sphere_attributes(ret_vertices, ret_uvs, ret_normals, ret_indices);
+}
+
+std::shared_ptr<Model> Model::Sphere(uint16_t divisions) {
+  Icosphere sphere(divisions);
+  std::vector<glm::vec2> uvs;
   std::vector<glm::vec3> normals;
-  return std::make_shared<Model>(v, uv, normals);
+  std::vector<unsigned int> indices;
+  std::vector<Lod> lods;
+  sphere_lods(sphere, indices, lods);
+  add_sphere_attributes(sphere.vertices_, uvs, normals, indices);
+
+  return std::make_shared<Model>(sphere.vertices_, uvs, normals, indices, lods);
+}
+
+std::shared_ptr<Model> Model::LightProxySphere(uint16_t divisions) {
+  Icosphere sphere(divisions);
+  std::vector<glm::vec2> uvs;
+  std::vector<glm::vec3> normals;
+  std::vector<unsigned int> indices;
+  std::vector<Lod> lods;
+  sphere_lods(sphere, indices, lods);
+
+  return std::make_shared<Model>(sphere.vertices_, uvs, normals, indices, lods);
 }
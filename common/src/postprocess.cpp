@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <iostream>
+#include <postprocess.hpp>
+
+namespace {
+
+GLuint CreateTarget(GLenum internal_format, unsigned int width, unsigned int height) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+bool FramebufferComplete(const char* name) {
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE)
+    return true;
+  std::cout << "Incomplete framebuffer: " << name << std::endl;
+  return false;
+}
+
+}
+
+PostProcess::PostProcess(unsigned int width, unsigned int height, unsigned int max_levels)
+  : width_(width), height_(height), scale_(1.0f), scene_width_(width), scene_height_(height),
+    downsample_shader_("shaders/Fullscreen.vert",
+                       NULL,
+                       "shaders/BloomDownsample.frag"),
+    upsample_shader_("shaders/Fullscreen.vert",
+                     NULL,
+                     "shaders/BloomUpsample.frag"),
+    tonemap_shader_("shaders/Fullscreen.vert",
+                    NULL,
+                    "shaders/Tonemap.frag") {
+  downsample_shader_.use();
+  downsample_shader_.set_int("Source", 0);
+  upsample_shader_.use();
+  upsample_shader_.set_int("Source", 0);
+  tonemap_shader_.use();
+  tonemap_shader_.set_int("Scene", 0);
+  tonemap_shader_.set_int("Bloom", 1);
+
+  scene_texture_ = CreateTarget(GL_RGBA16F, width_, height_);
+  glGenTextures(1, &scene_depth_);
+  glBindTexture(GL_TEXTURE_2D, scene_depth_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width_, height_, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glGenFramebuffers(1, &scene_framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, scene_framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scene_texture_, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, scene_depth_, 0);
+  FramebufferComplete("scene");
+
+  // Bloom mips start at half resolution and stop before they get smaller
+  // than a few pixels.
+  unsigned int level_width = width_ / 2, level_height = height_ / 2;
+  while(levels_.size() < max_levels && std::min(level_width, level_height) >= 4) {
+    Level level = {CreateTarget(GL_R11F_G11F_B10F, level_width, level_height), 0, level_width, level_height};
+    glGenFramebuffers(1, &level.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level.texture, 0);
+    FramebufferComplete("bloom");
+    levels_.push_back(level);
+    level_width /= 2;
+    level_height /= 2;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glGenVertexArrays(1, &fullscreen_vao_);
+}
+
+PostProcess::~PostProcess() {
+  for(Level& level : levels_) {
+    glDeleteFramebuffers(1, &level.framebuffer);
+    glDeleteTextures(1, &level.texture);
+  }
+  glDeleteFramebuffers(1, &scene_framebuffer_);
+  glDeleteTextures(1, &scene_depth_);
+  glDeleteTextures(1, &scene_texture_);
+  glDeleteVertexArrays(1, &fullscreen_vao_);
+}
+
+bool PostProcess::is_valid() {
+  return downsample_shader_.is_valid() && upsample_shader_.is_valid() && tonemap_shader_.is_valid();
+}
+
+void PostProcess::begin_scene(float scale) {
+  scale_ = std::min(1.0f, std::max(0.1f, scale));
+  scene_width_ = std::max(1u, (unsigned int)(width_ * scale_ + 0.5f));
+  scene_height_ = std::max(1u, (unsigned int)(height_ * scale_ + 0.5f));
+
+  glBindFramebuffer(GL_FRAMEBUFFER, scene_framebuffer_);
+  glViewport(0, 0, scene_width_, scene_height_);
+}
+
+void PostProcess::bright_pass(const BloomSettings& settings) {
+  glDisable(GL_DEPTH_TEST);
+  glBindVertexArray(fullscreen_vao_);
+
+  downsample_shader_.use();
+  downsample_shader_.set_int("BrightPass", 1);
+  downsample_shader_.set_vec3("Threshold", {settings.threshold, settings.threshold - settings.knee,
+                                            0.25f / std::max(settings.knee, 1e-4f)});
+  downsample_shader_.set_vec2("SourceTexelSize", {1.0f / width_, 1.0f / height_});
+  set_scene_region(downsample_shader_);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, scene_texture_);
+  bind_level(levels_[0]);
+  draw_fullscreen();
+}
+
+void PostProcess::downsample() {
+  downsample_shader_.use();
+  downsample_shader_.set_int("BrightPass", 0);
+  downsample_shader_.set_vec2("SourceScale", {1.0f, 1.0f});
+  downsample_shader_.set_vec2("SourceClamp", {1.0f, 1.0f});
+
+  glActiveTexture(GL_TEXTURE0);
+  for(unsigned int i = 1; i < levels_.size(); i++) {
+    const Level& source = levels_[i - 1];
+    downsample_shader_.set_vec2("SourceTexelSize", {1.0f / source.width, 1.0f / source.height});
+    glBindTexture(GL_TEXTURE_2D, source.texture);
+    bind_level(levels_[i]);
+    draw_fullscreen();
+  }
+}
+
+void PostProcess::upsample(const BloomSettings& settings) {
+  upsample_shader_.use();
+  upsample_shader_.set_float("Radius", settings.radius);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  glActiveTexture(GL_TEXTURE0);
+  for(unsigned int i = levels_.size() - 1; i > 0; i--) {
+    const Level& source = levels_[i];
+    upsample_shader_.set_vec2("SourceTexelSize", {1.0f / source.width, 1.0f / source.height});
+    glBindTexture(GL_TEXTURE_2D, source.texture);
+    bind_level(levels_[i - 1]);
+    draw_fullscreen();
+  }
+  glDisable(GL_BLEND);
+}
+
+void PostProcess::composite(const BloomSettings& settings, GLuint framebuffer) {
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, width_, height_);
+
+  tonemap_shader_.use();
+  // Every mip got added into the first one, normalize to keep the
+  // intensity independent of the level count.
+  tonemap_shader_.set_float("BloomIntensity", settings.intensity / levels_.size());
+  tonemap_shader_.set_float("Exposure", settings.exposure);
+  tonemap_shader_.set_vec2("SceneSize", {(float)width_, (float)height_});
+  tonemap_shader_.set_int("Upscale", scale_ < 1.0f);
+  set_scene_region(tonemap_shader_);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, scene_texture_);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, levels_[0].texture);
+  draw_fullscreen();
+
+  glEnable(GL_DEPTH_TEST);
+}
+
+unsigned int PostProcess::level_count() const {
+  return levels_.size();
+}
+
+float PostProcess::scale() const {
+  return scale_;
+}
+
+unsigned int PostProcess::scene_width() const {
+  return scene_width_;
+}
+
+unsigned int PostProcess::scene_height() const {
+  return scene_height_;
+}
+
+GLuint PostProcess::scene_depth() const {
+  return scene_depth_;
+}
+
+void PostProcess::bind_level(const Level& level) {
+  glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+  glViewport(0, 0, level.width, level.height);
+}
+
+void PostProcess::draw_fullscreen() {
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// Maps full screen UVs onto the rendered part of the scene target and keeps
+// bilinear taps from reaching the stale texels next to it.
+void PostProcess::set_scene_region(const Shader& shader) {
+  shader.set_vec2("SourceScale", {(float)scene_width_ / width_, (float)scene_height_ / height_});
+  shader.set_vec2("SourceClamp", {(scene_width_ - 0.5f) / width_, (scene_height_ - 0.5f) / height_});
+}
@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <renderer.hpp>
+
+namespace {
+
+const char* ShadowMatrixNames[6] = {
+  "ShadowMatrices[0]",
+  "ShadowMatrices[1]",
+  "ShadowMatrices[2]",
+  "ShadowMatrices[3]",
+  "ShadowMatrices[4]",
+  "ShadowMatrices[5]"
+};
+
+const GLenum TransformTextureUnit = GL_TEXTURE3;
+const int TransformTextureIndex = 3;
+const GLenum CascadeTextureUnit = GL_TEXTURE4;
+const int CascadeTextureIndex = 4;
+const int PageTableIndex = Texture::PageTableUnit - GL_TEXTURE0;
+const int AlbedoCacheIndex = VirtualTextureCache::AlbedoCacheUnit - GL_TEXTURE0;
+const int NormalCacheIndex = VirtualTextureCache::NormalCacheUnit - GL_TEXTURE0;
+const GLenum LightmapTextureUnit = GL_TEXTURE8;
+const int LightmapTextureIndex = 8;
+const GLenum LightmapRectTextureUnit = GL_TEXTURE9;
+const int LightmapRectTextureIndex = 9;
+const GLenum ShadowMaskTextureUnit = GL_TEXTURE10;
+const int ShadowMaskTextureIndex = 10;
+
+const char* CascadeMatrixNames[FrameCommands::MaxCascades] = {
+  "CascadeMatrices[0]",
+  "CascadeMatrices[1]",
+  "CascadeMatrices[2]",
+  "CascadeMatrices[3]"
+};
+
+// Order of the passes in the indirect buffer, the cube faces and cascades
+// take one each.
+enum Pass : unsigned int {
+  ShadowPass,
+  LitPass = ShadowPass + FrameCommands::CubeFaces,
+  UnlitPass,
+  CascadePass
+};
+
+const DrawPass& PassAt(const FrameCommands& commands, unsigned int pass) {
+  if(pass < LitPass)
+    return commands.shadow[pass - ShadowPass];
+  if(pass == LitPass)
+    return commands.lit;
+  if(pass == UnlitPass)
+    return commands.unlit;
+  return commands.cascades[pass - CascadePass];
+}
+
+}
+
+Renderer::Renderer(unsigned int width, unsigned int height, unsigned int shadow_resolution,
+                   unsigned int cascade_resolution, VirtualTextureCache* virtual_textures)
+  : width_(width), height_(height), shadow_resolution_(shadow_resolution), cascade_resolution_(cascade_resolution),
+    tex_shader_("shaders/ShadowedNormal.vert",
+                NULL,
+                "shaders/ShadowedNormal.frag"),
+    cube_shadow_shader_("shaders/CubeShadowMap.vert",
+                        "shaders/CubeShadowMap.geom",
+                        "shaders/CubeShadowMap.frag"),
+    monocolor_shader_("shaders/Monocolor.vert",
+                      NULL,
+                      "shaders/Monocolor.frag"),
+    cascade_shader_("shaders/CascadeShadowMap.vert",
+                    NULL,
+                    "shaders/CascadeShadowMap.frag"),
+    feedback_shader_("shaders/ShadowedNormal.vert",
+                     NULL,
+                     "shaders/VirtualFeedback.frag"),
+    prepass_shader_("shaders/ShadowedNormal.vert",
+                    NULL,
+                    "shaders/DepthPrepass.frag"),
+    post_(width, height),
+    shadow_mask_(width, height),
+    timer_({"shadow", "shadow mask", "scene", "feedback", "bright pass", "downsample", "upsample", "composite"}),
+    virtual_textures_(virtual_textures) {
+  bloom.threshold = 1.0f;
+  bloom.knee = 0.5f;
+  bloom.intensity = 1.0f;
+  bloom.radius = 1.0f;
+  bloom.exposure = 1.0f;
+  render_scale = 1.0f;
+  output_framebuffer = 0;
+  lightmap_texture = 0;
+  shadow_mask_divisor = 0;
+
+  monocolor_shader_.use();
+  // Well above 1 so the light bulb blooms.
+  monocolor_shader_.set_vec3("Color", {8.0f, 8.0f, 8.0f});
+  monocolor_shader_.set_int("Transforms", TransformTextureIndex);
+
+  cube_shadow_shader_.use();
+  cube_shadow_shader_.set_int("Transforms", TransformTextureIndex);
+
+  cascade_shader_.use();
+  cascade_shader_.set_int("Transforms", TransformTextureIndex);
+
+  tex_shader_.use();
+  tex_shader_.set_int("DiffuseTextureSampler", 0);
+  tex_shader_.set_int("NormalTextureSampler", 1);
+  tex_shader_.set_int("DepthSampler", 2);
+  tex_shader_.set_int("Transforms", TransformTextureIndex);
+  tex_shader_.set_int("CascadeSampler", CascadeTextureIndex);
+  tex_shader_.set_int("PageTable", PageTableIndex);
+  tex_shader_.set_int("AlbedoCache", AlbedoCacheIndex);
+  tex_shader_.set_int("NormalCache", NormalCacheIndex);
+  tex_shader_.set_int("VirtualTexture", 0);
+  tex_shader_.set_int("Lightmap", LightmapTextureIndex);
+  tex_shader_.set_int("LightmapRects", LightmapRectTextureIndex);
+  tex_shader_.set_int("ShadowMask", ShadowMaskTextureIndex);
+
+  feedback_shader_.use();
+  feedback_shader_.set_int("Transforms", TransformTextureIndex);
+  feedback_shader_.set_int("PageTable", PageTableIndex);
+  feedback_shader_.set_int("LightmapRects", LightmapRectTextureIndex);
+
+  prepass_shader_.use();
+  prepass_shader_.set_int("Transforms", TransformTextureIndex);
+  prepass_shader_.set_int("LightmapRects", LightmapRectTextureIndex);
+
+  tex_offset_location_ = tex_shader_.location("DrawOffset");
+  cube_shadow_offset_location_ = cube_shadow_shader_.location("DrawOffset");
+  cube_shadow_face_location_ = cube_shadow_shader_.location("Face");
+  monocolor_offset_location_ = monocolor_shader_.location("DrawOffset");
+  cascade_offset_location_ = cascade_shader_.location("DrawOffset");
+  cascade_matrix_location_ = cascade_shader_.location("LightMatrix");
+  tex_virtual_location_ = tex_shader_.location("VirtualTexture");
+  feedback_offset_location_ = feedback_shader_.location("DrawOffset");
+  feedback_virtual_location_ = feedback_shader_.location("VirtualTexture");
+  prepass_offset_location_ = prepass_shader_.location("DrawOffset");
+
+  multi_draw_indirect_ = GLAD_GL_VERSION_4_3;
+  std::cout << "Draw submission: " << (multi_draw_indirect_ ? "multi-draw indirect" : "base vertex loop")
+            << std::endl;
+
+  glGenBuffers(1, &transformbuffer_);
+  glBindBuffer(GL_TEXTURE_BUFFER, transformbuffer_);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+  glGenTextures(1, &transform_texture_);
+  glBindTexture(GL_TEXTURE_BUFFER, transform_texture_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, transformbuffer_);
+
+  glGenBuffers(1, &lightmapbuffer_);
+  glBindBuffer(GL_TEXTURE_BUFFER, lightmapbuffer_);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+  glGenTextures(1, &lightmap_rect_texture_);
+  glBindTexture(GL_TEXTURE_BUFFER, lightmap_rect_texture_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightmapbuffer_);
+
+  glGenBuffers(1, &indirectbuffer_);
+
+  // Utilities for shadow mapping
+  glGenFramebuffers(1, &depth_map_fbo_);
+  glGenTextures(1, &depth_cubemap_);
+
+  glBindTexture(GL_TEXTURE_CUBE_MAP, depth_cubemap_);
+  for (int i = 0; i < 6; i++)
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, 
+                 shadow_resolution_, shadow_resolution_, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, depth_map_fbo_);
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_cubemap_, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+
+  // Sun cascades, one layer each, sampled with hardware depth comparison.
+  cascade_fbo_ = 0;
+  cascade_texture_ = 0;
+  if(cascade_resolution_) {
+    glGenTextures(1, &cascade_texture_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cascade_texture_);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, cascade_resolution_, cascade_resolution_,
+                 FrameCommands::MaxCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glGenFramebuffers(1, &cascade_fbo_);
+    glBindFramebuffer(GL_FRAMEBUFFER, cascade_fbo_);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascade_texture_, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+Renderer::~Renderer() {
+  glDeleteFramebuffers(1, &cascade_fbo_);
+  glDeleteTextures(1, &cascade_texture_);
+  glDeleteBuffers(1, &indirectbuffer_);
+  glDeleteTextures(1, &transform_texture_);
+  glDeleteBuffers(1, &transformbuffer_);
+  glDeleteTextures(1, &lightmap_rect_texture_);
+  glDeleteBuffers(1, &lightmapbuffer_);
+  glDeleteTextures(1, &depth_cubemap_);
+  glDeleteFramebuffers(1, &depth_map_fbo_);
+}
+
+bool Renderer::is_valid() {
+  return tex_shader_.is_valid() && cube_shadow_shader_.is_valid() && monocolor_shader_.is_valid() &&
+    cascade_shader_.is_valid() && feedback_shader_.is_valid() && prepass_shader_.is_valid() && post_.is_valid() &&
+    shadow_mask_.is_valid();
+}
+
+void Renderer::render(const FrameCommands& commands) {
+  timer_.next_frame();
+  if(virtual_textures_)
+    virtual_textures_->update();
+  upload(commands);
+  GeometryArena::current()->bind();
+
+  timer_.begin(ShadowStage);
+  if(!commands.directional)
+    shadow_pass(commands);
+  else if(cascade_resolution_)
+    cascade_pass(commands);
+  timer_.end();
+  bool masked = shadow_mask_divisor && !commands.directional;
+  timer_.begin(ShadowMaskStage);
+  if(masked)
+    shadow_mask_pass(commands);
+  timer_.end();
+  timer_.begin(SceneStage);
+  main_pass(commands, masked);
+  timer_.end();
+  timer_.begin(FeedbackStage);
+  if(virtual_textures_)
+    feedback_pass(commands);
+  timer_.end();
+
+  timer_.begin(BrightPassStage);
+  post_.bright_pass(bloom);
+  timer_.end();
+  timer_.begin(DownsampleStage);
+  post_.downsample();
+  timer_.end();
+  timer_.begin(UpsampleStage);
+  post_.upsample(bloom);
+  timer_.end();
+  timer_.begin(CompositeStage);
+  post_.composite(bloom, output_framebuffer);
+  timer_.end();
+}
+
+const GpuTimer& Renderer::timer() const {
+  return timer_;
+}
+
+void Renderer::upload(const FrameCommands& commands) {
+  // Orphan the buffers so the driver never waits on last frame's draws.
+  glBindBuffer(GL_TEXTURE_BUFFER, transformbuffer_);
+  glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, commands.transforms.size()) * sizeof(glm::mat4),
+               NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0, commands.transforms.size() * sizeof(glm::mat4),
+                  commands.transforms.data());
+  glActiveTexture(TransformTextureUnit);
+  glBindTexture(GL_TEXTURE_BUFFER, transform_texture_);
+
+  glBindBuffer(GL_TEXTURE_BUFFER, lightmapbuffer_);
+  glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, commands.lightmaps.size()) * sizeof(glm::vec4),
+               NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0, commands.lightmaps.size() * sizeof(glm::vec4), commands.lightmaps.data());
+  glActiveTexture(LightmapRectTextureUnit);
+  glBindTexture(GL_TEXTURE_BUFFER, lightmap_rect_texture_);
+
+  GeometryArena::current()->reserve_draw_ids(commands.transforms.size());
+
+  if(!multi_draw_indirect_)
+    return;
+  unsigned int pass_count = CascadePass + commands.cascade_count;
+  size_t size = 0;
+  for(unsigned int pass = 0; pass < pass_count; pass++) {
+    indirect_offsets_[pass] = size;
+    size += PassAt(commands, pass).draws.size() * sizeof(DrawElementsIndirectCommand);
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectbuffer_);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, std::max<size_t>(1, size), NULL, GL_STREAM_DRAW);
+  for(unsigned int pass = 0; pass < pass_count; pass++) {
+    const DrawPass& draws = PassAt(commands, pass);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, indirect_offsets_[pass],
+                    draws.draws.size() * sizeof(DrawElementsIndirectCommand), draws.draws.data());
+  }
+}
+
+void Renderer::draw(const Shader& shader, GLint offset_location, const FrameCommands& commands,
+                    unsigned int pass_index, GLint virtual_location) {
+  const DrawPass& pass = PassAt(commands, pass_index);
+  size_t indirect_offset = indirect_offsets_[pass_index];
+  for(const DrawBatch& batch : pass.batches) {
+    if(batch.texture) {
+      batch.texture->use();
+      if(virtual_location >= 0)
+        shader.set_int(virtual_location, batch.texture->virtual_id());
+    }
+
+    if(multi_draw_indirect_) {
+      shader.set_int(offset_location, 0);
+      size_t offset = indirect_offset + batch.first * sizeof(DrawElementsIndirectCommand);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, batch.count, 0);
+      continue;
+    }
+    for(unsigned int i = batch.first; i < batch.first + batch.count; i++) {
+      const DrawElementsIndirectCommand& command = pass.draws[i];
+      shader.set_int(offset_location, command.baseInstance);
+      glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                               (void*)((size_t)command.firstIndex * sizeof(unsigned int)), command.baseVertex);
+    }
+  }
+}
+
+void Renderer::shadow_pass(const FrameCommands& commands) {
+  glViewport(0, 0, shadow_resolution_, shadow_resolution_);
+  glBindFramebuffer(GL_FRAMEBUFFER, depth_map_fbo_);
+  glClear(GL_DEPTH_BUFFER_BIT);
+
+  cube_shadow_shader_.use();
+
+  cube_shadow_shader_.set_vec3("LightPosition", commands.light_position);
+  cube_shadow_shader_.set_float("far_plane", commands.shadow_far);
+  for(int i = 0; i < 6; i++)
+    cube_shadow_shader_.set_mat4(ShadowMatrixNames[i], commands.shadow_transforms[i]);
+
+  // Each face draws only the meshlets inside its own frustum.
+  for(unsigned int face = 0; face < FrameCommands::CubeFaces; face++) {
+    if(commands.shadow[face].draws.empty())
+      continue;
+    cube_shadow_shader_.set_int(cube_shadow_face_location_, face);
+    draw(cube_shadow_shader_, cube_shadow_offset_location_, commands, ShadowPass + face);
+  }
+}
+
+void Renderer::cascade_pass(const FrameCommands& commands) {
+  glViewport(0, 0, cascade_resolution_, cascade_resolution_);
+  glBindFramebuffer(GL_FRAMEBUFFER, cascade_fbo_);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.f, 4.f);
+
+  cascade_shader_.use();
+  for(unsigned int c = 0; c < commands.cascade_count; c++) {
+    if(!commands.cascade_updated[c])
+      continue;
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascade_texture_, 0, c);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    cascade_shader_.set_mat4(cascade_matrix_location_, commands.cascade_matrices[c]);
+    draw(cascade_shader_, cascade_offset_location_, commands, CascadePass + c);
+  }
+
+  glDisable(GL_POLYGON_OFFSET_FILL);
+}
+
+void Renderer::shadow_mask_pass(const FrameCommands& commands) {
+  post_.begin_scene(render_scale);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+  prepass_shader_.use();
+  prepass_shader_.set_mat4("P", commands.projection);
+  prepass_shader_.set_mat4("V", commands.view);
+  draw(prepass_shader_, prepass_offset_location_, commands, LitPass);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  shadow_mask_.render(commands, post_.scene_depth(), depth_cubemap_, post_.scene_width(), post_.scene_height(),
+                      shadow_mask_divisor);
+  GeometryArena::current()->bind();
+}
+
+void Renderer::main_pass(const FrameCommands& commands, bool prepassed) {
+  post_.begin_scene(render_scale);
+  glClearColor(0.5f, 0.5f, 0.5f, 0.f);
+  glClear(prepassed ? GL_COLOR_BUFFER_BIT : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  tex_shader_.use();
+
+  tex_shader_.set_mat4("P", commands.projection);
+  tex_shader_.set_mat4("V", commands.view);
+  tex_shader_.set_vec3("LightPosition", commands.light_position);
+  tex_shader_.set_vec3("CameraPosition", commands.camera_position);
+  tex_shader_.set_float("far_plane", commands.shadow_far);
+  tex_shader_.set_int("Directional", commands.directional);
+  tex_shader_.set_vec3("SunDirection", commands.sun_direction);
+  // Without a cascade array the sun casts no shadows.
+  unsigned int cascade_count = cascade_texture_ ? commands.cascade_count : 0;
+  tex_shader_.set_int("CascadeCount", cascade_count);
+  for(unsigned int c = 0; c < cascade_count; c++)
+    tex_shader_.set_mat4(CascadeMatrixNames[c], commands.cascade_matrices[c]);
+  // With the static casters baked, the cube map often holds nothing at all.
+  bool dynamic_shadows = false;
+  for(unsigned int face = 0; face < FrameCommands::CubeFaces; face++)
+    dynamic_shadows = dynamic_shadows || !commands.shadow[face].draws.empty();
+  tex_shader_.set_int("UseLightmap", commands.lightmapped && lightmap_texture);
+  tex_shader_.set_int("DynamicShadows", dynamic_shadows);
+  tex_shader_.set_int("UseShadowMask", prepassed);
+
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, depth_cubemap_);
+  glActiveTexture(LightmapTextureUnit);
+  glBindTexture(GL_TEXTURE_2D, lightmap_texture);
+  if(cascade_count) {
+    glActiveTexture(CascadeTextureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cascade_texture_);
+  }
+  glActiveTexture(ShadowMaskTextureUnit);
+  glBindTexture(GL_TEXTURE_2D, shadow_mask_.texture());
+  if(virtual_textures_)
+    virtual_textures_->bind_caches();
+
+  // Only the surfaces the prepass left in front get shaded.
+  if(prepassed)
+    glDepthFunc(GL_LEQUAL);
+  draw(tex_shader_, tex_offset_location_, commands, LitPass, tex_virtual_location_);
+  glDepthFunc(GL_LESS);
+
+  monocolor_shader_.use();
+  monocolor_shader_.set_mat4("V", commands.view);
+  monocolor_shader_.set_mat4("P", commands.projection);
+
+  draw(monocolor_shader_, monocolor_offset_location_, commands, UnlitPass);
+}
+
+void Renderer::feedback_pass(const FrameCommands& commands) {
+  virtual_textures_->begin_feedback();
+
+  feedback_shader_.use();
+  feedback_shader_.set_mat4("P", commands.projection);
+  feedback_shader_.set_mat4("V", commands.view);
+  float scene_width = std::max(1.0f, width_ * render_scale);
+  feedback_shader_.set_float("MipBias", std::log2(virtual_textures_->feedback_width() / scene_width));
+
+  draw(feedback_shader_, feedback_offset_location_, commands, LitPass, feedback_virtual_location_);
+
+  virtual_textures_->end_feedback();
+}
@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <cmath>
+#include <resolution.hpp>
+
+ResolutionController::ResolutionController(float budget_ms, float min_scale, float max_scale)
+  : budget_ms_(budget_ms), min_scale_(min_scale), max_scale_(max_scale), scale_(max_scale),
+    smoothed_ms_(0.0), cooldown_(Cooldown) {}
+
+float ResolutionController::update(double gpu_ms) {
+  if(gpu_ms <= 0.0)
+    return scale_;
+  smoothed_ms_ = smoothed_ms_ > 0.0 ? smoothed_ms_ + (gpu_ms - smoothed_ms_) * Smoothing : gpu_ms;
+
+  if(cooldown_ > 0) {
+    cooldown_--;
+    return scale_;
+  }
+  if(smoothed_ms_ <= budget_ms_ * Upper && smoothed_ms_ >= budget_ms_ * Lower)
+    return scale_;
+  if(smoothed_ms_ < budget_ms_ * Lower && scale_ >= max_scale_)
+    return scale_;
+
+  // Aim for the middle of the dead band.
+  float target = budget_ms_ * (Upper + Lower) * 0.5f;
+  float wanted = scale_ * std::sqrt(target / smoothed_ms_);
+  wanted = std::min(scale_ + MaxChange, std::max(scale_ - MaxChange, wanted));
+  // Snap away from the current scale so small corrections still move.
+  wanted = wanted < scale_ ? std::floor(wanted / Step + 1e-3f) * Step : std::ceil(wanted / Step - 1e-3f) * Step;
+  wanted = std::min(max_scale_, std::max(min_scale_, wanted));
+  if(wanted != scale_) {
+    // Expect the new pixel count right away instead of waiting for the
+    // average to catch up.
+    smoothed_ms_ *= (wanted * wanted) / (scale_ * scale_);
+    scale_ = wanted;
+    cooldown_ = Cooldown;
+  }
+  return scale_;
+}
+
+float ResolutionController::scale() const {
+  return scale_;
+}
+
+double ResolutionController::smoothed_ms() const {
+  return smoothed_ms_;
+}
@@ -0,0 +1,300 @@
+#include <scenequery.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const unsigned int MaxLeafEntries = 2;
+// Median splits keep the tree balanced, so this covers 2^64 instances.
+const unsigned int MaxDepth = 64;
+const unsigned int QueryGrain = 256;
+const float Miss = std::numeric_limits<float>::infinity();
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Distance at which the ray enters the box within [0, max_t], infinity when
+// it misses it.
+float ray_box(const glm::vec3& lower, const glm::vec3& upper, const glm::vec3& origin,
+              const glm::vec3& inverse_direction, float max_t) {
+  glm::vec3 t0 = (lower - origin) * inverse_direction;
+  glm::vec3 t1 = (upper - origin) * inverse_direction;
+  glm::vec3 near = glm::min(t0, t1);
+  glm::vec3 far = glm::max(t0, t1);
+  float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+  float exit = std::min(std::min(far.x, far.y), std::min(far.z, max_t));
+  return enter <= exit ? enter : Miss;
+}
+
+glm::vec3 inverse_of(const glm::vec3& direction) {
+  glm::vec3 inverse_direction;
+  for(int c = 0; c < 3; c++) {
+    float d = direction[c];
+    inverse_direction[c] = 1.0f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+  }
+  return inverse_direction;
+}
+
+// Gribb-Hartmann plane extraction, normals point inwards.
+void extract_frustum(const glm::mat4& m, glm::vec4 planes[6]) {
+  glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+  planes[0] = row3 + row0;
+  planes[1] = row3 - row0;
+  planes[2] = row3 + row1;
+  planes[3] = row3 - row1;
+  planes[4] = row3 + row2;
+  planes[5] = row3 - row2;
+}
+
+bool box_outside(const glm::vec4 planes[6], const glm::vec3& lower, const glm::vec3& upper) {
+  for(int i = 0; i < 6; i++) {
+    const glm::vec4& plane = planes[i];
+    glm::vec3 farthest(plane.x > 0.0f ? upper.x : lower.x, plane.y > 0.0f ? upper.y : lower.y,
+                       plane.z > 0.0f ? upper.z : lower.z);
+    if(glm::dot(glm::vec3(plane), farthest) + plane.w < 0.0f)
+      return true;
+  }
+  return false;
+}
+
+}
+
+SceneQuery::SceneQuery() : stats_() {}
+
+void SceneQuery::build(JobSystem& jobs, const Scene& scene, unsigned int flags) {
+  auto start = std::chrono::steady_clock::now();
+  stats_ = SceneQueryStats();
+  nodes_.clear();
+  entries_.clear();
+
+  std::vector<glm::mat4> transforms;
+  InstanceTransforms(scene, transforms);
+  for(unsigned int i = 0; i < scene.instances.size(); i++) {
+    const Instance& instance = scene.instances[i];
+    if(!(instance.flags & flags))
+      continue;
+    if(!instance.model->bvh()) {
+      instance.model->build_bvh(jobs);
+      stats_.models++;
+    }
+    const TriangleBVH* bvh = instance.model->bvh();
+    if(!bvh->triangle_count())
+      continue;
+
+    Entry entry;
+    entry.transform = transforms[i];
+    entry.inverse = glm::inverse(transforms[i]);
+    entry.bvh = bvh;
+    entry.instance = i;
+    entry.lower = glm::vec3(std::numeric_limits<float>::max());
+    entry.upper = glm::vec3(-std::numeric_limits<float>::max());
+    glm::vec3 lower = bvh->lower(), upper = bvh->upper();
+    for(unsigned int corner = 0; corner < 8; corner++) {
+      glm::vec3 p(corner & 1 ? upper.x : lower.x, corner & 2 ? upper.y : lower.y, corner & 4 ? upper.z : lower.z);
+      p = glm::vec3(entry.transform * glm::vec4(p, 1.0f));
+      entry.lower = glm::min(entry.lower, p);
+      entry.upper = glm::max(entry.upper, p);
+    }
+    entries_.push_back(entry);
+    stats_.triangles += bvh->triangle_count();
+  }
+  stats_.instances = entries_.size();
+  if(!entries_.empty()) {
+    nodes_.reserve(entries_.size() * 2);
+    build_node(0, entries_.size());
+  }
+  stats_.build_ms = elapsed_ms(start);
+}
+
+// Halves the entries at the median centroid along the longest axis of the
+// centroid bounds. Scenes hold few enough instances for this to be cheap,
+// the surface area heuristic pays off within the models.
+unsigned int SceneQuery::build_node(unsigned int begin, unsigned int end) {
+  unsigned int index = nodes_.size();
+  nodes_.push_back(Node());
+  glm::vec3 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+  glm::vec3 centroid_lower = lower, centroid_upper = upper;
+  for(unsigned int i = begin; i < end; i++) {
+    lower = glm::min(lower, entries_[i].lower);
+    upper = glm::max(upper, entries_[i].upper);
+    glm::vec3 centroid = (entries_[i].lower + entries_[i].upper) * 0.5f;
+    centroid_lower = glm::min(centroid_lower, centroid);
+    centroid_upper = glm::max(centroid_upper, centroid);
+  }
+  nodes_[index].lower = lower;
+  nodes_[index].upper = upper;
+
+  if(end - begin <= MaxLeafEntries) {
+    nodes_[index].index = begin;
+    nodes_[index].entries = end - begin;
+    return index;
+  }
+
+  glm::vec3 extent = centroid_upper - centroid_lower;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+  unsigned int split = begin + (end - begin) / 2;
+  std::nth_element(entries_.begin() + begin, entries_.begin() + split, entries_.begin() + end,
+                   [axis](const Entry& a, const Entry& b) {
+                     return a.lower[axis] + a.upper[axis] < b.lower[axis] + b.upper[axis];
+                   });
+  build_node(begin, split);
+  unsigned int second = build_node(split, end);
+  nodes_[index].index = second;
+  nodes_[index].entries = 0;
+  return index;
+}
+
+bool SceneQuery::intersect(const QueryRay& ray, SceneHit& ret_hit) const {
+  ret_hit = {ray.max_t, NoInstance, 0, 0.0f, 0.0f};
+  if(nodes_.empty())
+    return false;
+  glm::vec3 inverse_direction = inverse_of(ray.direction);
+
+  struct Pending {
+    unsigned int node;
+    float enter;
+  };
+  Pending stack[MaxDepth];
+  unsigned int size = 0;
+  Pending pending = {0, ray_box(nodes_[0].lower, nodes_[0].upper, ray.origin, inverse_direction, ray.max_t)};
+  if(pending.enter == Miss)
+    return false;
+  while(true) {
+    if(pending.enter < ret_hit.t) {
+      const Node& current = nodes_[pending.node];
+      if(!current.entries) {
+        const Node& first = nodes_[pending.node + 1];
+        const Node& second = nodes_[current.index];
+        Pending near = {pending.node + 1,
+                        ray_box(first.lower, first.upper, ray.origin, inverse_direction, ret_hit.t)};
+        Pending far = {current.index, ray_box(second.lower, second.upper, ray.origin, inverse_direction, ret_hit.t)};
+        if(far.enter < near.enter)
+          std::swap(near, far);
+        if(near.enter != Miss) {
+          if(far.enter != Miss)
+            stack[size++] = far;
+          pending = near;
+          continue;
+        }
+      } else {
+        for(unsigned int e = current.index; e < current.index + current.entries; e++) {
+          const Entry& entry = entries_[e];
+          glm::vec3 origin = glm::vec3(entry.inverse * glm::vec4(ray.origin, 1.0f));
+          glm::vec3 direction = glm::vec3(entry.inverse * glm::vec4(ray.direction, 0.0f));
+          RayHit hit;
+          if(entry.bvh->intersect(origin, direction, ret_hit.t, hit))
+            ret_hit = {hit.t, entry.instance, hit.triangle, hit.u, hit.v};
+        }
+      }
+    }
+    if(!size)
+      return ret_hit.instance != NoInstance;
+    pending = stack[--size];
+  }
+}
+
+bool SceneQuery::occluded(const QueryRay& ray) const {
+  if(nodes_.empty())
+    return false;
+  glm::vec3 inverse_direction = inverse_of(ray.direction);
+
+  unsigned int stack[MaxDepth];
+  unsigned int size = 0;
+  unsigned int node = 0;
+  while(true) {
+    const Node& current = nodes_[node];
+    if(ray_box(current.lower, current.upper, ray.origin, inverse_direction, ray.max_t) != Miss) {
+      if(!current.entries) {
+        stack[size++] = current.index;
+        node++;
+        continue;
+      }
+      for(unsigned int e = current.index; e < current.index + current.entries; e++) {
+        const Entry& entry = entries_[e];
+        glm::vec3 origin = glm::vec3(entry.inverse * glm::vec4(ray.origin, 1.0f));
+        glm::vec3 direction = glm::vec3(entry.inverse * glm::vec4(ray.direction, 0.0f));
+        if(entry.bvh->occluded(origin, direction, ray.max_t))
+          return true;
+      }
+    }
+    if(!size)
+      return false;
+    node = stack[--size];
+  }
+}
+
+bool SceneQuery::occluded(const glm::vec3& from, const glm::vec3& to) const {
+  return occluded(QueryRay{from, to - from, 1.0f});
+}
+
+void SceneQuery::frustum(const glm::mat4& view_projection, std::vector<SceneTriangle>& ret_triangles) const {
+  if(nodes_.empty())
+    return;
+  glm::vec4 planes[6];
+  extract_frustum(view_projection, planes);
+
+  std::vector<unsigned int> triangles;
+  unsigned int stack[MaxDepth];
+  unsigned int size = 0;
+  unsigned int node = 0;
+  while(true) {
+    const Node& current = nodes_[node];
+    if(!box_outside(planes, current.lower, current.upper)) {
+      if(!current.entries) {
+        stack[size++] = current.index;
+        node++;
+        continue;
+      }
+      for(unsigned int e = current.index; e < current.index + current.entries; e++) {
+        const Entry& entry = entries_[e];
+        if(box_outside(planes, entry.lower, entry.upper))
+          continue;
+        // The planes as seen from model space.
+        glm::vec4 model_planes[6];
+        glm::mat4 transpose = glm::transpose(entry.transform);
+        for(int p = 0; p < 6; p++)
+          model_planes[p] = transpose * planes[p];
+        triangles.clear();
+        entry.bvh->frustum(model_planes, 6, triangles);
+        for(unsigned int triangle : triangles)
+          ret_triangles.push_back({entry.instance, triangle});
+      }
+    }
+    if(!size)
+      return;
+    node = stack[--size];
+  }
+}
+
+void SceneQuery::intersect(JobSystem& jobs, const QueryRay* rays, unsigned int count, SceneHit* ret_hits) const {
+  auto trace = [&](unsigned int begin, unsigned int end) {
+    for(unsigned int i = begin; i < end; i++)
+      intersect(rays[i], ret_hits[i]);
+  };
+  JobGroup group;
+  jobs.parallel_for(group, count, QueryGrain, trace);
+  jobs.wait(group);
+}
+
+void SceneQuery::occluded(JobSystem& jobs, const QueryRay* rays, unsigned int count,
+                          unsigned char* ret_occluded) const {
+  auto trace = [&](unsigned int begin, unsigned int end) {
+    for(unsigned int i = begin; i < end; i++)
+      ret_occluded[i] = occluded(rays[i]);
+  };
+  JobGroup group;
+  jobs.parallel_for(group, count, QueryGrain, trace);
+  jobs.wait(group);
+}
+
+const SceneQueryStats& SceneQuery::stats() const {
+  return stats_;
+}
@@ -119,36 +119,48 @@ void Shader::use() {
   glUseProgram(id_);
 }
 
-void Shader::set_int(const std::string & name, int value) const {
-  glUniform1i(glGetUniformLocation(id_, name.c_str()), value);
+void Shader::set_int(const char* name, int value) const {
+  glUniform1i(glGetUniformLocation(id_, name), value);
 }
 
-void Shader::set_float(const std::string & name, float value) const {
-  glUniform1f(glGetUniformLocation(id_, name.c_str()), value);
+void Shader::set_float(const char* name, float value) const {
+  glUniform1f(glGetUniformLocation(id_, name), value);
 }
 
-void Shader::set_vec2(const std::string & name, const glm::vec2 & value) const {
-  glUniform2fv(glGetUniformLocation(id_, name.c_str()), 1, &value[0]);
+void Shader::set_vec2(const char* name, const glm::vec2 & value) const {
+  glUniform2fv(glGetUniformLocation(id_, name), 1, &value[0]);
 }
 
-void Shader::set_vec3(const std::string & name, const glm::vec3 & value) const {
-  glUniform3fv(glGetUniformLocation(id_, name.c_str()), 1, &value[0]);
+void Shader::set_vec3(const char* name, const glm::vec3 & value) const {
+  glUniform3fv(glGetUniformLocation(id_, name), 1, &value[0]);
 }
 
-void Shader::set_vec4(const std::string & name, const glm::vec4 & value) const {
-  glUniform4fv(glGetUniformLocation(id_, name.c_str()), 1, &value[0]);
+void Shader::set_vec4(const char* name, const glm::vec4 & value) const {
+  glUniform4fv(glGetUniformLocation(id_, name), 1, &value[0]);
 }
 
-void Shader::set_mat2(const std::string & name, const glm::mat2 & value) const {
-  glUniformMatrix2fv(glGetUniformLocation(id_, name.c_str()), 1, GL_FALSE, &value[0][0]);
+void Shader::set_mat2(const char* name, const glm::mat2 & value) const {
+  glUniformMatrix2fv(glGetUniformLocation(id_, name), 1, GL_FALSE, &value[0][0]);
 }
 
-void Shader::set_mat3(const std::string & name, const glm::mat3 & value) const {
-  glUniformMatrix3fv(glGetUniformLocation(id_, name.c_str()), 1, GL_FALSE, &value[0][0]);
+void Shader::set_mat3(const char* name, const glm::mat3 & value) const {
+  glUniformMatrix3fv(glGetUniformLocation(id_, name), 1, GL_FALSE, &value[0][0]);
 }
 
-void Shader::set_mat4(const std::string & name, const glm::mat4 & value) const {
-  glUniformMatrix4fv(glGetUniformLocation(id_, name.c_str()), 1, GL_FALSE, &value[0][0]);
+void Shader::set_mat4(const char* name, const glm::mat4 & value) const {
+  glUniformMatrix4fv(glGetUniformLocation(id_, name), 1, GL_FALSE, &value[0][0]);
+}
+
+GLint Shader::location(const char* name) const {
+  return glGetUniformLocation(id_, name);
+}
+
+void Shader::set_int(GLint location, int value) const {
+  glUniform1i(location, value);
+}
+
+void Shader::set_mat4(GLint location, const glm::mat4 & value) const {
+  glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
 }
 
 bool Shader::is_valid() {
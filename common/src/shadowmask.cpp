@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <iostream>
+#include <shadowmask.hpp>
+
+namespace {
+
+GLuint CreateTarget(GLenum internal_format, GLenum format, unsigned int width, unsigned int height) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_FLOAT, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+GLuint CreateFramebuffer(GLuint texture, const char* name) {
+  GLuint framebuffer;
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cout << "Incomplete framebuffer: " << name << std::endl;
+  return framebuffer;
+}
+
+}
+
+ShadowMask::ShadowMask(unsigned int width, unsigned int height)
+  : width_(width), height_(height),
+    mask_shader_("shaders/Fullscreen.vert",
+                 NULL,
+                 "shaders/ShadowMask.frag"),
+    upsample_shader_("shaders/Fullscreen.vert",
+                     NULL,
+                     "shaders/ShadowUpsample.frag") {
+  mask_shader_.use();
+  mask_shader_.set_int("Depth", 0);
+  mask_shader_.set_int("DepthSampler", 2);
+  upsample_shader_.use();
+  upsample_shader_.set_int("Depth", 0);
+  upsample_shader_.set_int("LowMask", 1);
+
+  unsigned int low_width = (width_ + MinDivisor - 1) / MinDivisor;
+  unsigned int low_height = (height_ + MinDivisor - 1) / MinDivisor;
+  low_texture_ = CreateTarget(GL_RG16F, GL_RG, low_width, low_height);
+  low_framebuffer_ = CreateFramebuffer(low_texture_, "shadow mask");
+  texture_ = CreateTarget(GL_R8, GL_RED, width_, height_);
+  framebuffer_ = CreateFramebuffer(texture_, "shadow upsample");
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glGenVertexArrays(1, &fullscreen_vao_);
+}
+
+ShadowMask::~ShadowMask() {
+  glDeleteFramebuffers(1, &framebuffer_);
+  glDeleteTextures(1, &texture_);
+  glDeleteFramebuffers(1, &low_framebuffer_);
+  glDeleteTextures(1, &low_texture_);
+  glDeleteVertexArrays(1, &fullscreen_vao_);
+}
+
+bool ShadowMask::is_valid() {
+  return mask_shader_.is_valid() && upsample_shader_.is_valid();
+}
+
+void ShadowMask::render(const FrameCommands& commands, GLuint depth, GLuint depth_cubemap, unsigned int scene_width,
+                        unsigned int scene_height, unsigned int divisor) {
+  divisor = std::min(MaxDivisor, std::max(MinDivisor, divisor));
+  unsigned int low_width = (scene_width + divisor - 1) / divisor;
+  unsigned int low_height = (scene_height + divisor - 1) / divisor;
+  glm::mat4 inverse_view_projection = glm::inverse(commands.projection * commands.view);
+  glm::vec2 scene_size(scene_width, scene_height);
+
+  glDisable(GL_DEPTH_TEST);
+  glBindVertexArray(fullscreen_vao_);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, depth);
+
+  mask_shader_.use();
+  mask_shader_.set_mat4("InverseViewProjection", inverse_view_projection);
+  mask_shader_.set_vec3("CameraPosition", commands.camera_position);
+  mask_shader_.set_vec3("LightPosition", commands.light_position);
+  mask_shader_.set_float("far_plane", commands.shadow_far);
+  mask_shader_.set_vec2("SceneSize", scene_size);
+  mask_shader_.set_int("Divisor", divisor);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, depth_cubemap);
+  glBindFramebuffer(GL_FRAMEBUFFER, low_framebuffer_);
+  glViewport(0, 0, low_width, low_height);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  upsample_shader_.use();
+  upsample_shader_.set_mat4("InverseViewProjection", inverse_view_projection);
+  upsample_shader_.set_vec3("CameraPosition", commands.camera_position);
+  upsample_shader_.set_vec2("SceneSize", scene_size);
+  upsample_shader_.set_vec2("LowSize", {(float)low_width, (float)low_height});
+  upsample_shader_.set_int("Divisor", divisor);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, low_texture_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glViewport(0, 0, scene_width, scene_height);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  glEnable(GL_DEPTH_TEST);
+}
+
+GLuint ShadowMask::texture() const {
+  return texture_;
+}
@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <simplify.hpp>
+
+namespace {
+
+// Symmetric 4x4 matrix stored as its upper triangle, w sums the weights of
+// its planes.
+struct Quadric {
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2, w;
+
+  Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), w(0) {}
+
+  Quadric(const glm::vec3& n, double d, double weight) {
+    a2 = weight * n.x * n.x; ab = weight * n.x * n.y; ac = weight * n.x * n.z; ad = weight * n.x * d;
+    b2 = weight * n.y * n.y; bc = weight * n.y * n.z; bd = weight * n.y * d;
+    c2 = weight * n.z * n.z; cd = weight * n.z * d;
+    d2 = weight * d * d;
+    w = weight;
+  }
+
+  Quadric& operator+=(const Quadric& o) {
+    a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+    b2 += o.b2; bc += o.bc; bd += o.bd;
+    c2 += o.c2; cd += o.cd;
+    d2 += o.d2;
+    w += o.w;
+    return *this;
+  }
+
+  double error(const glm::vec3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+             + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+             + c2 * z * z + 2 * cd * z
+             + d2;
+    return e > 0 ? e : 0;
+  }
+};
+
+struct Collapse {
+  double cost;
+  unsigned int from, to;
+  unsigned int from_version, to_version;
+
+  bool operator>(const Collapse& o) const { return cost > o.cost; }
+};
+
+struct PositionHash {
+  size_t operator()(const glm::vec3& p) const {
+    uint32_t h[3];
+    std::memcpy(h, &p, sizeof(h));
+    return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+  }
+};
+
+struct PositionEqual {
+  bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  }
+};
+
+class Simplifier {
+ public:
+  Simplifier(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices) {
+    // Collapses operate on positions, attribute vertices (wedges) sharing a
+    // position are welded together for topology purposes.
+    std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> welded;
+    wedge_position_.resize(vertices.size());
+    for(unsigned int i = 0; i < vertices.size(); i++) {
+      auto it = welded.emplace(vertices[i], (unsigned int)positions_.size());
+      if(it.second)
+        positions_.push_back(vertices[i]);
+      wedge_position_[i] = it.first->second;
+    }
+
+    triangle_count_ = indices.size() / 3;
+    corners_.assign(indices.begin(), indices.begin() + triangle_count_ * 3);
+    removed_.assign(triangle_count_, false);
+    adjacency_.resize(positions_.size());
+    quadrics_.resize(positions_.size());
+    distances_.resize(positions_.size());
+    version_.assign(positions_.size(), 0);
+    alive_.assign(positions_.size(), true);
+    alive_triangles_ = triangle_count_;
+
+    for(unsigned int t = 0; t < triangle_count_; t++) {
+      if(degenerate(t)) {
+        removed_[t] = true;
+        alive_triangles_--;
+        continue;
+      }
+      for(int c = 0; c < 3; c++)
+        adjacency_[position(t, c)].push_back(t);
+
+      glm::vec3 p0 = positions_[position(t, 0)];
+      glm::vec3 n = glm::cross(positions_[position(t, 1)] - p0, positions_[position(t, 2)] - p0);
+      float area = glm::length(n);
+      if(area <= 0.0f)
+        continue;
+      n /= area;
+      Quadric q(n, -glm::dot(n, p0), 1.0);
+      for(int c = 0; c < 3; c++) {
+        quadrics_[position(t, c)] += q;
+        distances_[position(t, c)] += q;
+      }
+    }
+
+    add_border_quadrics();
+    for(unsigned int p = 0; p < positions_.size(); p++)
+      push_edges(p);
+    max_error_ = 0.0;
+  }
+
+  // Can be called again with a lower target to continue from the last result.
+  float run(unsigned int target_triangles) {
+    while(alive_triangles_ > target_triangles && !queue_.empty()) {
+      Collapse c = queue_.top();
+      queue_.pop();
+      if(!alive_[c.from] || !alive_[c.to] ||
+         version_[c.from] != c.from_version || version_[c.to] != c.to_version)
+        continue;
+      if(!can_collapse(c.from, c.to))
+        continue;
+      Quadric sum = distances_[c.from];
+      sum += distances_[c.to];
+      max_error_ = std::max(max_error_, sum.error(positions_[c.to]) / sum.w);
+      collapse(c.from, c.to);
+    }
+    return (float)std::sqrt(max_error_);
+  }
+
+  void result(std::vector<unsigned int>& ret_indices) const {
+    for(unsigned int t = 0; t < triangle_count_; t++) {
+      if(removed_[t])
+        continue;
+      for(int c = 0; c < 3; c++)
+        ret_indices.push_back(corners_[t * 3 + c]);
+    }
+  }
+
+ private:
+  unsigned int position(unsigned int t, int c) const {
+    return wedge_position_[corners_[t * 3 + c]];
+  }
+
+  bool degenerate(unsigned int t) const {
+    unsigned int a = position(t, 0), b = position(t, 1), c = position(t, 2);
+    return a == b || b == c || c == a;
+  }
+
+  // Open edges get a plane perpendicular to the face so that the outline of
+  // the mesh is preserved.
+  void add_border_quadrics() {
+    std::unordered_map<uint64_t, int> edge_use;
+    auto key = [](unsigned int a, unsigned int b) {
+      return ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+    };
+    for(unsigned int t = 0; t < triangle_count_; t++) {
+      if(removed_[t])
+        continue;
+      for(int c = 0; c < 3; c++)
+        edge_use[key(position(t, c), position(t, (c + 1) % 3))]++;
+    }
+    for(unsigned int t = 0; t < triangle_count_; t++) {
+      if(removed_[t])
+        continue;
+      glm::vec3 p0 = positions_[position(t, 0)];
+      glm::vec3 face = glm::cross(positions_[position(t, 1)] - p0, positions_[position(t, 2)] - p0);
+      if(glm::length(face) <= 0.0f)
+        continue;
+      face = glm::normalize(face);
+      for(int c = 0; c < 3; c++) {
+        unsigned int a = position(t, c), b = position(t, (c + 1) % 3);
+        if(edge_use[key(a, b)] != 1)
+          continue;
+        glm::vec3 edge = positions_[b] - positions_[a];
+        float length = glm::length(edge);
+        if(length <= 0.0f)
+          continue;
+        glm::vec3 n = glm::normalize(glm::cross(edge, face));
+        Quadric q(n, -glm::dot(n, positions_[a]), 10.0 * length * length);
+        quadrics_[a] += q;
+        quadrics_[b] += q;
+        Quadric plane(n, -glm::dot(n, positions_[a]), 1.0);
+        distances_[a] += plane;
+        distances_[b] += plane;
+      }
+    }
+  }
+
+  void neighbours(unsigned int p, std::vector<unsigned int>& ret) const {
+    ret.clear();
+    for(unsigned int t : adjacency_[p]) {
+      for(int c = 0; c < 3; c++) {
+        unsigned int q = position(t, c);
+        if(q != p && std::find(ret.begin(), ret.end(), q) == ret.end())
+          ret.push_back(q);
+      }
+    }
+  }
+
+  void push_edges(unsigned int p) {
+    neighbours(p, scratch_);
+    for(unsigned int q : scratch_) {
+      Quadric sum = quadrics_[p];
+      sum += quadrics_[q];
+      queue_.push({sum.error(positions_[q]), p, q, version_[p], version_[q]});
+      queue_.push({sum.error(positions_[p]), q, p, version_[q], version_[p]});
+    }
+  }
+
+  // Fills wedge_pairs_ for collapse().
+  bool can_collapse(unsigned int from, unsigned int to) {
+    // The edge must still exist and the link condition must hold, otherwise
+    // the collapse would pinch the surface into a non-manifold shape. The
+    // triangles of the edge pair every wedge at from with the one at to on
+    // the same side of any UV or normal seam.
+    unsigned int shared = 0;
+    wedge_pairs_.clear();
+    for(unsigned int t : adjacency_[from]) {
+      int from_corner = -1, to_corner = -1;
+      for(int c = 0; c < 3; c++) {
+        if(position(t, c) == from)
+          from_corner = c;
+        else if(position(t, c) == to)
+          to_corner = c;
+      }
+      if(to_corner < 0)
+        continue;
+      shared++;
+      unsigned int wedge = corners_[t * 3 + from_corner], target = corners_[t * 3 + to_corner];
+      auto pair = std::find_if(wedge_pairs_.begin(), wedge_pairs_.end(),
+                               [wedge](const WedgePair& p) { return p.from == wedge; });
+      // A seam along the edge that ends at from gives its wedge two targets.
+      if(pair != wedge_pairs_.end() && pair->to != target)
+        return false;
+      if(pair == wedge_pairs_.end())
+        wedge_pairs_.push_back({wedge, target});
+    }
+    if(shared == 0)
+      return false;
+
+    neighbours(from, from_ring_);
+    neighbours(to, to_ring_);
+    unsigned int common = 0;
+    for(unsigned int q : from_ring_)
+      if(std::find(to_ring_.begin(), to_ring_.end(), q) != to_ring_.end())
+        common++;
+    if(common > shared)
+      return false;
+
+    // Reject collapses which flip or squash a surviving triangle, or take a
+    // wedge of from across a seam the edge does not follow.
+    for(unsigned int t : adjacency_[from]) {
+      glm::vec3 p[3], moved[3];
+      bool has_to = false;
+      for(int c = 0; c < 3; c++) {
+        unsigned int q = position(t, c);
+        has_to = has_to || q == to;
+        p[c] = positions_[q];
+        moved[c] = q == from ? positions_[to] : p[c];
+      }
+      if(has_to)
+        continue;
+      for(int c = 0; c < 3; c++)
+        if(position(t, c) == from && matching_wedge(corners_[t * 3 + c]) == NoWedge)
+          return false;
+      glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+      glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+      float after_length = glm::length(after);
+      if(after_length <= 1e-12f)
+        return false;
+      if(glm::dot(before, after) < 0.2f * glm::length(before) * after_length)
+        return false;
+    }
+    return true;
+  }
+
+  // Wedge at the collapse target paired with a wedge at its source by the
+  // last can_collapse().
+  unsigned int matching_wedge(unsigned int wedge) const {
+    for(const WedgePair& pair : wedge_pairs_)
+      if(pair.from == wedge)
+        return pair.to;
+    return NoWedge;
+  }
+
+  void collapse(unsigned int from, unsigned int to) {
+    for(unsigned int t : adjacency_[from]) {
+      bool has_to = false;
+      for(int c = 0; c < 3; c++)
+        has_to = has_to || position(t, c) == to;
+
+      if(has_to) {
+        removed_[t] = true;
+        alive_triangles_--;
+        for(int c = 0; c < 3; c++) {
+          unsigned int q = position(t, c);
+          if(q == from)
+            continue;
+          std::vector<unsigned int>& list = adjacency_[q];
+          list.erase(std::remove(list.begin(), list.end(), t), list.end());
+        }
+        continue;
+      }
+
+      for(int c = 0; c < 3; c++) {
+        unsigned int& corner = corners_[t * 3 + c];
+        if(wedge_position_[corner] == from)
+          corner = matching_wedge(corner);
+      }
+      adjacency_[to].push_back(t);
+    }
+
+    adjacency_[from].clear();
+    alive_[from] = false;
+    quadrics_[to] += quadrics_[from];
+    distances_[to] += distances_[from];
+    version_[to]++;
+    push_edges(to);
+  }
+
+  static const unsigned int NoWedge = ~0u;
+
+  struct WedgePair {
+    unsigned int from;
+    unsigned int to;
+  };
+
+  std::vector<glm::vec3> positions_;
+  std::vector<unsigned int> wedge_position_;
+
+  std::vector<unsigned int> corners_;
+  std::vector<bool> removed_;
+  unsigned int triangle_count_;
+  unsigned int alive_triangles_;
+  double max_error_;
+
+  std::vector<std::vector<unsigned int>> adjacency_;
+  // The border planes are weighted up in the collapse cost, so the error is
+  // measured on the same planes at unit weight. Divided by w it is the mean
+  // squared distance to the planes a vertex stands for.
+  std::vector<Quadric> quadrics_;
+  std::vector<Quadric> distances_;
+  std::vector<unsigned int> version_;
+  std::vector<bool> alive_;
+
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue_;
+  // Reused by every candidate, the queue pops millions of them.
+  std::vector<unsigned int> scratch_;
+  std::vector<unsigned int> from_ring_;
+  std::vector<unsigned int> to_ring_;
+  std::vector<WedgePair> wedge_pairs_;
+};
+
+}
+
+float SimplifyMesh(const std::vector<glm::vec3>& vertices,
+                   const std::vector<unsigned int>& indices,
+                   unsigned int target_triangles,
+                   std::vector<unsigned int>& ret_indices) {
+  Simplifier simplifier(vertices, indices);
+  float error = simplifier.run(target_triangles);
+  simplifier.result(ret_indices);
+  return error;
+}
+
+void SimplifyMeshLevels(const std::vector<glm::vec3>& vertices,
+                        const std::vector<unsigned int>& indices,
+                        unsigned int level_count,
+                        std::vector<std::vector<unsigned int>>& ret_levels,
+                        std::vector<float>& ret_errors) {
+  Simplifier simplifier(vertices, indices);
+  unsigned int triangles = indices.size() / 3;
+  ret_levels.resize(level_count);
+  ret_errors.resize(level_count);
+  for(unsigned int level = 0; level < level_count; level++) {
+    ret_errors[level] = simplifier.run(triangles / 2);
+    ret_levels[level].clear();
+    simplifier.result(ret_levels[level]);
+    triangles = ret_levels[level].size() / 3;
+  }
+}
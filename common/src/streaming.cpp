@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <streaming.hpp>
+
+namespace {
+
+bool FartherFirst(const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) {
+  return a.first > b.first;
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+bool LoadWorld(const char* path, std::vector<StreamCell>& ret_cells) {
+  std::ifstream ifs(path);
+  if(!ifs.is_open()) {
+    std::cout << "Could not open " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int number = 0;
+  while(std::getline(ifs, line)) {
+    number++;
+    std::istringstream in(line);
+    std::string keyword;
+    if(!(in >> keyword) || keyword[0] == '#')
+      continue;
+
+    if(keyword == "cell") {
+      StreamCell cell;
+      if(!(in >> cell.center.x >> cell.center.y >> cell.center.z >> cell.radius)) {
+        std::cout << path << ":" << number << ": expected cell <x> <y> <z> <radius>" << std::endl;
+        return false;
+      }
+      ret_cells.push_back(cell);
+    } else if(keyword == "object") {
+      StreamObject object;
+      if(ret_cells.empty() ||
+         !(in >> object.mesh >> object.albedo >> object.normal >> object.position.x >> object.position.y >>
+           object.position.z >> object.scale >> object.angle)) {
+        std::cout << path << ":" << number << ": expected object <mesh> <albedo> <normal> <x> <y> <z> <scale> "
+                  << "<angle> inside a cell" << std::endl;
+        return false;
+      }
+      object.flags = Instance::CastsShadow | Instance::Lit;
+      ret_cells.back().objects.push_back(object);
+    } else {
+      std::cout << path << ":" << number << ": unknown keyword " << keyword << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+WorldStreamer::WorldStreamer(Scene& scene, std::vector<StreamCell> cells, const StreamSettings& settings)
+  : scene_(scene), static_instances_(scene.instances.size()), cells_(std::move(cells)), settings_(settings),
+    states_(cells_.size(), State::Unloaded), distances_(cells_.size(), 0.0f), cell_bytes_(cells_.size(), 0),
+    resident_(cells_.size()),
+    last_camera_(0.0f), has_camera_(false), instances_dirty_(false), update_count_(0), stats_(),
+    in_flight_(-1), running_(true), max_load_ms_(0.0) {
+  thread_ = std::thread(&WorldStreamer::io_loop, this);
+}
+
+WorldStreamer::~WorldStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void WorldStreamer::update(const glm::vec3& camera, float dt) {
+  auto start = std::chrono::steady_clock::now();
+  update_count_++;
+
+  glm::vec3 velocity(0.0f);
+  if(has_camera_ && dt > 0.0f)
+    velocity = (camera - last_camera_) / dt;
+  last_camera_ = camera;
+  has_camera_ = true;
+  glm::vec3 predicted = camera + velocity * settings_.prediction_time;
+
+  for(unsigned int i = 0; i < cells_.size(); i++)
+    distances_[i] = std::max(0.0f, glm::distance(predicted, cells_[i].center) - cells_[i].radius);
+
+  collect_loaded();
+  unload_distant();
+  upload();
+  request();
+
+  while(!retired_.empty() && update_count_ - retired_.front().first >= RetireDelay)
+    retired_.erase(retired_.begin());
+
+  if(instances_dirty_)
+    rebuild_instances();
+
+  stats_.max_update_ms = std::max(stats_.max_update_ms, MillisecondsSince(start));
+}
+
+StreamStats WorldStreamer::take_stats() {
+  StreamStats stats = stats_;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.max_load_ms = max_load_ms_;
+    max_load_ms_ = 0.0;
+  }
+  stats_.max_update_ms = 0.0;
+  return stats;
+}
+
+void WorldStreamer::io_loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(true) {
+    cv_.wait(lock, [this] { return !running_ || (!queue_.empty() && loaded_.size() < MaxStaged); });
+    if(!running_)
+      return;
+
+    std::pop_heap(queue_.begin(), queue_.end(), FartherFirst);
+    unsigned int cell = queue_.back().second;
+    queue_.pop_back();
+    in_flight_ = cell;
+    lock.unlock();
+
+    std::unique_ptr<LoadedCell> loaded(new LoadedCell());
+    load(cell, *loaded);
+
+    lock.lock();
+    max_load_ms_ = std::max(max_load_ms_, loaded->load_ms);
+    loaded_.push_back(std::move(loaded));
+    in_flight_ = -1;
+  }
+}
+
+void WorldStreamer::load(unsigned int cell, LoadedCell& ret_loaded) {
+  auto start = std::chrono::steady_clock::now();
+  ret_loaded.cell = cell;
+  ret_loaded.bytes = 0;
+
+  // Objects of a cell repeating a mesh or texture share it.
+  std::map<std::string, unsigned int> meshes;
+  std::map<std::pair<std::string, std::string>, unsigned int> textures;
+  for(const StreamObject& object : cells_[cell].objects) {
+    auto mesh = meshes.emplace(object.mesh, (unsigned int)ret_loaded.meshes.size());
+    if(mesh.second) {
+      ret_loaded.meshes.emplace_back();
+      if(LoadMesh(object.mesh.c_str(), settings_.lod_levels, ret_loaded.meshes.back())) {
+        ret_loaded.bytes += ret_loaded.meshes.back().gpu_bytes();
+      } else {
+        ret_loaded.meshes.pop_back();
+        mesh.first->second = NoMesh;
+      }
+    }
+
+    auto texture = textures.emplace(std::make_pair(object.albedo, object.normal),
+                                    (unsigned int)ret_loaded.textures.size());
+    if(texture.second) {
+      ret_loaded.textures.emplace_back();
+      Texture::Images& images = ret_loaded.textures.back();
+      Texture::Decode(Texture::Format::PNG, object.albedo.c_str(), object.normal.c_str(), images);
+      ret_loaded.bytes += images.albedo.size() + images.normal.size();
+    }
+
+    ret_loaded.objects.push_back({mesh.first->second, texture.first->second});
+  }
+  ret_loaded.load_ms = MillisecondsSince(start);
+}
+
+void WorldStreamer::collect_loaded() {
+  std::vector<std::unique_ptr<LoadedCell>> loaded;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    unsigned int room = MaxStaged - std::min<size_t>(MaxStaged, staged_.size());
+    while(room-- > 0 && !loaded_.empty()) {
+      loaded.push_back(std::move(loaded_.front()));
+      loaded_.erase(loaded_.begin());
+    }
+  }
+  if(!loaded.empty())
+    cv_.notify_one();
+
+  for(std::unique_ptr<LoadedCell>& cell : loaded) {
+    stats_.loads++;
+    cell_bytes_[cell->cell] = cell->bytes;
+    // Moved out of range while it was loading.
+    if(distances_[cell->cell] > settings_.unload_radius) {
+      states_[cell->cell] = State::Unloaded;
+      continue;
+    }
+    states_[cell->cell] = State::Staged;
+    stats_.staged_bytes += cell->bytes;
+    staged_.push_back(std::move(cell));
+  }
+  stats_.peak_staged_bytes = std::max(stats_.peak_staged_bytes, stats_.staged_bytes);
+}
+
+void WorldStreamer::unload_distant() {
+  for(unsigned int i = 0; i < cells_.size(); i++)
+    if(states_[i] == State::Resident && distances_[i] > settings_.unload_radius)
+      evict(i);
+}
+
+void WorldStreamer::upload() {
+  size_t uploaded = 0;
+  while(uploaded < settings_.upload_budget) {
+    if(!uploading_) {
+      if(staged_.empty())
+        return;
+      auto nearest = std::min_element(staged_.begin(), staged_.end(),
+                                      [this](const std::unique_ptr<LoadedCell>& a,
+                                             const std::unique_ptr<LoadedCell>& b) {
+                                        return distances_[a->cell] < distances_[b->cell];
+                                      });
+      std::unique_ptr<LoadedCell> cell = std::move(*nearest);
+      staged_.erase(nearest);
+      stats_.staged_bytes -= cell->bytes;
+
+      if(distances_[cell->cell] > settings_.unload_radius || !make_room(cell->bytes, distances_[cell->cell])) {
+        states_[cell->cell] = State::Unloaded;
+        continue;
+      }
+      uploading_ = std::move(cell);
+      uploaded_.reset(new ResidentCell());
+      uploaded_->bytes = 0;
+    }
+
+    // One texture or mesh at a time, so a cell may take several updates.
+    LoadedCell& cell = *uploading_;
+    ResidentCell& resident = *uploaded_;
+    if(resident.textures.size() < cell.textures.size()) {
+      const Texture::Images& images = cell.textures[resident.textures.size()];
+      resident.textures.emplace_back(new Texture(images));
+      uploaded += resident.textures.back()->bytes();
+    } else if(resident.models.size() < cell.meshes.size()) {
+      const MeshData& mesh = cell.meshes[resident.models.size()];
+      resident.models.emplace_back(new Model(mesh));
+      uploaded += mesh.gpu_bytes();
+    }
+
+    if(resident.textures.size() == cell.textures.size() && resident.models.size() == cell.meshes.size()) {
+      resident.objects = cell.objects;
+      resident.bytes = cell.bytes;
+      stats_.resident_bytes += cell.bytes;
+      stats_.peak_resident_bytes = std::max(stats_.peak_resident_bytes, stats_.resident_bytes);
+      stats_.resident_cells++;
+      states_[cell.cell] = State::Resident;
+      resident_[cell.cell] = std::move(uploaded_);
+      uploading_.reset();
+      instances_dirty_ = true;
+    }
+  }
+}
+
+// Evicts resident cells farther than distance until bytes fit the budget.
+bool WorldStreamer::make_room(size_t bytes, float distance) {
+  while(stats_.resident_bytes + bytes > settings_.memory_budget) {
+    int farthest = -1;
+    for(unsigned int i = 0; i < cells_.size(); i++)
+      if(states_[i] == State::Resident && distances_[i] > distance &&
+         (farthest < 0 || distances_[i] > distances_[farthest]))
+        farthest = i;
+    if(farthest < 0)
+      return false;
+    evict(farthest);
+  }
+  return true;
+}
+
+void WorldStreamer::evict(unsigned int cell) {
+  stats_.resident_bytes -= resident_[cell]->bytes;
+  stats_.resident_cells--;
+  stats_.evictions++;
+  states_[cell] = State::Unloaded;
+  retired_.push_back({update_count_, std::move(resident_[cell])});
+  instances_dirty_ = true;
+}
+
+void WorldStreamer::request() {
+  // Past the budget only cells nearer than the farthest resident one can
+  // get in, anything else would be dropped or evicted right away. Sizes of
+  // cells never loaded are guessed from the resident ones.
+  float farthest = 0.0f;
+  for(unsigned int i = 0; i < cells_.size(); i++)
+    if(states_[i] == State::Resident)
+      farthest = std::max(farthest, distances_[i]);
+  size_t average = stats_.resident_cells ? stats_.resident_bytes / stats_.resident_cells : 0;
+  // Staged and half uploaded cells will take their share of the budget too.
+  size_t committed = stats_.resident_bytes + stats_.staged_bytes + (uploading_ ? uploading_->bytes : 0);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.clear();
+    for(unsigned int i = 0; i < cells_.size(); i++) {
+      if(states_[i] != State::Unloaded && states_[i] != State::Loading)
+        continue;
+      if((int)i == in_flight_ || std::any_of(loaded_.begin(), loaded_.end(),
+                                              [i](const std::unique_ptr<LoadedCell>& cell) {
+                                                return cell->cell == i;
+                                              }))
+        continue;
+      size_t bytes = cell_bytes_[i] ? cell_bytes_[i] : average;
+      bool fits = committed + bytes <= settings_.memory_budget || distances_[i] < farthest;
+      if(distances_[i] < settings_.load_radius && fits) {
+        queue_.push_back({distances_[i], i});
+        states_[i] = State::Loading;
+      } else {
+        states_[i] = State::Unloaded;
+      }
+    }
+    std::make_heap(queue_.begin(), queue_.end(), FartherFirst);
+
+    stats_.loading_cells = queue_.size() + loaded_.size() + (in_flight_ >= 0 ? 1 : 0);
+  }
+  cv_.notify_one();
+}
+
+void WorldStreamer::rebuild_instances() {
+  scene_.instances.resize(static_instances_);
+  const glm::vec3 up(0.0f, 1.0f, 0.0f);
+  for(unsigned int i = 0; i < cells_.size(); i++) {
+    if(states_[i] != State::Resident)
+      continue;
+    const ResidentCell& resident = *resident_[i];
+    for(unsigned int j = 0; j < cells_[i].objects.size(); j++) {
+      const StreamObject& object = cells_[i].objects[j];
+      if(resident.objects[j].first == NoMesh)
+        continue;
+      scene_.instances.push_back({resident.models[resident.objects[j].first].get(),
+                                  resident.textures[resident.objects[j].second].get(),
+                                  object.position, up, object.angle, object.scale, object.flags});
+    }
+  }
+  instances_dirty_ = false;
+}
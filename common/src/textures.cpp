@@ -1,60 +1,90 @@
 #include <textures.hpp>
 #include <stb_image.h>
 
+#include <cmath>
 #include <iostream>
 
-Texture::Texture(Texture::Format format, const char* albedo, const char* normal) {
-  unsigned char *albedo_data, *normal_data;
+namespace {
+
+bool DecodePNG(const char* path, int& ret_width, int& ret_height, std::vector<unsigned char>& ret_pixels) {
+  int comp;
+  unsigned char* data = stbi_load(path, &ret_width, &ret_height, &comp, STBI_rgb_alpha);
+  if(data == nullptr) {
+    std::cout << "Failed to load the texture " << path << std::endl;
+    return false;
+  }
+  ret_pixels.assign(data, data + (size_t)ret_width * ret_height * 4);
+  stbi_image_free(data);
+  return true;
+}
+
+// A single texel, sampled with GL_REPEAT it covers any uv.
+void SolidImage(glm::vec3 color, int& ret_width, int& ret_height, std::vector<unsigned char>& ret_pixels) {
+  color = glm::clamp(color, 0.0f, 1.0f) * 255.0f;
+  ret_width = ret_height = 1;
+  ret_pixels = {(unsigned char)std::lround(color.x), (unsigned char)std::lround(color.y),
+                (unsigned char)std::lround(color.z), 255};
+}
+
+GLuint CreateTexture(int width, int height, const std::vector<unsigned char>& pixels) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  return texture;
+}
+
+}
+
+bool Texture::Decode(Texture::Format format, const char* albedo, const char* normal, Images& ret_images) {
+  ret_images.albedo_width = ret_images.albedo_height = 0;
+  ret_images.normal_width = ret_images.normal_height = 0;
   switch(format) {
     case Texture::Format::PNG:
-      int w_albedo, h_albedo, w_normal, h_normal, comp;
-      if(albedo) {
-        albedo_data = stbi_load(albedo, &w_albedo, &h_albedo, &comp, STBI_rgb_alpha);
-        if(albedo_data == nullptr) {
-          std::cout << "Failed to load the texture " << albedo << std::endl;
-          return;
-        }
-      } else {
-        albedo_texture_ = 0;
-      }
-      if(normal) {
-        normal_data = stbi_load(normal, &w_normal, &h_normal, &comp, STBI_rgb_alpha);
-        if(normal_data == nullptr) {
-          std::cout << "Failed to load the texture " << normal << std::endl;
-          return;
-        }
-      } else {
-        normal_texture_ = 0;
-      }
-
-      glGenTextures(1, &albedo_texture_);
-      glBindTexture(GL_TEXTURE_2D, albedo_texture_);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w_albedo, h_albedo, 0, GL_RGBA, GL_UNSIGNED_BYTE, albedo_data);
-
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-      glGenTextures(1, &normal_texture_);
-      glBindTexture(GL_TEXTURE_2D, normal_texture_);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w_normal, h_normal, 0, GL_RGB, GL_UNSIGNED_BYTE, normal_data);
-
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-      stbi_image_free(albedo_data);
-      stbi_image_free(normal_data);
-
+      if(albedo && !DecodePNG(albedo, ret_images.albedo_width, ret_images.albedo_height, ret_images.albedo))
+        return false;
+      if(normal && !DecodePNG(normal, ret_images.normal_width, ret_images.normal_height, ret_images.normal))
+        return false;
       break;
   }
+  return true;
+}
+
+Texture::Texture(Texture::Format format, const char* albedo, const char* normal)
+  : albedo_texture_(0), normal_texture_(0), bytes_(0), virtual_id_(0), page_table_(0) {
+  Images images;
+  if(Decode(format, albedo, normal, images))
+    upload(images);
+}
+
+Texture::Texture(const Images& images)
+  : albedo_texture_(0), normal_texture_(0), bytes_(0), virtual_id_(0), page_table_(0) {
+  upload(images);
+}
+
+Texture::Texture(unsigned int virtual_id, GLuint page_table)
+  : albedo_texture_(0), normal_texture_(0), bytes_(0), virtual_id_(virtual_id), page_table_(page_table) {
+}
+
+void Texture::upload(const Images& images) {
+  if(images.albedo.size())
+    albedo_texture_ = CreateTexture(images.albedo_width, images.albedo_height, images.albedo);
+  if(images.normal.size())
+    normal_texture_ = CreateTexture(images.normal_width, images.normal_height, images.normal);
+  bytes_ = images.albedo.size() + images.normal.size();
 }
 
 Texture::Texture(Texture && other) {
   albedo_texture_ = other.albedo_texture_;
   normal_texture_ = other.normal_texture_;
+  bytes_ = other.bytes_;
+  virtual_id_ = other.virtual_id_;
+  page_table_ = other.page_table_;
 
   other.albedo_texture_ = 0;
   other.normal_texture_ = 0;
@@ -64,8 +94,13 @@ Texture& Texture::operator=(Texture && other) {
   if(this == &other)
     return *this;
 
+  glDeleteTextures(1, &albedo_texture_);
+  glDeleteTextures(1, &normal_texture_);
   albedo_texture_ = other.albedo_texture_;
   normal_texture_ = other.normal_texture_;
+  bytes_ = other.bytes_;
+  virtual_id_ = other.virtual_id_;
+  page_table_ = other.page_table_;
 
   other.albedo_texture_ = 0;
   other.normal_texture_ = 0;
@@ -79,9 +114,52 @@ Texture::~Texture() {
 }
 
 void Texture::use() {
+  if(virtual_id_) {
+    glActiveTexture(PageTableUnit);
+    glBindTexture(GL_TEXTURE_2D, page_table_);
+    return;
+  }
+
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, albedo_texture_);
 
   glActiveTexture(GL_TEXTURE1);
   glBindTexture(GL_TEXTURE_2D, normal_texture_);
 }
+
+size_t Texture::bytes() const {
+  return bytes_;
+}
+
+unsigned int Texture::virtual_id() const {
+  return virtual_id_;
+}
+
+TextureCache::TextureCache(Loader loader) : loader_(std::move(loader)) {}
+
+Texture* TextureCache::get(const std::string& albedo, const std::string& normal, const glm::vec3& diffuse) {
+  std::string key = albedo + "|" + normal;
+  if(albedo.empty())
+    key += "|" + std::to_string(diffuse.x) + "," + std::to_string(diffuse.y) + "," + std::to_string(diffuse.z);
+  std::shared_ptr<Texture>& texture = textures_[key];
+  if(texture)
+    return texture.get();
+
+  if(loader_ && !albedo.empty())
+    texture = loader_(albedo.c_str(), normal.empty() ? nullptr : normal.c_str());
+  if(texture)
+    return texture.get();
+
+  Texture::Images images;
+  images.albedo_width = images.albedo_height = images.normal_width = images.normal_height = 0;
+  if(albedo.empty() || !DecodePNG(albedo.c_str(), images.albedo_width, images.albedo_height, images.albedo))
+    SolidImage(diffuse, images.albedo_width, images.albedo_height, images.albedo);
+  if(normal.empty() || !DecodePNG(normal.c_str(), images.normal_width, images.normal_height, images.normal))
+    SolidImage(glm::vec3(0.5f, 0.5f, 1.0f), images.normal_width, images.normal_height, images.normal);
+  texture = std::make_shared<Texture>(images);
+  return texture.get();
+}
+
+unsigned int TextureCache::size() const {
+  return textures_.size();
+}
@@ -0,0 +1,221 @@
+#include <transforms.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Transforms per job item, a multiple of every lane width.
+const unsigned int BatchSize = 8;
+const unsigned int BatchGrain = 512;
+const unsigned int PropagateGrain = 2048;
+
+#if defined(__AVX__)
+typedef __m256 Lane;
+const unsigned int LaneWidth = 8;
+inline Lane Load(const float* p) { return _mm256_loadu_ps(p); }
+inline Lane Add(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+inline Lane Sub(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+inline Lane Mul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+inline void Store(float* p, Lane value) { _mm256_storeu_ps(p, value); }
+#elif defined(__SSE2__) || defined(_M_X64)
+typedef __m128 Lane;
+const unsigned int LaneWidth = 4;
+inline Lane Load(const float* p) { return _mm_loadu_ps(p); }
+inline Lane Add(Lane a, Lane b) { return _mm_add_ps(a, b); }
+inline Lane Sub(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+inline Lane Mul(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+inline void Store(float* p, Lane value) { _mm_storeu_ps(p, value); }
+#else
+typedef float Lane;
+const unsigned int LaneWidth = 1;
+inline Lane Load(const float* p) { return *p; }
+inline Lane Add(Lane a, Lane b) { return a + b; }
+inline Lane Sub(Lane a, Lane b) { return a - b; }
+inline Lane Mul(Lane a, Lane b) { return a * b; }
+inline void Store(float* p, Lane value) { *p = value; }
+#endif
+
+unsigned int padded(unsigned int count) {
+  return (count + BatchSize - 1) / BatchSize * BatchSize;
+}
+
+}
+
+TransformSystem::TransformSystem() : size_(0), hierarchy_dirty_(false), updated_count_(0) {}
+
+void TransformSystem::resize(unsigned int count) {
+  size_ = count;
+  unsigned int capacity = padded(count);
+  px_.assign(capacity, 0.0f);
+  py_.assign(capacity, 0.0f);
+  pz_.assign(capacity, 0.0f);
+  qx_.assign(capacity, 0.0f);
+  qy_.assign(capacity, 0.0f);
+  qz_.assign(capacity, 0.0f);
+  qw_.assign(capacity, 1.0f);
+  scale_.assign(capacity, 1.0f);
+  parent_.assign(count, NoParent);
+  dirty_.assign(capacity, 1);
+  moved_.assign(capacity, 0);
+  local_.assign(count, glm::mat4(1.0f));
+  world_.assign(count, glm::mat4(1.0f));
+  levels_.clear();
+  hierarchy_dirty_ = false;
+}
+
+unsigned int TransformSystem::size() const {
+  return size_;
+}
+
+void TransformSystem::set(unsigned int index, const glm::vec3& position, const glm::quat& rotation, float scale) {
+  px_[index] = position.x;
+  py_[index] = position.y;
+  pz_[index] = position.z;
+  qx_[index] = rotation.x;
+  qy_[index] = rotation.y;
+  qz_[index] = rotation.z;
+  qw_[index] = rotation.w;
+  scale_[index] = scale;
+  dirty_[index] = 1;
+}
+
+void TransformSystem::set_parent(unsigned int index, unsigned int parent) {
+  if(parent != NoParent && parent >= index) {
+    std::cout << "Transform " << index << " can not have parent " << parent << std::endl;
+    parent = NoParent;
+  }
+  parent_[index] = parent;
+  dirty_[index] = 1;
+  hierarchy_dirty_ = true;
+}
+
+unsigned int TransformSystem::parent(unsigned int index) const {
+  return parent_[index];
+}
+
+void TransformSystem::update(JobSystem& jobs) {
+  if(hierarchy_dirty_)
+    build_levels();
+
+  std::atomic<unsigned int> updated(0);
+  {
+    JobGroup group;
+    auto compose = [this, &updated](unsigned int begin, unsigned int end) {
+      unsigned int count = this->compose(begin * BatchSize, std::min(size_, end * BatchSize));
+      updated.fetch_add(count, std::memory_order_relaxed);
+    };
+    jobs.parallel_for(group, padded(size_) / BatchSize, BatchGrain, compose);
+    jobs.wait(group);
+  }
+
+  // Each level only reads the one above it, which is complete.
+  for(const std::vector<unsigned int>& level : levels_) {
+    JobGroup group;
+    auto propagate = [this, &level, &updated](unsigned int begin, unsigned int end) {
+      unsigned int count = this->propagate(level, begin, end);
+      updated.fetch_add(count, std::memory_order_relaxed);
+    };
+    jobs.parallel_for(group, level.size(), PropagateGrain, propagate);
+    jobs.wait(group);
+  }
+
+  updated_count_ = updated.load(std::memory_order_relaxed);
+}
+
+unsigned int TransformSystem::updated_count() const {
+  return updated_count_;
+}
+
+void TransformSystem::build_levels() {
+  std::vector<unsigned int> depth(size_, 0);
+  levels_.clear();
+  for(unsigned int i = 0; i < size_; i++) {
+    if(parent_[i] == NoParent)
+      continue;
+    depth[i] = depth[parent_[i]] + 1;
+    if(levels_.size() < depth[i])
+      levels_.resize(depth[i]);
+    levels_[depth[i] - 1].push_back(i);
+  }
+  hierarchy_dirty_ = false;
+}
+
+// Scale and rotation go into the upper 3x3 as columns of the quaternion's
+// rotation matrix times the scale, the position into the last column.
+// Returns the number of transforms composed.
+unsigned int TransformSystem::compose(unsigned int begin, unsigned int end) {
+  unsigned int count = 0;
+  for(unsigned int batch = begin; batch < end; batch += BatchSize) {
+    unsigned int batch_end = std::min(end, batch + BatchSize);
+    bool dirty = false;
+    for(unsigned int i = batch; i < batch_end; i++) {
+      moved_[i] = dirty_[i];
+      dirty = dirty || dirty_[i];
+    }
+    if(!dirty)
+      continue;
+
+    float columns[12][BatchSize];
+    for(unsigned int lane = 0; lane < BatchSize; lane += LaneWidth) {
+      unsigned int i = batch + lane;
+      Lane x = Load(&qx_[i]), y = Load(&qy_[i]), z = Load(&qz_[i]), w = Load(&qw_[i]);
+      Lane s = Load(&scale_[i]);
+      Lane two_s = Add(s, s);
+
+      Lane xx = Mul(x, x), yy = Mul(y, y), zz = Mul(z, z);
+      Lane xy = Mul(x, y), xz = Mul(x, z), yz = Mul(y, z);
+      Lane wx = Mul(w, x), wy = Mul(w, y), wz = Mul(w, z);
+
+      Store(&columns[0][lane], Sub(s, Mul(two_s, Add(yy, zz))));
+      Store(&columns[1][lane], Mul(two_s, Add(xy, wz)));
+      Store(&columns[2][lane], Mul(two_s, Sub(xz, wy)));
+      Store(&columns[3][lane], Mul(two_s, Sub(xy, wz)));
+      Store(&columns[4][lane], Sub(s, Mul(two_s, Add(xx, zz))));
+      Store(&columns[5][lane], Mul(two_s, Add(yz, wx)));
+      Store(&columns[6][lane], Mul(two_s, Add(xz, wy)));
+      Store(&columns[7][lane], Mul(two_s, Sub(yz, wx)));
+      Store(&columns[8][lane], Sub(s, Mul(two_s, Add(xx, yy))));
+      Store(&columns[9][lane], Load(&px_[i]));
+      Store(&columns[10][lane], Load(&py_[i]));
+      Store(&columns[11][lane], Load(&pz_[i]));
+    }
+
+    for(unsigned int i = batch; i < batch_end; i++) {
+      if(!dirty_[i])
+        continue;
+      dirty_[i] = 0;
+      count++;
+      unsigned int lane = i - batch;
+      glm::mat4& m = parent_[i] == NoParent ? world_[i] : local_[i];
+      m[0] = glm::vec4(columns[0][lane], columns[1][lane], columns[2][lane], 0.0f);
+      m[1] = glm::vec4(columns[3][lane], columns[4][lane], columns[5][lane], 0.0f);
+      m[2] = glm::vec4(columns[6][lane], columns[7][lane], columns[8][lane], 0.0f);
+      m[3] = glm::vec4(columns[9][lane], columns[10][lane], columns[11][lane], 1.0f);
+    }
+  }
+  return count;
+}
+
+// Returns the number of transforms moved by their parent only.
+unsigned int TransformSystem::propagate(const std::vector<unsigned int>& level, unsigned int begin,
+                                        unsigned int end) {
+  unsigned int count = 0;
+  for(unsigned int k = begin; k < end; k++) {
+    unsigned int i = level[k];
+    unsigned int parent = parent_[i];
+    if(!moved_[i] && !moved_[parent])
+      continue;
+    world_[i] = world_[parent] * local_[i];
+    count += !moved_[i];
+    moved_[i] = 1;
+  }
+  return count;
+}
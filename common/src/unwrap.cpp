@@ -0,0 +1,201 @@
+#include <unwrap.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+// Neighbours join a chart while their normal stays within about 40 degrees
+// of the normal of its first triangle, so the projection does not fold.
+const float ChartCosine = 0.75f;
+const int MaxFitAttempts = 16;
+
+struct Chart {
+  unsigned int first;  // in the chart triangle list
+  unsigned int count;
+  glm::vec3 tangent;
+  glm::vec3 bitangent;
+  glm::vec2 lower;  // projected bounds in model units
+  glm::vec2 upper;
+  unsigned int width;  // texels, padding included
+  unsigned int height;
+  unsigned int x;
+  unsigned int y;
+};
+
+struct Edge {
+  uint64_t key;
+  unsigned int triangle;
+};
+
+bool by_key(const Edge& a, const Edge& b) {
+  return a.key < b.key;
+}
+
+// Ids equal for vertices at the same position, so charts grow across UV
+// and normal seams.
+void weld_positions(const std::vector<glm::vec3>& vertices, std::vector<unsigned int>& ret_ids) {
+  std::vector<unsigned int> order(vertices.size());
+  std::iota(order.begin(), order.end(), 0u);
+  auto less = [&](unsigned int a, unsigned int b) {
+    const glm::vec3& p = vertices[a];
+    const glm::vec3& q = vertices[b];
+    if(p.x != q.x)
+      return p.x < q.x;
+    if(p.y != q.y)
+      return p.y < q.y;
+    return p.z < q.z;
+  };
+  std::sort(order.begin(), order.end(), less);
+  ret_ids.resize(vertices.size());
+  for(unsigned int i = 0; i < order.size(); i++)
+    ret_ids[order[i]] = i && vertices[order[i]] == vertices[order[i - 1]] ? ret_ids[order[i - 1]] : order[i];
+}
+
+// Shelf packing, tallest charts first. Returns the side of the smallest
+// square found that holds every chart.
+unsigned int pack(std::vector<Chart>& charts, const std::vector<unsigned int>& tallest_first) {
+  size_t area = 0;
+  unsigned int widest = 1;
+  for(const Chart& chart : charts) {
+    area += (size_t)chart.width * chart.height;
+    widest = std::max(widest, chart.width);
+  }
+  unsigned int side = std::max(widest, (unsigned int)std::ceil(std::sqrt((double)area)));
+  while(true) {
+    unsigned int x = 0, y = 0, shelf = 0;
+    for(unsigned int c : tallest_first) {
+      Chart& chart = charts[c];
+      if(x + chart.width > side) {
+        y += shelf;
+        x = shelf = 0;
+      }
+      chart.x = x;
+      chart.y = y;
+      x += chart.width;
+      shelf = std::max(shelf, chart.height);
+    }
+    if(y + shelf <= side)
+      return side;
+    side += std::max(1u, side / 16);
+  }
+}
+
+}
+
+void UnwrapLightmap(const std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices,
+                    const std::vector<UnwrapRange>& ranges, float texels_per_unit, unsigned int padding,
+                    unsigned int max_size, std::vector<unsigned int>& ret_remap, std::vector<glm::vec2>& ret_uvs,
+                    unsigned int& ret_size) {
+  std::vector<unsigned int> welded;
+  weld_positions(vertices, welded);
+
+  std::vector<Chart> charts;
+  std::vector<unsigned int> chart_triangles;  // first index of each triangle
+  for(const UnwrapRange& range : ranges) {
+    unsigned int triangles = range.count / 3;
+    std::vector<glm::vec3> normals(triangles);
+    std::vector<Edge> edges;
+    edges.reserve(range.count);
+    for(unsigned int t = 0; t < triangles; t++) {
+      const unsigned int* corners = &indices[range.first + t * 3];
+      glm::vec3 normal = glm::cross(vertices[corners[1]] - vertices[corners[0]],
+                                    vertices[corners[2]] - vertices[corners[0]]);
+      float length = glm::length(normal);
+      normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+      for(int k = 0; k < 3; k++) {
+        uint64_t a = welded[corners[k]], b = welded[corners[(k + 1) % 3]];
+        edges.push_back({std::min(a, b) << 32 | std::max(a, b), t});
+      }
+    }
+    std::sort(edges.begin(), edges.end(), by_key);
+
+    std::vector<unsigned char> assigned(triangles, 0);
+    for(unsigned int seed = 0; seed < triangles; seed++) {
+      if(assigned[seed])
+        continue;
+      Chart chart = {};
+      chart.first = chart_triangles.size();
+      glm::vec3 axis = normals[seed] == glm::vec3(0.0f) ? glm::vec3(0.0f, 0.0f, 1.0f) : normals[seed];
+      assigned[seed] = 1;
+      chart_triangles.push_back(range.first + seed * 3);
+      // Breadth first over shared edges, the triangle list is the queue.
+      for(unsigned int next = chart.first; next < chart_triangles.size(); next++) {
+        const unsigned int* corners = &indices[chart_triangles[next]];
+        for(int k = 0; k < 3; k++) {
+          uint64_t a = welded[corners[k]], b = welded[corners[(k + 1) % 3]];
+          Edge key = {std::min(a, b) << 32 | std::max(a, b), 0};
+          auto edge = std::lower_bound(edges.begin(), edges.end(), key, by_key);
+          for(; edge != edges.end() && edge->key == key.key; ++edge) {
+            unsigned int neighbour = edge->triangle;
+            if(assigned[neighbour] || glm::dot(normals[neighbour], axis) < ChartCosine)
+              continue;
+            assigned[neighbour] = 1;
+            chart_triangles.push_back(range.first + neighbour * 3);
+          }
+        }
+      }
+      chart.count = chart_triangles.size() - chart.first;
+
+      glm::vec3 helper = std::abs(axis.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+      chart.tangent = glm::normalize(glm::cross(helper, axis));
+      chart.bitangent = glm::cross(axis, chart.tangent);
+      chart.lower = glm::vec2(std::numeric_limits<float>::max());
+      chart.upper = glm::vec2(-std::numeric_limits<float>::max());
+      for(unsigned int i = chart.first; i < chart.first + chart.count; i++) {
+        for(int k = 0; k < 3; k++) {
+          const glm::vec3& p = vertices[indices[chart_triangles[i] + k]];
+          glm::vec2 projected(glm::dot(p, chart.tangent), glm::dot(p, chart.bitangent));
+          chart.lower = glm::min(chart.lower, projected);
+          chart.upper = glm::max(chart.upper, projected);
+        }
+      }
+      charts.push_back(chart);
+    }
+  }
+
+  std::vector<unsigned int> tallest_first(charts.size());
+  std::iota(tallest_first.begin(), tallest_first.end(), 0u);
+  unsigned int size = 1;
+  for(int attempt = 0; attempt < MaxFitAttempts; attempt++) {
+    for(Chart& chart : charts) {
+      glm::vec2 extent = (chart.upper - chart.lower) * texels_per_unit;
+      chart.width = std::max(1u, (unsigned int)std::ceil(extent.x)) + 2 * padding;
+      chart.height = std::max(1u, (unsigned int)std::ceil(extent.y)) + 2 * padding;
+    }
+    std::stable_sort(tallest_first.begin(), tallest_first.end(),
+                     [&](unsigned int a, unsigned int b) { return charts[a].height > charts[b].height; });
+    size = pack(charts, tallest_first);
+    if(size <= max_size)
+      break;
+    // Padding does not shrink with the density, aim a little lower.
+    texels_per_unit *= 0.95f * max_size / size;
+  }
+  ret_size = size;
+
+  ret_remap.clear();
+  ret_uvs.clear();
+  std::vector<unsigned int> stamp(vertices.size(), ~0u);
+  std::vector<unsigned int> copy(vertices.size());
+  for(unsigned int c = 0; c < charts.size(); c++) {
+    const Chart& chart = charts[c];
+    glm::vec2 origin(chart.x + padding, chart.y + padding);
+    for(unsigned int i = chart.first; i < chart.first + chart.count; i++) {
+      for(int k = 0; k < 3; k++) {
+        unsigned int& index = indices[chart_triangles[i] + k];
+        if(stamp[index] != c) {
+          stamp[index] = c;
+          copy[index] = ret_remap.size();
+          const glm::vec3& p = vertices[index];
+          glm::vec2 projected(glm::dot(p, chart.tangent), glm::dot(p, chart.bitangent));
+          ret_remap.push_back(index);
+          ret_uvs.push_back((origin + (projected - chart.lower) * texels_per_unit) / (float)size);
+        }
+        index = copy[index];
+      }
+    }
+  }
+}
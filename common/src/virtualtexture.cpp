@@ -0,0 +1,584 @@
+#include <virtualtexture.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const unsigned int PageSize = VirtualTextureCache::PageSize;
+const unsigned int PageBorder = VirtualTextureCache::PageBorder;
+const unsigned int PageSlot = VirtualTextureCache::PageSlot;
+const size_t MapBytes = PageSlot * PageSlot * 4;
+// Page coordinates have 8 bits in the feedback.
+const unsigned int MaxPages = 256;
+
+glm::vec4 texel(const std::vector<unsigned char>& pixels, int width, int height, int x, int y) {
+  x = ((x % width) + width) % width;
+  y = ((y % height) + height) % height;
+  const unsigned char* t = &pixels[((size_t)y * width + x) * 4];
+  return glm::vec4(t[0], t[1], t[2], t[3]);
+}
+
+void store(glm::vec4 value, bool normal, unsigned char* ret_texel) {
+  if(normal) {
+    glm::vec3 n = glm::vec3(value) / 127.5f - 1.0f;
+    float length = glm::length(n);
+    n = length > 0.0f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    value = glm::vec4((n + 1.0f) * 127.5f, value.w);
+  }
+  for(int c = 0; c < 4; c++)
+    ret_texel[c] = (unsigned char)glm::clamp(value[c] + 0.5f, 0.0f, 255.0f);
+}
+
+// Bilinear, wrapping around like the GL_REPEAT textures it replaces.
+void resample(const std::vector<unsigned char>& pixels, int width, int height, unsigned int size, bool normal,
+              std::vector<unsigned char>& ret_pixels) {
+  ret_pixels.resize((size_t)size * size * 4);
+  for(unsigned int y = 0; y < size; y++) {
+    float sy = (y + 0.5f) * height / size - 0.5f;
+    int y0 = (int)std::floor(sy);
+    float fy = sy - y0;
+    for(unsigned int x = 0; x < size; x++) {
+      float sx = (x + 0.5f) * width / size - 0.5f;
+      int x0 = (int)std::floor(sx);
+      float fx = sx - x0;
+      glm::vec4 top = glm::mix(texel(pixels, width, height, x0, y0), texel(pixels, width, height, x0 + 1, y0), fx);
+      glm::vec4 bottom = glm::mix(texel(pixels, width, height, x0, y0 + 1),
+                                  texel(pixels, width, height, x0 + 1, y0 + 1), fx);
+      store(glm::mix(top, bottom, fy), normal, &ret_pixels[((size_t)y * size + x) * 4]);
+    }
+  }
+}
+
+// Box filters a level into the next one, half the size.
+void downsample(std::vector<unsigned char>& pixels, unsigned int size, bool normal) {
+  unsigned int half = size / 2;
+  for(unsigned int y = 0; y < half; y++)
+    for(unsigned int x = 0; x < half; x++) {
+      glm::vec4 sum(0.0f);
+      for(unsigned int dy = 0; dy < 2; dy++)
+        for(unsigned int dx = 0; dx < 2; dx++)
+          sum += texel(pixels, size, size, 2 * x + dx, 2 * y + dy);
+      // Rows before y are done with, so the level is reduced in place.
+      store(sum * 0.25f, normal, &pixels[((size_t)y * half + x) * 4]);
+    }
+  pixels.resize((size_t)half * half * 4);
+}
+
+void copy_page(const std::vector<unsigned char>& pixels, unsigned int size, unsigned int page_x,
+               unsigned int page_y, unsigned char* ret_page) {
+  for(unsigned int y = 0; y < PageSlot; y++) {
+    unsigned int sy = (page_y * PageSize + y + size - PageBorder) % size;
+    for(unsigned int x = 0; x < PageSlot; x++) {
+      unsigned int sx = (page_x * PageSize + x + size - PageBorder) % size;
+      std::memcpy(ret_page + ((size_t)y * PageSlot + x) * 4, &pixels[((size_t)sy * size + sx) * 4], 4);
+    }
+  }
+}
+
+bool open_page_file(const std::string& path, std::ifstream& ret_file, VirtualTextureHeader& ret_header) {
+  ret_file.close();
+  ret_file.clear();
+  ret_file.open(path, std::ios::binary);
+  if(!ret_file.read((char*)&ret_header, sizeof(ret_header)))
+    return false;
+  if(std::memcmp(ret_header.magic, "GPVT", 4) != 0 || ret_header.version != VirtualTextureVersion)
+    return false;
+  unsigned int pages = ret_header.size / PageSize;
+  if(pages == 0 || pages > MaxPages || (pages & (pages - 1)) || ret_header.size != pages * PageSize)
+    return false;
+  unsigned int levels = 0;
+  size_t count = 0;
+  for(unsigned int n = pages; n > 0; n /= 2) {
+    levels++;
+    count += (size_t)n * n;
+  }
+  if(ret_header.levels != levels)
+    return false;
+
+  // A bake cut short leaves a truncated file.
+  ret_file.seekg(0, std::ios::end);
+  if((size_t)ret_file.tellg() != sizeof(ret_header) + count * 2 * MapBytes)
+    return false;
+  return true;
+}
+
+// Orders page keys coarse pages first, they are the fallbacks of the finer
+// ones.
+bool coarse_first(uint32_t a, uint32_t b) {
+  unsigned int level_a = (a >> 8) & 0xff;
+  unsigned int level_b = (b >> 8) & 0xff;
+  return level_a != level_b ? level_a > level_b : a < b;
+}
+
+GLuint create_cache(unsigned int side) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  return texture;
+}
+
+}
+
+bool BakeVirtualTexture(const char* albedo, const char* normal, const char* path) {
+  Texture::Images images;
+  if(!Texture::Decode(Texture::Format::PNG, albedo, normal, images))
+    return false;
+  if(images.albedo.empty()) {
+    std::cout << "No albedo map for the virtual texture " << path << std::endl;
+    return false;
+  }
+  if(images.normal.empty()) {
+    images.normal_width = images.normal_height = 1;
+    images.normal = {128, 128, 255, 255};
+  }
+
+  int largest = std::max({images.albedo_width, images.albedo_height, images.normal_width, images.normal_height});
+  unsigned int size = PageSize;
+  while(size < (unsigned int)largest && size < PageSize * MaxPages)
+    size *= 2;
+
+  VirtualTextureHeader header;
+  std::memcpy(header.magic, "GPVT", 4);
+  header.version = VirtualTextureVersion;
+  header.size = size;
+  header.levels = 1;
+  for(unsigned int n = size / PageSize; n > 1; n /= 2)
+    header.levels++;
+
+  std::vector<unsigned char> albedo_level;
+  std::vector<unsigned char> normal_level;
+  resample(images.albedo, images.albedo_width, images.albedo_height, size, false, albedo_level);
+  resample(images.normal, images.normal_width, images.normal_height, size, true, normal_level);
+
+  std::ofstream file(path, std::ios::binary);
+  file.write((const char*)&header, sizeof(header));
+  std::vector<unsigned char> page(MapBytes);
+  for(unsigned int level = 0; level < header.levels; level++) {
+    unsigned int pages = (size >> level) / PageSize;
+    for(unsigned int y = 0; y < pages; y++)
+      for(unsigned int x = 0; x < pages; x++) {
+        copy_page(albedo_level, size >> level, x, y, page.data());
+        file.write((const char*)page.data(), page.size());
+        copy_page(normal_level, size >> level, x, y, page.data());
+        file.write((const char*)page.data(), page.size());
+      }
+    if(level + 1 < header.levels) {
+      downsample(albedo_level, size >> level, false);
+      downsample(normal_level, size >> level, true);
+    }
+  }
+  if(!file) {
+    std::cout << "Failed to write the virtual texture " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+VirtualTextureCache::VirtualTextureCache(const VirtualTextureSettings& settings)
+  : settings_(settings), page_bytes_(2 * MapBytes), frame_(0), stats_(), feedback_frame_(0), running_(true) {
+  unsigned int side = settings_.cache_pages * PageSlot;
+  albedo_cache_ = create_cache(side);
+  normal_cache_ = create_cache(side);
+  slots_.assign(settings_.cache_pages * settings_.cache_pages, Slot{0, 0, false});
+  stats_.cache_pages = slots_.size();
+  stats_.cache_bytes = 2 * (size_t)side * side * 4;
+
+  glGenTextures(1, &feedback_texture_);
+  glBindTexture(GL_TEXTURE_2D, feedback_texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, settings_.feedback_width, settings_.feedback_height, 0,
+               GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glGenRenderbuffers(1, &feedback_depth_);
+  glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, settings_.feedback_width, settings_.feedback_height);
+
+  glGenFramebuffers(1, &feedback_fbo_);
+  glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedback_texture_, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth_);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cout << "The virtual texture feedback framebuffer is incomplete" << std::endl;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  size_t feedback_pixels = (size_t)settings_.feedback_width * settings_.feedback_height;
+  glGenBuffers(FeedbackLatency, feedback_pbos_);
+  for(unsigned int i = 0; i < FeedbackLatency; i++) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbos_[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, feedback_pixels * 4, nullptr, GL_STREAM_READ);
+    feedback_issued_[i] = false;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  requests_.reserve(feedback_pixels);
+
+  buffers_.resize(MaxInFlight * page_bytes_);
+  for(unsigned int i = 0; i < MaxInFlight; i++)
+    free_buffers_.push_back(i);
+  queue_.reserve(MaxInFlight);
+  loaded_.reserve(MaxInFlight);
+  uploading_.reserve(MaxInFlight);
+
+  thread_ = std::thread(&VirtualTextureCache::io_loop, this);
+}
+
+VirtualTextureCache::~VirtualTextureCache() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  cv_.notify_all();
+  thread_.join();
+
+  for(auto& file : files_)
+    glDeleteTextures(1, &file->page_table);
+  glDeleteTextures(1, &albedo_cache_);
+  glDeleteTextures(1, &normal_cache_);
+  glDeleteFramebuffers(1, &feedback_fbo_);
+  glDeleteTextures(1, &feedback_texture_);
+  glDeleteRenderbuffers(1, &feedback_depth_);
+  glDeleteBuffers(FeedbackLatency, feedback_pbos_);
+}
+
+std::shared_ptr<Texture> VirtualTextureCache::add(const char* albedo, const char* normal) {
+  if(files_.size() + 1 >= MaxPages) {
+    std::cout << "Too many virtual textures" << std::endl;
+    return nullptr;
+  }
+
+  std::unique_ptr<PageFile> file(new PageFile());
+  file->path = std::string(albedo) + ".vt";
+  VirtualTextureHeader header;
+  if(!open_page_file(file->path, file->file, header)) {
+    if(!BakeVirtualTexture(albedo, normal, file->path.c_str()))
+      return nullptr;
+    if(!open_page_file(file->path, file->file, header)) {
+      std::cout << "Failed to read the virtual texture " << file->path << std::endl;
+      return nullptr;
+    }
+  }
+
+  file->levels = header.levels;
+  file->pages = header.size / PageSize;
+  unsigned int count = 0;
+  for(unsigned int level = 0; level < file->levels; level++) {
+    file->level_offsets.push_back(count);
+    count += (file->pages >> level) * (file->pages >> level);
+  }
+  file->slots.assign(count, int(Absent));
+  file->table.assign(count, 0);
+
+  // The coarsest page is what every other page falls back to.
+  int slot = allocate_slot();
+  if(slot < 0) {
+    std::cout << "The virtual texture cache is full" << std::endl;
+    return nullptr;
+  }
+  std::vector<unsigned char> page(page_bytes_);
+  file->file.seekg(sizeof(VirtualTextureHeader) + (size_t)(count - 1) * page_bytes_);
+  if(!file->file.read((char*)page.data(), page.size())) {
+    std::cout << "Failed to read the virtual texture " << file->path << std::endl;
+    return nullptr;
+  }
+  unsigned int id = files_.size() + 1;
+  upload_page(slot, page.data());
+  slots_[slot] = Slot{Key(id, file->levels - 1, 0, 0), frame_, true};
+  file->slots[count - 1] = slot;
+
+  glGenTextures(1, &file->page_table);
+  glActiveTexture(Texture::PageTableUnit);
+  glBindTexture(GL_TEXTURE_2D, file->page_table);
+  for(unsigned int level = 0; level < file->levels; level++)
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8UI, file->pages >> level, file->pages >> level, 0, GL_RGBA_INTEGER,
+                 GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, file->levels - 1);
+  file->dirty = true;
+
+  GLuint page_table = file->page_table;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.push_back(std::move(file));
+  }
+  stats_.textures++;
+  return std::make_shared<Texture>(id, page_table);
+}
+
+uint32_t VirtualTextureCache::Key(unsigned int texture, unsigned int level, unsigned int x, unsigned int y) {
+  return texture | level << 8 | x << 16 | y << 24;
+}
+
+bool VirtualTextureCache::decode(uint32_t key, PageFile*& ret_file, unsigned int& ret_level,
+                                 unsigned int& ret_page) const {
+  unsigned int id = key & 0xff;
+  if(id == 0 || id > files_.size())
+    return false;
+  ret_file = files_[id - 1].get();
+  ret_level = (key >> 8) & 0xff;
+  if(ret_level >= ret_file->levels)
+    return false;
+  unsigned int pages = ret_file->pages >> ret_level;
+  unsigned int x = (key >> 16) & 0xff;
+  unsigned int y = key >> 24;
+  if(x >= pages || y >= pages)
+    return false;
+  ret_page = ret_file->level_offsets[ret_level] + y * pages + x;
+  return true;
+}
+
+void VirtualTextureCache::update() {
+  frame_++;
+  read_feedback();
+  upload_loaded();
+  update_page_tables();
+}
+
+void VirtualTextureCache::read_feedback() {
+  // The oldest readback, the next end_feedback() reuses its buffer.
+  unsigned int index = feedback_frame_ % FeedbackLatency;
+  if(!feedback_issued_[index])
+    return;
+  feedback_issued_[index] = false;
+
+  size_t count = (size_t)settings_.feedback_width * settings_.feedback_height;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbos_[index]);
+  const uint32_t* pixels = (const uint32_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 4, GL_MAP_READ_BIT);
+  if(pixels) {
+    requests_.assign(pixels, pixels + count);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if(!pixels)
+    return;
+
+  std::sort(requests_.begin(), requests_.end(), coarse_first);
+  requests_.erase(std::unique(requests_.begin(), requests_.end()), requests_.end());
+  for(uint32_t key : requests_)
+    request(key);
+}
+
+void VirtualTextureCache::request(uint32_t key) {
+  PageFile* file;
+  unsigned int level, page;
+  if(!decode(key, file, level, page))
+    return;
+  unsigned int id = key & 0xff;
+  unsigned int x = (key >> 16) & 0xff;
+  unsigned int y = key >> 24;
+
+  // The page and the ancestors it falls back to are all in use, missing
+  // ones are loaded coarsest first. Nothing more is read while loaded pages
+  // still wait for a slot.
+  bool queued = false;
+  for(unsigned int l = file->levels; l-- > level;) {
+    unsigned int pages = file->pages >> l;
+    unsigned int px = x >> (l - level);
+    unsigned int py = y >> (l - level);
+    int& slot = file->slots[file->level_offsets[l] + py * pages + px];
+    if(slot >= 0) {
+      slots_[slot].last_used = frame_;
+    } else if(slot == Absent && free_buffers_.size() && uploading_.empty()) {
+      unsigned int buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+      slot = Loading;
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.emplace_back(Key(id, l, px, py), buffer);
+      stats_.requests++;
+      queued = true;
+    }
+  }
+  if(queued)
+    cv_.notify_one();
+}
+
+void VirtualTextureCache::upload_loaded() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uploading_.insert(uploading_.end(), loaded_.begin(), loaded_.end());
+    loaded_.clear();
+  }
+
+  // Pages go in as long as the budget and the slots last. With every slot
+  // holding a page in use this frame, those the last feedback still shows
+  // wait for one, the others give back their buffer.
+  size_t kept = 0;
+  unsigned int uploads = 0;
+  for(size_t i = 0; i < uploading_.size(); i++) {
+    uint32_t key = uploading_[i].first;
+    unsigned int buffer = uploading_[i].second;
+    if(uploads < settings_.uploads_per_frame) {
+      PageFile* file;
+      unsigned int level, page;
+      decode(key, file, level, page);
+      int slot = allocate_slot();
+      if(slot >= 0) {
+        upload_page(slot, &buffers_[buffer * page_bytes_]);
+        slots_[slot] = Slot{key, frame_, false};
+        file->slots[page] = slot;
+        file->dirty = true;
+        free_buffers_.push_back(buffer);
+        uploads++;
+        continue;
+      }
+      if(!std::binary_search(requests_.begin(), requests_.end(), key, coarse_first)) {
+        file->slots[page] = Absent;
+        free_buffers_.push_back(buffer);
+        continue;
+      }
+    }
+    uploading_[kept++] = uploading_[i];
+  }
+  uploading_.resize(kept);
+  stats_.uploads += uploads;
+}
+
+int VirtualTextureCache::allocate_slot() {
+  int oldest = -1;
+  for(size_t i = 0; i < slots_.size(); i++) {
+    const Slot& slot = slots_[i];
+    if(slot.key == 0)
+      return i;
+    if(slot.pinned || slot.last_used == frame_)
+      continue;
+    if(oldest < 0 || slot.last_used < slots_[oldest].last_used)
+      oldest = i;
+  }
+  if(oldest < 0)
+    return -1;
+
+  PageFile* file;
+  unsigned int level, page;
+  decode(slots_[oldest].key, file, level, page);
+  file->slots[page] = Absent;
+  file->dirty = true;
+  slots_[oldest].key = 0;
+  stats_.evictions++;
+  return oldest;
+}
+
+void VirtualTextureCache::upload_page(int slot, const unsigned char* data) {
+  GLint x = (slot % settings_.cache_pages) * PageSlot;
+  GLint y = (slot / settings_.cache_pages) * PageSlot;
+  glActiveTexture(AlbedoCacheUnit);
+  glBindTexture(GL_TEXTURE_2D, albedo_cache_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, PageSlot, PageSlot, GL_RGBA, GL_UNSIGNED_BYTE, data);
+  glActiveTexture(NormalCacheUnit);
+  glBindTexture(GL_TEXTURE_2D, normal_cache_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, PageSlot, PageSlot, GL_RGBA, GL_UNSIGNED_BYTE, data + MapBytes);
+}
+
+void VirtualTextureCache::update_page_tables() {
+  for(auto& file : files_) {
+    if(!file->dirty)
+      continue;
+    file->dirty = false;
+
+    // Coarse to fine so a missing page copies the entry of its parent, the
+    // entry is the slot and the level of the page to sample.
+    glActiveTexture(Texture::PageTableUnit);
+    glBindTexture(GL_TEXTURE_2D, file->page_table);
+    for(unsigned int level = file->levels; level-- > 0;) {
+      unsigned int pages = file->pages >> level;
+      uint32_t* table = &file->table[file->level_offsets[level]];
+      const int* slots = &file->slots[file->level_offsets[level]];
+      const uint32_t* parent = level + 1 < file->levels ? &file->table[file->level_offsets[level + 1]] : nullptr;
+      for(unsigned int y = 0; y < pages; y++)
+        for(unsigned int x = 0; x < pages; x++) {
+          int slot = slots[y * pages + x];
+          if(slot >= 0)
+            table[y * pages + x] = (slot % settings_.cache_pages) | (slot / settings_.cache_pages) << 8 |
+                                   level << 16 | 0xffu << 24;
+          else
+            table[y * pages + x] = parent ? parent[(y / 2) * (pages / 2) + x / 2] : 0;
+        }
+      glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pages, pages, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, table);
+    }
+  }
+}
+
+void VirtualTextureCache::begin_feedback() {
+  glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo_);
+  glViewport(0, 0, settings_.feedback_width, settings_.feedback_height);
+  const GLuint none[4] = {0, 0, 0, 0};
+  glClearBufferuiv(GL_COLOR, 0, none);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTextureCache::end_feedback() {
+  unsigned int index = feedback_frame_ % FeedbackLatency;
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pbos_[index]);
+  glReadPixels(0, 0, settings_.feedback_width, settings_.feedback_height, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+               nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  feedback_issued_[index] = true;
+  feedback_frame_++;
+}
+
+unsigned int VirtualTextureCache::feedback_width() const {
+  return settings_.feedback_width;
+}
+
+unsigned int VirtualTextureCache::feedback_height() const {
+  return settings_.feedback_height;
+}
+
+void VirtualTextureCache::bind_caches() const {
+  glActiveTexture(AlbedoCacheUnit);
+  glBindTexture(GL_TEXTURE_2D, albedo_cache_);
+  glActiveTexture(NormalCacheUnit);
+  glBindTexture(GL_TEXTURE_2D, normal_cache_);
+}
+
+VirtualTextureStats VirtualTextureCache::take_stats() {
+  VirtualTextureStats stats = stats_;
+  stats.resident_pages = 0;
+  for(const Slot& slot : slots_)
+    stats.resident_pages += slot.key != 0;
+  stats_.requests = 0;
+  stats_.uploads = 0;
+  stats_.evictions = 0;
+  return stats;
+}
+
+void VirtualTextureCache::io_loop() {
+  while(true) {
+    uint32_t key;
+    unsigned int buffer;
+    PageFile* file;
+    unsigned int level, page;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return !running_ || queue_.size(); });
+      if(!running_)
+        return;
+      key = queue_.front().first;
+      buffer = queue_.front().second;
+      queue_.erase(queue_.begin());
+      decode(key, file, level, page);
+    }
+
+    unsigned char* data = &buffers_[buffer * page_bytes_];
+    file->file.seekg(sizeof(VirtualTextureHeader) + (size_t)page * page_bytes_);
+    if(!file->file.read((char*)data, page_bytes_)) {
+      std::cout << "Failed to read a page of " << file->path << std::endl;
+      file->file.clear();
+      std::memset(data, 0, page_bytes_);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    loaded_.emplace_back(key, buffer);
+  }
+}
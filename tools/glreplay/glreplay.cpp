@@ -0,0 +1,749 @@
+// Replays a trace written by GLCapture in a hidden window and reports where
+// the captured frames spend their time: per frame totals, then per GL call
+// the count, the time and how many calls did not change any state.
+//
+//   glreplay TRACE
+//
+// Runs on any GL 3.3 core driver, LIBGL_ALWAYS_SOFTWARE=1 selects Mesa's
+// llvmpipe for replays without a GPU.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <SDL2/SDL.h>
+
+#include <gltrace.hpp>
+
+namespace {
+
+struct CallStats {
+  unsigned long count = 0;
+  unsigned long redundant = 0;
+  double ms = 0.0;
+};
+
+struct FrameTiming {
+  unsigned int index;
+  unsigned long calls;
+  unsigned long draws;
+  double submit_ms;
+  double finish_ms;
+};
+
+// Object names of the capture mapped to the replay's.
+class NameMap {
+ public:
+  GLuint operator[](GLuint name) const {
+    auto it = names_.find(name);
+    return it == names_.end() ? name : it->second;
+  }
+  void set(GLuint captured, GLuint replayed) { names_[captured] = replayed; }
+  void erase(GLuint captured) { names_.erase(captured); }
+
+ private:
+  std::unordered_map<GLuint, GLuint> names_;
+};
+
+// Last value the trace gave each piece of state, a call setting the same
+// value again is redundant.
+class StateCache {
+ public:
+  typedef std::tuple<int, uint32_t, uint32_t> Key;
+
+  bool redundant(TraceCall call, uint32_t a, uint32_t b, const void* value, size_t bytes) {
+    std::string& last = values_[Key((int)call, a, b)];
+    std::string current(static_cast<const char*>(value), bytes);
+    if(last == current)
+      return true;
+    last.swap(current);
+    return false;
+  }
+
+  template <typename T>
+  bool redundant(TraceCall call, uint32_t a, uint32_t b, const T& value) {
+    return redundant(call, a, b, &value, sizeof(T));
+  }
+
+  // Deleting or relinking can change what a name refers to.
+  void clear() { values_.clear(); }
+
+ private:
+  std::map<Key, std::string> values_;
+};
+
+bool IsDraw(TraceCall call) {
+  return call == TraceCall::DrawArrays || call == TraceCall::DrawElementsBaseVertex ||
+    call == TraceCall::MultiDrawElementsIndirect;
+}
+
+const void* Offset(uint64_t offset) {
+  return reinterpret_cast<const void*>((uintptr_t)offset);
+}
+
+class Replayer {
+ public:
+  explicit Replayer(TraceReader& reader)
+    : reader_(reader), program_(0), vertex_array_(0), active_texture_(GL_TEXTURE0), captured_frame_(false),
+      unsupported_(0), setup_calls_(0), setup_ms_(0.0) {}
+
+  bool run();
+  void report() const;
+
+ private:
+  void execute(TraceCall call, bool& ret_redundant);
+
+  uint32_t u32() { return reader_.read<uint32_t>(); }
+  int32_t i32() { return reader_.read<int32_t>(); }
+  int64_t i64() { return reader_.read<int64_t>(); }
+  uint64_t u64() { return reader_.read<uint64_t>(); }
+  float f32() { return reader_.read<float>(); }
+  unsigned char u8() { return reader_.read<unsigned char>(); }
+
+  GLint location(int32_t captured) const;
+  void read_names(std::vector<GLuint>& ret_names);
+  void gen(void (APIENTRYP function)(GLsizei, GLuint*), NameMap& map);
+  void remove(void (APIENTRYP function)(GLsizei, const GLuint*), NameMap& map);
+
+  TraceReader& reader_;
+  NameMap buffers_, textures_, framebuffers_, renderbuffers_, vertex_arrays_, queries_, shaders_, programs_;
+  std::map<std::pair<GLuint, GLint>, GLint> locations_;  // by captured program and location
+  StateCache state_;
+  GLuint program_;  // captured names
+  GLuint vertex_array_;
+  GLenum active_texture_;
+
+  bool captured_frame_;
+  FrameTiming frame_;
+  std::vector<FrameTiming> frames_;
+  CallStats calls_[(int)TraceCall::Count];
+  unsigned long unsupported_;
+  unsigned long setup_calls_;
+  double setup_ms_;
+};
+
+GLint Replayer::location(int32_t captured) const {
+  auto it = locations_.find(std::make_pair(program_, (GLint)captured));
+  return it == locations_.end() ? -1 : it->second;
+}
+
+void Replayer::read_names(std::vector<GLuint>& ret_names) {
+  ret_names.resize(std::max(0, i32()));
+  for(GLuint& name : ret_names)
+    name = u32();
+}
+
+void Replayer::gen(void (APIENTRYP function)(GLsizei, GLuint*), NameMap& map) {
+  std::vector<GLuint> captured, replayed;
+  read_names(captured);
+  replayed.resize(captured.size());
+  function(captured.size(), replayed.data());
+  for(size_t i = 0; i < captured.size(); i++)
+    map.set(captured[i], replayed[i]);
+}
+
+void Replayer::remove(void (APIENTRYP function)(GLsizei, const GLuint*), NameMap& map) {
+  std::vector<GLuint> names;
+  read_names(names);
+  for(GLuint& name : names) {
+    GLuint captured = name;
+    name = map[captured];
+    map.erase(captured);
+  }
+  function(names.size(), names.data());
+  state_.clear();
+}
+
+bool Replayer::run() {
+  TraceCall call;
+  while(reader_.next(call)) {
+    if(call >= TraceCall::Count) {
+      std::cout << "Unknown call " << (int)call << " in the trace" << std::endl;
+      return false;
+    }
+
+    if(call == TraceCall::FrameBegin) {
+      frame_ = FrameTiming();
+      frame_.index = u32();
+      captured_frame_ = u8() != 0;
+      continue;
+    }
+    if(call == TraceCall::FrameEnd) {
+      if(captured_frame_) {
+        auto start = std::chrono::steady_clock::now();
+        glFinish();
+        frame_.finish_ms =
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        frames_.push_back(frame_);
+      }
+      captured_frame_ = false;
+      continue;
+    }
+
+    bool redundant = false;
+    auto start = std::chrono::steady_clock::now();
+    execute(call, redundant);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if(!captured_frame_) {
+      setup_calls_++;
+      setup_ms_ += ms;
+      continue;
+    }
+    CallStats& stats = calls_[(int)call];
+    stats.count++;
+    stats.redundant += redundant;
+    stats.ms += ms;
+    frame_.calls++;
+    frame_.draws += IsDraw(call);
+    frame_.submit_ms += ms;
+  }
+  if(reader_.truncated())
+    std::cout << "The trace is truncated" << std::endl;
+  return true;
+}
+
+void Replayer::execute(TraceCall call, bool& ret_redundant) {
+  switch(call) {
+    case TraceCall::ActiveTexture: {
+      GLenum unit = u32();
+      ret_redundant = unit == active_texture_;
+      active_texture_ = unit;
+      glActiveTexture(unit);
+      break;
+    }
+    case TraceCall::AttachShader: {
+      GLuint program = programs_[u32()];
+      glAttachShader(program, shaders_[u32()]);
+      break;
+    }
+    case TraceCall::BeginQuery: {
+      GLenum target = u32();
+      glBeginQuery(target, queries_[u32()]);
+      break;
+    }
+    case TraceCall::BindBuffer: {
+      GLenum target = u32();
+      GLuint buffer = u32();
+      // The element array binding belongs to the vertex array.
+      uint32_t owner = target == GL_ELEMENT_ARRAY_BUFFER ? vertex_array_ : 0;
+      ret_redundant = state_.redundant(call, target, owner, buffer);
+      glBindBuffer(target, buffers_[buffer]);
+      break;
+    }
+    case TraceCall::BindFramebuffer: {
+      GLenum target = u32();
+      GLuint framebuffer = u32();
+      bool draw = state_.redundant(call, GL_DRAW_FRAMEBUFFER, 0, framebuffer);
+      bool read = state_.redundant(call, GL_READ_FRAMEBUFFER, 0, framebuffer);
+      ret_redundant = target == GL_FRAMEBUFFER ? draw && read : target == GL_DRAW_FRAMEBUFFER ? draw : read;
+      glBindFramebuffer(target, framebuffers_[framebuffer]);
+      break;
+    }
+    case TraceCall::BindRenderbuffer: {
+      GLenum target = u32();
+      GLuint renderbuffer = u32();
+      ret_redundant = state_.redundant(call, target, 0, renderbuffer);
+      glBindRenderbuffer(target, renderbuffers_[renderbuffer]);
+      break;
+    }
+    case TraceCall::BindTexture: {
+      GLenum target = u32();
+      GLuint texture = u32();
+      ret_redundant = state_.redundant(call, active_texture_, target, texture);
+      glBindTexture(target, textures_[texture]);
+      break;
+    }
+    case TraceCall::BindVertexArray: {
+      GLuint vertex_array = u32();
+      ret_redundant = vertex_array == vertex_array_;
+      vertex_array_ = vertex_array;
+      glBindVertexArray(vertex_arrays_[vertex_array]);
+      break;
+    }
+    case TraceCall::BlendFunc: {
+      GLenum factors[2] = {u32(), u32()};
+      ret_redundant = state_.redundant(call, 0, 0, factors);
+      glBlendFunc(factors[0], factors[1]);
+      break;
+    }
+    case TraceCall::BufferData: {
+      GLenum target = u32();
+      int64_t size = i64();
+      const void* data = nullptr;
+      if(u8()) {
+        uint32_t bytes;
+        data = reader_.read_blob(bytes);
+      }
+      glBufferData(target, size, data, u32());
+      break;
+    }
+    case TraceCall::BufferSubData: {
+      GLenum target = u32();
+      int64_t offset = i64();
+      uint32_t bytes;
+      const void* data = reader_.read_blob(bytes);
+      glBufferSubData(target, offset, bytes, data);
+      break;
+    }
+    case TraceCall::Clear:
+      glClear(u32());
+      break;
+    case TraceCall::ClearBufferuiv: {
+      GLenum buffer = u32();
+      GLint drawbuffer = i32();
+      uint32_t bytes;
+      glClearBufferuiv(buffer, drawbuffer, static_cast<const GLuint*>(reader_.read_blob(bytes)));
+      break;
+    }
+    case TraceCall::ClearColor: {
+      float color[4] = {f32(), f32(), f32(), f32()};
+      ret_redundant = state_.redundant(call, 0, 0, color);
+      glClearColor(color[0], color[1], color[2], color[3]);
+      break;
+    }
+    case TraceCall::ColorMask: {
+      unsigned char mask[4] = {u8(), u8(), u8(), u8()};
+      ret_redundant = state_.redundant(call, 0, 0, mask);
+      glColorMask(mask[0], mask[1], mask[2], mask[3]);
+      break;
+    }
+    case TraceCall::CompileShader:
+      glCompileShader(shaders_[u32()]);
+      break;
+    case TraceCall::CopyBufferSubData: {
+      GLenum read_target = u32();
+      GLenum write_target = u32();
+      int64_t read_offset = i64();
+      int64_t write_offset = i64();
+      glCopyBufferSubData(read_target, write_target, read_offset, write_offset, i64());
+      break;
+    }
+    case TraceCall::CreateProgram:
+      programs_.set(u32(), glCreateProgram());
+      break;
+    case TraceCall::CreateShader: {
+      GLenum type = u32();
+      shaders_.set(u32(), glCreateShader(type));
+      break;
+    }
+    case TraceCall::DeleteBuffers:
+      remove(glDeleteBuffers, buffers_);
+      break;
+    case TraceCall::DeleteFramebuffers:
+      remove(glDeleteFramebuffers, framebuffers_);
+      break;
+    case TraceCall::DeleteProgram:
+      glDeleteProgram(programs_[u32()]);
+      state_.clear();
+      break;
+    case TraceCall::DeleteQueries:
+      remove(glDeleteQueries, queries_);
+      break;
+    case TraceCall::DeleteRenderbuffers:
+      remove(glDeleteRenderbuffers, renderbuffers_);
+      break;
+    case TraceCall::DeleteShader:
+      glDeleteShader(shaders_[u32()]);
+      break;
+    case TraceCall::DeleteTextures:
+      remove(glDeleteTextures, textures_);
+      break;
+    case TraceCall::DeleteVertexArrays:
+      remove(glDeleteVertexArrays, vertex_arrays_);
+      break;
+    case TraceCall::DepthFunc: {
+      GLenum function = u32();
+      ret_redundant = state_.redundant(call, 0, 0, function);
+      glDepthFunc(function);
+      break;
+    }
+    case TraceCall::DetachShader: {
+      GLuint program = programs_[u32()];
+      glDetachShader(program, shaders_[u32()]);
+      break;
+    }
+    case TraceCall::Disable:
+    case TraceCall::Enable: {
+      GLenum capability = u32();
+      unsigned char enabled = call == TraceCall::Enable;
+      ret_redundant = state_.redundant(TraceCall::Enable, capability, 0, enabled);
+      if(enabled)
+        glEnable(capability);
+      else
+        glDisable(capability);
+      break;
+    }
+    case TraceCall::DrawArrays: {
+      GLenum mode = u32();
+      GLint first = i32();
+      glDrawArrays(mode, first, i32());
+      break;
+    }
+    case TraceCall::DrawBuffer:
+      glDrawBuffer(u32());
+      break;
+    case TraceCall::DrawElementsBaseVertex: {
+      GLenum mode = u32();
+      GLsizei count = i32();
+      GLenum type = u32();
+      const void* indices = Offset(u64());
+      glDrawElementsBaseVertex(mode, count, type, indices, i32());
+      break;
+    }
+    case TraceCall::EnableVertexAttribArray:
+      glEnableVertexAttribArray(u32());
+      break;
+    case TraceCall::EndQuery:
+      glEndQuery(u32());
+      break;
+    case TraceCall::FramebufferRenderbuffer: {
+      GLenum target = u32();
+      GLenum attachment = u32();
+      GLenum renderbuffer_target = u32();
+      glFramebufferRenderbuffer(target, attachment, renderbuffer_target, renderbuffers_[u32()]);
+      break;
+    }
+    case TraceCall::FramebufferTexture: {
+      GLenum target = u32();
+      GLenum attachment = u32();
+      GLuint texture = textures_[u32()];
+      glFramebufferTexture(target, attachment, texture, i32());
+      break;
+    }
+    case TraceCall::FramebufferTexture2D: {
+      GLenum target = u32();
+      GLenum attachment = u32();
+      GLenum texture_target = u32();
+      GLuint texture = textures_[u32()];
+      glFramebufferTexture2D(target, attachment, texture_target, texture, i32());
+      break;
+    }
+    case TraceCall::FramebufferTextureLayer: {
+      GLenum target = u32();
+      GLenum attachment = u32();
+      GLuint texture = textures_[u32()];
+      GLint level = i32();
+      glFramebufferTextureLayer(target, attachment, texture, level, i32());
+      break;
+    }
+    case TraceCall::GenBuffers:
+      gen(glGenBuffers, buffers_);
+      break;
+    case TraceCall::GenFramebuffers:
+      gen(glGenFramebuffers, framebuffers_);
+      break;
+    case TraceCall::GenQueries:
+      gen(glGenQueries, queries_);
+      break;
+    case TraceCall::GenRenderbuffers:
+      gen(glGenRenderbuffers, renderbuffers_);
+      break;
+    case TraceCall::GenTextures:
+      gen(glGenTextures, textures_);
+      break;
+    case TraceCall::GenVertexArrays:
+      gen(glGenVertexArrays, vertex_arrays_);
+      break;
+    case TraceCall::GetUniformLocation: {
+      GLuint program = u32();
+      uint32_t bytes;
+      const char* name = static_cast<const char*>(reader_.read_blob(bytes));
+      GLint replayed = glGetUniformLocation(programs_[program], std::string(name, bytes).c_str());
+      locations_[std::make_pair(program, (GLint)i32())] = replayed;
+      break;
+    }
+    case TraceCall::LinkProgram:
+      glLinkProgram(programs_[u32()]);
+      state_.clear();
+      break;
+    case TraceCall::MapBufferRange: {
+      GLenum target = u32();
+      int64_t offset = i64();
+      int64_t length = i64();
+      glMapBufferRange(target, offset, length, u32());
+      break;
+    }
+    case TraceCall::MultiDrawElementsIndirect: {
+      GLenum mode = u32();
+      GLenum type = u32();
+      const void* indirect = Offset(u64());
+      GLsizei draw_count = i32();
+      GLsizei stride = i32();
+      if(glad_glMultiDrawElementsIndirect)
+        glMultiDrawElementsIndirect(mode, type, indirect, draw_count, stride);
+      else
+        unsupported_++;
+      break;
+    }
+    case TraceCall::PolygonOffset: {
+      float offset[2] = {f32(), f32()};
+      ret_redundant = state_.redundant(call, 0, 0, offset);
+      glPolygonOffset(offset[0], offset[1]);
+      break;
+    }
+    case TraceCall::ReadBuffer:
+      glReadBuffer(u32());
+      break;
+    case TraceCall::ReadPixels: {
+      GLint x = i32();
+      GLint y = i32();
+      GLsizei width = i32();
+      GLsizei height = i32();
+      GLenum format = u32();
+      GLenum type = u32();
+      // Always into a pixel pack buffer, the pointer is an offset.
+      glReadPixels(x, y, width, height, format, type, const_cast<void*>(Offset(u64())));
+      break;
+    }
+    case TraceCall::RenderbufferStorage: {
+      GLenum target = u32();
+      GLenum format = u32();
+      GLsizei width = i32();
+      glRenderbufferStorage(target, format, width, i32());
+      break;
+    }
+    case TraceCall::ShaderSource: {
+      GLuint shader = shaders_[u32()];
+      GLsizei count = i32();
+      std::vector<const GLchar*> strings(count);
+      std::vector<GLint> lengths(count);
+      for(GLsizei i = 0; i < count; i++) {
+        uint32_t bytes;
+        strings[i] = static_cast<const GLchar*>(reader_.read_blob(bytes));
+        lengths[i] = bytes;
+      }
+      glShaderSource(shader, count, strings.data(), lengths.data());
+      break;
+    }
+    case TraceCall::TexBuffer: {
+      GLenum target = u32();
+      GLenum format = u32();
+      glTexBuffer(target, format, buffers_[u32()]);
+      break;
+    }
+    case TraceCall::TexImage2D:
+    case TraceCall::TexImage3D: {
+      GLenum target = u32();
+      GLint level = i32();
+      GLint internal_format = i32();
+      GLsizei width = i32();
+      GLsizei height = i32();
+      GLsizei depth = call == TraceCall::TexImage3D ? i32() : 1;
+      GLint border = i32();
+      GLenum format = u32();
+      GLenum type = u32();
+      const void* pixels = nullptr;
+      if(u8()) {
+        uint32_t bytes;
+        pixels = reader_.read_blob(bytes);
+      }
+      if(call == TraceCall::TexImage3D)
+        glTexImage3D(target, level, internal_format, width, height, depth, border, format, type, pixels);
+      else
+        glTexImage2D(target, level, internal_format, width, height, border, format, type, pixels);
+      break;
+    }
+    case TraceCall::TexParameteri: {
+      GLenum target = u32();
+      GLenum name = u32();
+      glTexParameteri(target, name, i32());
+      break;
+    }
+    case TraceCall::TexSubImage2D: {
+      GLenum target = u32();
+      GLint level = i32();
+      GLint x = i32();
+      GLint y = i32();
+      GLsizei width = i32();
+      GLsizei height = i32();
+      GLenum format = u32();
+      GLenum type = u32();
+      uint32_t bytes;
+      glTexSubImage2D(target, level, x, y, width, height, format, type, reader_.read_blob(bytes));
+      break;
+    }
+    case TraceCall::Uniform1f: {
+      int32_t captured = i32();
+      float value = f32();
+      ret_redundant = state_.redundant(call, program_, captured, value);
+      glUniform1f(location(captured), value);
+      break;
+    }
+    case TraceCall::Uniform1i: {
+      int32_t captured = i32();
+      int32_t value = i32();
+      ret_redundant = state_.redundant(call, program_, captured, value);
+      glUniform1i(location(captured), value);
+      break;
+    }
+    case TraceCall::Uniform2fv:
+    case TraceCall::Uniform3fv:
+    case TraceCall::Uniform4fv: {
+      int32_t captured = i32();
+      GLsizei count = i32();
+      uint32_t bytes;
+      const GLfloat* value = static_cast<const GLfloat*>(reader_.read_blob(bytes));
+      ret_redundant = state_.redundant(call, program_, captured, value, bytes);
+      if(call == TraceCall::Uniform2fv)
+        glUniform2fv(location(captured), count, value);
+      else if(call == TraceCall::Uniform3fv)
+        glUniform3fv(location(captured), count, value);
+      else
+        glUniform4fv(location(captured), count, value);
+      break;
+    }
+    case TraceCall::UniformMatrix2fv:
+    case TraceCall::UniformMatrix3fv:
+    case TraceCall::UniformMatrix4fv: {
+      int32_t captured = i32();
+      GLsizei count = i32();
+      GLboolean transpose = u8();
+      uint32_t bytes;
+      const GLfloat* value = static_cast<const GLfloat*>(reader_.read_blob(bytes));
+      ret_redundant = state_.redundant(call, program_, captured, value, bytes);
+      if(call == TraceCall::UniformMatrix2fv)
+        glUniformMatrix2fv(location(captured), count, transpose, value);
+      else if(call == TraceCall::UniformMatrix3fv)
+        glUniformMatrix3fv(location(captured), count, transpose, value);
+      else
+        glUniformMatrix4fv(location(captured), count, transpose, value);
+      break;
+    }
+    case TraceCall::UnmapBuffer:
+      glUnmapBuffer(u32());
+      break;
+    case TraceCall::UseProgram: {
+      GLuint program = u32();
+      ret_redundant = program == program_;
+      program_ = program;
+      glUseProgram(programs_[program]);
+      break;
+    }
+    case TraceCall::VertexAttribDivisor: {
+      GLuint index = u32();
+      glVertexAttribDivisor(index, u32());
+      break;
+    }
+    case TraceCall::VertexAttribIPointer: {
+      GLuint index = u32();
+      GLint size = i32();
+      GLenum type = u32();
+      GLsizei stride = i32();
+      glVertexAttribIPointer(index, size, type, stride, Offset(u64()));
+      break;
+    }
+    case TraceCall::VertexAttribPointer: {
+      GLuint index = u32();
+      GLint size = i32();
+      GLenum type = u32();
+      GLboolean normalized = u8();
+      GLsizei stride = i32();
+      glVertexAttribPointer(index, size, type, normalized, stride, Offset(u64()));
+      break;
+    }
+    case TraceCall::Viewport: {
+      GLint viewport[4] = {i32(), i32(), i32(), i32()};
+      ret_redundant = state_.redundant(call, 0, 0, viewport);
+      glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void Replayer::report() const {
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "setup: " << setup_calls_ << " calls, " << setup_ms_ << " ms" << std::endl;
+  if(frames_.empty()) {
+    std::cout << "No captured frames in the trace" << std::endl;
+    return;
+  }
+
+  double total_ms = 0.0, worst_ms = 0.0;
+  for(const FrameTiming& frame : frames_) {
+    double ms = frame.submit_ms + frame.finish_ms;
+    total_ms += ms;
+    worst_ms = std::max(worst_ms, ms);
+    std::cout << "frame " << frame.index << ": " << ms << " ms (submit " << frame.submit_ms << ", finish "
+              << frame.finish_ms << "), " << frame.calls << " calls, " << frame.draws << " draws" << std::endl;
+  }
+  std::cout << frames_.size() << " frames, average " << total_ms / frames_.size() << " ms, worst " << worst_ms
+            << " ms" << std::endl;
+  if(unsupported_)
+    std::cout << unsupported_ << " calls are not supported by this context and were skipped" << std::endl;
+
+  std::vector<int> order;
+  unsigned long max_count = 0;
+  for(int i = 0; i < (int)TraceCall::Count; i++) {
+    if(!calls_[i].count)
+      continue;
+    order.push_back(i);
+    max_count = std::max(max_count, calls_[i].count);
+  }
+  std::sort(order.begin(), order.end(), [this](int a, int b) { return calls_[a].ms > calls_[b].ms; });
+
+  // Submit time only, GPU work shows up in the finish of each frame.
+  std::cout << std::endl << std::left << std::setw(26) << "call" << std::right << std::setw(10) << "count"
+            << std::setw(10) << "/frame" << std::setw(11) << "redundant" << std::setw(12) << "total ms"
+            << std::setw(10) << "us/call" << "  count histogram" << std::endl;
+  for(int i : order) {
+    const CallStats& stats = calls_[i];
+    int bar = (int)(30 * stats.count / max_count);
+    std::cout << std::left << std::setw(26) << TraceCallName((TraceCall)i) << std::right << std::setw(10)
+              << stats.count << std::setw(10) << (double)stats.count / frames_.size() << std::setw(11)
+              << stats.redundant << std::setw(12) << stats.ms << std::setw(10) << 1000.0 * stats.ms / stats.count
+              << "  " << std::string(std::max(bar, 1), '#') << std::endl;
+  }
+}
+
+}
+
+int main(int ArgCount, char **Args) {
+  if(ArgCount < 2) {
+    std::cout << "Usage: glreplay TRACE" << std::endl;
+    return 1;
+  }
+
+  TraceReader reader(Args[1]);
+  if(!reader.is_valid())
+    return 1;
+
+  if(SDL_Init(SDL_INIT_VIDEO) != 0) {
+    std::cout << "Failed to initialize SDL: " << SDL_GetError() << std::endl;
+    return 1;
+  }
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+  SDL_Window* window = SDL_CreateWindow("glreplay", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                        reader.header().width, reader.header().height,
+                                        SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if(!window) {
+    std::cout << "Failed to create a window: " << SDL_GetError() << std::endl;
+    return 1;
+  }
+  SDL_GLContext context = SDL_GL_CreateContext(window);
+  if(!context || !gladLoadGLLoader((GLADloadproc) SDL_GL_GetProcAddress)) {
+    std::cout << "Failed to initialize OpenGL context" << std::endl;
+    return 1;
+  }
+  std::cout << "Replaying " << Args[1] << " on " << glGetString(GL_RENDERER) << std::endl;
+
+  Replayer replayer(reader);
+  bool ok = replayer.run();
+  replayer.report();
+
+  SDL_GL_DeleteContext(context);
+  SDL_DestroyWindow(window);
+  SDL_Quit();
+  return ok ? 0 : 1;
+}